@@ -1,12 +1,17 @@
 /*********************************************
  Display a link to provide more information about
- the badge.
+ the badge, and, a turn of the knob away, how
+ the badge has been doing.
 **********************************************/
 
+#include <stdio.h>
+
 #include "colors.h"
 #include "menu.h"
 #include "button.h"
 #include "framebuffer.h"
+#include "scheduler.h"
+#include "display_power.h"
 
 /* Program states.  Initial state is ABOUT_BADGE_INIT */
 enum about_badge_state_t {
@@ -17,18 +22,26 @@ enum about_badge_state_t {
 
 static enum about_badge_state_t about_badge_state = ABOUT_BADGE_INIT;
 static int screen_changed = 0;
+static int showing_stats = 0;
 
 static void about_badge_init(void)
 {
 	FbInit();
 	about_badge_state = ABOUT_BADGE_RUN;
 	screen_changed = 1;
+	showing_stats = 0;
+	scheduler_set_frame_rate(SCHEDULER_ON_INPUT); /* Nothing changes until a button is pressed */
 }
 
 static void check_buttons(void)
 {
     int down_latches = button_down_latches();
 
+	if (button_get_rotation(0) || BUTTON_PRESSED(BADGE_BUTTON_LEFT, down_latches) ||
+	    BUTTON_PRESSED(BADGE_BUTTON_RIGHT, down_latches)) {
+		showing_stats = !showing_stats;
+		screen_changed = 1;
+	}
 	if (BUTTON_PRESSED(BADGE_BUTTON_ENCODER_SW, down_latches) ||
 	    BUTTON_PRESSED(BADGE_BUTTON_A, down_latches) ||
 	    BUTTON_PRESSED(BADGE_BUTTON_B, down_latches)) {
@@ -36,15 +49,33 @@ static void check_buttons(void)
 	}
 }
 
+static void draw_stats(void)
+{
+	struct display_power_stats display;
+	char text[160];
+
+	display_power_get_stats(&display);
+	snprintf(text, sizeof(text), "DISPLAY POWER\n\nWAKES %lu\nLAST %lu MS\nFROM %s\nSLOWEST %lu MS\n"
+			"SAVED %lu UAH\n",
+		(unsigned long) display.wakes, (unsigned long) (display.last_wake_us / 1000),
+		display.last_wake_from == DISPLAY_POWER_SLEEP ? "SLEEP" : "IDLE",
+		(unsigned long) (display.max_wake_us / 1000), (unsigned long) display.saved_uah);
+	FbWriteString(text);
+}
+
 static void draw_screen(void)
 {
-	if (!screen_changed)
+	/* The figures change without any input, so they're drawn each frame */
+	if (!screen_changed && !showing_stats)
 		return;
 	FbColor(WHITE);
 	FbClear();
 	FbMove(2, 2);
-	FbWriteString("THIS BADGE WAS\nBUILT AND\nPROGRAMMED BY\nHACKRVA MEMBERS\n"
-			"\nVISIT\n\nhttps://\nhackrva.github.\nio/badge2023/\n\nFOR MORE\nINFORMATION");
+	if (showing_stats)
+		draw_stats();
+	else
+		FbWriteString("THIS BADGE WAS\nBUILT AND\nPROGRAMMED BY\nHACKRVA MEMBERS\n"
+				"\nVISIT\n\nhttps://\nhackrva.github.\nio/badge2023/\n\nFOR MORE\nINFORMATION");
 	FbSwapBuffers();
 	screen_changed = 0;
 }
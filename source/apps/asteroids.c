@@ -8,6 +8,7 @@
 #include "fxp_sqrt.h"
 #include "xorshift.h"
 #include "random.h"
+#include "spatial_hash.h"
 
 #if TARGET_PICO
 #define printf(...)
@@ -65,6 +66,13 @@ static struct asteroid {
 } asteroid[MAXASTEROIDS] = { 0 };
 static int nasteroids;
 
+/* Asteroids by position, for collisions: 32 pixel cells, so each asteroid is in at most 4 */
+#define ASTEROID_CELL_SHIFT (5 + 8)
+#define ASTEROID_HASH_BUCKETS 128
+static uint16_t asteroid_bucket[ASTEROID_HASH_BUCKETS];
+static struct spatial_hash_entry asteroid_hash_entry[4 * MAXASTEROIDS];
+static struct spatial_hash asteroid_hash;
+
 /* return a random int between 0 and n - 1 */
 static int random_num(int n)
 {
@@ -169,6 +177,8 @@ static void asteroids_init(void)
 	screen_changed = 1;
 	generate_asteroid_forms();
 	add_initial_asteroids();
+	spatial_hash_init(&asteroid_hash, ASTEROID_CELL_SHIFT, asteroid_bucket, ASTEROID_HASH_BUCKETS,
+		asteroid_hash_entry, 4 * MAXASTEROIDS);
 	init_player(&player);
 	lives = 3;
 	score = 0;
@@ -361,20 +371,42 @@ static void apply_position_delta(struct pos_vel *p)
 		p->y -= (LCD_YSIZE << 8);
 }
 
-static void check_player_asteroid_collision(struct ship *p)
+/* Must be redone whenever asteroids are added or removed, as that changes their indices */
+static void hash_asteroids(void)
 {
+	spatial_hash_clear(&asteroid_hash);
 	for (int i = 0; i < nasteroids; i++) {
 		struct asteroid *a = &asteroid[i];
-		int dx = (p->p.x >> 8) - (a->p.x >> 8);
-		int dy = (p->p.y >> 8) - (a->p.y >> 8);
+		/* The collision radius is 12 * radius >> 8 pixels, plus a pixel for the rounding */
+		spatial_hash_insert(&asteroid_hash, i, a->p.x, a->p.y, 12 * a->radius + (1 << 8));
+	}
+}
+
+/* Returns the index of an asteroid at x, y, or -1 if there isn't one */
+static int find_asteroid_at(int x, int y)
+{
+	uint16_t id[MAXASTEROIDS];
+	int n = spatial_hash_query(&asteroid_hash, x, y, 0, id, MAXASTEROIDS);
+
+	for (int i = 0; i < n; i++) {
+		struct asteroid *a = &asteroid[id[i]];
+		int dx = (x >> 8) - (a->p.x >> 8);
+		int dy = (y >> 8) - (a->p.y >> 8);
 		int dist_squared = (dx * dx) + (dy * dy);
-		if (dist_squared < (12 * a->radius >> 8) * (12 * a->radius >> 8)) {
-			player_dead_counter = 100;
-			add_sparks(p->p.x, p->p.y, 3 << 8, 20);
-			init_player(p);
-			lives--;
-		}
+		if (dist_squared < (12 * a->radius >> 8) * (12 * a->radius >> 8))
+			return id[i];
 	}
+	return -1;
+}
+
+static void check_player_asteroid_collision(struct ship *p)
+{
+	if (find_asteroid_at(p->p.x, p->p.y) < 0)
+		return;
+	player_dead_counter = 100;
+	add_sparks(p->p.x, p->p.y, 3 << 8, 20);
+	init_player(p);
+	lives--;
 }
 
 static void move_player(struct ship *player)
@@ -389,32 +421,32 @@ static void move_player(struct ship *player)
 
 static void check_bullet_asteroid_collision(struct bullet *b)
 {
-	for (int i = 0; i < nasteroids; i++) {
-		struct asteroid *a = &asteroid[i];
-		int dx = (b->p.x >> 8) - (a->p.x >> 8);
-		int dy = (b->p.y >> 8) - (a->p.y >> 8);
-		int dist_squared = (dx * dx) + (dy * dy);
-		if (dist_squared < (12 * a->radius >> 8) * (12 * a->radius >> 8)) {
-			int r = a->radius / 2;
-			if (r >= 256)
-				score += 20;
-			else if (r >= 128)
-				score += 50;
-			else if (r >= 64)
-				score += 100;
-			if (r > min_asteroid_radius) {
-				int vx = random_num(1 << 8) - (1 << 7);
-				int vy = random_num(1 << 8) - (1 << 7);
-				add_asteroid(a->p.x, a->p.y, vx, vy, r);
-				vx = random_num(1 << 8) - (1 << 7);
-				vy = random_num(1 << 8) - (1 << 7);
-				add_asteroid(a->p.x, a->p.y, vx, vy, r);
-			}
-			remove_asteroid(i);
-			add_sparks(b->p.x, b->p.y, 2 << 8, 8);
-			b->life = 0;
-		}
+	int i = find_asteroid_at(b->p.x, b->p.y);
+	struct asteroid *a;
+	int r;
+
+	if (i < 0)
+		return;
+	a = &asteroid[i];
+	r = a->radius / 2;
+	if (r >= 256)
+		score += 20;
+	else if (r >= 128)
+		score += 50;
+	else if (r >= 64)
+		score += 100;
+	if (r > min_asteroid_radius) {
+		int vx = random_num(1 << 8) - (1 << 7);
+		int vy = random_num(1 << 8) - (1 << 7);
+		add_asteroid(a->p.x, a->p.y, vx, vy, r);
+		vx = random_num(1 << 8) - (1 << 7);
+		vy = random_num(1 << 8) - (1 << 7);
+		add_asteroid(a->p.x, a->p.y, vx, vy, r);
 	}
+	remove_asteroid(i);
+	hash_asteroids();
+	add_sparks(b->p.x, b->p.y, 2 << 8, 8);
+	b->life = 0;
 }
 
 static void move_bullet(struct bullet *b)
@@ -548,6 +580,7 @@ static void draw_screen(void)
 	if (!screen_changed)
 		return;
 	FbColor(WHITE);
+	hash_asteroids();
 	move_player(&player);
 	move_bullets();
 	move_sparks();
@@ -9,6 +9,9 @@
 #include "framebuffer.h"
 #include "trig.h"
 #include "fxp_sqrt.h"
+#include "fxp_math.h"
+#include "transform3d.h"
+#include "spatial_hash.h"
 #include "xorshift.h"
 #include "random.h"
 #include "rtc.h"
@@ -49,19 +52,17 @@ static struct tank_brain {
 #define TANK_DEST_ARRIVE_DIST (10 << 8)
 } tank_brain = { 0 };
 
-struct bz_vertex {
-	int32_t x, y, z; /* 3d coord */
-	int32_t px, py; /* projected vertex */
-};
-
 struct bz_model {
 	int nvertices;
 	int nsegs;
-	struct bz_vertex *vert;
+	struct fxp_vec3 *vert;
 	int16_t *vlist;
 	int prescale_numerator, prescale_denominator;
+	int32_t radius; /* bounding sphere, for culling */
 };
 
+#define BZ_MAX_MODEL_VERTICES 40
+
 struct bz_object {
 	int32_t x, y, z;
 	int scale;
@@ -75,15 +76,15 @@ struct bz_object {
 	unsigned char model;
 };
 
-static struct bz_vertex bz_cube_verts[] = {
-	{ -10,  20,  10, 0, 0 },
-	{  10,  20,  10, 0, 0 },
-	{  10,  20, -10, 0, 0 },
-	{ -10,  20, -10, 0, 0 },
-	{ -10,   0,  10, 0, 0 },
-	{  10,   0,  10, 0, 0 },
-	{  10,   0, -10, 0, 0 },
-	{ -10,   0, -10, 0, 0 },
+static struct fxp_vec3 bz_cube_verts[] = {
+	{ -10,  20,  10 },
+	{  10,  20,  10 },
+	{  10,  20, -10 },
+	{ -10,  20, -10 },
+	{ -10,   0,  10 },
+	{  10,   0,  10 },
+	{  10,   0, -10 },
+	{ -10,   0, -10 },
 };
 
 static int16_t bz_cube_vlist[] = {
@@ -94,15 +95,15 @@ static int16_t bz_cube_vlist[] = {
 	3, 7,
 };
 
-static struct bz_vertex bz_short_cube_verts[] = {
-	{ -10,  10,  10, 0, 0 },
-	{  10,  10,  10, 0, 0 },
-	{  10,  10, -10, 0, 0 },
-	{ -10,  10, -10, 0, 0 },
-	{ -10,   0,  10, 0, 0 },
-	{  10,   0,  10, 0, 0 },
-	{  10,   0, -10, 0, 0 },
-	{ -10,   0, -10, 0, 0 },
+static struct fxp_vec3 bz_short_cube_verts[] = {
+	{ -10,  10,  10 },
+	{  10,  10,  10 },
+	{  10,  10, -10 },
+	{ -10,  10, -10 },
+	{ -10,   0,  10 },
+	{  10,   0,  10 },
+	{  10,   0, -10 },
+	{ -10,   0, -10 },
 };
 
 static int16_t bz_short_cube_vlist[] = {
@@ -113,12 +114,12 @@ static int16_t bz_short_cube_vlist[] = {
 	3, 7,
 };
 
-static struct bz_vertex bz_pyramid_verts[] = {
-	{ -10,   0,  10, 0, 0, },
-	{  10,   0,  10, 0, 0, },
-	{  10,   0, -10, 0, 0, },
-	{ -10,   0, -10, 0, 0, },
-	{   0,  20,   0, 0, 0, },
+static struct fxp_vec3 bz_pyramid_verts[] = {
+	{ -10,   0,  10 },
+	{  10,   0,  10 },
+	{  10,   0, -10 },
+	{ -10,   0, -10 },
+	{   0,  20,   0 },
 };
 
 static int16_t bz_pyramid_vlist[] = {
@@ -127,12 +128,12 @@ static int16_t bz_pyramid_vlist[] = {
 	4, 3,
 };
 
-static struct bz_vertex bz_narrow_pyramid_verts[] = {
-	{ -5,   0,  5, 0, 0, },
-	{  5,   0,  5, 0, 0, },
-	{  5,   0, -5, 0, 0, },
-	{ -5,   0, -5, 0, 0, },
-	{   0,  20,   0, 0, 0, },
+static struct fxp_vec3 bz_narrow_pyramid_verts[] = {
+	{ -5,   0,  5 },
+	{  5,   0,  5 },
+	{  5,   0, -5 },
+	{ -5,   0, -5 },
+	{   0,  20,   0 },
 };
 
 static int16_t bz_narrow_pyramid_vlist[] = {
@@ -141,62 +142,62 @@ static int16_t bz_narrow_pyramid_vlist[] = {
 	4, 3,
 };
 
-static struct bz_vertex bz_horiz_line_verts[] = {
-	{ -10, 0, 0, 0, 0 },
-	{  10, 0, 0, 0, 0 },
+static struct fxp_vec3 bz_horiz_line_verts[] = {
+	{ -10, 0, 0 },
+	{  10, 0, 0 },
 };
 
 static int16_t bz_horiz_line_vlist[] = {
 	0, 1,
 };
 
-static struct bz_vertex bz_vert_line_verts[] = {
-	{ 0, 20, 0, 0, 0 },
-	{ 0, 0,  0, 0, 0 },
+static struct fxp_vec3 bz_vert_line_verts[] = {
+	{ 0, 20, 0 },
+	{ 0, 0,  0 },
 };
 
 static int16_t bz_vert_line_vlist[] = {
 	0, 1,
 };
 
-static struct bz_vertex bz_tank_verts[] = {
+static struct fxp_vec3 bz_tank_verts[] = {
 	/* Bottom */
-	{ -50, 0, 100, 0, 0 }, /* 0 */
-	{ -50, 0, -100, 0, 0 },
-	{  50, 0, -100, 0, 0 },
-	{  50, 0, 100, 0, 0 },
+	{ -50, 0, 100 }, /* 0 */
+	{ -50, 0, -100 },
+	{  50, 0, -100 },
+	{  50, 0, 100 },
 
 	/* Mid section */
-	{ -60, 30, 120, 0, 0 }, /* 4 */
-	{  -60, 30, -120, 0, 0 },
-	{  60, 30, -120,  0, 0 },
-	{  60, 30, 120, 0, 0 },
+	{ -60, 30, 120 }, /* 4 */
+	{  -60, 30, -120 },
+	{  60, 30, -120 },
+	{  60, 30, 120 },
 
 	/* Top */
-	{ -50, 50, 80, 0, 0 }, /* 8 */
-	{ -50, 50, -50, 0, 0 },
-	{  50, 50, -50, 0, 0 },
-	{  50, 50, 80, 0, 0 },
+	{ -50, 50, 80 }, /* 8 */
+	{ -50, 50, -50 },
+	{  50, 50, -50 },
+	{  50, 50, 80 },
 
 	/* Turret top */
-	{ -25, 80, 60, 0, 0 }, /* 12 */
-	{ -25, 80, 15, 0, 0 },
-	{  25, 80, 15, 0, 0 },
-	{  25, 80, 60, 0, 0 },
+	{ -25, 80, 60 }, /* 12 */
+	{ -25, 80, 15 },
+	{  25, 80, 15 },
+	{  25, 80, 60 },
 
 	/* Vertical parts of turret */
-	{ -30, 50, 70, 0, 0 }, /* 16 */
-	{ -30, 50,   0, 0, 0 },
-	{  30, 50,   0, 0, 0 },
-	{  30, 50, 70, 0, 0 },
+	{ -30, 50, 70 }, /* 16 */
+	{ -30, 50,   0 },
+	{  30, 50,   0 },
+	{  30, 50, 70 },
 
 	/* barrel */
-	{ 0, 70, 0, 0, 0 }, /* 20 */
-	{ 0, 70, -170, 0, 0 },
-	{ 5, 65, 0, 0, 0 },
-	{ 5, 65, -170, 0, 0 },
-	{ -5, 65, 0, 0, 0 },
-	{ -5, 65, -170, 0, 0 },
+	{ 0, 70, 0 }, /* 20 */
+	{ 0, 70, -170 },
+	{ 5, 65, 0 },
+	{ 5, 65, -170 },
+	{ -5, 65, 0 },
+	{ -5, 65, -170 },
 };
 
 static int16_t bz_tank_vlist[] = {
@@ -221,13 +222,13 @@ static int16_t bz_tank_vlist[] = {
 	21, 23, 25,
 };
 
-static struct bz_vertex bz_artillery_shell_vert[] = {
-	{ 0, 0, 1, 0, 0 },
-	{ 0, 1, 0, 0, 0 },
-	{ 0, 0, -1, 0, 0 },
-	{ 0, -1, 0, 0, 0 },
-	{ -1, 0, 0, 0, 0 },
-	{ 1, 0, 0, 0, 0 },
+static struct fxp_vec3 bz_artillery_shell_vert[] = {
+	{ 0, 0, 1 },
+	{ 0, 1, 0 },
+	{ 0, 0, -1 },
+	{ 0, -1, 0 },
+	{ -1, 0, 0 },
+	{ 1, 0, 0 },
 };
 
 static int16_t bz_artillery_shell_vlist[] = {
@@ -235,31 +236,31 @@ static int16_t bz_artillery_shell_vlist[] = {
 	1, 4, 3, 5, 1,
 };
 
-static struct bz_vertex bz_chunk0_vert[] = {
-	{ -3, 1, 2, 0, 0 },
-	{  3, 4, 0, 0, 0 },
-	{  4, -1, 4, 0, 0 }, 
-	{  1, -2, -1, 0, 0 },
+static struct fxp_vec3 bz_chunk0_vert[] = {
+	{ -3, 1, 2 },
+	{  3, 4, 0 },
+	{  4, -1, 4 }, 
+	{  1, -2, -1 },
 };
 
 static int16_t bz_chunk0_vlist[] = {
 	0, 1, 2, 0, 3, 2, -1, 3, 1,
 };
 
-static struct bz_vertex bz_chunk1_vert[] = {
-	{ -3, 3, 0, 0, 0 },
-	{  0, -2, 0, 0, 0 },
-	{  3, -1, 0, 0, 0 },
+static struct fxp_vec3 bz_chunk1_vert[] = {
+	{ -3, 3, 0 },
+	{  0, -2, 0 },
+	{  3, -1, 0 },
 };
 
 static int16_t bz_chunk1_vlist[] = {
 	0, 1, 2, 0,
 };
 
-static struct bz_vertex bz_chunk2_vert[] = {
-	{ -4, 2, 0, 0, 0 },
-	{  1, -3, 0, 0, 0 },
-	{  2, -2, 0, 0, 0 },
+static struct fxp_vec3 bz_chunk2_vert[] = {
+	{ -4, 2, 0 },
+	{  1, -3, 0 },
+	{  2, -2, 0 },
 };
 
 static int16_t bz_chunk2_vlist[] = {
@@ -396,6 +397,19 @@ static const int nmodels = ARRAYSIZE(bz_model);
 #define MAX_BZ_OBJECTS 100
 static struct bz_object bzo[MAX_BZ_OBJECTS] = { 0 };
 static int nbz_objects = 0;
+
+/*
+ * Objects by x, z position, for collisions.  It's rebuilt when objects are
+ * removed, which renumbers them, and in between things move, so each object
+ * is entered with a margin of as far as anything moves in a frame: shells, at
+ * SHELL_SPEED.
+ */
+#define BZ_CELL_SHIFT (5 + 8)
+#define BZ_HASH_BUCKETS 256
+#define BZ_HASH_MARGIN (5 << 8)
+static uint16_t bz_hash_bucket[BZ_HASH_BUCKETS];
+static struct spatial_hash_entry bz_hash_entry[4 * MAX_BZ_OBJECTS];
+static struct spatial_hash bz_hash;
 static unsigned int xorshift_state = 0;
 static int bz_kills = 0;
 static int bz_deaths = 0;
@@ -432,8 +446,11 @@ static struct camera {
 	int32_t vx, vy, vz;
 	int orientation;
 	int eyedist;
+	struct fxp_mat3 view_rotation; /* world to view, from set_view_rotation() */
 } camera;
 
+static struct transform3d_view bz_view;
+
 #define MAX_SPARKS 100
 #define SPARKS_PER_EXPLOSION (MAX_SPARKS / 4)
 #define SPARK_GRAVITY (-10)
@@ -542,6 +559,26 @@ enum battlezone_state_t {
 static enum battlezone_state_t battlezone_state = BATTLEZONE_INIT;
 static int screen_changed = 0;
 
+static void hash_object(int i)
+{
+	switch (bzo[i].model) {
+	case CHUNK0_MODEL: /* Nothing collides with "chunks" */
+	case CHUNK1_MODEL:
+	case CHUNK2_MODEL:
+		return;
+	default:
+		break;
+	}
+	spatial_hash_insert(&bz_hash, i, bzo[i].x, bzo[i].z, BZ_HASH_MARGIN);
+}
+
+static void hash_objects(void)
+{
+	spatial_hash_clear(&bz_hash);
+	for (int i = 0; i < nbz_objects; i++)
+		hash_object(i);
+}
+
 static int add_object(int x, int y, int z, int orientation, uint8_t model, uint16_t color)
 {
 	if (nbz_objects >= MAX_BZ_OBJECTS)
@@ -557,6 +594,7 @@ static int add_object(int x, int y, int z, int orientation, uint8_t model, uint1
 	bzo[nbz_objects].vz = 0;
 	bzo[nbz_objects].alive = 1;
 	bzo[nbz_objects].parent_obj = NO_PARENT_OBJ;
+	hash_object(nbz_objects);
 	nbz_objects++;
 	return nbz_objects - 1;
 }
@@ -577,6 +615,8 @@ static void prescale_models(void)
 	already_scaled = 1;
 
 	for (int i = 0; i < nmodels; i++) {
+		struct bz_model *m = (struct bz_model *) bz_model[i];
+
 		for (int j = 0; j < bz_model[i]->nvertices; j++) {
 			bz_model[i]->vert[j].x *= bz_model[i]->prescale_numerator;
 			bz_model[i]->vert[j].y *= bz_model[i]->prescale_numerator;
@@ -585,6 +625,7 @@ static void prescale_models(void)
 			bz_model[i]->vert[j].y /= bz_model[i]->prescale_denominator;
 			bz_model[i]->vert[j].z /= bz_model[i]->prescale_denominator;
 		}
+		m->radius = transform3d_radius(m->vert, m->nvertices);
 	}
 }
 
@@ -607,6 +648,8 @@ static void battlezone_init(void)
 	}
 
 	nbz_objects = 0;
+	spatial_hash_init(&bz_hash, BZ_CELL_SHIFT, bz_hash_bucket, BZ_HASH_BUCKETS,
+		bz_hash_entry, 4 * MAX_BZ_OBJECTS);
 	nsparks = 0;
 	prescale_models();
 	add_initial_objects();
@@ -618,6 +661,7 @@ static void battlezone_init(void)
 	camera.vy = 0;
 	camera.orientation = 0;
 	camera.eyedist = 100 * 256;
+	transform3d_view_init(&bz_view, camera.eyedist, LCD_XSIZE, LCD_YSIZE, 256);
 
 	FbInit();
 	FbClear();
@@ -632,8 +676,13 @@ static void bump_player(void)
 
 static int shell_collision(struct bz_object *s)
 {
-	int dx, dz;
-	for (int i = 0; i < nbz_objects; i++) {
+	uint16_t id[MAX_BZ_OBJECTS];
+	int dx, dz, n, hit = -1;
+
+	n = spatial_hash_query(&bz_hash, s->x, s->z, 8 << 8, id, MAX_BZ_OBJECTS);
+	for (int j = 0; j < n; j++) {
+		int i = id[j];
+
 		if (s == &bzo[i]) /* can't collide with self */
 			continue;
 
@@ -656,9 +705,12 @@ static int shell_collision(struct bz_object *s)
 			dx = -dx;
 		if (dz < 0)
 			dz = -dz;
-		 if (dx < (8 << 8) &&  dz < (8 << 8))
-			return i + 1;
+		/* The lowest numbered object is the one that gets hit, as it always has been */
+		if (dx < (8 << 8) && dz < (8 << 8) && (hit < 0 || i < hit))
+			hit = i;
 	}
+	if (hit >= 0)
+		return hit + 1;
 
 	if (s->parent_obj == PLAYER_PARENT_OBJ) /* player can't hit themselves */
 		return 0;
@@ -677,7 +729,11 @@ static int shell_collision(struct bz_object *s)
 
 static int player_obstacle_collision(int nx, int nz)
 {
-	for (int i = 0; i < nbz_objects; i++) {
+	uint16_t id[MAX_BZ_OBJECTS];
+	int n = spatial_hash_query(&bz_hash, nx, nz, 15 << 8, id, MAX_BZ_OBJECTS);
+
+	for (int j = 0; j < n; j++) {
+		int i = id[j];
 		int dx, dz;
 
 		switch (bzo[i].model) {
@@ -703,7 +759,11 @@ static int player_obstacle_collision(int nx, int nz)
 
 static int tank_obstacle_collision(struct bz_object *tank, int nx, int nz)
 {
-	for (int i = 0; i < nbz_objects; i++) {
+	uint16_t id[MAX_BZ_OBJECTS];
+	int n = spatial_hash_query(&bz_hash, nx, nz, 15 << 8, id, MAX_BZ_OBJECTS);
+
+	for (int j = 0; j < n; j++) {
+		int i = id[j];
 		int dx, dz;
 
 		if (&bzo[i] == tank) /* Can't collide with self */
@@ -810,52 +870,33 @@ static void check_buttons(void)
 	}
 }
 
-static void project_vertex(struct camera *c, struct bz_vertex *v, struct bz_object *o)
+/*
+ * Rotation for an object or the camera facing orientation.  It flips x as
+ * well as rotating, which is how the models were made, and the object and
+ * camera flips cancel out.
+ */
+static void bz_rotation(struct fxp_mat3 *m, int orientation)
 {
-	int32_t x, y, z, a, nx, ny, nz;
-
-	a = o->orientation;
-	a = -a;
-	if (a < 0)
-		a = a + 128;
-	if (a >= 128)
-		a = a - 128;
-
-	/* Rotate for object orientation */
-	nx = ((-v->x * cosine(a)) / 256) - ((v->z * sine(a)) / 256);
-	ny = v->y;
-	nz = ((v->z * cosine(a)) / 256) - ((v->x * sine(a)) / 256); 
-	x = nx;
-	y = ny;
-	z = nz;
-
-	/* Translate for +object position and -camera position */
-	x = x + o->x - c->x;
-	y = y + o->y - c->y;
-	z = z + o->z - c->z;
-
-	/* Rotate for camera */
-	a = 128 - c->orientation;
-	if (a > 127)
-		a = a - 128;
-
-	nx = ((-x * cosine(a)) / 256) - ((z * sine(a)) / 256);
-	ny = y;
-	nz = ((z * cosine(a)) / 256) - ((x * sine(a)) / 256); 
-	x = nx;
-	y = ny;
-	z = nz;
-
-	if (z >= 0) {
-		v->px = -1;
-		v->py = -1;
-		return;
-	}
+	fxp_angle a = FXP_ANGLE_FROM_TRIG(-orientation);
+	int32_t c = fxp_cos(a), s = fxp_sin(a);
+
+	m->m[0][0] = -c;
+	m->m[0][1] = 0;
+	m->m[0][2] = -s;
+	m->m[1][0] = 0;
+	m->m[1][1] = FXP_ONE;
+	m->m[1][2] = 0;
+	m->m[2][0] = -s;
+	m->m[2][1] = 0;
+	m->m[2][2] = c;
+}
 
-	v->px = (int) (((int64_t) c->eyedist * (int64_t) x) / -z);
-	v->py = (int) (((int64_t) c->eyedist * (int64_t) y) / -z);
-	v->px = v->px + (64 * 256);
-	v->py = (160 * 256) - (v->py + (80 * 256));
+/* Once a frame: the camera looks down -z, and view space looks down +z */
+static void set_view_rotation(struct camera *c)
+{
+	bz_rotation(&c->view_rotation, c->orientation);
+	for (int i = 0; i < 3; i++)
+		c->view_rotation.m[2][i] = -c->view_rotation.m[2][i];
 }
 
 static int onscreen(int x, int y)
@@ -867,44 +908,21 @@ static int onscreen(int x, int y)
 	return 1;
 }
 
-static void draw_projected_line(struct bz_vertex *v1, struct bz_vertex *v2)
-{
-	int x1, y1, x2, y2, onscreen1, onscreen2;
-
-	x1 = v1->px / 256;
-	y1 = v1->py / 256;
-	x2 = v2->px / 256;
-	y2 = v2->py / 256;
-	onscreen1 = onscreen(x1, y1);
-	onscreen2 = onscreen(x2, y2);
-	if (!onscreen1 && !onscreen2)
-		return;
-	if (!onscreen1 || !onscreen2)
-		FbClippedLine(x1, y1, x2, y2);
-	else
-		FbLine(x1, y1, x2, y2);
-}
-
 static void draw_object(struct camera *c, int n)
 {
-	struct bz_model *m = (struct bz_model *) bz_model[bzo[n].model];
-	int v1, v2;
-
+	static struct transform3d_vertex projected[BZ_MAX_MODEL_VERTICES];
+	const struct bz_model *m = bz_model[bzo[n].model];
+	struct fxp_vec3 offset = { bzo[n].x - c->x, bzo[n].y - c->y, bzo[n].z - c->z };
+	struct fxp_mat3 orientation;
+	struct transform3d t;
+
+	bz_rotation(&orientation, bzo[n].orientation);
+	transform3d_set(&t, &c->view_rotation, &orientation, &offset);
+	if (!transform3d_sphere_visible(&bz_view, &t, m->radius))
+		return;
+	transform3d_vertices(&bz_view, &t, m->vert, projected, m->nvertices);
 	FbColor(bzo[n].color);
-
-	for (int i = 0; i < m->nvertices; i++)
-		project_vertex(c, &m->vert[i], &bzo[n]);
-
-	for (int i = 0; i < m->nsegs - 1;) {
-		v1 = m->vlist[i];
-		v2 = m->vlist[i + 1];
-		if (v2 == -1) {
-			i = i + 2;
-			continue;
-		}
-		draw_projected_line(&m->vert[v1], &m->vert[v2]);
-		i++;
-	}
+	transform3d_draw_edges(&bz_view, projected, m->vlist, m->nsegs);
 }
 
 static void draw_mountains(void)
@@ -936,70 +954,23 @@ static void draw_horizon(void)
 	FbHorizontalLine(0, 80, 128, 80);
 }
 
-static int inside_view_frustum(struct camera *c, struct bz_object *o)
-{
-	int dx, dz;
-	signed short sdx, sdz;
-
-	dx = o->x - c->x;
-	dz = o->z - c->z;
-
-	if (abs(dx) > 32000 || abs(dz) > 32000) {
-		dx = dx >> 8;
-		dz = dz >> 8;
-	}
-	sdx = (signed short) dx;
-	sdz = (signed short) dz;
-	int a = arctan2(-sdx, -sdz);
-	if (a < 0)
-		a += 128;
-	if (a > 127)
-		a -= 128;
-	a = a - c->orientation;
-	if (a < 0)
-		a += 128;
-	if (a > 127)
-		a -= 128;
-	return (a < 18 && a >= 0) || (a > 128 - 18 && a < 128);
-}
-
 static void draw_objects(struct camera *c)
 {
 	for (int i = 0; i < nbz_objects; i++)
-		if (inside_view_frustum(c, &bzo[i]))
-			draw_object(c, i);
+		draw_object(c, i);
 }
 
 static void draw_spark(struct camera *c, struct bz_spark *s)
 {
-	int x, y, z, nx, ny, nz, a, sx, sy;
-
-	/* Translate for +object position and -camera position */
-	x = s->x - c->x;
-	y = s->y - c->y;
-	z = s->z - c->z;
-
-	/* Rotate for camera */
-	a = 128 - c->orientation;
-	if (a > 127)
-		a = a - 128;
-
-	nx = ((-x * cosine(a)) / 256) - ((z * sine(a)) / 256);
-	ny = y;
-	nz = ((z * cosine(a)) / 256) - ((x * sine(a)) / 256); 
-	x = nx;
-	y = ny;
-	z = nz;
-
-	if (z >= 0)
-		return;
-
-	sx = (c->eyedist * x) / -z;
-	sy = (c->eyedist * y) / -z;
-	sx = sx + (64 * 256);
-	sy = (160 * 256) - (sy + (80 * 256));
-	if (onscreen(sx >> 8, sy >> 8))
-		FbPoint(sx >> 8, sy >> 8);
+	static const struct fxp_vec3 origin = { 0, 0, 0 };
+	struct fxp_vec3 offset = { s->x - c->x, s->y - c->y, s->z - c->z };
+	struct transform3d_vertex p;
+	struct transform3d t;
+
+	transform3d_set(&t, &c->view_rotation, NULL, &offset);
+	transform3d_vertices(&bz_view, &t, &origin, &p, 1);
+	if (p.z >= bz_view.near && onscreen(p.sx >> 8, p.sy >> 8))
+		FbPoint(p.sx >> 8, p.sy >> 8);
 }
 
 static void draw_sparks(struct camera *c)
@@ -1511,6 +1482,7 @@ static void remove_dead_objects(void)
 		}
 		remove_object(i);
 	}
+	hash_objects();
 }
 
 static void draw_screen(void)
@@ -1533,6 +1505,7 @@ static void draw_screen(void)
 
 	draw_horizon();
 	draw_mountains();
+	set_view_rotation(&camera);
 	draw_objects(&camera);
 	draw_sparks(&camera);
 	draw_radar();
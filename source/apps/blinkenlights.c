@@ -1,6 +1,7 @@
 #include "colors.h"
 #include "menu.h"
 #include "ir.h"
+#include "show_sync.h"
 #include "blinkenlights.h"
 #include "button.h"
 #include "led_pwm.h"
@@ -123,29 +124,19 @@ static void set_bl_mode(__attribute__((unused)) struct menu_t *m)
 
 static void set_local_leds(void)
 {
-    led_pwm_enable(BADGE_LED_RGB_RED, bl_red * 255 / 100);
-    led_pwm_enable(BADGE_LED_RGB_GREEN, bl_green * 255 / 100);
-    led_pwm_enable(BADGE_LED_RGB_BLUE, bl_blue * 255 / 100);
+    led_effect_fade(bl_red * 255 / 100, bl_green * 255 / 100, bl_blue * 255 / 100, 300);
 }
 
 static void set_bl_go(__attribute__((unused)) struct menu_t *m)
 {
     if(bl_mode == BCAST_ONLY || bl_mode == LOCAL_AND_BCAST)
     {
-        uint16_t data = PACKRGB( bl_red, bl_green, bl_blue);
-        uint8_t byte_data[2];
-        byte_data[0] = data >> 8;
-        byte_data[1] = data;
+        /* This one changes color now, and every badge that hears it at the same moment as the others */
+        uint8_t args[4] = { bl_red * 255 / 100, bl_green * 255 / 100, bl_blue * 255 / 100, 30 };
 
-        IR_DATA ir_packet = {0};
-        ir_packet.app_address = IR_LED;
-        ir_packet.recipient_address = IR_BADGE_ID_BROADCAST;
-        ir_packet.data = byte_data;
-        ir_packet.data_length = 2;
-        ir_send_complete_message(&ir_packet);
+        show_sync_cue(SHOW_CUE_LED_FADE, args, sizeof(args), 0);
     }
-
-    if(bl_mode == LOCAL_ONLY || bl_mode == LOCAL_AND_BCAST)
+    else
     {
         set_local_leds();
     }
@@ -20,6 +20,9 @@
 #include "rtc.h"
 
 #define BADGE_IR_CLUE_GAME_ADDRESS IR_APP3
+/* Questions and answers are rebroadcast every 10th frame; an 8 byte message is about a second
+ * of air time, so don't let the repeats crowd out everyone else's. */
+#define CLUE_IR_MIN_INTERVAL_MS 2000
 #define BADGE_IR_BROADCAST_ID 0
 #define CLUESOE ((uint64_t) 0xC100050E << 32)
 
@@ -255,6 +258,7 @@ static void clue_init(void)
 	question.person = -1;
 	question.location = -1;
 	question.weapon = -1;
+	ir_set_app_rate_limit(BADGE_IR_CLUE_GAME_ADDRESS, CLUE_IR_MIN_INTERVAL_MS);
 	ir_add_callback(clue_ir_packet_callback, BADGE_IR_CLUE_GAME_ADDRESS);
 	scan_for_incoming_packets = 1;
 }
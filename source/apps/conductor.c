@@ -1,5 +1,5 @@
 #include "menu.h"
-#include "ir.h"
+#include "show_sync.h"
 #include "conductor.h"
 #include "button.h"
 #include "audio.h"
@@ -191,19 +191,12 @@ static void run_conductor(uint32_t down_latches)
     {
         if(con_mode == BCAST_ONLY || con_mode == LOCAL_AND_BCAST)
         {
-            IR_DATA ir_packet = {0};
-            ir_packet.recipient_address = IR_BADGE_ID_BROADCAST;
-            ir_packet.data_length = 2;
-            ir_packet.app_address = IR_LIVEAUDIO;
-            uint16_t data = (((2048 >> 8) & 0xF) << 12) | (freq & 0x0FFF);
-            uint8_t byte_data[2];
-            byte_data[0] = data >> 8;
-            byte_data[1] = data;
-            ir_packet.data = byte_data;
-            ir_send_complete_message(&ir_packet);
-        }
+            /* Played here now, and together on every badge that hears it once it's been sent */
+            uint8_t args[3] = { freq >> 8, freq & 0xff, 40 };
 
-        if(con_mode == LOCAL_AND_BCAST || con_mode == LOCAL_ONLY)
+            show_sync_cue(SHOW_CUE_NOTE, args, sizeof(args), 0);
+        }
+        else
             audio_out_beep(freq, 400);
     }
 }
@@ -99,34 +99,17 @@ static void draw_screen(void)
 	screen_changed = 0;
 }
 
-#define NSAMPLES 5
-static union acceleration acc_sample[NSAMPLES];
-
 static void check_accelerometer(void)
 {
-	static int n = 0;
+	struct accelerometer_motion motion;
 	union acceleration a;
 
-	union acceleration acceleration = accelerometer_last_sample();
-
-	/* Average the last few samples */
-	acc_sample[n] = acceleration;
-	n = n + 1;
-	if (n >= NSAMPLES)
-		n = 0;
-	a.x = 0;
-	a.y = 0;
-	a.z = 0;
-	for (int i = 0; i < NSAMPLES; i++) {
-		a.x += acc_sample[i].x;
-		a.y += acc_sample[i].y;
-		a.z += acc_sample[i].z;
-	}
-	a.x /= NSAMPLES;
-	a.y /= NSAMPLES;
-	a.z /= NSAMPLES;
+	/* Gravity is already smoothed */
+	accelerometer_get_motion(&motion);
+	a = motion.gravity;
 
-	if (a.z < -900) /* screen facing floor, more or less, erase everything */
+	/* screen facing floor, more or less, or shaken, like the real thing: erase everything */
+	if (a.z < -900 || (accelerometer_take_events() & ACCELEROMETER_EVENT_SHAKE))
 		clear_etch_a_sketch();
 }
 
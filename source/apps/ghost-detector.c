@@ -12,8 +12,13 @@ Author: Stephen M. Cameron <stephenmcameron@gmail.com>
 #include "button.h"
 #include "trig.h"
 #include "framebuffer.h"
+#include "spectrum.h"
+
+/* Louder than this, and the microphone has picked up a ghost */
+#define GHOST_LEVEL 1500
 
 static int radar_angle = 0;
+static unsigned char blip_radius[128];
 
 /* Program states.  Initial state is GHOSTDETECTOR_INIT */
 enum ghostdetector_state_t {
@@ -28,6 +33,8 @@ static void ghostdetector_init(void)
 {
 	FbInit();
 	FbClear();
+	memset(blip_radius, 0, sizeof(blip_radius));
+	spectrum_start();
 	ghostdetector_state = GHOSTDETECTOR_RUN;
 }
 
@@ -75,12 +82,33 @@ static void draw_reticle(int color)
 	draw_reticle_line(23, 8);
 }
 
+static void draw_blip(int r, int color)
+{
+	FbColor(color);
+	FbCircle(64 + (cosine(radar_angle) * r) / 256, 64 + (sine(radar_angle) * r) / 256, 2);
+}
+
+/* A blip on the beam for anything the microphone hears, further out the higher it is, until the beam comes round again */
+static void draw_ghost(void)
+{
+	const struct spectrum *s = spectrum_poll();
+
+	if (blip_radius[radar_angle])
+		draw_blip(blip_radius[radar_angle], BLACK);
+	blip_radius[radar_angle] = 0;
+	if (s->level < GHOST_LEVEL)
+		return;
+	blip_radius[radar_angle] = 8 + s->loudest_bin * 52 / SPECTRUM_BINS;
+	draw_blip(blip_radius[radar_angle], GREEN);
+}
+
 static void draw_screen(void)
 {
 	draw_reticle(RED);
 	draw_radar_beam(BLACK);
 	radar_angle = (radar_angle + 1) % 128;
 	draw_radar_beam(WHITE);
+	draw_ghost();
 	FbSwapBuffers();
 }
 
@@ -92,6 +120,7 @@ static void ghostdetector_run(void)
 
 static void ghostdetector_exit(void)
 {
+	spectrum_stop();
 	ghostdetector_state = GHOSTDETECTOR_INIT; /* So that when we start again, we do not immediately exit */
 	returnToMenus();
 }
@@ -66,7 +66,8 @@
 #include "random.h"
 #include "string.h"
 #include "bline.h"
-#include "a_star.h"
+#include "grid_path.h"
+#include "flow_field.h"
 #include "dynmenu.h"
 #include "led_pwm.h"
 #include "rtc.h"
@@ -243,20 +244,12 @@ static int display_message = 0;
 static unsigned char room_cost[COST_YDIM][COST_XDIM];
 
 #define DEBUG_PATHFINDING 0
-/* Workspace for A* algorithm. */
-static unsigned char nodeset1[A_STAR_NODESET_SIZE(ASTAR_MAXNODES)];
-static unsigned char nodeset2[A_STAR_NODESET_SIZE(ASTAR_MAXNODES)];
-static unsigned char scoremap1[A_STAR_SCOREMAP_SIZE(ASTAR_MAXNODES)];
-static unsigned char scoremap2[A_STAR_SCOREMAP_SIZE(ASTAR_MAXNODES)];
-static unsigned char nodemap[A_STAR_NODEMAP_SIZE(ASTAR_MAXNODES)];
-static unsigned char a_star_path1[A_STAR_PATH_SIZE(ASTAR_MAXNODES)];
-static unsigned char a_star_path2[A_STAR_PATH_SIZE(ASTAR_MAXNODES)];
-static struct a_star_working_space astar_workspace = {
-	{ nodeset1, nodeset2 },
-	nodemap,
-	{ scoremap1, scoremap2 },
-	{ a_star_path1, a_star_path2 },
-};
+static const struct grid_path_map room_map = { &room_cost[0][0], COST_XDIM, COST_YDIM };
+/* Workspace for path finding. */
+static uint16_t astar_workspace[GRID_PATH_WORKSPACE_SIZE(ASTAR_MAXNODES) / sizeof(uint16_t) + 1];
+/* Soldiers chasing the player share a flow field towards where any of them last saw him. */
+static uint16_t chase_workspace[FLOW_FIELD_WORKSPACE_SIZE(ASTAR_MAXNODES) / sizeof(uint16_t) + 1];
+static struct flow_field chase_field;
 
 /* These wallx[] arrays define internal walls in rooms.  There are pairs of numbers,
  * with a -1 sentinel value  at the end.  The pairs of numbers define horizontal
@@ -541,179 +534,40 @@ struct gulag_object {
 } go[GULAG_MAXOBJS];
 int gulag_nobjs = 0;
 
-#define whole_note 3200 
-#define half_note 1600  
-#define quarter_note 800 
-#define dotted_quarter 1200
-#define eighth_note 400 
-#define sixteenth_note 200 
-#define thirtysecond_note 100 
-
-static struct note natl_anthem_notes[] = {
-	{ NOTE_D5, dotted_quarter, }, /* measure 1 */
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-
-	{ NOTE_F5, dotted_quarter, }, /* measure 2 */
-	{ NOTE_Ef5, eighth_note, },
-	{ NOTE_D5, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-
-	{ NOTE_Bf4, quarter_note, }, /* measure 3 */
-	{ NOTE_D5, quarter_note, },
-	{ NOTE_A4, quarter_note, },
-	{ NOTE_D5, quarter_note, },
-
-	{ NOTE_G4, dotted_quarter, }, /* measure 4 */
-	{ NOTE_A4, eighth_note, },
-	{ NOTE_Bf4, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-
-	{ NOTE_D5, dotted_quarter, }, /* measure 5 */
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-
-	{ NOTE_F5, dotted_quarter, }, /* measure 6 */
-	{ NOTE_Ef5, eighth_note, },
-	{ NOTE_D5, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-
-	{ NOTE_Bf4, quarter_note, }, /* measure 7 */
-	{ NOTE_D5, quarter_note, },
-	{ NOTE_A4, quarter_note, },
-	{ NOTE_D5, quarter_note, },
-
-	{ NOTE_G4, half_note }, /* measure 8 */
-	{ NOTE_REST, half_note },
-
-	{ NOTE_A4, dotted_quarter, }, /* measure 9 */
-	{ NOTE_A4, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_Bf4, eighth_note, },
-	{ NOTE_A4, eighth_note, },
-
-	{ NOTE_G4, eighth_note, }, /* measure 10 */
-	{ NOTE_A4, eighth_note, },
-	{ NOTE_Bf4, eighth_note, },
-	{ NOTE_G4, eighth_note, },
-	{ NOTE_A4, quarter_note, },
-	{ NOTE_A4, quarter_note, },
-
-	{ NOTE_Bf4, quarter_note, }, /* measure 11 */
-	{ NOTE_Bf4, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-
-	{ NOTE_D5, half_note, }, /* measure 12 */
-	{ NOTE_D5, quarter_note, },
-	{ NOTE_REST, quarter_note, },
-
-	{ NOTE_A4, dotted_quarter, }, /* measure 13 */
-	{ NOTE_A4, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_Bf4, eighth_note, },
-	{ NOTE_A4, eighth_note, },
-
-	{ NOTE_G4, eighth_note, }, /* measure 14 */
-	{ NOTE_A4, eighth_note, },
-	{ NOTE_Bf4, eighth_note, },
-	{ NOTE_G4, eighth_note, },
-	{ NOTE_A4, quarter_note, },
-	{ NOTE_A4, quarter_note, },
-
-	{ NOTE_Bf4, quarter_note, }, /* measure 15 */
-	{ NOTE_D5, quarter_note, },
-	{ NOTE_A4, quarter_note, },
-	{ NOTE_D5, quarter_note, },
-
-	{ NOTE_G4, dotted_quarter, }, /* measure 16 */
-	{ NOTE_A4, eighth_note, },
-	{ NOTE_Bf4, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-
-	{ NOTE_F5, dotted_quarter }, /* measure 17 */
-	{ NOTE_E5, eighth_note, },
-	{ NOTE_F5, quarter_note, },
-	{ NOTE_D5, quarter_note, },
-
-	{ NOTE_C5, quarter_note, }, /* measure 18 */
-	{ NOTE_C5, quarter_note, },
-	{ NOTE_F5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-
-	{ NOTE_Bf4, quarter_note, }, /* measure 19 */
-	{ NOTE_Bf4, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-
-	{ NOTE_D5, dotted_quarter, }, /* measure 20 */
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_Bf4, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-
-	{ NOTE_F5, dotted_quarter, }, /* measure 21 */
-	{ NOTE_E5, eighth_note, },
-	{ NOTE_F5, quarter_note, },
-	{ NOTE_D5, quarter_note, },
-
-	{ NOTE_C5, quarter_note, }, /* measure 22 */
-	{ NOTE_C5, quarter_note, },
-	{ NOTE_F5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-
-	{ NOTE_Bf4, quarter_note, }, /* measure 23 */
-	{ NOTE_Bf4, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-	{ NOTE_C5, quarter_note, },
-
-	{ NOTE_D5, dotted_quarter, }, /* measure 24 */
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_Bf4, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-
-	{ NOTE_F5, dotted_quarter, }, /* measure 25 */
-	{ NOTE_E5, eighth_note, },
-	{ NOTE_F5, quarter_note, },
-	{ NOTE_D5, quarter_note, },
-
-	{ NOTE_C5, quarter_note, }, /* measure 26 */
-	{ NOTE_C5, quarter_note, },
-	{ NOTE_F5, eighth_note, },
-	{ NOTE_Ef5, eighth_note, },
-	{ NOTE_D5, eighth_note, },
-	{ NOTE_C5, eighth_note, },
-
-	{ NOTE_Bf4, quarter_note, }, /* measure 27 */
-	{ NOTE_D5, quarter_note, },
-	{ NOTE_A4, quarter_note, },
-	{ NOTE_D5, quarter_note, },
-
-	{ NOTE_G4, half_note, }, /* measure 28 */
-	{ NOTE_G4, quarter_note, },
-	{ NOTE_REST, quarter_note, },
+/* Converted from the struct note table natl_anthem_notes by tools/tune-converter.py */
+static const uint8_t natl_anthem_notes[] = {
+	TUNE_LENGTH(3), TUNE_N(D, 5), TUNE_LENGTH(1), TUNE_N(D, 5), TUNE_N(D, 5), TUNE_N(C, 5), TUNE_N(D, 5), TUNE_N(Ef, 5), /* measure 1 */
+	TUNE_LENGTH(3), TUNE_N(F, 5), TUNE_LENGTH(1), TUNE_N(Ef, 5), TUNE_LENGTH(2), TUNE_N(D, 5), TUNE_N(C, 5), /* measure 2 */
+	TUNE_N(Bf, 4), TUNE_N(D, 5), TUNE_N(A, 4), TUNE_N(D, 5), /* measure 3 */
+	TUNE_LENGTH(3), TUNE_N(G, 4), TUNE_LENGTH(1), TUNE_N(A, 4), TUNE_LENGTH(2), TUNE_N(Bf, 4), TUNE_N(C, 5), /* measure 4 */
+	TUNE_LENGTH(3), TUNE_N(D, 5), TUNE_LENGTH(1), TUNE_N(D, 5), TUNE_N(D, 5), TUNE_N(C, 5), TUNE_N(D, 5), TUNE_N(Ef, 5), /* measure 5 */
+	TUNE_LENGTH(3), TUNE_N(F, 5), TUNE_LENGTH(1), TUNE_N(Ef, 5), TUNE_LENGTH(2), TUNE_N(D, 5), TUNE_N(C, 5), /* measure 6 */
+	TUNE_N(Bf, 4), TUNE_N(D, 5), TUNE_N(A, 4), TUNE_N(D, 5), /* measure 7 */
+	TUNE_LENGTH(4), TUNE_N(G, 4), TUNE_REST, /* measure 8 */
+	TUNE_LENGTH(3), TUNE_N(A, 4), TUNE_LENGTH(1), TUNE_N(A, 4), TUNE_N(D, 5), TUNE_N(C, 5), TUNE_N(Bf, 4), TUNE_N(A, 4), /* measure 9 */
+	TUNE_N(G, 4), TUNE_N(A, 4), TUNE_N(Bf, 4), TUNE_N(G, 4), TUNE_LENGTH(2), TUNE_N(A, 4), TUNE_N(A, 4), /* measure 10 */
+	TUNE_N(Bf, 4), TUNE_N(Bf, 4), TUNE_N(C, 5), TUNE_N(C, 5), /* measure 11 */
+	TUNE_LENGTH(4), TUNE_N(D, 5), TUNE_LENGTH(2), TUNE_N(D, 5), TUNE_REST, /* measure 12 */
+	TUNE_LENGTH(3), TUNE_N(A, 4), TUNE_LENGTH(1), TUNE_N(A, 4), TUNE_N(D, 5), TUNE_N(C, 5), TUNE_N(Bf, 4), TUNE_N(A, 4), /* measure 13 */
+	TUNE_N(G, 4), TUNE_N(A, 4), TUNE_N(Bf, 4), TUNE_N(G, 4), TUNE_LENGTH(2), TUNE_N(A, 4), TUNE_N(A, 4), /* measure 14 */
+	TUNE_N(Bf, 4), TUNE_N(D, 5), TUNE_N(A, 4), TUNE_N(D, 5), /* measure 15 */
+	TUNE_LENGTH(3), TUNE_N(G, 4), TUNE_LENGTH(1), TUNE_N(A, 4), TUNE_REPEAT(2), TUNE_LENGTH(1), TUNE_N(Bf, 4), TUNE_N(C, 5), /* measure 16 */
+	TUNE_N(D, 5), TUNE_N(Ef, 5),
+	TUNE_LENGTH(3), TUNE_N(F, 5), TUNE_LENGTH(1), TUNE_N(E, 5), TUNE_LENGTH(2), TUNE_N(F, 5), TUNE_N(D, 5), /* measure 17 */
+	TUNE_N(C, 5), TUNE_N(C, 5), TUNE_LENGTH(1), TUNE_N(F, 5), TUNE_N(Ef, 5), TUNE_N(D, 5), TUNE_N(C, 5), /* measure 18 */
+	TUNE_LENGTH(2), TUNE_N(Bf, 4), TUNE_N(Bf, 4), TUNE_N(C, 5), TUNE_N(C, 5), /* measure 19 */
+	TUNE_LENGTH(3), TUNE_N(D, 5), TUNE_LENGTH(1), TUNE_N(C, 5), TUNE_REPEAT_END, TUNE_N(Bf, 4), TUNE_N(C, 5), TUNE_N(D, 5), /* measure 20 */
+	TUNE_N(Ef, 5),
+	TUNE_LENGTH(3), TUNE_N(F, 5), TUNE_LENGTH(1), TUNE_N(E, 5), TUNE_LENGTH(2), TUNE_N(F, 5), TUNE_N(D, 5), /* measure 25 */
+	TUNE_N(C, 5), TUNE_N(C, 5), TUNE_LENGTH(1), TUNE_N(F, 5), TUNE_N(Ef, 5), TUNE_N(D, 5), TUNE_N(C, 5), /* measure 26 */
+	TUNE_LENGTH(2), TUNE_N(Bf, 4), TUNE_N(D, 5), TUNE_N(A, 4), TUNE_N(D, 5), /* measure 27 */
+	TUNE_LENGTH(4), TUNE_N(G, 4), TUNE_LENGTH(2), TUNE_N(G, 4), TUNE_REST, TUNE_END, /* measure 28 */
 };
 
-static struct tune ukrainian_natl_anthem = {
-	.num_notes = ARRAYSIZE(natl_anthem_notes),
-	.note = &natl_anthem_notes[0],
+static const struct tune ukrainian_natl_anthem = {
+	.tick_ms = 400,
+	.num_channels = 1,
+	.channel = { natl_anthem_notes },
 };
 
 typedef void (*gulag_object_drawing_function)(struct gulag_object *o);
@@ -2173,15 +2027,6 @@ static int fpdot8y_to_astary(int y)
 	return y / dy;
 }
 
-/* given an a-star node (in our case, a pointer into room_cost array),
- * return x y coords into room_cost array */
-void astar_node_get_xy(void *node, int *x, int *y)
-{
-	void *origin = (void *) room_cost;
-	*y = (node - origin) / COST_XDIM;
-	*x = (node - origin) % COST_XDIM;
-}
-
 /* Fill in room_cost[][] upon entry into a room.  It does bounding box checks vs.
  * walls in the room to set things up to allow the soldiers to avoid the
  * walls.  */
@@ -2203,63 +2048,7 @@ static void init_room_cost(struct castle *c, int room)
 				room_cost[y][x] = 0;
 		}
 	}
-}
-
-/* A-star callback, returns manhattan distance between nodes,
- * which the nodes will be pointers into room_cost[][] array
- */
-static int distance_fn(__attribute__((unused)) void *context, void *n1, void *n2)
-{
-	int x1, y1, x2, y2;
-
-	astar_node_get_xy(n1, &x1, &y1);
-	astar_node_get_xy(n2, &x2, &y2);
-	return abs(x1 - x2) + abs(y1 - y2);
-}
-
-/* A-star callback, returns the estimated cost to travel between two nodes. */
-static int cost_fn(__attribute__((unused)) void *context, void *n1, void *n2)
-{
-	unsigned char c1, c2;
-	int c;
-
-	/* The nodes will be pointers into room_cost[][] array */
-	c1 = *(unsigned char *) n1;
-	c2 = *(unsigned char *) n2;
-	c = c1 + c2 + 1; /* plus 1 so cost is not zero */
-	return c;
-}
-
-/* Callback function for A-star to iterate over a node's neighbors */
-static void *neighbor_fn(__attribute__((unused)) void *context, void *node, int neighbor)
-{
-	/* 8 x/y offsets for N, NE, E, SE, S, SW, W, NW */
-	const char xo[] = { 0, 1, 1, 1, 0, -1, -1, -1 };
-	const char yo[] = { -1, -1, 0, 1, 1, 1, 0, -1 };
-	int x, y, nx, ny;
-	int count = 0;
-	unsigned char *n;
-
-	if (neighbor > 7 || neighbor < 0)
-		return NULL;
-	astar_node_get_xy(node, &x, &y);
-
-	/* Each node has up to eight neighbors, we need to return the right one */
-	for (int i = 0; i < 8; i++) {
-		nx = x + xo[i];
-		ny = y + yo[i];
-		if (nx < 0 || nx >= COST_XDIM) /* no neighbor this way */
-			continue;
-		if (ny < 0 || ny >= COST_YDIM) /* no neighbor this way */
-			continue;
-		n = &room_cost[ny][nx];
-		if (*n == 255) /* wall, not a viable neighbor (aka infinite cost) */
-			continue;
-		if (count == neighbor) /* viable neighbor node this way */
-			return n;
-		count++;
-	}
-	return NULL;
+	flow_field_init(&chase_field, &room_map, GRID_PATH_8_CONNECTED, chase_workspace);
 }
 
 static void gulag_init(void)
@@ -4370,6 +4159,8 @@ static void soldier_look_for_player(struct gulag_object *s, struct player *p)
 			s->tsd.soldier.last_seen_x = dx;
 			s->tsd.soldier.last_seen_y = dy;
 			s->tsd.soldier.sees_player_now = 1;
+			/* Only worked out again when he's seen in another cell */
+			flow_field_set_target(&chase_field, dy * COST_XDIM + dx);
 		}
 	} else {
 		s->tsd.soldier.sees_player_now = 0;
@@ -4449,9 +4240,47 @@ static void maybe_surrender(struct gulag_object *s)
 	s->tsd.soldier.anim_frame = HANDSUP_FIGURE;
 }
 
+/* Move a soldier towards the next step of his path */
+static void soldier_follow_path(struct gulag_object *s, struct path_data *pd)
+{
+	int dx, dy, angle, newx, newy, speed;
+
+	if (s->tsd.soldier.on_fire)
+		speed = difficulty[3].soldier_speed; /* max speed when on fire */
+	else
+		speed = difficulty[difficulty_level].soldier_speed;
+
+	dx = astarx_to_8dot8x(pd->pathx[pd->current_step]);
+	dy = astary_to_8dot8y(pd->pathy[pd->current_step]);
+
+	dx = (dx >> 8) - (s->x >> 8);
+	dy = (dy >> 8) - (s->y >> 8);
+
+	angle = arctan2(dy, -dx);
+	if (angle < 0)
+		angle += 128;
+	s->tsd.soldier.angle = (unsigned char) angle;
+	newx = ((-cosine(angle) * speed) >> 8) + s->x;
+	newy = ((sine(angle) * speed) >> 8) + s->y;
+
+	s->x = newx;
+	s->y = newy;
+	/* Have we arrived at our next path step? */
+	dx = astarx_to_8dot8x(pd->pathx[pd->current_step]);
+	dy = astary_to_8dot8y(pd->pathy[pd->current_step]);
+	dx = abs(dx - s->x);
+	dy = abs(dy - s->y);
+	if (dx <= (1 << 8) + (1 << 7) && dy <= (1 << 8) + (1 << 7)) {
+		/* Yes, we have arrived at our next path step, advance to the next one. */
+		pd->current_step++;
+		if (pd->current_step > pd->nsteps) /* paranoia, shouldn't happen */
+			pd->current_step = pd->nsteps;
+	}
+}
+
 static void move_soldier(struct gulag_object *s)
 {
-	int dx, dy, angle, newx, newy, p;
+	int dx, dy, p, chase;
 	struct path_data *pd;
 #define SOLDIER_MOVE_THROTTLE 2
 
@@ -4493,6 +4322,7 @@ static void move_soldier(struct gulag_object *s)
 			break;						/* so long as he's not on fire. */
 		/* Or choose a destination and start moving there. */
 		do {
+			chase = 0;
 			if (s->tsd.soldier.disarmed || s->tsd.soldier.hit_timer) {
 				/* Disarmed or hit, so try to avoid the player */
 				int minx, miny;
@@ -4521,6 +4351,7 @@ static void move_soldier(struct gulag_object *s)
 					/* Choose a destination where the player was last seen */
 					dx = s->tsd.soldier.last_seen_x;
 					dy = s->tsd.soldier.last_seen_y;
+					chase = 1;
 				} else {
 					/* Choose a destination randomly */
 					dx = random_num(COST_XDIM);
@@ -4532,7 +4363,7 @@ static void move_soldier(struct gulag_object *s)
 		s->tsd.soldier.desty = dy;
 		pd->nsteps = 0;
 		pd->current_step = 0;
-		s->tsd.soldier.state = SOLDIER_STATE_MOVING;
+		s->tsd.soldier.state = chase ? SOLDIER_STATE_CHASING : SOLDIER_STATE_MOVING;
 		/* TODO: maybe if we see the player, do something else. */
 		break;
 	case SOLDIER_STATE_MOVING:
@@ -4552,11 +4383,11 @@ static void move_soldier(struct gulag_object *s)
 				int sy = fpdot8y_to_astary(s->y);
 				int gx = s->tsd.soldier.destx;
 				int gy = s->tsd.soldier.desty;
-				void *start = &room_cost[sy][sx];
-				void *goal = &room_cost[gy][gx];
-				struct a_star_path *path = a_star(room_cost, &astar_workspace, start, goal,
-						ASTAR_MAXNODES, distance_fn, cost_fn, neighbor_fn);
-				if (!path) {
+				uint16_t path[SOLDIER_PATH_LENGTH];
+				/* room_cost[][] is all 0 or 255, so jump point search works */
+				int length = grid_path_find(&room_map, sy * COST_XDIM + sx, gy * COST_XDIM + gx,
+						GRID_PATH_JUMP_POINTS, astar_workspace, path, SOLDIER_PATH_LENGTH);
+				if (length < 0) {
 					/* We do not expect this to happen. */
 					s->tsd.soldier.state = SOLDIER_STATE_RESTING;
 					pd->nsteps = 0;
@@ -4569,64 +4400,47 @@ static void move_soldier(struct gulag_object *s)
 				}
 #if 0
 				/* Debug code */
-				for (int i = 0; i < path->node_count; i++) {
-					int x, y;
-
-					astar_node_get_xy(path->path[i], &x, &y);
-					printf("xy = %d, %d\n", x, y);
-				}
+				for (int i = 0; i < length && i < SOLDIER_PATH_LENGTH; i++)
+					printf("xy = %d, %d\n", path[i] % COST_XDIM, path[i] / COST_XDIM);
 				printf("------\n");
 #endif
 				/* Copy up to SOLDIER_PATH_LENGTH steps into the soldiers cached pathing data */
-				pd->nsteps = path->node_count > SOLDIER_PATH_LENGTH ? SOLDIER_PATH_LENGTH : path->node_count;
+				pd->nsteps = length > SOLDIER_PATH_LENGTH ? SOLDIER_PATH_LENGTH : length;
 				for (int i = 0; i < pd->nsteps; i++) {
-					int x, y;
-
-					astar_node_get_xy(path->path[i], &x, &y);
-					pd->pathx[i] = x;
-					pd->pathy[i] = y;
+					pd->pathx[i] = path[i] % COST_XDIM;
+					pd->pathy[i] = path[i] / COST_XDIM;
 				}
 				pd->current_step = 1; /* We're standing on zero already */
 			}
 		} else { /* move in the direction of the next pathfinding step */
-			int speed;
-
-			if (s->tsd.soldier.on_fire)
-				speed = difficulty[3].soldier_speed; /* max speed when on fire */
-			else
-				speed = difficulty[difficulty_level].soldier_speed;
-
-			dx = astarx_to_8dot8x(pd->pathx[pd->current_step]);
-			dy = astary_to_8dot8y(pd->pathy[pd->current_step]);
-
-			dx = (dx >> 8) - (s->x >> 8);
-			dy = (dy >> 8) - (s->y >> 8);
-
-			angle = arctan2(dy, -dx);
-			if (angle < 0)
-				angle += 128;
-			s->tsd.soldier.angle = (unsigned char) angle;
-			newx = ((-cosine(angle) * speed) >> 8) + s->x;
-			newy = ((sine(angle) * speed) >> 8) + s->y;
-
-			s->x = newx;
-			s->y = newy;
-			/* Have we arrived at our next path step? */
-			dx = astarx_to_8dot8x(pd->pathx[pd->current_step]);
-			dy = astary_to_8dot8y(pd->pathy[pd->current_step]);
-			dx = abs(dx - s->x);
-			dy = abs(dy - s->y);
-			if (dx <= (1 << 8) + (1 << 7) && dy <= (1 << 8) + (1 << 7)) {
-				/* Yes, we have arrived at our next path step, advance to the next one. */
-				pd->current_step++;
-				if (pd->current_step > pd->nsteps) /* paranoia, shouldn't happen */
-					pd->current_step = pd->nsteps;
-			}
+			soldier_follow_path(s, pd);
 		}
 		advance_soldier_animation(s);
 		screen_changed = 1;
 		break;
 	case SOLDIER_STATE_CHASING:
+		/* Like moving, but one step at a time from the shared chase field, towards the last sighting */
+		if (pd->current_step == pd->nsteps) {
+			int sx = fpdot8x_to_astarx(s->x);
+			int sy = fpdot8y_to_astary(s->y);
+			int next;
+
+			next = flow_field_next_step(&chase_field, sy * COST_XDIM + sx);
+			if (next < 0) {
+				/* Arrived, or there's no way there */
+				s->tsd.soldier.state = SOLDIER_STATE_RESTING;
+				break;
+			}
+			pd->pathx[0] = sx;
+			pd->pathy[0] = sy;
+			pd->pathx[1] = next % COST_XDIM;
+			pd->pathy[1] = next / COST_XDIM;
+			pd->nsteps = 2;
+			pd->current_step = 1;
+		}
+		soldier_follow_path(s, pd);
+		advance_soldier_animation(s);
+		screen_changed = 1;
 		break;
 	case SOLDIER_STATE_FLEEING:
 		break;
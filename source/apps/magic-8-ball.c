@@ -47,9 +47,6 @@ enum magic_8_ball_state_t {
 static enum magic_8_ball_state_t magic_8_ball_state = MAGIC8BALL_INIT;
 static int screen_changed = 0;
 
-#define NSAMPLES 5
-static union acceleration acc_sample[NSAMPLES];
-
 /* return a random int between 0 and n - 1 */
 static int random_num(int n)
 {
@@ -67,29 +64,15 @@ static int random_num(int n)
 
 static void check_accelerometer(void)
 {
-	static int n = 0;
+	struct accelerometer_motion motion;
 	union acceleration a;
 
-	union acceleration acceleration = accelerometer_last_sample();
-
-	/* Average the last few samples */
-	acc_sample[n] = acceleration;
-	n = n + 1;
-	if (n >= NSAMPLES)
-		n = 0;
-	a.x = 0;
-	a.y = 0;
-	a.z = 0;
-	for (int i = 0; i < NSAMPLES; i++) {
-		a.x += acc_sample[i].x;
-		a.y += acc_sample[i].y;
-		a.z += acc_sample[i].z;
-	}
-	a.x /= NSAMPLES;
-	a.y /= NSAMPLES;
-	a.z /= NSAMPLES;
+	/* Gravity is already smoothed */
+	accelerometer_get_motion(&motion);
+	a = motion.gravity;
 
-	if (a.z < -800) { /* screen facing floor, more or less, erase everything */
+	/* screen facing floor, more or less, or shaken: erase everything */
+	if (a.z < -800 || (accelerometer_take_events() & ACCELEROMETER_EVENT_SHAKE)) {
 		/* turn screen brightness to zero */
 		led_pwm_enable(BADGE_LED_DISPLAY_BACKLIGHT, 0);
 		screen_brightness = 0;
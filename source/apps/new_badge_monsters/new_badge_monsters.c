@@ -11,10 +11,14 @@
 #include "colors.h"
 #include "framebuffer.h"
 #include "key_value_storage.h"
+#include "rtc.h"
 #include "utils.h"
 
 #define ARRAYSIZE(x) (sizeof((x)) / sizeof((x)[0]))
 
+// pause between one trade being acknowledged (or given up on) and offering it again
+#define TRADE_RESEND_DELAY_MS 1000
+
 #ifdef __linux__
 #define LOG(...) printf(__VA_ARGS__)
 #else
@@ -331,6 +335,10 @@ struct game_state {
     struct dynmenu_item menu_item[ARRAYSIZE(new_monsters) + 1];
     // TODO: since the two menus are different app states, we might not need this
     enum menu_level_t menu_level;
+    // a trade is waiting to be acknowledged by another badge
+    bool trade_in_flight;
+    // don't offer the monster again until this time
+    uint64_t next_trade_ms;
 };
 
 
@@ -352,8 +360,11 @@ static struct game_state state = {
         0,
         0,
         0xFFFFFF,
-        0x0
-    }, {}, GAME_MENU_LEVEL
+        0x0,
+        { 0 }
+    }, {}, GAME_MENU_LEVEL,
+    false,
+    0
 };
 
 static state_to_function_map_fn_type state_to_function_map[] = {
@@ -395,6 +406,7 @@ static void app_init()
     FbInit();
     // set up to receive IR
     register_ir_packet_callback(ir_packet_callback);
+    state.trade_in_flight = false;
     // initialize menu and load main menu
     dynmenu_init(&state.menu, state.menu_item, ARRAYSIZE(state.menu_item));
     setup_main_menu();
@@ -421,7 +433,7 @@ static void exit_app(void)
 {
     state.app_state = APP_INIT;
     save_to_flash();
-    unregister_ir_packet_callback(ir_packet_callback);
+    unregister_ir_packet_callback();
     returnToMenus();
 }
 
@@ -433,8 +445,7 @@ static void game_menu(void)
     }
     if (state.screen_changed) {
         LOG("game_menu(): draw_menu()\n");
-        dynmenu_draw(&state.menu);
-        FbPushBuffer();
+        dynmenu_show(&state.menu);
         state.screen_changed = false;
     }
     check_for_incoming_packets();
@@ -460,19 +471,43 @@ static void monster_menu(void)
 }
 
 /*
- * If trading_monstes_enabled == false, sets it to true and draws a message to screen.
- * Sends an IR packet every 10 loops.
+ * Called once another badge has acknowledged our monster, or we've given up on it.
  */
-static void trade_monsters(void)
+static void trade_done(__attribute__((unused)) uint8_t msg_id, IR_RELIABLE_STATUS status,
+                       __attribute__((unused)) void *cookie)
 {
-    static int counter = 0;
-
-    counter++;
-    if ((counter % 10) == 0) { /* transmit our monster IR packet */
-        build_and_send_packet(BADGE_IR_GAME_ADDRESS, BADGE_IR_BROADCAST_ID,
-                              (OPCODE_XMIT_MONSTER << 12) | (state.initial_mon & 0x01ff));
+    state.trade_in_flight = false;
+    state.next_trade_ms = rtc_get_ms_since_boot() + TRADE_RESEND_DELAY_MS;
+    if (status == IR_RELIABLE_OK) {
         audio_out_beep(500, 100);
     }
+
+    /* Only said on the trading screen; a cancelled trade means we're leaving it anyway */
+    if (status == IR_RELIABLE_CANCELLED || state.app_state != TRADE_MONSTERS || !state.trading_monsters_enabled) {
+        return;
+    }
+    FbColor(BLACK);
+    FbMove(10, 90);
+    FbFilledRectangle(LCD_XSIZE - 20, 10);
+    FbMove(10, 90);
+    if (status == IR_RELIABLE_OK) {
+        FbColor(WHITE);
+        FbWriteLine("TRADED!");
+    } else {
+        FbColor(RED);
+        FbWriteLine("NO TAKERS");
+    }
+    FbColor(WHITE);
+    FbPushBuffer();
+}
+
+/*
+ * If trading_monstes_enabled == false, sets it to true and draws a message to screen.
+ * Offers our monster to whichever badge answers first, and offers it again once that
+ * trade completes.
+ */
+static void trade_monsters(void)
+{
     if (!state.trading_monsters_enabled) {
         FbClear();
         FbMove(10, 60);
@@ -481,6 +516,13 @@ static void trade_monsters(void)
         FbWriteLine("MONSTERS!");
         FbPushBuffer();
         state.trading_monsters_enabled = true;
+        state.next_trade_ms = 0;
+    }
+    check_for_incoming_packets();
+    if (!state.trade_in_flight && rtc_get_ms_since_boot() >= state.next_trade_ms) {
+        /* transmit our monster IR packet */
+        state.trade_in_flight = build_and_send_packet(BADGE_IR_GAME_ADDRESS, BADGE_IR_BROADCAST_ID,
+                              (OPCODE_XMIT_MONSTER << 12) | (state.initial_mon & 0x01ff), trade_done);
     }
     trade_monsters_button_handler();
 }
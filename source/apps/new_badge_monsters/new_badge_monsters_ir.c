@@ -1,46 +1,31 @@
-#include <string.h>
 #include <stdio.h>
 
 #include "new_badge_monsters_ir.h"
 #include "new_badge_monsters.h"
-#include "init.h"
-
-/* These need to be protected from interrupts. */
-#define QUEUE_SIZE 5
-#define QUEUE_DATA_SIZE 4
+#include "ir_reliable.h"
 
 const IR_APP_ID BADGE_IR_GAME_ADDRESS = IR_APP2;
-const int BADGE_IR_BROADCAST_ID = 0;
+const int BADGE_IR_BROADCAST_ID = IR_RELIABLE_ANY_PEER;
 const unsigned char OPCODE_XMIT_MONSTER = 0x01;
 
-static int queue_in=0;
-static int queue_out=0;
-static IR_DATA packet_queue[QUEUE_SIZE] = { {0} };
-static uint8_t packet_data[QUEUE_SIZE][QUEUE_DATA_SIZE] = {{0}};
-
 
-void register_ir_packet_callback(void (*callback)(const IR_DATA *))
+void register_ir_packet_callback(ir_reliable_rx_callback callback)
 {
-    ir_add_callback(callback, BADGE_IR_GAME_ADDRESS);
+    /* Trades are started by the user, so don't let background chatter starve them */
+    ir_set_app_priority(BADGE_IR_GAME_ADDRESS, IR_PRIORITY_INTERACTIVE);
+    ir_reliable_open(BADGE_IR_GAME_ADDRESS, callback);
 }
 
-void unregister_ir_packet_callback(void (*callback)(const IR_DATA *))
+void unregister_ir_packet_callback(void)
 {
-    ir_remove_callback(callback, BADGE_IR_GAME_ADDRESS);
+    ir_reliable_close(BADGE_IR_GAME_ADDRESS);
 }
 
-void build_and_send_packet(uint8_t address, uint16_t badge_id, uint16_t payload)
+bool build_and_send_packet(uint8_t address, uint16_t badge_id, uint16_t payload, ir_reliable_done_callback done)
 {
     uint8_t byte_payload[2] = {payload >> 8, payload & 0xFF};
-    IR_DATA ir_packet = {
-            .data_length = 2,
-            .recipient_address = badge_id,
-            .app_address = address,
-            .data = byte_payload
-    };
-
-    ir_send_complete_message(&ir_packet);
 
+    return ir_reliable_send(address, badge_id, byte_payload, sizeof(byte_payload), done, NULL) >= 0;
 }
 
 uint16_t get_payload(IR_DATA* packet)
@@ -66,37 +51,22 @@ void process_packet(IR_DATA* packet)
 
 void check_for_incoming_packets(void)
 {
-    IR_DATA *new_packet;
-    int next_queue_out;
-    uint32_t interrupt_state = hal_disable_interrupts();
-    while (queue_out != queue_in) {
-        next_queue_out = (queue_out + 1) % QUEUE_SIZE;
-        new_packet = &packet_queue[queue_out];
-        queue_out = next_queue_out;
-        hal_restore_interrupts(interrupt_state);
-        process_packet(new_packet);
-        interrupt_state = hal_disable_interrupts();
-    }
-    hal_restore_interrupts(interrupt_state);
+    /* Delivers received packets to ir_packet_callback() and finishes off our own sends */
+    ir_reliable_poll();
 }
 
-void ir_packet_callback(const IR_DATA *data)
+bool ir_packet_callback(__attribute__((unused)) uint16_t from, const uint8_t *data, uint8_t length)
 {
-    // This is called in an interrupt context!
-	int next_queue_in;
-
-	next_queue_in = (queue_in + 1) % QUEUE_SIZE;
-	if (next_queue_in == queue_out) {
-        /* queue is full, drop packet */
-		return;
-    }
-    size_t data_size = data->data_length;
-    if (QUEUE_DATA_SIZE < data_size) {
-        data_size = QUEUE_DATA_SIZE;
-    }
-    memcpy(&packet_data[queue_in], data->data, data_size);
-	memcpy(&packet_queue[queue_in], data, sizeof(packet_queue[0]));
-    packet_queue[queue_in].data = packet_data[queue_in];
+    /* Called from ir_reliable_poll(), so not in interrupt context */
+    IR_DATA packet = {
+        .recipient_address = ir_reliable_address(),
+        .app_address = BADGE_IR_GAME_ADDRESS,
+        .data_length = length,
+        .data = (uint8_t *) data,
+    };
 
-	queue_in = next_queue_in;
+    if (length < 2)
+        return true; /* nothing we understand, but no point having it resent */
+    process_packet(&packet);
+    return true;
 }
@@ -3,17 +3,19 @@
 
 #include <stdint.h>
 
-#include "ir.h"
+#include <stdbool.h>
 
-typedef void (*ir_callback)(const IR_DATA *);
+#include "ir.h"
+#include "ir_reliable.h"
 
-void register_ir_packet_callback(ir_callback callback);
-void unregister_ir_packet_callback(ir_callback callback);
+void register_ir_packet_callback(ir_reliable_rx_callback callback);
+void unregister_ir_packet_callback(void);
 uint16_t get_payload(IR_DATA* packet);
 void process_packet(IR_DATA* packet);
 void check_for_incoming_packets(void);
-void ir_packet_callback(const IR_DATA *data);
-void build_and_send_packet(uint8_t address, uint16_t badge_id, uint16_t payload);
+bool ir_packet_callback(uint16_t from, const uint8_t *data, uint8_t length);
+/* Sends payload reliably; done is called once another badge has acknowledged it, or we give up. */
+bool build_and_send_packet(uint8_t address, uint16_t badge_id, uint16_t payload, ir_reliable_done_callback done);
 
 /*
  * We have 16 bits of payload. Let's say the high order 4 bits are the opcode.
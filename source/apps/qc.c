@@ -112,67 +112,41 @@ static const struct qc_button QC_BTN[] = {
     {BADGE_BUTTON_ENCODER_2_A, "ENC 2", 666, check_encoder},
 };
 
-static struct note tune0[] = {
-	{ NOTE_C4, 100 },
+/* Converted from the old struct note tables by tools/tune-converter.py */
+static const uint8_t tune0[] = {
+	TUNE_LENGTH(1), TUNE_N(C, 4), TUNE_END,
 };
 
-static struct note tune1[] = {
-	{ NOTE_C4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_D4, 100 },
+static const uint8_t tune1[] = {
+	TUNE_LENGTH(1), TUNE_N(C, 4), TUNE_REST, TUNE_N(D, 4), TUNE_END,
 };
 
-static struct note tune2[] = {
-	{ NOTE_C4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_D4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_E4, 100 },
+static const uint8_t tune2[] = {
+	TUNE_LENGTH(1), TUNE_N(C, 4), TUNE_REST, TUNE_N(D, 4), TUNE_REST, TUNE_N(E, 4), TUNE_END,
 };
 
-static struct note tune3[] = {
-	{ NOTE_C4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_D4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_E4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_F4, 100 },
+static const uint8_t tune3[] = {
+	TUNE_LENGTH(1), TUNE_N(C, 4), TUNE_REST, TUNE_N(D, 4), TUNE_REST, TUNE_N(E, 4), TUNE_REST, TUNE_N(F, 4),
+	TUNE_END,
 };
 
-static struct note tune4[] = {
-	{ NOTE_C4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_D4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_E4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_F4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_G4, 100 },
+static const uint8_t tune4[] = {
+	TUNE_LENGTH(1), TUNE_N(C, 4), TUNE_REST, TUNE_N(D, 4), TUNE_REST, TUNE_N(E, 4), TUNE_REST, TUNE_N(F, 4),
+	TUNE_REST, TUNE_N(G, 4), TUNE_END,
 };
 
-static struct note tune5[] = {
-	{ NOTE_C4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_D4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_E4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_F4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_G4, 100 },
-	{ NOTE_REST, 100 },
-	{ NOTE_A4, 100 },
+static const uint8_t tune5[] = {
+	TUNE_LENGTH(1), TUNE_N(C, 4), TUNE_REST, TUNE_N(D, 4), TUNE_REST, TUNE_N(E, 4), TUNE_REST, TUNE_N(F, 4),
+	TUNE_REST, TUNE_N(G, 4), TUNE_REST, TUNE_N(A, 4), TUNE_END,
 };
 
-static struct tune accel_tune[] = {
-	{ ARRAY_SIZE(tune0), tune0, },
-	{ ARRAY_SIZE(tune1), tune1, },
-	{ ARRAY_SIZE(tune2), tune2, },
-	{ ARRAY_SIZE(tune3), tune3, },
-	{ ARRAY_SIZE(tune4), tune4, },
-	{ ARRAY_SIZE(tune5), tune5, },
+static const struct tune accel_tune[] = {
+	{ .tick_ms = 100, .num_channels = 1, .channel = { tune0 } },
+	{ .tick_ms = 100, .num_channels = 1, .channel = { tune1 } },
+	{ .tick_ms = 100, .num_channels = 1, .channel = { tune2 } },
+	{ .tick_ms = 100, .num_channels = 1, .channel = { tune3 } },
+	{ .tick_ms = 100, .num_channels = 1, .channel = { tune4 } },
+	{ .tick_ms = 100, .num_channels = 1, .channel = { tune5 } },
 };
 
 static int trigger_accel_sound = 0;
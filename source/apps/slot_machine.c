@@ -744,6 +744,15 @@ static void led_rgb_off(void)
 	led_pwm_disable(BADGE_LED_RGB_BLUE);
 }
 
+static const struct audio_sound bonus_bell =
+{
+	.wave = AUDIO_WAVE_TRIANGLE,
+	.volume = 255,
+	.decay_ms = 100,
+	.sustain = 96,
+	.release_ms = 400,
+};
+
 static void audio_play_jingle(void)
 {
 	char offset[4];
@@ -843,7 +852,8 @@ static void slot_machine_payout(void)
 	{
 		/* free spin if on pay line */
 		bonus_active = true;
-		audio_out_beep(4000, 100);
+		/* a bell on its own voice, ringing over the payout beep */
+		audio_voice_play(AUDIO_VOICE_ANY, &bonus_bell, 4000, 100);
 		led_pwm_enable(BADGE_LED_RGB_RED, 5);
 		led_pwm_enable(BADGE_LED_RGB_GREEN, 4);
 		led_pwm_enable(BADGE_LED_RGB_BLUE, 40);		
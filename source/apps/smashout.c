@@ -63,6 +63,7 @@ static int balls = 0;
 static int score_inc = 0;
 static int balls_inc = 0;
 static unsigned int xorshift_state;
+static struct button_encoder encoder = BUTTON_ENCODER(BADGE_BUTTON_ENCODER_A);
 
 /* Program states.  Initial state is SMASHOUT_GAME_INIT */
 enum smashout_program_state_t {
@@ -105,22 +106,27 @@ static void smashout_game_init(void)
 	ball.vy = BALL_START_VY;
 	oldball = ball;
 	smashout_program_state = SMASHOUT_GAME_PLAY;
+	button_event_flush();
 }
 
+/* Every press and detent since the last frame, in the order they happened, so none are lost */
 static void smashout_check_buttons(void)
 {
-	int rotary_switch = button_get_rotation(0);
-	int down_latches = button_down_latches();
-
-	if (BUTTON_PRESSED(BADGE_BUTTON_ENCODER_SW, down_latches) ||
-		BUTTON_PRESSED(BADGE_BUTTON_ENCODER_2_SW, down_latches))
-		smashout_program_state = SMASHOUT_GAME_EXIT;
-	else if (BUTTON_PRESSED(BADGE_BUTTON_LEFT, down_latches))
-		paddle.vx = -PADDLE_SPEED;
-	else if (BUTTON_PRESSED(BADGE_BUTTON_RIGHT, down_latches))
-		paddle.vx = PADDLE_SPEED;
-	if (rotary_switch)
-		paddle.vx += PADDLE_SPEED * rotary_switch;
+	struct button_event e;
+
+	while (button_event_get(&e)) {
+		if (e.type == BUTTON_EVENT_DOWN) {
+			if (e.button == BADGE_BUTTON_ENCODER_SW || e.button == BADGE_BUTTON_ENCODER_2_SW)
+				smashout_program_state = SMASHOUT_GAME_EXIT;
+			else if (e.button == BADGE_BUTTON_LEFT)
+				paddle.vx = -PADDLE_SPEED;
+			else if (e.button == BADGE_BUTTON_RIGHT)
+				paddle.vx = PADDLE_SPEED;
+		} else {
+			/* Spun quickly, the encoder flings the paddle further */
+			paddle.vx += PADDLE_SPEED * button_encoder_event(&encoder, &e);
+		}
+	}
 }
 
 static void smashout_draw_paddle(void)
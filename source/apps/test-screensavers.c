@@ -5,30 +5,10 @@
 #include "display.h"
 #include "screensavers.h"
 #include "badge.h"
-
-extern unsigned short popup_time;
-
-typedef void (*ss_func)(void);
+#include "scheduler.h"
 
 static bool saved_screensaver_disabled = 0;
 
-static const ss_func ss[] = {
-	just_the_badge_tips,
-	dotty,
-	disp_asset_saver,
-	hack_the_dragon,
-	stupid_rects,
-	carzy_tunnel_animator,
-	for_president,
-	smiley,
-	matrix,
-	bluescreen,
-	qix,
-	hyperspace_screen_saver,
-	holly_screensaver,
-	nametag_screensaver,
-};
-static const int num_screen_savers = sizeof(ss) / sizeof(ss[0]);
 static int current_screen_saver = -1;
 
 /* Program states.  Initial state is TEST_SCREENSAVERS_INIT */
@@ -40,6 +20,25 @@ enum test_screensavers_state_t {
 
 static enum test_screensavers_state_t test_screensavers_state = TEST_SCREENSAVERS_INIT;
 
+static void draw_instructions(void)
+{
+	FbClear();
+	FbColor(CYAN);
+	FbBackgroundColor(BLACK);
+	FbMove(2, 2);
+	FbWriteString(
+		"\n"
+		"USE ROTARY KNOBS\n"
+		"  TO SELECT A\n"
+		" STATIC SCREEN\n"
+		"    SAVER.\n"
+		"\n"
+		"  PRESS LEFT\n"
+		" ROTARY SWITCH\n"
+		"   TO EXIT\n");
+	FbPushBuffer();
+}
+
 static void test_screensavers_init(void)
 {
 	FbInit();
@@ -47,25 +46,29 @@ static void test_screensavers_init(void)
 	FbClear();
 	test_screensavers_state = TEST_SCREENSAVERS_RUN;
 	current_screen_saver = -1;
-	popup_time = 9 * 30;
+	scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+	draw_instructions();
 
 	/* Disable the actual screensaver while the screensaver test app is running */
 	saved_screensaver_disabled = badge_system_data()->screensaver_disabled;
 	badge_system_data()->screensaver_disabled = 1;
-	screensaver_set_animation_count(0);
 }
 
 static void next_screensaver(int direction)
 {
 	current_screen_saver += direction;
 	if (current_screen_saver < -1)
-		current_screen_saver = num_screen_savers - 1;
-	if (current_screen_saver >= num_screen_savers)
-		current_screen_saver = -1; 
+		current_screen_saver = screensaver_count() - 1;
+	if (current_screen_saver >= screensaver_count())
+		current_screen_saver = -1;
 	display_reset();
-	FbBackgroundColor(BLACK);
-	FbClear();
-	screensaver_set_animation_count(0);
+	screensaver_stop();
+	if (current_screen_saver == -1) {
+		scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+		draw_instructions();
+	} else {
+		screensaver_start(current_screen_saver);
+	}
 }
 
 static void check_buttons(void)
@@ -94,40 +97,15 @@ static void check_buttons(void)
 	}
 }
 
-static void draw_instructions(void)
-{
-	FbClear();
-	FbColor(CYAN);
-	FbBackgroundColor(BLACK);
-	FbMove(2, 2);
-	FbWriteString(
-		"\n"
-		"USE ROTARY KNOBS\n"
-		"  TO SELECT A\n"
-		" STATIC SCREEN\n"
-		"    SAVER.\n"
-		"\n"
-		"  PRESS LEFT\n"
-		" ROTARY SWITCH\n"
-		"   TO EXIT\n");
-	FbPushBuffer();
-}
-
-static void draw_screen(void)
-{
-	if (current_screen_saver == -1)
-		draw_instructions();
-	else
-		ss[current_screen_saver]();
-}
-
 static void test_screensavers_run(void)
 {
 	check_buttons();
-	draw_screen();
-	popup_time--;
-	if (popup_time == 0)
-		popup_time = 9 * 30;
+	if (current_screen_saver != -1) {
+		/* Round and round the same one */
+		if (screensaver_finished())
+			screensaver_start(current_screen_saver);
+		screensaver_frame();
+	}
 
 	/* Prevent badge from going "dormant" so screen will stay lit */
 	button_reset_last_input_timestamp();
@@ -137,7 +115,7 @@ static void test_screensavers_exit(void)
 {
 	/* So that when we start again, we do not immediately exit */
 	test_screensavers_state = TEST_SCREENSAVERS_INIT;
-	popup_time = 0;
+	screensaver_stop();
 	/* Restore the original screensaver_disabled value */
 	badge_system_data()->screensaver_disabled = saved_screensaver_disabled;
 	display_reset(); /* In case the display got messed up (for unknown reasons it happens). */
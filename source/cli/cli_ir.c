@@ -6,6 +6,7 @@
 #include "cli.h"
 #include "ir.h"
 #include "rtc.h"
+#include "show_sync.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -120,6 +121,81 @@ int run_ir_last(__attribute__((unused)) char *args) {
     return 0;
 }
 
+int run_ir_stats(char *args) {
+
+    IR_CHANNEL_STATS stats;
+    ir_get_channel_stats(&stats);
+
+    uint64_t elapsed_us = rtc_get_us_since_boot() - stats.since_us;
+    if (!elapsed_us) {
+        elapsed_us = 1;
+    }
+    printf("Channel stats over %lu ms:\n", (unsigned long) (elapsed_us / 1000));
+    printf("  Utilisation: rx %lu%%, tx %lu%%\n",
+           (unsigned long) (stats.rx_busy_us * 100 / elapsed_us),
+           (unsigned long) (stats.tx_busy_us * 100 / elapsed_us));
+    printf("  Bad frames: %u\n", (unsigned) stats.rx_bad_frames);
+    printf("  Sent: %u, deferred: %u, dropped busy: %u, rate limited: %u, queue full: %u\n",
+           (unsigned) stats.tx_messages, (unsigned) stats.tx_deferrals,
+           (unsigned) stats.tx_dropped_busy, (unsigned) stats.tx_rate_limited, (unsigned) stats.tx_queue_full);
+#if TARGET_SIMULATOR
+    IR_SIM_TX_QUEUE_STATS queue;
+    ir_sim_get_tx_queue_stats(&queue);
+    printf("  Transmit queue: depth %u (max %u), dropped %u, sent %u in %u batches\n",
+           queue.depth, queue.max_depth, queue.drops, queue.sent, queue.batches);
+#endif
+
+    char *reset_string = cli_get_token(&args);
+    if (reset_string && !strcmp(reset_string, "reset")) {
+        ir_reset_channel_stats();
+    }
+    return 0;
+}
+
+int run_ir_show(__attribute__((unused)) char *args) {
+    struct show_sync_stats stats;
+    show_sync_get_stats(&stats);
+
+    printf("Show sync: %s, show time %lu us\n",
+           show_sync_leading() ? "leading" : show_sync_locked() ? "following" : "not locked",
+           (unsigned long) show_sync_now());
+    printf("  Beacons: sent %lu, heard %lu, last off by %ld us\n", (unsigned long) stats.beacons_sent,
+           (unsigned long) stats.beacons_heard, (long) stats.last_error_us);
+    printf("  Cues: heard %lu, played %lu, dropped %lu, worst %ld us late\n", (unsigned long) stats.cues_heard,
+           (unsigned long) stats.cues_played, (unsigned long) stats.cues_dropped, (long) stats.worst_late_us);
+    // Comparing the local times across simulator instances, whose clocks are all the host's, gives the spread
+    printf("  Last cue: show time %lu, played at %llu us, %ld us late\n", (unsigned long) stats.last_cue_at,
+           (unsigned long long) stats.last_played_us, (long) stats.last_late_us);
+    return 0;
+}
+
+int run_ir_capture(char *args) {
+
+    char *action = cli_get_token(&args);
+    if (!action) {
+        puts("No capture action specified");
+        return 1;
+    }
+
+    if (!strcmp(action, "start")) {
+        if (!ir_capture_start(cli_get_token(&args))) {
+            puts("Couldn't start capture");
+            return 1;
+        }
+    } else if (!strcmp(action, "stop")) {
+        if (!ir_capture_stop()) {
+            puts("Couldn't save capture");
+            return 1;
+        }
+    } else if (!strcmp(action, "dump")) {
+        ir_capture_dump();
+    } else {
+        puts("Capture action must be one of start, stop, dump");
+        return 1;
+    }
+    return 0;
+}
+
 static const CLI_COMMAND ir_subcommands[] = {
         {.name="send", .process=run_ir_send,
                 .help="usage: ir send [dest, 0-1023] [app 0-63] [data (hex string up to 64 bytes)]"},
@@ -127,6 +203,12 @@ static const CLI_COMMAND ir_subcommands[] = {
                 .help="usage: ir handler [app_num] - Install packet reception interrupt handler."},
         {.name="last", .process=run_ir_last,
                 .help="usage: ir last - Show last packet received by the packet handler."},
+        {.name="stats", .process=run_ir_stats,
+                .help="usage: ir stats [reset] - Show channel utilisation and backoff counters."},
+        {.name="show", .process=run_ir_show,
+                .help="usage: ir show - Show group show sync state and counters."},
+        {.name="capture", .process=run_ir_capture,
+                .help="usage: ir capture start [name] | stop | dump - Log received and sent messages."},
         {}
 };
 
@@ -134,5 +216,5 @@ static const CLI_COMMAND ir_subcommands[] = {
 const CLI_COMMAND ir_command = {
         .name="ir", .subcommands=(CLI_COMMAND *) ir_subcommands,
         .help="usage: ir subcommand [[args...]]\n"
-              "valid subcommands: send handler last"
+              "valid subcommands: send handler last stats show capture"
 };
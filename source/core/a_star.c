@@ -1,209 +1,233 @@
 #include "a_star.h"
 
-#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
-struct nodeset {
-	int nmembers;
-	int maxmembers;
-	__extension__ void *node[0];
+/* heap_pos[] values for nodes which are not in the open set */
+#define NOT_SEEN (-1)
+#define CLOSED (-2)
+
+/*
+ * Per-node state is kept in parallel arrays indexed by node index, so
+ * membership and score lookups are constant time.  The open set is a
+ * binary min-heap of node indices ordered by fscore, and heap_pos[]
+ * tracks where each node sits in it so its score can be decreased in place.
+ */
+struct a_star_state {
+	int maxnodes;
+	void **node;	/* index -> node */
+	int *gscore;
+	int *fscore;
+	int *came_from;
+	int *heap_pos;
+	int *heap;
+	int heap_size;
+
+	/* Either the caller maps nodes to indices ... */
+	a_star_node_index_fn node_index;
+
+	/* ... or, for a_star(), a hash table of index + 1 (0 is empty) does. */
+	int *hash;
+	unsigned int hash_mask;
+	int hash_shift;
+	int nnodes;
 };
 
-static int nodeset_empty(struct nodeset *n)
+/* Fibonacci hashing; the top bits are used, since the bottom bits of node
+ * pointers are often all the same. */
+static unsigned int hash_pointer(struct a_star_state *s, void *p)
 {
-	return (n->nmembers == 0);
-}
-
-static void nodeset_add_node(struct nodeset *n, void *node)
-{
-	int i;
+	uintptr_t x = (uintptr_t) p;
 
-	for (i = 0; i < n->nmembers; i++) {
-		if (n->node[i] == node)
-			return;
-	}
-	assert(n->nmembers < n->maxmembers);
-	n->node[n->nmembers] = node;
-	n->nmembers++;
+	x ^= x >> 16;
+	return ((uint32_t) x * 2654435761u) >> s->hash_shift;
 }
 
-static void nodeset_remove_node(struct nodeset *n, void *node)
+static int hashed_node_index(struct a_star_state *s, void *node)
 {
-	int i;
+	unsigned int i = hash_pointer(s, node);
 
-	for (i = 0; i < n->nmembers; i++) {
-		if (n->node[i] != node)
-			continue;
-		if (i == n->nmembers - 1) {
-			n->node[i] = NULL;
-			n->nmembers--;
-			return;
-		}
-		n->node[i] = n->node[n->nmembers - 1];
-		n->nmembers--;
-		n->node[n->nmembers] = NULL;
-		return;
+	while (s->hash[i]) {
+		int index = s->hash[i] - 1;
+		if (s->node[index] == node)
+			return index;
+		i = (i + 1) & s->hash_mask;
 	}
+	assert(s->nnodes < s->maxnodes);
+	s->hash[i] = s->nnodes + 1;
+	s->node[s->nnodes] = node;
+	s->heap_pos[s->nnodes] = NOT_SEEN;
+	return s->nnodes++;
 }
 
-static int nodeset_contains_node(struct nodeset *n, void *node)
+static int node_index(struct a_star_state *s, void *context, void *node)
 {
-	int i;
-
-	for (i = 0; i < n->nmembers; i++)
-		if (n->node[i] == node)
-			return 1;
-	return 0;
+	int index;
+
+	if (!s->node_index)
+		return hashed_node_index(s, node);
+	index = s->node_index(context, node);
+	assert(index >= 0 && index < s->maxnodes);
+	if (s->heap_pos[index] == NOT_SEEN)
+		s->node[index] = node;
+	return index;
 }
 
-static struct nodeset *nodeset_new(int maxnodes, void *address)
+/* Lower fscore first; on a tie prefer the node further from the start, which is
+ * usually closer to the goal, so straight runs don't fan out. */
+static int heap_less(struct a_star_state *s, int a, int b)
 {
-	struct nodeset *n;
-
-	n = address;
-	memset(n, 0, sizeof(*n) + maxnodes * sizeof(void *));
-	n->maxmembers = maxnodes;
-	return n;
+	if (s->fscore[a] != s->fscore[b])
+		return s->fscore[a] < s->fscore[b];
+	return s->gscore[a] > s->gscore[b];
 }
 
-struct node_pair {
-	void *from, *to;
-};
-
-struct node_map {
-	int nelements;
-	__extension__ struct node_pair p[0];
-};
-
-struct score_entry {
-	void *node;
-	int score;
-};
-
-struct score_map {
-	int nelements;
-	__extension__ struct score_entry s[0];
-};
-
-static int score_map_get_score(struct score_map *m, void *node)
+static void heap_set(struct a_star_state *s, int pos, int index)
 {
-	int i;
-
-	for (i = 0; i < m->nelements; i++)
-		if (m->s[i].node == node)
-			return m->s[i].score;
-	assert(0);
-	return 0x7fffffff;
+	s->heap[pos] = index;
+	s->heap_pos[index] = pos;
 }
 
-static void *lowest_score(struct nodeset *candidates, struct score_map *s)
+static void heap_sift_up(struct a_star_state *s, int pos)
 {
+	int index = s->heap[pos];
 
-	int i;
-	int score, lowest_score;
-	void *lowest = NULL;
-
-	for (i = 0; i < candidates->nmembers; i++) {
-		score = score_map_get_score(s, candidates->node[i]);
-		if (lowest != NULL && score > lowest_score)
-			continue;
-		lowest = candidates->node[i];
-		lowest_score = score;
+	while (pos > 0) {
+		int parent = (pos - 1) / 2;
+		if (!heap_less(s, index, s->heap[parent]))
+			break;
+		heap_set(s, pos, s->heap[parent]);
+		pos = parent;
 	}
-	return lowest;
-}
-
-static struct score_map *score_map_new(int maxnodes, void *address)
-{
-	struct score_map *s;
-
-	s = address;
-	memset(s, 0, sizeof(*s) + sizeof(struct score_entry) * maxnodes);
-	s->nelements = maxnodes;
-	return s;
+	heap_set(s, pos, index);
 }
 
-static void score_map_add_score(struct score_map *s, void *node, int score)
+static void heap_sift_down(struct a_star_state *s, int pos)
 {
-	int i;
+	int index = s->heap[pos];
 
-	for (i = 0; i < s->nelements; i++) {
-		if (s->s[i].node != node)
-			continue;
-		s->s[i].score = score;
-		return;
-	}
-	for (i = 0; i < s->nelements; i++) {
-		if (s->s[i].node != NULL)
-			continue;
-		s->s[i].node = node;
-		s->s[i].score = score;
-		return;
+	for (;;) {
+		int child = 2 * pos + 1;
+		if (child >= s->heap_size)
+			break;
+		if (child + 1 < s->heap_size && heap_less(s, s->heap[child + 1], s->heap[child]))
+			child++;
+		if (!heap_less(s, s->heap[child], index))
+			break;
+		heap_set(s, pos, s->heap[child]);
+		pos = child;
 	}
-	assert(0);
+	heap_set(s, pos, index);
 }
 
-static struct node_map *node_map_new(int maxnodes, void *address)
+static void heap_push(struct a_star_state *s, int index)
 {
-	struct node_map *n;
-
-	n = address;
-	memset(n, 0, sizeof(*n) + sizeof(struct node_pair) * maxnodes);
-	n->nelements = maxnodes;
-	return n;
+	assert(s->heap_size < s->maxnodes);
+	s->heap[s->heap_size] = index;
+	s->heap_size++;
+	heap_sift_up(s, s->heap_size - 1);
 }
 
-static void node_map_set_from(struct node_map *n, void *to, void *from)
+static int heap_pop(struct a_star_state *s)
 {
-	int i;
+	int index = s->heap[0];
 
-	for (i = 0; i < n->nelements; i++) {
-		if (n->p[i].to != to)
-			continue;
-		n->p[i].from = from;
-		return;
-	}
-	/* didn't find it, pick a NULL entry */
-	for (i = 0; i < n->nelements; i++) {
-		if (n->p[i].to != NULL)
-			continue;
-		n->p[i].to = to;
-		n->p[i].from = from;
-		return;
+	s->heap_size--;
+	if (s->heap_size > 0) {
+		s->heap[0] = s->heap[s->heap_size];
+		heap_sift_down(s, 0);
 	}
-	assert(0); /* should never get here */
+	s->heap_pos[index] = CLOSED;
+	return index;
 }
 
-static void *node_map_get_from(struct node_map *n, void *to)
+static struct a_star_path *search(struct a_star_state *s, void *context,
+				struct a_star_path *path,
+				void *start, void *goal,
+				a_star_node_cost_fn distance,
+				a_star_node_cost_fn cost_estimate,
+				a_star_neighbor_iterator_fn nth_neighbor)
 {
-	int i;
-
-	for (i = 0; i < n->nelements; i++)
-		if (n->p[i].to == to)
-			return n->p[i].from;
+	int current, neighbor, tentative_gscore;
+	int i, n, count;
+	void *neighbor_node;
+
+	current = node_index(s, context, start);
+	s->gscore[current] = 0;
+	s->fscore[current] = cost_estimate(context, start, goal);
+	s->came_from[current] = -1;
+	heap_push(s, current);
+
+	while (s->heap_size > 0) {
+		current = heap_pop(s);
+		if (s->node[current] == goal) {
+			count = 0;
+			for (i = current; i >= 0; i = s->came_from[i])
+				count++;
+			path->node_count = count;
+			for (i = current; i >= 0; i = s->came_from[i])
+				path->path[--count] = s->node[i];
+			return path;
+		}
+		n = 0;
+		while ((neighbor_node = nth_neighbor(context, s->node[current], n))) {
+			n++;
+			neighbor = node_index(s, context, neighbor_node);
+			if (s->heap_pos[neighbor] == CLOSED)
+				continue;
+			tentative_gscore = s->gscore[current] + distance(context, s->node[current], neighbor_node);
+			if (s->heap_pos[neighbor] != NOT_SEEN && tentative_gscore >= s->gscore[neighbor])
+				continue;
+			s->came_from[neighbor] = current;
+			s->gscore[neighbor] = tentative_gscore;
+			s->fscore[neighbor] = tentative_gscore + cost_estimate(context, neighbor_node, goal);
+			if (s->heap_pos[neighbor] == NOT_SEEN)
+				heap_push(s, neighbor);
+			else
+				heap_sift_up(s, s->heap_pos[neighbor]);
+		}
+	}
 	return NULL;
 }
 
-static void reconstruct_path(struct node_map *came_from, void *current, void ***path, int *nodecount, int maxnodes, void *address)
+struct a_star_path *a_star_indexed(void *context, void *working_space,
+				void *start, void *goal,
+				int maxnodes,
+				a_star_node_cost_fn distance,
+				a_star_node_cost_fn cost_estimate,
+				a_star_neighbor_iterator_fn nth_neighbor,
+				a_star_node_index_fn node_index)
 {
-	int i;
-	void **p = address;
-	memset(p, 0, sizeof(*p) * maxnodes);
-
-	for (i = 0; i < came_from->nelements; i++)
-		if (came_from->p[i].to == NULL)
-			break;
-	p[0] = current;
-	i = 1;
-	while ((current = node_map_get_from(came_from, current))) {
-		p[i] = current;
-		i++;
-	}
-	*nodecount = i;
-	*path = p;
+	struct a_star_state s;
+	unsigned char *p = working_space;
+	struct a_star_path *path;
+
+	path = (struct a_star_path *) p;
+	p += sizeof(*path) + maxnodes * sizeof(void *);
+	s.node = (void **) p;
+	p += maxnodes * sizeof(void *);
+	s.gscore = (int *) p;
+	s.fscore = s.gscore + maxnodes;
+	s.came_from = s.fscore + maxnodes;
+	s.heap_pos = s.came_from + maxnodes;
+	s.heap = s.heap_pos + maxnodes;
+
+	s.maxnodes = maxnodes;
+	s.heap_size = 0;
+	s.node_index = node_index;
+	s.hash = NULL;
+	memset(s.heap_pos, 0xff, maxnodes * sizeof(int)); /* all NOT_SEEN */
+
+	return search(&s, context, path, start, goal, distance, cost_estimate, nth_neighbor);
 }
 
+/*
+ * The original interface, with no way to turn a node into an index.  Nodes
+ * get indices in the order they're discovered, through a pointer hash table.
+ * The arrays are carved out of the caller's existing working space, whose
+ * chunk sizes have room to spare for them.
+ */
 struct a_star_path *a_star(void *context, struct a_star_working_space *working_space,
 				void *start, void *goal,
 				int maxnodes,
@@ -211,59 +235,28 @@ struct a_star_path *a_star(void *context, struct a_star_working_space *working_s
 				a_star_node_cost_fn cost_estimate,
 				a_star_neighbor_iterator_fn nth_neighbor)
 {
-	struct nodeset *openset, *closedset;
-	struct node_map *came_from;
-	struct score_map *gscore, *fscore;
-	void *neighbor, *current;
-	int tentative_gscore;
-	int i, n;
-	void **answer = NULL;
-	int answer_count = 0;
-	struct a_star_path *return_value;
-
-	closedset = nodeset_new(maxnodes, working_space->nodeset[0]);
-	openset = nodeset_new(maxnodes, working_space->nodeset[1]);
-	came_from = node_map_new(maxnodes, working_space->nodemap);
-	gscore = score_map_new(maxnodes, working_space->scoremap[0]);
-	fscore = score_map_new(maxnodes, working_space->scoremap[1]);
-
-	nodeset_add_node(openset, start);
-	score_map_add_score(gscore, start, 0.0);
-	score_map_add_score(fscore, start, cost_estimate(context, start, goal));
-
-	while (!nodeset_empty(openset)) {
-		current = lowest_score(openset, fscore);
-		if (current == goal) {
-			reconstruct_path(came_from, current, &answer, &answer_count, maxnodes, working_space->a_star_path[0]);
-			break;
-		}
-		nodeset_remove_node(openset, current);
-		nodeset_add_node(closedset, current);
-		n = 0;
-		while ((neighbor = nth_neighbor(context, current, n))) {
-			n++;
-			if (nodeset_contains_node(closedset, neighbor))
-				continue;
-			tentative_gscore = score_map_get_score(gscore, current) + distance(context, current, neighbor);
-			if (!nodeset_contains_node(openset, neighbor))
-				nodeset_add_node(openset, neighbor);
-			else if (tentative_gscore >= score_map_get_score(gscore, neighbor))
-				continue;
-			node_map_set_from(came_from, neighbor, current);
-			score_map_add_score(gscore, neighbor, tentative_gscore);
-			score_map_add_score(fscore, neighbor,
-					score_map_get_score(gscore, neighbor) +
-						cost_estimate(context, neighbor, goal));
-		}
-	}
-	if (answer_count == 0) {
-		return_value = NULL;
-	} else {
-		return_value = working_space->a_star_path[1];
-		return_value->node_count = answer_count;
-		for (i = 0; i < answer_count; i++) {
-			return_value->path[answer_count - i - 1] = answer[i];
-		}
-	}
-	return return_value;
+	struct a_star_state s;
+	unsigned int hash_size;
+
+	s.maxnodes = maxnodes;
+	s.node = working_space->nodeset[0];			/* maxnodes pointers */
+	s.gscore = working_space->scoremap[0];			/* 4 * maxnodes ints */
+	s.fscore = s.gscore + maxnodes;
+	s.came_from = s.fscore + maxnodes;
+	s.heap_pos = s.came_from + maxnodes;
+	s.heap = working_space->nodemap;			/* maxnodes ints */
+	s.heap_size = 0;
+	s.node_index = NULL;
+	s.nnodes = 0;
+
+	/* A power of two between 2 and 4 times maxnodes, so it fits in 4 * maxnodes ints */
+	s.hash_shift = 32;
+	for (hash_size = 1; hash_size < 2 * (unsigned int) maxnodes; hash_size *= 2)
+		s.hash_shift--;
+	s.hash = working_space->scoremap[1];
+	s.hash_mask = hash_size - 1;
+	memset(s.hash, 0, hash_size * sizeof(int));
+
+	return search(&s, context, working_space->a_star_path[1], start, goal,
+			distance, cost_estimate, nth_neighbor);
 }
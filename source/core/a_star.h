@@ -14,18 +14,23 @@ struct a_star_working_space {
 	void *a_star_path[2];
 };
 
-#define A_STAR_NODESET_SIZE(maxnodes) (2 * sizeof(int) + (maxnodes) * sizeof(void *))
-#define A_STAR_NODEMAP_SIZE(maxnodes) (8 + 16 * (maxnodes))
-#define A_STAR_SCOREMAP_SIZE(maxnodes) (16 * ((maxnodes) + 1))
-#define A_STAR_PATH_SIZE(maxnodes) (sizeof(int) + (maxnodes) * sizeof(void *))
-
 struct a_star_path {
 	int node_count;
 	__extension__ void *path[0];
 };
 
+#define A_STAR_NODESET_SIZE(maxnodes) (2 * sizeof(int) + (maxnodes) * sizeof(void *))
+#define A_STAR_NODEMAP_SIZE(maxnodes) (8 + 16 * (maxnodes))
+#define A_STAR_SCOREMAP_SIZE(maxnodes) (16 * ((maxnodes) + 1))
+#define A_STAR_PATH_SIZE(maxnodes) (sizeof(struct a_star_path) + (maxnodes) * sizeof(void *))
+
+/* Working space for a_star_indexed(): the path, a node pointer and five ints per node. */
+#define A_STAR_INDEXED_WORKSPACE_SIZE(maxnodes) \
+	(A_STAR_PATH_SIZE(maxnodes) + (maxnodes) * (sizeof(void *) + 5 * sizeof(int)))
+
 typedef int (*a_star_node_cost_fn)(void *context, void *first, void *second);
 typedef void *(*a_star_neighbor_iterator_fn)(void *context, void *node, int neighbor);
+typedef int (*a_star_node_index_fn)(void *context, void *node);
 
 /**
  *
@@ -75,4 +80,35 @@ struct a_star_path *a_star(void *context,
 		a_star_node_cost_fn distance,
 		a_star_node_cost_fn cost_estimate,
 		a_star_neighbor_iterator_fn nth_neighbor);
+
+/**
+ *
+ * a_star_indexed - same as a_star(), in less than half the memory.
+ *
+ * Takes the same parameters as a_star(), except:
+ *
+ * @working_space: a single chunk of at least A_STAR_INDEXED_WORKSPACE_SIZE(maxnodes)
+ *		   bytes, aligned for a pointer.
+ *
+ * @node_index: a function you provide which maps a node to a unique integer in
+ *		[0, maxnodes), e.g. its offset in the array of nodes.  The node's state
+ *		is then kept at that index, with no table to find it in.
+ *
+ * Returns:
+ *   A pointer to struct a_star_path within working_space, or NULL if there is no path.
+ *
+ * a_star() itself uses the same code, finding node indices with a hash table,
+ * which costs about as much as the callback here: test_a_star times both within
+ * a few percent of each other.  What this saves is working space, e.g. 36872
+ * bytes instead of 81992 for a 32x32 grid on a 64 bit host.
+ */
+struct a_star_path *a_star_indexed(void *context,
+		void *working_space,
+		void *start,
+		void *goal,
+		int maxnodes,
+		a_star_node_cost_fn distance,
+		a_star_node_cost_fn cost_estimate,
+		a_star_neighbor_iterator_fn nth_neighbor,
+		a_star_node_index_fn node_index);
 #endif
@@ -13,7 +13,9 @@
 #include "key_value_storage.h"
 #include "settings.h"
 #include "uid.h"
-#include "xorshift.h"
+#include "scheduler.h"
+#include "show_sync.h"
+#include "display_power.h"
 
 /*
   inital system data, will be save/restored from flash
@@ -57,6 +59,7 @@ void UserInit(void)
     }
 
     setup_settings_menus();
+    show_sync_init();
 }
 
 
@@ -78,101 +81,31 @@ unsigned char dormant(void) {
     }
 }
 
-// in frames
-#define SCREEN_SAVE_POPUP_DELAY (10 * 1000 / 30)
-unsigned int screen_save_popup_cnt = SCREEN_SAVE_POPUP_DELAY;
+// Between popups the display dozes, and frames only run for input, so this is in time rather than frames
+#define SCREEN_SAVE_POPUP_DELAY_MS (10 * 1000)
+static uint32_t screen_save_popup_due_ms;
 
-// in frames
-#define POPUP_LENGTH (9 * 30)
-unsigned short popup_time = POPUP_LENGTH;
-
-unsigned char brightScreen = 1;
-unsigned char current_screen_saver = 0;
-
-#define HIGH_PROB_THRESH 100
-#define MEDIUM_PROB_THRESH 30
-#define LOW_PROB_THRESH 15
+/* Doze until the next popup */
+static void start_popup_delay(void)
+{
+    screen_save_popup_due_ms = (uint32_t) rtc_get_ms_since_boot() + SCREEN_SAVE_POPUP_DELAY_MS;
+    scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+    display_power_doze();
+}
 
 void do_screen_save_popup(void)
 {
-
-    static unsigned char prob_val = 50;
-    static unsigned int xorshift_state = 0xa5a5a5a5;
-
     if (badge_system_data()->screensaver_disabled)
 	return;
 
-    if(popup_time == POPUP_LENGTH) {
-	prob_val = xorshift(&xorshift_state) % 100;
-    }
-    
-    if(popup_time){
-        
-        if(prob_val < MEDIUM_PROB_THRESH){
-            
-            switch(current_screen_saver%4){
-                case 0:
-                    smiley();
-                    break;
-                case 1:
-                    bluescreen();
-                    break;
-                case 2:
-                    hack_the_dragon();
-                    break;
-                case 3:
-                    for_president();
-                    break;
-            }
-        }
-        else if(prob_val < HIGH_PROB_THRESH){
-            switch(current_screen_saver%10){
-                case 0:
-                    disp_asset_saver();
-                    break;
-                case 1:
-                    stupid_rects();
-                    break;
-                case 2:
-                    dotty();
-                    break;
-                case 3:
-                    carzy_tunnel_animator();
-                    break;
-                case 4:
-                    just_the_badge_tips();
-                    break;
-                case 5:
-                    qix();
-                    break;
-                case 6:
-                    matrix();
-                    break;
-                case 7:
-                    hyperspace_screen_saver();
-                    break;
-                case 8:
-                    holly_screensaver();
-                    break;
-                case 9:
-                    nametag_screensaver();
-                    break;
-            }
-        }
-        popup_time--;
-    }
-    else{ // stop the popup!
+    if (!screensaver_running())
+        screensaver_start(screensaver_pick());
+    screensaver_frame();
+    if (screensaver_finished()) { // stop the popup!
+        screensaver_stop();
         FbClear();
-        popup_time = POPUP_LENGTH;
-        screen_save_popup_cnt = SCREEN_SAVE_POPUP_DELAY;
-        screensaver_set_animation_count(0);
-        led_pwm_disable(BADGE_LED_RGB_RED);
-        led_pwm_disable(BADGE_LED_RGB_GREEN);
-        led_pwm_disable(BADGE_LED_RGB_BLUE);
-        current_screen_saver++; // TODO: add randomness to this
-        //current_screen_saver = timestamp%5;
+        start_popup_delay();
     }
-    
 }
 
 /* is_dormant is 1 if the screen saver has been activated
@@ -182,11 +115,11 @@ unsigned char screen_save_lockout = 0;
 
 unsigned char screensaver_inverted = 0;
 
-uint64_t ProcessIO(void)
-{
-    // 30 fps
-    static const uint64_t frame_interval_us_default = 1000000/30;
+// The running app's frame rate, while the screen saver runs at the default one
+static int app_frame_rate;
 
+void ProcessIO(void)
+{
     /*
 	this ProcessIO() is the badge main loop
 	buttons are serviced only when the app finishes
@@ -195,19 +128,18 @@ uint64_t ProcessIO(void)
 
     //IRhandler(); /* do any pending IR callbacks */
     menus();
+    display_power_update();
 
-    //initialize assuming the badge is active (backlight is powered);
-    brightScreen = 1;
-    
     if(dormant() && !is_dormant && !screen_save_lockout) {
         is_dormant = 1;
+        app_frame_rate = scheduler_frame_rate();
         // Turn off LED to allow sleep modes
         led_pwm_disable(BADGE_LED_RGB_RED);
         led_pwm_disable(BADGE_LED_RGB_BLUE);
         led_pwm_disable(BADGE_LED_RGB_GREEN);
+        // The display keeps what it's showing while it dozes; the popups draw over it
         FbClear();
         FbColor(BLACK);
-        FbSwapBuffers();
         if(!screensaver_inverted) {
             if(display_get_display_mode() == DISPLAY_MODE_NORMAL) {
                 display_set_display_mode_noninverted();
@@ -216,6 +148,7 @@ uint64_t ProcessIO(void)
                 display_set_display_mode_inverted();
             }
         }
+        start_popup_delay();
     }
     
     if(is_dormant){
@@ -223,11 +156,10 @@ uint64_t ProcessIO(void)
         if (!dormant() || ir_messages_seen(false)) {
             //|| (IRpacketInCurr != IRpacketInNext)){
             is_dormant = 0;
+            scheduler_set_frame_rate(app_frame_rate);
             ir_messages_seen(true);
-            brightScreen = 1;
-            led_pwm_enable(BADGE_LED_DISPLAY_BACKLIGHT, G_sysData.backlight);
-            popup_time = POPUP_LENGTH;
-            screen_save_popup_cnt = SCREEN_SAVE_POPUP_DELAY;
+            display_power_wake();
+            screensaver_stop();
             menu_redraw_main_menu = 1; //hack
             //reset timer
             button_reset_last_input_timestamp();
@@ -241,25 +173,17 @@ uint64_t ProcessIO(void)
                 }
             }
             
-            return frame_interval_us_default;
-        }
-        else if (brightScreen){
-            led_pwm_disable(BADGE_LED_DISPLAY_BACKLIGHT);
-            brightScreen = 0;
+            return;
         }
-            
-        if(screen_save_popup_cnt){
-            screen_save_popup_cnt--;
-            //PowerSaveIdle();
+
+        if (badge_system_data()->screensaver_disabled) {
+            return; // doze until woken
         }
-        else if(!screen_save_popup_cnt){
-            if(!brightScreen){
-                brightScreen = 1;
-                led_pwm_enable(BADGE_LED_DISPLAY_BACKLIGHT, G_sysData.backlight);
+        if ((int32_t) ((uint32_t) rtc_get_ms_since_boot() - screen_save_popup_due_ms) >= 0) {
+            if (!screensaver_running()) {
+                display_power_wake();
             }
             do_screen_save_popup();
         }
     }
-
-    return frame_interval_us_default;
 }
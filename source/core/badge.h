@@ -24,6 +24,6 @@ typedef struct {
 
 SYSTEM_DATA* badge_system_data(void);
 void UserInit(void);
-uint64_t ProcessIO(void);
+void ProcessIO(void);
 
 #endif
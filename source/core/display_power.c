@@ -0,0 +1,154 @@
+#include <stdbool.h>
+
+#include "display_power.h"
+#include "badge.h"
+#include "button.h"
+#include "framebuffer.h"
+#include "led_pwm.h"
+#include "rtc.h"
+#include "scheduler.h"
+
+/* A screen that only draws on input is static once there's been none for this long */
+#define STATIC_AFTER_MS 1000
+/* Dozing turns to sleep after this long: long enough for someone picking the badge back up to find it quick */
+#define SLEEP_AFTER_US 5000000
+
+/*
+ * Rough currents, in microamps, for the estimate: the controller's from the
+ * ST7735S datasheet, and the backlight's from its LEDs and resistor.  About
+ * half the controller's goes on driving the panel's rows, which partial
+ * display saves in proportion.
+ */
+#define BACKLIGHT_UA 20000	/* at full brightness */
+static const uint32_t controller_ua[DISPLAY_POWER_MODES] = {
+	[DISPLAY_POWER_NORMAL] = 4000,
+	[DISPLAY_POWER_STATIC] = 2500,
+	[DISPLAY_POWER_IDLE] = 1000,
+	[DISPLAY_POWER_SLEEP] = 10,
+};
+
+static bool dozing;
+static int rows_first, rows_count;
+static int rows_frame_rate;		/* the app's frame rate when it set them */
+static int rows_shown;			/* what the controller's been told */
+static bool waking;
+static uint64_t woke_us;
+static unsigned short woke_pushes;
+static uint64_t mode_since_us;
+static uint64_t saved_ua_ms;
+static struct display_power_stats stats;
+
+static void go_to_sleep(void *context);
+static struct scheduler_task sleep_task = SCHEDULER_TASK("display sleep", go_to_sleep, NULL, 0);
+
+static uint32_t backlight_ua(void)
+{
+	return (uint32_t) BACKLIGHT_UA * badge_system_data()->backlight / 255;
+}
+
+static uint32_t current_ua(void)
+{
+	uint32_t ua = controller_ua[stats.mode];
+
+	if (rows_shown)
+		ua = ua / 2 + ua / 2 * rows_shown / LCD_YSIZE;
+	return dozing ? ua : ua + backlight_ua();
+}
+
+/* Add up the time since the last change, at the current current */
+static void account(uint64_t now)
+{
+	uint64_t us = now - mode_since_us;
+
+	stats.mode_us[stats.mode] += us;
+	saved_ua_ms += us / 1000 * (controller_ua[DISPLAY_POWER_NORMAL] + backlight_ua() - current_ua());
+	mode_since_us = now;
+}
+
+static void set_mode(enum display_power mode, int rows)
+{
+	if (mode == stats.mode && rows == rows_shown)
+		return;
+	account(rtc_get_us_since_boot());
+	display_set_power(mode);
+	display_set_partial(rows ? rows_first : 0, rows);
+	stats.mode = mode;
+	rows_shown = rows;
+}
+
+static void go_to_sleep(__attribute__((unused)) void *context)
+{
+	if (dozing)
+		set_mode(DISPLAY_POWER_SLEEP, 0);
+}
+
+void display_power_update(void)
+{
+	uint64_t now = rtc_get_us_since_boot();
+	int rate = scheduler_frame_rate();
+	bool still;
+
+	if (waking && G_Fb.pushes != woke_pushes) {
+		waking = false;
+		stats.last_wake_us = (uint32_t) (now - woke_us);
+		if (stats.last_wake_us > stats.max_wake_us)
+			stats.max_wake_us = stats.last_wake_us;
+	}
+	if (dozing)
+		return;
+
+	/* Rows set for one app's static screen aren't for the next's */
+	if (rate != rows_frame_rate)
+		rows_count = 0;
+	still = rate == SCHEDULER_ON_INPUT &&
+		(uint32_t) rtc_get_ms_since_boot() - button_last_input_timestamp() >= STATIC_AFTER_MS;
+	if (still)
+		set_mode(DISPLAY_POWER_STATIC, rows_count);
+	else
+		set_mode(DISPLAY_POWER_NORMAL, 0);
+}
+
+void display_power_doze(void)
+{
+	if (dozing)
+		return;
+	account(rtc_get_us_since_boot());
+	dozing = true;
+	waking = false;
+	led_pwm_disable(BADGE_LED_DISPLAY_BACKLIGHT);
+	set_mode(DISPLAY_POWER_IDLE, 0);
+	scheduler_start(&sleep_task, SLEEP_AFTER_US);
+}
+
+void display_power_wake(void)
+{
+	uint64_t now = rtc_get_us_since_boot();
+
+	if (!dozing)
+		return;
+	scheduler_stop(&sleep_task);
+	stats.last_wake_from = stats.mode;
+	set_mode(DISPLAY_POWER_NORMAL, 0);
+	dozing = false;
+	led_pwm_enable(BADGE_LED_DISPLAY_BACKLIGHT, badge_system_data()->backlight);
+	waking = true;
+	woke_us = now;
+	woke_pushes = G_Fb.pushes;
+	stats.wakes++;
+}
+
+void display_power_set_rows(int first, int count)
+{
+	if (first < 0 || count < 0 || first + count > LCD_YSIZE)
+		count = 0;
+	rows_first = first;
+	rows_count = count;
+	rows_frame_rate = scheduler_frame_rate();
+}
+
+void display_power_get_stats(struct display_power_stats *out)
+{
+	account(rtc_get_us_since_boot());
+	*out = stats;
+	out->saved_uah = (uint32_t) (saved_ua_ms / 3600000);
+}
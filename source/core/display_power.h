@@ -0,0 +1,51 @@
+#ifndef DISPLAY_POWER_H__
+#define DISPLAY_POWER_H__
+
+/*
+ * Display power management: the backlight and the display controller's
+ * power modes (see display.h), following what the badge is doing.
+ *
+ * Awake, the display runs at full power.  While the running app only draws
+ * on input (it asked for SCHEDULER_ON_INPUT, like About and the schedule)
+ * and there's been none for a moment, its screen is static: the controller
+ * refreshes the panel slowly, and only the rows the app says it uses, if it
+ * says.  When the badge goes dormant (see ProcessIO()) the display dozes,
+ * with the backlight off and the controller in its idle mode, from which it
+ * wakes straight away; after a while dozing it sleeps, and takes longer to
+ * wake.  The scheduler runs a frame for a button press or an IR message, so
+ * either wakes it promptly.
+ *
+ * The statistics give the time from each wake to the first frame shown
+ * after it, and an estimate of the current saved against running at full
+ * power all the time; About Badge shows them.
+ */
+
+#include <stdint.h>
+
+#include "display.h"
+
+/* Once a frame, after the app's had its go */
+void display_power_update(void);
+
+/* Backlight off and the controller idle, then asleep */
+void display_power_doze(void);
+
+/* Backlight on and the controller at full power */
+void display_power_wake(void);
+
+/* For a static screen: the rows it draws on, or a count of 0 for all of them; until the app next changes frame rate */
+void display_power_set_rows(int first, int count);
+
+struct display_power_stats {
+	enum display_power mode;
+	uint64_t mode_us[DISPLAY_POWER_MODES];	/* time spent in each */
+	uint32_t wakes;
+	enum display_power last_wake_from;	/* idle or asleep */
+	uint32_t last_wake_us;		/* from waking to the first frame shown */
+	uint32_t max_wake_us;
+	uint32_t saved_uah;		/* estimated, in microamp hours */
+};
+
+void display_power_get_stats(struct display_power_stats *stats);
+
+#endif
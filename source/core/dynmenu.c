@@ -11,6 +11,7 @@ void dynmenu_init(struct dynmenu *dm, struct dynmenu_item *item, unsigned char m
 {
 	dm->item = item;
 	dm->max_items = max_items;
+	dm->drawn.valid = 0;
 }
 
 void dynmenu_set_colors(struct dynmenu *dm, int color, int selected_color)
@@ -28,6 +29,7 @@ void dynmenu_clear(struct dynmenu *dm)
 	dm->current_item = 0;
 	dm->menu_active = 0;
 	dm->chosen_cookie = 0;
+	dm->drawn.valid = 0;
 }
 
 #define ARRAYSIZE(x) (sizeof((x)) / sizeof((x)[0]))
@@ -50,33 +52,39 @@ void dynmenu_add_item(struct dynmenu *dm, char *text, int next_state, unsigned c
     dm->item[i].next_state = next_state;
     dm->item[i].cookie = cookie;
     dm->nitems++;
+    dm->drawn.valid = 0;
 }
 
-void dynmenu_draw(struct dynmenu *dm)
+/* The items either side of the current one that are drawn, which leaves the current item in the center */
+static void visible_items(struct dynmenu *dm, int current_item, int *first_item, int *last_item)
 {
-	int i, y, first_item, last_item;
+	*first_item = current_item - 3;
+	if (*first_item < 0)
+		*first_item = 0;
+	*last_item = current_item + 3;
+	if (*last_item > dm->nitems - 1)
+		*last_item = dm->nitems - 1;
+}
 
-    /* choose a starting point that leaves the current item in the center */
-	first_item = dm->current_item - 3;
-	if (first_item < 0)
-		first_item = 0;
-	last_item = dm->current_item + 3;
-	if (last_item > dm->nitems - 1)
-		last_item = dm->nitems - 1;
+/* The rows the items and the rectangle around the current one cover */
+static void items_rows(struct dynmenu *dm, int current_item, int *top, int *bottom)
+{
+	int first_item, last_item;
 
-    /* write menu title (1 to 3 lines) */
-	FbClear();
-	FbColor(WHITE);
-	FbMove(8, 5);
-	FbWriteLine(dm->title);
-	if (dm->title2[0] != '\0') {
-		FbMove(8, 12);
-		FbWriteLine(dm->title2);
-	}
-	if (dm->title3[0] != '\0') {
-		FbMove(8, 19);
-		FbWriteLine(dm->title3);
-	}
+	visible_items(dm, current_item, &first_item, &last_item);
+	*top = LCD_YSIZE / 2 - 10 * (current_item - first_item);
+	if (*top > LCD_YSIZE / 2 - 2)
+		*top = LCD_YSIZE / 2 - 2;
+	*bottom = LCD_YSIZE / 2 + 10 * (last_item - current_item) + 8;
+	if (*bottom < LCD_YSIZE / 2 + 10)
+		*bottom = LCD_YSIZE / 2 + 10;
+}
+
+static void draw_items(struct dynmenu *dm)
+{
+	int i, y, first_item, last_item;
+
+	visible_items(dm, dm->current_item, &first_item, &last_item);
 
     /* get y position for the first item */
 	y = LCD_YSIZE / 2 - 10 * (dm->current_item - first_item);
@@ -97,6 +105,59 @@ void dynmenu_draw(struct dynmenu *dm)
 	FbRectangle(LCD_XSIZE - 7, 12);
 }
 
+void dynmenu_draw(struct dynmenu *dm)
+{
+    /* write menu title (1 to 3 lines) */
+	dm->drawn.background = G_Fb.BGcolor;
+	FbClear();
+	FbColor(WHITE);
+	FbMove(8, 5);
+	FbWriteLine(dm->title);
+	if (dm->title2[0] != '\0') {
+		FbMove(8, 12);
+		FbWriteLine(dm->title2);
+	}
+	if (dm->title3[0] != '\0') {
+		FbMove(8, 19);
+		FbWriteLine(dm->title3);
+	}
+
+	draw_items(dm);
+	dm->drawn.valid = 0;
+}
+
+void dynmenu_show(struct dynmenu *dm)
+{
+	int old_top, old_bottom, top, bottom;
+
+	if (!dm->drawn.valid || G_Fb.buffer != dm->drawn.buffer || G_Fb.pushes != dm->drawn.pushes || G_Fb.changed) {
+		/* Not what's on the screen, or someone else has drawn since */
+		dynmenu_draw(dm);
+		FbPushBuffer();
+	} else if (dm->current_item != dm->drawn.current_item) {
+		/*
+		 * The current item stays in the center, so every item moves; but
+		 * the titles don't, so only the items' rows need redrawing and sending.
+		 */
+		items_rows(dm, dm->drawn.current_item, &old_top, &old_bottom);
+		items_rows(dm, dm->current_item, &top, &bottom);
+		if (old_top < top)
+			top = old_top;
+		if (old_bottom > bottom)
+			bottom = old_bottom;
+		FbMove(0, top);
+		FbColor(dm->drawn.background);
+		FbFilledRectangle(LCD_XSIZE, bottom - top);
+		draw_items(dm);
+		FbPushRows(top, bottom - top);
+	}
+
+	dm->drawn.current_item = dm->current_item;
+	dm->drawn.buffer = G_Fb.buffer;
+	dm->drawn.pushes = G_Fb.pushes;
+	dm->drawn.valid = 1;
+}
+
 /*
  * Change the current item on the menu by going down (positive direction) or
  * up (negative direction). If we would move past the beginning or end of the menu,
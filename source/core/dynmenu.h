@@ -28,6 +28,13 @@ struct dynmenu {
 	unsigned char menu_active;	/* Is this menu active? currently on screen? */
 	unsigned char chosen_cookie;	/* Contains the cookie of the most recently selected item. */
 	int color, selected_color;	/* Color of menu text and color of currently selected item. */
+	struct {			/* What dynmenu_show() last sent to the screen */
+		unsigned short *buffer;
+		unsigned short pushes;
+		unsigned short background;
+		unsigned char current_item;
+		unsigned char valid;
+	} drawn;
 };
 
 /* dynmenu_init(): Initialize a dynamic menu, dm.
@@ -55,6 +62,14 @@ void dynmenu_add_item(struct dynmenu *dm, char *text, int next_state, unsigned c
 /* Draws the menu. */
 void dynmenu_draw(struct dynmenu *dm);
 
+/* Draws the menu and sends it to the screen, in place of dynmenu_draw() then FbSwapBuffers() or FbPushBuffer().
+ * If the menu is still on the screen from last time, only what has changed is redrawn and sent: nothing, if the
+ * current item is the same, or just the items' rows if it isn't.  It's redrawn in full after dynmenu_clear() or
+ * dynmenu_add_item(), or if anything else has drawn since; change the titles or items' text some other way and it
+ * won't notice.  Unlike FbSwapBuffers(), this leaves the menu in the buffer, so clear it before drawing something else.
+ */
+void dynmenu_show(struct dynmenu *dm);
+
 /* Adjust the current selection up (direction is negative) or down (direction is positive).
  * Typically, direction is either 1 or -1, and connected to the D-pad buttons.
  */
@@ -0,0 +1,105 @@
+#include "fft.h"
+#include "fxp_math.h"
+
+/*
+ * Radix-2 decimation in time: reorder the input by bit reversed index, then
+ * log2(n) stages of butterflies.  The twiddle factors come from fxp_sin()
+ * once, into a table for the largest transform that smaller ones step
+ * through.
+ */
+
+#define TWIDDLES (1 << (FFT_MAX_BITS - 1))
+
+static int16_t twiddle_cos[TWIDDLES];
+static int16_t twiddle_sin[TWIDDLES];
+static int twiddles_ready;
+
+static int16_t q15_from_q16(int32_t x)
+{
+	x = (x + 1) >> 1;
+	return (int16_t) (x > 32767 ? 32767 : x);
+}
+
+static void make_twiddles(void)
+{
+	/* e^(-2 pi i k / 2^FFT_MAX_BITS) */
+	for (int k = 0; k < TWIDDLES; k++) {
+		fxp_angle a = (fxp_angle) (k << (16 - FFT_MAX_BITS));
+
+		twiddle_cos[k] = q15_from_q16(fxp_cos(a));
+		twiddle_sin[k] = q15_from_q16(-fxp_sin(a));
+	}
+	twiddles_ready = 1;
+}
+
+static void bit_reverse(int16_t *re, int16_t *im, int bits)
+{
+	int n = 1 << bits;
+
+	for (int i = 0, j = 0; i < n; i++) {
+		int bit = n >> 1;
+
+		if (i < j) {
+			int16_t t = re[i];
+
+			re[i] = re[j];
+			re[j] = t;
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+		/* Add 1 to j from the top bit down */
+		while (j & bit) {
+			j ^= bit;
+			bit >>= 1;
+		}
+		j |= bit;
+	}
+}
+
+void fft_q15(int16_t *re, int16_t *im, int bits)
+{
+	int n = 1 << bits;
+
+	if (bits < 1 || bits > FFT_MAX_BITS)
+		return;
+	if (!twiddles_ready)
+		make_twiddles();
+	bit_reverse(re, im, bits);
+
+	for (int half = 1, stride = TWIDDLES; half < n; half <<= 1, stride >>= 1) {
+		for (int k = 0; k < half; k++) {
+			int32_t wr = twiddle_cos[k * stride];
+			int32_t wi = twiddle_sin[k * stride];
+
+			for (int i = k; i < n; i += half << 1) {
+				int j = i + half;
+				/* (re[j] + i im[j]) * (wr + i wi), still Q15 */
+				int32_t tr = (re[j] * wr - im[j] * wi + (1 << 14)) >> 15;
+				int32_t ti = (re[j] * wi + im[j] * wr + (1 << 14)) >> 15;
+				int32_t ur = re[i], ui = im[i];
+
+				re[i] = (int16_t) ((ur + tr) >> 1);
+				im[i] = (int16_t) ((ui + ti) >> 1);
+				re[j] = (int16_t) ((ur - tr) >> 1);
+				im[j] = (int16_t) ((ui - ti) >> 1);
+			}
+		}
+	}
+}
+
+void fft_window_hann(int16_t *samples, int n)
+{
+	/* 0.5 - 0.5 cos(2 pi i / n), in Q16 */
+	for (int i = 0; i < n; i++) {
+		int32_t w = (FXP_ONE - fxp_cos((fxp_angle) (i * 65536 / n))) >> 1;
+
+		samples[i] = (int16_t) ((samples[i] * w) >> 16);
+	}
+}
+
+void fft_magnitudes(const int16_t *re, const int16_t *im, uint16_t *magnitudes, int n)
+{
+	for (int i = 0; i < n; i++)
+		magnitudes[i] = (uint16_t) fxp_isqrt((uint32_t) (re[i] * re[i]) + (uint32_t) (im[i] * im[i]));
+}
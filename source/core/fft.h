@@ -0,0 +1,28 @@
+#ifndef FFT_H__
+#define FFT_H__
+
+/*
+ * Fixed point FFT for spectrum.c, small and fast enough to run on a block
+ * of microphone samples every frame.
+ *
+ * Samples are Q15 in int16_t.  fft_q15() works in place on separate real
+ * and imaginary arrays of 2^bits points, and divides by 2 at each stage so
+ * nothing can overflow: the results are the true transform / n.  A full
+ * scale sine wave of amplitude A on a bin comes out as two peaks of A / 2,
+ * one in bin k and one in bin n - k.
+ */
+
+#include <stdint.h>
+
+#define FFT_MAX_BITS 10		/* up to 1024 points */
+
+/* Transform re[] and im[], both 1 << bits long, in place */
+void fft_q15(int16_t *re, int16_t *im, int bits);
+
+/* Multiply n samples by a Hann window, which keeps a tone between two bins from smearing across the whole spectrum */
+void fft_window_hann(int16_t *samples, int n);
+
+/* Magnitudes of the first n of the results, sqrt(re^2 + im^2) */
+void fft_magnitudes(const int16_t *re, const int16_t *im, uint16_t *magnitudes, int n);
+
+#endif
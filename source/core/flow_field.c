@@ -0,0 +1,310 @@
+#include "flow_field.h"
+
+#include <string.h>
+
+#define ORTHOGONAL_STEP 2
+#define DIAGONAL_STEP 3
+
+static const int8_t xo[] = { 0, 1, 0, -1, 1, 1, -1, -1 };
+static const int8_t yo[] = { -1, 0, 1, 0, -1, 1, 1, -1 };
+
+static int ncells(const struct flow_field *f)
+{
+	return f->map->width * f->map->height;
+}
+
+static uint8_t cell_cost(const struct flow_field *f, int cell)
+{
+	if (cell == f->old_cell)
+		return f->old_cost;
+	return f->map->cost[cell];
+}
+
+static int open_cell(const struct flow_field *f, int x, int y)
+{
+	const struct grid_path_map *m = f->map;
+
+	if (x < 0 || y < 0 || x >= m->width || y >= m->height)
+		return 0;
+	return cell_cost(f, y * m->width + x) != GRID_PATH_WALL;
+}
+
+static int ndirections(const struct flow_field *f)
+{
+	return (f->flags & GRID_PATH_8_CONNECTED) ? 8 : 4;
+}
+
+/*
+ * Cost of stepping from (x, y) in direction i, or -1 if that's not a legal
+ * step.  Same rules as grid_path_find(): the cell stepped into must be open,
+ * and a diagonal step needs both cells beside it open too.
+ */
+static int step_cost(const struct flow_field *f, int x, int y, int i)
+{
+	int nx = x + xo[i], ny = y + yo[i];
+
+	if (!open_cell(f, nx, ny))
+		return -1;
+	if (i < 4)
+		return ORTHOGONAL_STEP + cell_cost(f, ny * f->map->width + nx);
+	if (!open_cell(f, nx, y) || !open_cell(f, x, ny))
+		return -1;
+	return DIAGONAL_STEP + cell_cost(f, ny * f->map->width + nx);
+}
+
+static int is_queued(const struct flow_field *f, int cell)
+{
+	return f->queued[cell >> 3] & (1 << (cell & 7));
+}
+
+static void set_queued(struct flow_field *f, int cell, int queued)
+{
+	if (queued)
+		f->queued[cell >> 3] |= 1 << (cell & 7);
+	else
+		f->queued[cell >> 3] &= ~(1 << (cell & 7));
+}
+
+/*
+ * Label correcting search: cells whose distance went down are queued, and
+ * each one popped offers its neighbors a path through it.  A cell is only
+ * ever in the queue once, so the ring needs one slot per cell.  queue[head]
+ * to queue[head + count] on entry are already queued.
+ */
+static void propagate(struct flow_field *f, int head, int count)
+{
+	int n = ncells(f), w = f->map->width;
+
+	while (count > 0) {
+		int cell = f->queue[head];
+		int x = cell % w, y = cell / w;
+
+		head = (head + 1) % n;
+		count--;
+		set_queued(f, cell, 0);
+		if (f->distance[cell] == FLOW_FIELD_UNREACHABLE)
+			continue;
+
+		/* Neighbors that could step into this cell: the reverse of each direction */
+		for (int i = 0; i < ndirections(f); i++) {
+			int nx = x + xo[i], ny = y + yo[i];
+			int neighbor = ny * w + nx;
+			int cost, d;
+
+			if (nx < 0 || ny < 0 || nx >= w || ny >= f->map->height)
+				continue;
+			if (f->map->cost[neighbor] == GRID_PATH_WALL)
+				continue;
+			cost = step_cost(f, nx, ny, i ^ 2);
+			if (cost < 0)
+				continue;
+			d = f->distance[cell] + cost;
+			if (d >= FLOW_FIELD_UNREACHABLE || d >= f->distance[neighbor])
+				continue;
+			f->distance[neighbor] = d;
+			if (!is_queued(f, neighbor)) {
+				set_queued(f, neighbor, 1);
+				f->queue[(head + count) % n] = neighbor;
+				count++;
+			}
+		}
+	}
+}
+
+void flow_field_init(struct flow_field *f, const struct grid_path_map *map, int flags, void *working_space)
+{
+	int n = map->width * map->height;
+
+	f->map = map;
+	f->flags = flags & GRID_PATH_8_CONNECTED;
+	f->distance = working_space;
+	f->queue = f->distance + n;
+	f->queued = (uint8_t *) (f->queue + n);
+	f->old_cell = -1;
+	memset(f->queued, 0, (n + 7) / 8);
+	flow_field_clear(f);
+}
+
+void flow_field_clear(struct flow_field *f)
+{
+	f->target = FLOW_FIELD_NO_TARGET;
+	memset(f->distance, 0xff, ncells(f) * sizeof(uint16_t));
+}
+
+void flow_field_set_target(struct flow_field *f, uint16_t target)
+{
+	if (target == f->target || target >= ncells(f))
+		return;
+	flow_field_clear(f);
+	f->target = target;
+	if (f->map->cost[target] == GRID_PATH_WALL)
+		return;
+	f->distance[target] = 0;
+	f->queue[0] = target;
+	set_queued(f, target, 1);
+	propagate(f, 0, 1);
+}
+
+/* Cheapest distance cell could get from its neighbors as they stand */
+static int best_from_neighbors(const struct flow_field *f, int cell)
+{
+	int w = f->map->width;
+	int x = cell % w, y = cell / w;
+	int best = FLOW_FIELD_UNREACHABLE;
+
+	if (f->map->cost[cell] == GRID_PATH_WALL)
+		return FLOW_FIELD_UNREACHABLE;
+	if (cell == f->target)
+		return 0;
+	for (int i = 0; i < ndirections(f); i++) {
+		int cost = step_cost(f, x, y, i);
+		int d;
+
+		if (cost < 0)
+			continue;
+		d = f->distance[(y + yo[i]) * w + x + xo[i]];
+		if (d == FLOW_FIELD_UNREACHABLE)
+			continue;
+		if (d + cost < best)
+			best = d + cost;
+	}
+	return best;
+}
+
+/*
+ * The cell got more expensive, or became a wall.  Any cell whose distance
+ * was reached through it, directly or by way of other such cells, may now be
+ * wrong, so find them all, forget their distances, and fill them back in
+ * from the cells around them that weren't affected.
+ *
+ * A cell depends on a neighbor if its distance is exactly the neighbor's
+ * plus the (old) cost of the step between them.  The changed cell's own
+ * neighbors are all treated as dependent, which covers diagonal steps a new
+ * wall has blocked as well as steps into the cell.  Ties mean a few cells
+ * get recomputed that didn't need to be.
+ */
+static void cost_increased(struct flow_field *f, int changed, uint8_t old_cost)
+{
+	const struct grid_path_map *m = f->map;
+	int w = m->width;
+	int cx = changed % w, cy = changed / w;
+	int count = 0;
+
+	/* Mark the changed cell and its neighborhood */
+	for (int i = -1; i < ndirections(f); i++) {
+		int x = cx + (i < 0 ? 0 : xo[i]), y = cy + (i < 0 ? 0 : yo[i]);
+		int cell = y * w + x;
+
+		if (x < 0 || y < 0 || x >= w || y >= m->height || is_queued(f, cell))
+			continue;
+		if (f->distance[cell] == FLOW_FIELD_UNREACHABLE || cell == f->target)
+			continue;
+		set_queued(f, cell, 1);
+		f->queue[count++] = cell;
+	}
+
+	/* Follow the dependencies outward, with the old cost in place since the distances were made with it */
+	f->old_cell = changed;
+	f->old_cost = old_cost;
+	for (int head = 0; head < count; head++) {
+		int cell = f->queue[head];
+		int x = cell % w, y = cell / w;
+
+		for (int i = 0; i < ndirections(f); i++) {
+			int nx = x + xo[i], ny = y + yo[i];
+			int neighbor = ny * w + nx;
+			int step;
+
+			if (nx < 0 || ny < 0 || nx >= w || ny >= m->height || is_queued(f, neighbor))
+				continue;
+			if (f->distance[neighbor] == FLOW_FIELD_UNREACHABLE || neighbor == f->target)
+				continue;
+			step = step_cost(f, nx, ny, i ^ 2);
+			if (step < 0 || f->distance[neighbor] != f->distance[cell] + step)
+				continue;
+			set_queued(f, neighbor, 1);
+			f->queue[count++] = neighbor;
+		}
+	}
+	f->old_cell = -1;
+
+	for (int i = 0; i < count; i++)
+		f->distance[f->queue[i]] = FLOW_FIELD_UNREACHABLE;
+	for (int i = 0; i < count; i++)
+		f->distance[f->queue[i]] = best_from_neighbors(f, f->queue[i]);
+	propagate(f, 0, count);
+}
+
+/* The cell got cheaper, or stopped being a wall: it and its neighbors may offer shorter routes now. */
+static void cost_decreased(struct flow_field *f, int changed)
+{
+	int w = f->map->width;
+	int cx = changed % w, cy = changed / w;
+	int count = 0;
+
+	f->distance[changed] = best_from_neighbors(f, changed);
+	for (int i = -1; i < ndirections(f); i++) {
+		int x = cx + (i < 0 ? 0 : xo[i]), y = cy + (i < 0 ? 0 : yo[i]);
+		int cell = y * w + x;
+		int d;
+
+		if (x < 0 || y < 0 || x >= w || y >= f->map->height || is_queued(f, cell))
+			continue;
+		/* Diagonals between neighbors may have just been unblocked */
+		d = best_from_neighbors(f, cell);
+		if (d < f->distance[cell])
+			f->distance[cell] = d;
+		set_queued(f, cell, 1);
+		f->queue[count++] = cell;
+	}
+	propagate(f, 0, count);
+}
+
+void flow_field_cell_changed(struct flow_field *f, uint16_t cell, uint8_t old_cost)
+{
+	uint8_t new_cost;
+
+	if (f->target == FLOW_FIELD_NO_TARGET || cell >= ncells(f))
+		return;
+	new_cost = f->map->cost[cell];
+	if (new_cost == old_cost)
+		return;
+	if (cell == f->target) {
+		/* Entering the target costs nothing, so only its becoming (or ceasing to be) a wall matters */
+		if (new_cost == GRID_PATH_WALL || old_cost == GRID_PATH_WALL) {
+			f->target = FLOW_FIELD_NO_TARGET;
+			flow_field_set_target(f, cell);
+		}
+		return;
+	}
+	if (new_cost == GRID_PATH_WALL || (old_cost != GRID_PATH_WALL && new_cost > old_cost))
+		cost_increased(f, cell, old_cost);
+	else
+		cost_decreased(f, cell);
+}
+
+int flow_field_next_step(const struct flow_field *f, uint16_t cell)
+{
+	int w = f->map->width;
+	int x = cell % w, y = cell / w;
+	int best = -1, best_distance = FLOW_FIELD_UNREACHABLE;
+
+	if (cell == f->target || f->target == FLOW_FIELD_NO_TARGET)
+		return -1;
+	for (int i = 0; i < ndirections(f); i++) {
+		int cost = step_cost(f, x, y, i);
+		int neighbor, d;
+
+		if (cost < 0)
+			continue;
+		neighbor = (y + yo[i]) * w + x + xo[i];
+		if (f->distance[neighbor] == FLOW_FIELD_UNREACHABLE)
+			continue;
+		d = f->distance[neighbor] + cost;
+		if (d < best_distance) {
+			best_distance = d;
+			best = neighbor;
+		}
+	}
+	return best;
+}
@@ -0,0 +1,73 @@
+#ifndef FLOW_FIELD_H__
+#define FLOW_FIELD_H__
+
+/*
+ * Flow fields (also known as Dijkstra maps) for many agents heading to the
+ * same place on a grid.  Instead of a path search per agent, one search
+ * outward from the target records every cell's cost to reach it; after that
+ * any agent, wherever it is, finds its next step by looking at the cells
+ * around it.
+ *
+ * The grid and step costs are the same as for grid_path_find(): see
+ * grid_path.h.  When the grid changes (a door opens, an obstacle moves), tell
+ * the field with flow_field_cell_changed() and only the cells affected are
+ * recomputed.
+ *
+ * Working memory is about 4 bytes per cell.
+ */
+
+#include <stdint.h>
+
+#include "grid_path.h"
+
+#define FLOW_FIELD_UNREACHABLE 0xffff
+#define FLOW_FIELD_NO_TARGET 0xffff
+
+#define FLOW_FIELD_WORKSPACE_SIZE(ncells) (2 * sizeof(uint16_t) * (ncells) + ((ncells) + 7) / 8)
+
+struct flow_field {
+	const struct grid_path_map *map;
+	int flags;		/* GRID_PATH_8_CONNECTED, or 0 */
+	uint16_t target;
+	uint16_t *distance;	/* cost from each cell to the target */
+	uint16_t *queue;
+	uint8_t *queued;	/* one bit per cell */
+	int old_cell;		/* while updating, a cell whose old cost is old_cost */
+	uint8_t old_cost;
+};
+
+/**
+ * flow_field_init - set up a flow field with no target
+ *
+ * @working_space: at least FLOW_FIELD_WORKSPACE_SIZE(width * height) bytes,
+ *		   aligned for a uint16_t.  map must stay valid for as long as
+ *		   the field is used.
+ */
+void flow_field_init(struct flow_field *f, const struct grid_path_map *map, int flags, void *working_space);
+
+/* Recompute the whole field for a new target, unless it's the current one. */
+void flow_field_set_target(struct flow_field *f, uint16_t target);
+
+/* Forget the target, e.g. when the grid is reloaded; the next set_target recomputes. */
+void flow_field_clear(struct flow_field *f);
+
+/* The map's cost for cell has changed from old_cost; update the cells that depend on it. */
+void flow_field_cell_changed(struct flow_field *f, uint16_t cell, uint8_t old_cost);
+
+/* Cost from cell to the target, or FLOW_FIELD_UNREACHABLE */
+static inline uint16_t flow_field_distance(const struct flow_field *f, uint16_t cell)
+{
+	return f->distance[cell];
+}
+
+/**
+ * flow_field_next_step - which cell to step into from cell to get to the target
+ *
+ * Works from a wall cell too, for an agent that's been pushed into one.
+ *
+ * Returns:
+ *   the cell, or -1 if cell is the target or the target can't be reached.
+ */
+int flow_field_next_step(const struct flow_field *f, uint16_t cell);
+
+#endif
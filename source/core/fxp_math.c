@@ -0,0 +1,253 @@
+#include "fxp_math.h"
+
+#include "fxp_math_tables.h"
+
+/* fxp_angle bits below the sine table's steps, interpolated */
+#define SINE_FRACTION_BITS (14 - 10)
+
+/* Sine of an angle in the first quarter turn, 0 to 16384 inclusive */
+static int32_t quarter_sine(uint32_t a)
+{
+	uint32_t i = a >> SINE_FRACTION_BITS;
+	uint32_t frac = a & ((1 << SINE_FRACTION_BITS) - 1);
+	int32_t v0, v1;
+
+	if (i >= FXP_SINE_TABLE_SIZE)
+		return FXP_ONE; /* the table can't hold 65536 */
+	v0 = fxp_sine_table[i];
+	v1 = fxp_sine_table[i + 1];
+	return v0 + (((v1 - v0) * (int32_t) frac + (1 << (SINE_FRACTION_BITS - 1))) >> SINE_FRACTION_BITS);
+}
+
+int32_t fxp_sin(fxp_angle a)
+{
+	uint32_t p = a & 0x3fff;
+
+	/* The second and fourth quarters mirror the first and third */
+	if (a & 0x4000)
+		p = 0x4000 - p;
+	if (a & 0x8000)
+		return -quarter_sine(p);
+	return quarter_sine(p);
+}
+
+int32_t fxp_cos(fxp_angle a)
+{
+	return fxp_sin((fxp_angle) (a + 0x4000));
+}
+
+/*
+ * Reduce to the first octant, where t = min / max is 0 to 1, then
+ * atan(t) = t * (c1 + t^2 * (c3 + t^2 * (c5 + t^2 * (c7 + t^2 * c9))))
+ * with the coefficients in fxp_angle steps * 4.  One divide, and all the
+ * arithmetic fits in 32 bits.
+ */
+#define ATAN_T_BITS 15
+
+fxp_angle fxp_atan2(int32_t y, int32_t x)
+{
+	uint32_t ax = x < 0 ? -(uint32_t) x : (uint32_t) x;
+	uint32_t ay = y < 0 ? -(uint32_t) y : (uint32_t) y;
+	uint32_t max = ax > ay ? ax : ay, min = ax > ay ? ay : ax;
+	int32_t t, t2, r, angle;
+
+	if (max == 0)
+		return 0;
+	/* Keep min << ATAN_T_BITS in 32 bits */
+	if (max >= (1u << 16)) {
+		int shift = 16 - __builtin_clz(max);
+
+		max >>= shift;
+		min >>= shift;
+	}
+	t = (int32_t) ((min << ATAN_T_BITS) / max);
+	t2 = (t * t) >> ATAN_T_BITS;
+	r = fxp_atan_poly[4];
+	for (int i = 3; i >= 0; i--)
+		r = fxp_atan_poly[i] + ((r * t2) >> ATAN_T_BITS);
+	angle = (((r * t) >> ATAN_T_BITS) + 2) >> 2;
+
+	if (ay > ax)
+		angle = 0x4000 - angle;
+	if (x < 0)
+		angle = 0x8000 - angle;
+	if (y < 0)
+		angle = -angle;
+	return (fxp_angle) angle;
+}
+
+/*
+ * Square root a bit pair at a time, the way it's done by hand.  The remainder
+ * never gets above twice the root, so it all fits in 32 bits.  extra_pairs
+ * pairs of zero bits follow x, each adding a bit to the root's fraction.
+ */
+static uint32_t sqrt_digits(uint32_t x, int extra_pairs)
+{
+	uint32_t root = 0, rem = 0;
+	int pairs = 16 + extra_pairs;
+
+	/* Skip leading zero pairs */
+	while (pairs > extra_pairs && (x & 0xc0000000) == 0) {
+		x <<= 2;
+		pairs--;
+	}
+	while (pairs-- > 0) {
+		uint32_t trial = (root << 2) | 1;
+		uint32_t fits;
+
+		rem = (rem << 2) | (x >> 30);
+		x <<= 2;
+		/* Without a branch, which the next bit makes unpredictable */
+		fits = -(uint32_t) (rem >= trial);
+		rem -= trial & fits;
+		root = (root << 1) | (fits & 1);
+	}
+	return root;
+}
+
+uint32_t fxp_isqrt(uint32_t x)
+{
+	return sqrt_digits(x, 0);
+}
+
+int32_t fxp_sqrt16(int32_t x)
+{
+	if (x <= 0)
+		return 0;
+	return (int32_t) sqrt_digits(x, 8);
+}
+
+/*
+ * One over the square root, then a Newton step, y = y * (3 - x * y^2) / 2,
+ * to win back the precision the square root's rounding lost.
+ */
+int32_t fxp_rsqrt16(int32_t x)
+{
+	uint32_t s;
+	int64_t y, t;
+
+	if (x <= 0)
+		return INT32_MAX;
+	s = sqrt_digits(x, 8);
+	if (s < 2)
+		return INT32_MAX;
+	y = 0xffffffffu / s;
+	t = (y * y * x) >> 32;
+	y = (y * (3 * FXP_ONE - t)) >> 17;
+	if (y > INT32_MAX)
+		return INT32_MAX;
+	return (int32_t) y;
+}
+
+void fxp_mat3_identity(struct fxp_mat3 *m)
+{
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			m->m[i][j] = i == j ? FXP_ONE : 0;
+}
+
+/* Rotation in the plane of axes i and j, taking i towards j */
+static void plane_rotation(struct fxp_mat3 *m, int i, int j, fxp_angle a)
+{
+	int32_t c = fxp_cos(a), s = fxp_sin(a);
+
+	fxp_mat3_identity(m);
+	m->m[i][i] = c;
+	m->m[i][j] = -s;
+	m->m[j][i] = s;
+	m->m[j][j] = c;
+}
+
+void fxp_mat3_rotate_x(struct fxp_mat3 *m, fxp_angle a)
+{
+	plane_rotation(m, 1, 2, a);
+}
+
+void fxp_mat3_rotate_y(struct fxp_mat3 *m, fxp_angle a)
+{
+	plane_rotation(m, 2, 0, a);
+}
+
+void fxp_mat3_rotate_z(struct fxp_mat3 *m, fxp_angle a)
+{
+	plane_rotation(m, 0, 1, a);
+}
+
+static int32_t round_q16(int64_t v)
+{
+	return (int32_t) ((v + (1 << 15)) >> 16);
+}
+
+void fxp_mat3_mul(struct fxp_mat3 *out, const struct fxp_mat3 *a, const struct fxp_mat3 *b)
+{
+	struct fxp_mat3 r;
+
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			r.m[i][j] = round_q16((int64_t) a->m[i][0] * b->m[0][j] +
+					(int64_t) a->m[i][1] * b->m[1][j] +
+					(int64_t) a->m[i][2] * b->m[2][j]);
+	*out = r;
+}
+
+void fxp_mat3_transform(struct fxp_vec3 *out, const struct fxp_mat3 *m, const struct fxp_vec3 *v)
+{
+	struct fxp_vec3 r;
+
+	r.x = round_q16((int64_t) m->m[0][0] * v->x + (int64_t) m->m[0][1] * v->y + (int64_t) m->m[0][2] * v->z);
+	r.y = round_q16((int64_t) m->m[1][0] * v->x + (int64_t) m->m[1][1] * v->y + (int64_t) m->m[1][2] * v->z);
+	r.z = round_q16((int64_t) m->m[2][0] * v->x + (int64_t) m->m[2][1] * v->y + (int64_t) m->m[2][2] * v->z);
+	*out = r;
+}
+
+void fxp_quat_from_axis_angle(struct fxp_quat *q, const struct fxp_vec3 *axis, fxp_angle a)
+{
+	fxp_angle half = a >> 1;
+	int32_t s = fxp_sin(half);
+
+	q->w = fxp_cos(half);
+	q->x = fxp_mul(axis->x, s);
+	q->y = fxp_mul(axis->y, s);
+	q->z = fxp_mul(axis->z, s);
+}
+
+void fxp_quat_mul(struct fxp_quat *out, const struct fxp_quat *a, const struct fxp_quat *b)
+{
+	struct fxp_quat r;
+
+	r.w = round_q16((int64_t) a->w * b->w - (int64_t) a->x * b->x - (int64_t) a->y * b->y - (int64_t) a->z * b->z);
+	r.x = round_q16((int64_t) a->w * b->x + (int64_t) a->x * b->w + (int64_t) a->y * b->z - (int64_t) a->z * b->y);
+	r.y = round_q16((int64_t) a->w * b->y - (int64_t) a->x * b->z + (int64_t) a->y * b->w + (int64_t) a->z * b->x);
+	r.z = round_q16((int64_t) a->w * b->z + (int64_t) a->x * b->y - (int64_t) a->y * b->x + (int64_t) a->z * b->w);
+	*out = r;
+}
+
+void fxp_quat_normalize(struct fxp_quat *q)
+{
+	int32_t n = round_q16((int64_t) q->w * q->w + (int64_t) q->x * q->x +
+				(int64_t) q->y * q->y + (int64_t) q->z * q->z);
+	int32_t r;
+
+	if (n <= 0)
+		return;
+	r = fxp_rsqrt16(n);
+	q->w = fxp_mul(q->w, r);
+	q->x = fxp_mul(q->x, r);
+	q->y = fxp_mul(q->y, r);
+	q->z = fxp_mul(q->z, r);
+}
+
+void fxp_quat_to_mat3(struct fxp_mat3 *m, const struct fxp_quat *q)
+{
+	int64_t w = q->w, x = q->x, y = q->y, z = q->z;
+
+	m->m[0][0] = FXP_ONE - round_q16(2 * (y * y + z * z));
+	m->m[0][1] = round_q16(2 * (x * y - w * z));
+	m->m[0][2] = round_q16(2 * (x * z + w * y));
+	m->m[1][0] = round_q16(2 * (x * y + w * z));
+	m->m[1][1] = FXP_ONE - round_q16(2 * (x * x + z * z));
+	m->m[1][2] = round_q16(2 * (y * z - w * x));
+	m->m[2][0] = round_q16(2 * (x * z - w * y));
+	m->m[2][1] = round_q16(2 * (y * z + w * x));
+	m->m[2][2] = FXP_ONE - round_q16(2 * (x * x + y * y));
+}
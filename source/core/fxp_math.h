@@ -0,0 +1,111 @@
+#ifndef FXP_MATH_H__
+#define FXP_MATH_H__
+
+/*
+ * Fixed point math, finer grained than trig.h and fxp_sqrt.h.
+ *
+ * Numbers are Q16: int32_t with 16 bits to the right of the point, so 1.0 is
+ * 65536 and the range is about +/- 32767.  Angles are fxp_angle, a uint16_t
+ * where 65536 would be a full turn, so they wrap around for free:
+ *
+ *   angle 0       0 degrees
+ *   angle 16384   90 degrees
+ *   angle 32768   180 degrees
+ *   angle 49152   270 degrees
+ *
+ * Like trig.h, angles go counter-clockwise with y up.  A trig.h angle a
+ * (0 - 127) is FXP_ANGLE_FROM_TRIG(a), and fxp_sin() of it is 256 times
+ * as precise as sine(), so where you'd have done
+ *
+ *   vx = (v * cosine(a)) / 256;
+ *
+ * you do
+ *
+ *   vx = fxp_mul(v, fxp_cos(angle));
+ *
+ * with v in Q16 too, or (v * fxp_cos(angle)) >> 16 with v an int small
+ * enough not to overflow.
+ *
+ * sin and cos interpolate a 4096 step table and are good to about 1 part in
+ * 65536; fxp_atan2() is good to about 1 fxp_angle step (0.006 degrees).
+ * test_fxp_math checks all of this, and times it against trig.h.
+ */
+
+#include <stdint.h>
+
+typedef uint16_t fxp_angle;
+
+#define FXP_ONE (1 << 16)
+#define FXP_ANGLE_FROM_TRIG(a) ((fxp_angle) ((unsigned int) (a) << 9))
+#define FXP_DEGREES(d) ((fxp_angle) ((int32_t) ((d) * 65536.0 / 360.0)))
+
+/* Table sizes, for tools/fxp-math-tables.c which generates the tables */
+#define FXP_SINE_TABLE_SIZE 1024	/* entries per quarter turn */
+#define FXP_ATAN_POLY_TERMS 5
+
+struct fxp_vec3 {
+	int32_t x, y, z;
+};
+
+/* Row major: m[row][column] */
+struct fxp_mat3 {
+	int32_t m[3][3];
+};
+
+/* w + xi + yj + zk */
+struct fxp_quat {
+	int32_t w, x, y, z;
+};
+
+/* Q16 multiply, rounded */
+static inline int32_t fxp_mul(int32_t a, int32_t b)
+{
+	return (int32_t) (((int64_t) a * b + (1 << 15)) >> 16);
+}
+
+/* Q16 divide; b must not be 0 */
+static inline int32_t fxp_div(int32_t a, int32_t b)
+{
+	return (int32_t) (((int64_t) a << 16) / b);
+}
+
+/* Q16 sine and cosine, -65536 to 65536 */
+int32_t fxp_sin(fxp_angle a);
+int32_t fxp_cos(fxp_angle a);
+
+/* Angle of the vector (x, y), both in any one fixed point format.  0 for (0, 0). */
+fxp_angle fxp_atan2(int32_t y, int32_t x);
+
+/* Integer square root of x, rounded down */
+uint32_t fxp_isqrt(uint32_t x);
+
+/* Q16 square root, and reciprocal square root (which saturates at INT32_MAX); x must not be negative */
+int32_t fxp_sqrt16(int32_t x);
+int32_t fxp_rsqrt16(int32_t x);
+
+void fxp_mat3_identity(struct fxp_mat3 *m);
+
+/* Rotations about each axis, counter-clockwise looking down the axis towards the origin */
+void fxp_mat3_rotate_x(struct fxp_mat3 *m, fxp_angle a);
+void fxp_mat3_rotate_y(struct fxp_mat3 *m, fxp_angle a);
+void fxp_mat3_rotate_z(struct fxp_mat3 *m, fxp_angle a);
+
+/* out = a * b, so out applies b and then a.  out may be a or b. */
+void fxp_mat3_mul(struct fxp_mat3 *out, const struct fxp_mat3 *a, const struct fxp_mat3 *b);
+
+/* out = m * v.  v is in any fixed point format, and so is out. */
+void fxp_mat3_transform(struct fxp_vec3 *out, const struct fxp_mat3 *m, const struct fxp_vec3 *v);
+
+/* Rotation by a about axis, which must be a unit vector */
+void fxp_quat_from_axis_angle(struct fxp_quat *q, const struct fxp_vec3 *axis, fxp_angle a);
+
+/* out = a * b, so out rotates by b and then a.  out may be a or b. */
+void fxp_quat_mul(struct fxp_quat *out, const struct fxp_quat *a, const struct fxp_quat *b);
+
+/* Scale back to unit length; do this now and then, as repeated products drift */
+void fxp_quat_normalize(struct fxp_quat *q);
+
+/* The rotation matrix for unit quaternion q */
+void fxp_quat_to_mat3(struct fxp_mat3 *m, const struct fxp_quat *q);
+
+#endif
@@ -0,0 +1,345 @@
+#include "grid_path.h"
+
+#include <string.h>
+
+#define ORTHOGONAL_STEP 2
+#define DIAGONAL_STEP 3
+#define MAX_SCORE 0xfffe
+#define NOT_SEEN 0xffff
+
+struct grid_search {
+	const struct grid_path_map *map;
+	int goal_x, goal_y;
+	int flags;
+	uint16_t *gscore;
+	uint16_t *parent;
+	uint16_t *heap;
+	uint16_t *heap_pos;	/* NOT_SEEN, or where the cell is in heap[] */
+	uint8_t *closed;	/* one bit per cell */
+	int heap_size;
+};
+
+static int open_cell(const struct grid_search *s, int x, int y)
+{
+	const struct grid_path_map *m = s->map;
+
+	if (x < 0 || y < 0 || x >= m->width || y >= m->height)
+		return 0;
+	return m->cost[y * m->width + x] != GRID_PATH_WALL;
+}
+
+static int is_closed(const struct grid_search *s, int cell)
+{
+	return s->closed[cell >> 3] & (1 << (cell & 7));
+}
+
+/* Octile distance, admissible since cell costs are never negative */
+static int heuristic(const struct grid_search *s, int cell)
+{
+	int dx = cell % s->map->width - s->goal_x;
+	int dy = cell / s->map->width - s->goal_y;
+
+	if (dx < 0)
+		dx = -dx;
+	if (dy < 0)
+		dy = -dy;
+	if (!(s->flags & (GRID_PATH_8_CONNECTED | GRID_PATH_JUMP_POINTS)))
+		return ORTHOGONAL_STEP * (dx + dy);
+	if (dx > dy)
+		return ORTHOGONAL_STEP * dx + (DIAGONAL_STEP - ORTHOGONAL_STEP) * dy;
+	return ORTHOGONAL_STEP * dy + (DIAGONAL_STEP - ORTHOGONAL_STEP) * dx;
+}
+
+/* Lower f first, and on a tie the cell furthest along */
+static int heap_less(const struct grid_search *s, int a, int b)
+{
+	int fa = s->gscore[a] + heuristic(s, a);
+	int fb = s->gscore[b] + heuristic(s, b);
+
+	if (fa != fb)
+		return fa < fb;
+	return s->gscore[a] > s->gscore[b];
+}
+
+static void heap_set(struct grid_search *s, int pos, int cell)
+{
+	s->heap[pos] = cell;
+	s->heap_pos[cell] = pos;
+}
+
+static void heap_sift_up(struct grid_search *s, int pos)
+{
+	int cell = s->heap[pos];
+
+	while (pos > 0) {
+		int parent = (pos - 1) / 2;
+		if (!heap_less(s, cell, s->heap[parent]))
+			break;
+		heap_set(s, pos, s->heap[parent]);
+		pos = parent;
+	}
+	heap_set(s, pos, cell);
+}
+
+static void heap_sift_down(struct grid_search *s, int pos)
+{
+	int cell = s->heap[pos];
+
+	for (;;) {
+		int child = 2 * pos + 1;
+		if (child >= s->heap_size)
+			break;
+		if (child + 1 < s->heap_size && heap_less(s, s->heap[child + 1], s->heap[child]))
+			child++;
+		if (!heap_less(s, s->heap[child], cell))
+			break;
+		heap_set(s, pos, s->heap[child]);
+		pos = child;
+	}
+	heap_set(s, pos, cell);
+}
+
+static int heap_pop(struct grid_search *s)
+{
+	int cell = s->heap[0];
+
+	s->heap_size--;
+	if (s->heap_size > 0) {
+		s->heap[0] = s->heap[s->heap_size];
+		heap_sift_down(s, 0);
+	}
+	s->closed[cell >> 3] |= 1 << (cell & 7);
+	return cell;
+}
+
+/* Reached cell from parent, which is `steps` steps away in a straight or diagonal line */
+static void relax(struct grid_search *s, int parent, int cell, int steps, int diagonal)
+{
+	int g;
+
+	if (is_closed(s, cell))
+		return;
+	g = s->gscore[parent] + steps * ((diagonal ? DIAGONAL_STEP : ORTHOGONAL_STEP) + s->map->cost[cell]);
+	if (g > MAX_SCORE)
+		g = MAX_SCORE;
+	if (s->heap_pos[cell] != NOT_SEEN && g >= s->gscore[cell])
+		return;
+	s->gscore[cell] = g;
+	s->parent[cell] = parent;
+	if (s->heap_pos[cell] == NOT_SEEN) {
+		s->heap[s->heap_size] = cell;
+		s->heap_size++;
+		heap_sift_up(s, s->heap_size - 1);
+	} else {
+		heap_sift_up(s, s->heap_pos[cell]);
+	}
+}
+
+static const int8_t xo[] = { 0, 1, 0, -1, 1, 1, -1, -1 };
+static const int8_t yo[] = { -1, 0, 1, 0, -1, 1, 1, -1 };
+
+static void expand_neighbors(struct grid_search *s, int cell)
+{
+	int w = s->map->width;
+	int x = cell % w, y = cell / w;
+	int ndirs = (s->flags & GRID_PATH_8_CONNECTED) ? 8 : 4;
+
+	for (int i = 0; i < ndirs; i++) {
+		int nx = x + xo[i], ny = y + yo[i];
+		if (!open_cell(s, nx, ny))
+			continue;
+		if (i >= 4 && (!open_cell(s, nx, y) || !open_cell(s, x, ny)))
+			continue;
+		relax(s, cell, ny * w + nx, 1, i >= 4);
+	}
+}
+
+/*
+ * Jump point search, for the variant that doesn't cut corners.  Moving in a
+ * straight line, a cell is a jump point if a cell beside it is open and the
+ * one behind that is a wall, because a path may have to turn there.  Moving
+ * diagonally, a cell is a jump point if a straight jump along either of the
+ * diagonal's components finds one.  The goal is always a jump point.
+ *
+ * Returns the number of steps to the jump point, or 0 if there isn't one.
+ */
+static int jump_straight(const struct grid_search *s, int x, int y, int dx, int dy)
+{
+	int steps = 0;
+
+	for (;;) {
+		x += dx;
+		y += dy;
+		if (!open_cell(s, x, y))
+			return 0;
+		steps++;
+		if (x == s->goal_x && y == s->goal_y)
+			return steps;
+		if (dx) {
+			if ((open_cell(s, x, y - 1) && !open_cell(s, x - dx, y - 1)) ||
+			    (open_cell(s, x, y + 1) && !open_cell(s, x - dx, y + 1)))
+				return steps;
+		} else {
+			if ((open_cell(s, x - 1, y) && !open_cell(s, x - 1, y - dy)) ||
+			    (open_cell(s, x + 1, y) && !open_cell(s, x + 1, y - dy)))
+				return steps;
+		}
+	}
+}
+
+static int jump_diagonal(const struct grid_search *s, int x, int y, int dx, int dy)
+{
+	int steps = 0;
+
+	for (;;) {
+		if (!open_cell(s, x + dx, y) || !open_cell(s, x, y + dy))
+			return 0;
+		x += dx;
+		y += dy;
+		if (!open_cell(s, x, y))
+			return 0;
+		steps++;
+		if (x == s->goal_x && y == s->goal_y)
+			return steps;
+		if (jump_straight(s, x, y, dx, 0) || jump_straight(s, x, y, 0, dy))
+			return steps;
+	}
+}
+
+static int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+static void jump_from(struct grid_search *s, int cell, int dx, int dy)
+{
+	int w = s->map->width;
+	int x = cell % w, y = cell / w;
+	int steps;
+
+	if (dx && dy)
+		steps = jump_diagonal(s, x, y, dx, dy);
+	else
+		steps = jump_straight(s, x, y, dx, dy);
+	if (steps)
+		relax(s, cell, (y + dy * steps) * w + x + dx * steps, steps, dx && dy);
+}
+
+/* Only the directions a path arriving from the parent could need to continue in */
+static void expand_jump_points(struct grid_search *s, int cell, int parent)
+{
+	int w = s->map->width;
+	int x = cell % w, y = cell / w;
+	int dx, dy;
+
+	if (parent == cell) {
+		for (int i = 0; i < 8; i++)
+			jump_from(s, cell, xo[i], yo[i]);
+		return;
+	}
+	dx = sign(x - parent % w);
+	dy = sign(y - parent / w);
+
+	if (dx && dy) {
+		jump_from(s, cell, dx, 0);
+		jump_from(s, cell, 0, dy);
+		jump_from(s, cell, dx, dy);
+	} else if (dx) {
+		jump_from(s, cell, dx, 0);
+		if (open_cell(s, x, y - 1))
+			jump_from(s, cell, 0, -1);
+		if (open_cell(s, x, y + 1))
+			jump_from(s, cell, 0, 1);
+		/* jump_diagonal() turns these down if they'd cut a corner */
+		jump_from(s, cell, dx, -1);
+		jump_from(s, cell, dx, 1);
+	} else {
+		jump_from(s, cell, 0, dy);
+		if (open_cell(s, x - 1, y))
+			jump_from(s, cell, -1, 0);
+		if (open_cell(s, x + 1, y))
+			jump_from(s, cell, 1, 0);
+		jump_from(s, cell, -1, dy);
+		jump_from(s, cell, 1, dy);
+	}
+}
+
+static int line_steps(int w, int from, int to)
+{
+	int dx = to % w - from % w;
+	int dy = to / w - from / w;
+
+	if (dx < 0)
+		dx = -dx;
+	if (dy < 0)
+		dy = -dy;
+	return dx > dy ? dx : dy;
+}
+
+/* Fill in path[] from the parent links, which may skip several cells in a straight or diagonal line */
+static int build_path(const struct grid_search *s, int start, int goal, uint16_t *path, int max_path)
+{
+	int w = s->map->width;
+	int length = 1, pos;
+
+	for (int c = goal; c != start; c = s->parent[c])
+		length += line_steps(w, s->parent[c], c);
+
+	pos = length - 1;
+	for (int c = goal; c != start; c = s->parent[c]) {
+		int p = s->parent[c];
+		int dx = sign(p % w - c % w), dy = sign(p / w - c / w);
+
+		for (int cell = c; cell != p; cell += dy * w + dx) {
+			if (pos < max_path)
+				path[pos] = cell;
+			pos--;
+		}
+	}
+	if (max_path > 0)
+		path[0] = start;
+	return length;
+}
+
+int grid_path_find(const struct grid_path_map *map, uint16_t start, uint16_t goal, int flags,
+		void *working_space, uint16_t *path, int max_path)
+{
+	struct grid_search s;
+	int ncells = map->width * map->height;
+	int cell;
+
+	/* The start may be a wall, e.g. if something has been pushed into one, and can be left */
+	if (start >= ncells || goal >= ncells || map->cost[goal] == GRID_PATH_WALL)
+		return -1;
+	if (flags & GRID_PATH_JUMP_POINTS)
+		flags |= GRID_PATH_8_CONNECTED;
+
+	s.map = map;
+	s.goal_x = goal % map->width;
+	s.goal_y = goal / map->width;
+	s.flags = flags;
+	s.gscore = working_space;
+	s.parent = s.gscore + ncells;
+	s.heap = s.parent + ncells;
+	s.heap_pos = s.heap + ncells;
+	s.closed = (uint8_t *) (s.heap_pos + ncells);
+	s.heap_size = 0;
+	memset(s.heap_pos, 0xff, ncells * sizeof(uint16_t));
+	memset(s.closed, 0, (ncells + 7) / 8);
+
+	s.gscore[start] = 0;
+	s.parent[start] = start;
+	heap_set(&s, 0, start);
+	s.heap_size = 1;
+
+	while (s.heap_size > 0) {
+		cell = heap_pop(&s);
+		if (cell == goal)
+			return build_path(&s, start, goal, path, max_path);
+		if (flags & GRID_PATH_JUMP_POINTS)
+			expand_jump_points(&s, cell, s.parent[cell]);
+		else
+			expand_neighbors(&s, cell);
+	}
+	return -1;
+}
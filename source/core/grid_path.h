@@ -0,0 +1,64 @@
+#ifndef GRID_PATH_H__
+#define GRID_PATH_H__
+
+/*
+ * Path finding on a 2D grid of cells, for when the general purpose a_star()
+ * is more than is needed.  Cells are numbered y * width + x and held in
+ * uint16_t, so a grid can have up to 65535 cells.  The map is an array of
+ * uint8_t costs, one per cell:
+ *
+ *   GRID_PATH_WALL    the cell can't be entered
+ *   anything else     added to the cost of each step into the cell
+ *
+ * A step costs 2 orthogonally or 3 diagonally, plus the cost of the cell
+ * entered.  Diagonal steps are only allowed if both of the cells they pass
+ * between are open, so paths never cut the corner of a wall.
+ *
+ * Working memory is about 8 bytes per cell (A_STAR_INDEXED_WORKSPACE_SIZE is
+ * 24 to 28, and the original a_star() working space 56 to 64).  Path costs
+ * are kept in 16 bits and saturate, so costs along a path should stay well
+ * under 65535.
+ */
+
+#include <stdint.h>
+
+#define GRID_PATH_WALL 255
+
+/* Flags for grid_path_find() */
+#define GRID_PATH_8_CONNECTED (1 << 0)	/* allow diagonal steps */
+#define GRID_PATH_JUMP_POINTS (1 << 1)	/* jump point search, see below; implies 8 connected */
+
+#define GRID_PATH_WORKSPACE_SIZE(ncells) (4 * sizeof(uint16_t) * (ncells) + ((ncells) + 7) / 8)
+
+struct grid_path_map {
+	const uint8_t *cost;
+	int width, height;
+};
+
+/**
+ *
+ * grid_path_find - find the cheapest path between two cells
+ *
+ * @map: the grid
+ * @start, @goal: cell indices
+ * @flags: GRID_PATH_* flags
+ *
+ * @working_space: at least GRID_PATH_WORKSPACE_SIZE(width * height) bytes,
+ *		   aligned for a uint16_t.
+ *
+ * @path: filled in with the cells along the path, start and goal included.
+ *	  At most max_path of them are written, from the start end.
+ *
+ * Jump point search (Harabor and Grastien, 2011) finds the same cost of path
+ * as plain A*, while only putting a handful of cells on the open list, but
+ * it is only valid when every open cell has the same cost, as in a grid of
+ * just 0 and GRID_PATH_WALL.
+ *
+ * Returns:
+ *   the number of cells in the whole path, which may be more than max_path,
+ *   or -1 if there is no path.
+ */
+int grid_path_find(const struct grid_path_map *map, uint16_t start, uint16_t goal, int flags,
+		void *working_space, uint16_t *path, int max_path);
+
+#endif
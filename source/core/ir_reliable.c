@@ -0,0 +1,331 @@
+/*
+ * Reliable IR request/response messaging. See ir_reliable.h.
+ *
+ * Wire format, in the data bytes of an IR message:
+ *
+ *   byte 0:   0xB0 magic in the high nibble, then type (2 bits) and the targeted flag
+ *   byte 1:   message ID, chosen by the sender
+ *   byte 2-3: peer address, big endian. For DATA this is the sender; for ACK and NACK it is
+ *             the badge whose message is being answered.
+ *   byte 4-5: DATA only, and only if the targeted flag is set: the intended recipient.
+ *
+ * followed by the payload for DATA. Headers are kept short since every byte is one NEC
+ * frame, a little over 100 ms on the air.
+ */
+
+#include <string.h>
+
+#include "ir_reliable.h"
+#include "badge.h"
+#include "init.h"
+#include "rtc.h"
+
+#define MAGIC_MASK 0xF0
+#define MAGIC 0xB0
+#define TYPE_SHIFT 2
+#define TYPE_MASK (0x3 << TYPE_SHIFT)
+#define TYPE_DATA (1 << TYPE_SHIFT)
+#define TYPE_ACK (2 << TYPE_SHIFT)
+#define TYPE_NACK (3 << TYPE_SHIFT)
+#define FLAG_TARGETED 0x02
+
+#define HEADER_LENGTH 4
+#define TARGETED_HEADER_LENGTH 6
+
+/* Air time of one IR message byte (one NEC frame period), used to size the retransmit timer. */
+#define FRAME_MS 108
+#define RTO_MARGIN_MS 300
+#define MAX_RETRIES 4
+
+#define RX_QUEUE_SIZE 6
+#define DEDUP_HISTORY 8
+
+struct outstanding_send {
+    bool in_use;
+    uint8_t app_id;
+    uint8_t msg_id;
+    uint8_t length;
+    uint8_t retries;
+    uint32_t deadline_ms;
+    uint32_t rto_ms;
+    ir_reliable_done_callback done_cb;
+    void *cookie;
+    uint8_t message[MAX_IR_MESSAGE_SIZE];
+};
+
+struct received_message {
+    uint8_t app_id;
+    uint8_t length;
+    uint8_t data[MAX_IR_MESSAGE_SIZE];
+};
+
+struct seen_message {
+    uint16_t from;
+    uint8_t app_id;
+    uint8_t msg_id;
+    bool valid;
+};
+
+static ir_reliable_rx_callback rx_callback[IR_MAX_ID];
+static uint8_t next_msg_id[IR_MAX_ID];
+static struct outstanding_send outstanding[IR_RELIABLE_MAX_OUTSTANDING];
+
+/* Filled from the IR interrupt, drained by ir_reliable_poll() */
+static struct received_message rx_queue[RX_QUEUE_SIZE];
+static volatile int rx_queue_in;
+static volatile int rx_queue_out;
+
+static struct seen_message seen[DEDUP_HISTORY];
+static int seen_next;
+
+uint16_t ir_reliable_address(void)
+{
+    uint16_t address = (uint16_t) badge_system_data()->badgeId;
+    /* 0 means "any peer", so make sure nobody actually has it */
+    return address ? address : 1;
+}
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t) rtc_get_ms_since_boot();
+}
+
+static bool time_reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t) (now - deadline) >= 0;
+}
+
+/* This is called in interrupt context (or from the IR thread in the simulator). */
+static void ir_reliable_ir_callback(const IR_DATA *data)
+{
+    if (data->data_length < HEADER_LENGTH || (data->data[0] & MAGIC_MASK) != MAGIC)
+        return;
+
+    int next_in = (rx_queue_in + 1) % RX_QUEUE_SIZE;
+    if (next_in == rx_queue_out)
+        return; /* queue full, the sender will retransmit */
+
+    rx_queue[rx_queue_in].app_id = data->app_address;
+    rx_queue[rx_queue_in].length = data->data_length;
+    memcpy(rx_queue[rx_queue_in].data, data->data, data->data_length);
+    rx_queue_in = next_in;
+}
+
+bool ir_reliable_open(IR_APP_ID app_id, ir_reliable_rx_callback rx_cb)
+{
+    if (app_id >= IR_MAX_ID)
+        return false;
+    if (!ir_add_callback(ir_reliable_ir_callback, app_id))
+        return false;
+    rx_callback[app_id] = rx_cb;
+    return true;
+}
+
+static void complete(struct outstanding_send *s, IR_RELIABLE_STATUS status)
+{
+    s->in_use = false;
+    if (s->done_cb)
+        s->done_cb(s->msg_id, status, s->cookie);
+}
+
+void ir_reliable_close(IR_APP_ID app_id)
+{
+    if (app_id >= IR_MAX_ID)
+        return;
+    ir_remove_callback(ir_reliable_ir_callback, app_id);
+    rx_callback[app_id] = NULL;
+    for (int i = 0; i < IR_RELIABLE_MAX_OUTSTANDING; i++)
+        if (outstanding[i].in_use && outstanding[i].app_id == app_id)
+            complete(&outstanding[i], IR_RELIABLE_CANCELLED);
+}
+
+static void send_raw(uint8_t app_id, const uint8_t *message, uint8_t length)
+{
+    IR_DATA ir_packet = {
+        .recipient_address = IR_BADGE_ID_BROADCAST,
+        .app_address = app_id,
+        .data_length = length,
+        .data = (uint8_t *) message,
+    };
+    ir_send_complete_message(&ir_packet);
+}
+
+static void send_reply(uint8_t app_id, uint8_t type, uint8_t msg_id, uint16_t to)
+{
+    uint8_t reply[HEADER_LENGTH] = { MAGIC | type, msg_id, to >> 8, to & 0xff };
+    send_raw(app_id, reply, sizeof(reply));
+}
+
+int ir_reliable_send(IR_APP_ID app_id, uint16_t to, const uint8_t *data, uint8_t length,
+                     ir_reliable_done_callback done_cb, void *cookie)
+{
+    if (app_id >= IR_MAX_ID || !rx_callback[app_id] || length > IR_RELIABLE_MAX_PAYLOAD)
+        return -1;
+
+    struct outstanding_send *s = NULL;
+    for (int i = 0; i < IR_RELIABLE_MAX_OUTSTANDING; i++) {
+        if (!outstanding[i].in_use) {
+            s = &outstanding[i];
+            break;
+        }
+    }
+    if (!s)
+        return -1;
+
+    uint16_t from = ir_reliable_address();
+    uint8_t header_length = to == IR_RELIABLE_ANY_PEER ? HEADER_LENGTH : TARGETED_HEADER_LENGTH;
+
+    s->app_id = app_id;
+    s->msg_id = next_msg_id[app_id]++;
+    s->retries = 0;
+    s->done_cb = done_cb;
+    s->cookie = cookie;
+    s->message[0] = MAGIC | TYPE_DATA | (to == IR_RELIABLE_ANY_PEER ? 0 : FLAG_TARGETED);
+    s->message[1] = s->msg_id;
+    s->message[2] = from >> 8;
+    s->message[3] = from & 0xff;
+    s->message[4] = to >> 8;
+    s->message[5] = to & 0xff;
+    memcpy(&s->message[header_length], data, length);
+    s->length = header_length + length;
+    /* Long enough for the message and the ACK to go out, plus a couple of backoff slots. */
+    s->rto_ms = (s->length + 1 + HEADER_LENGTH + 1) * FRAME_MS + RTO_MARGIN_MS;
+    s->in_use = true;
+
+    send_raw(app_id, s->message, s->length);
+    s->deadline_ms = now_ms() + s->rto_ms;
+    return s->msg_id;
+}
+
+bool ir_reliable_busy(IR_APP_ID app_id)
+{
+    for (int i = 0; i < IR_RELIABLE_MAX_OUTSTANDING; i++)
+        if (outstanding[i].in_use && outstanding[i].app_id == app_id)
+            return true;
+    return false;
+}
+
+static struct outstanding_send *find_outstanding(uint8_t app_id, uint8_t msg_id)
+{
+    for (int i = 0; i < IR_RELIABLE_MAX_OUTSTANDING; i++)
+        if (outstanding[i].in_use && outstanding[i].app_id == app_id && outstanding[i].msg_id == msg_id)
+            return &outstanding[i];
+    return NULL;
+}
+
+static bool already_seen(uint8_t app_id, uint16_t from, uint8_t msg_id)
+{
+    for (int i = 0; i < DEDUP_HISTORY; i++)
+        if (seen[i].valid && seen[i].app_id == app_id && seen[i].from == from && seen[i].msg_id == msg_id)
+            return true;
+    return false;
+}
+
+static void remember_seen(uint8_t app_id, uint16_t from, uint8_t msg_id)
+{
+    seen[seen_next].valid = true;
+    seen[seen_next].app_id = app_id;
+    seen[seen_next].from = from;
+    seen[seen_next].msg_id = msg_id;
+    seen_next = (seen_next + 1) % DEDUP_HISTORY;
+}
+
+static void handle_reply(const struct received_message *m, uint8_t type)
+{
+    uint16_t me = ir_reliable_address();
+    uint16_t answered = (m->data[2] << 8) | m->data[3];
+    struct outstanding_send *s;
+
+    if (answered != me)
+        return; /* somebody else's conversation */
+    s = find_outstanding(m->app_id, m->data[1]);
+    if (!s)
+        return; /* a late duplicate ACK */
+
+    if (type == TYPE_ACK) {
+        complete(s, IR_RELIABLE_OK);
+    } else {
+        /* Receiver is busy; give it a full timeout before trying again. That still
+         * counts as an attempt, so a receiver that stays busy ends in a timeout. */
+        s->retries++;
+        s->deadline_ms = now_ms() + s->rto_ms;
+    }
+}
+
+static void handle_data(const struct received_message *m)
+{
+    uint16_t me = ir_reliable_address();
+    uint16_t from = (m->data[2] << 8) | m->data[3];
+    uint8_t msg_id = m->data[1];
+    uint8_t header_length = HEADER_LENGTH;
+
+    if (m->data[0] & FLAG_TARGETED) {
+        if (m->length < TARGETED_HEADER_LENGTH)
+            return;
+        if (((m->data[4] << 8) | m->data[5]) != me)
+            return;
+        header_length = TARGETED_HEADER_LENGTH;
+    }
+    if (from == me || !rx_callback[m->app_id])
+        return;
+
+    if (already_seen(m->app_id, from, msg_id)) {
+        /* Our ACK got lost; answer again but don't deliver twice. */
+        send_reply(m->app_id, TYPE_ACK, msg_id, from);
+        return;
+    }
+    if (rx_callback[m->app_id](from, &m->data[header_length], m->length - header_length)) {
+        remember_seen(m->app_id, from, msg_id);
+        send_reply(m->app_id, TYPE_ACK, msg_id, from);
+    } else {
+        send_reply(m->app_id, TYPE_NACK, msg_id, from);
+    }
+}
+
+static void process_received(void)
+{
+    struct received_message m;
+    uint32_t interrupt_state = hal_disable_interrupts();
+
+    while (rx_queue_out != rx_queue_in) {
+        m = rx_queue[rx_queue_out];
+        rx_queue_out = (rx_queue_out + 1) % RX_QUEUE_SIZE;
+        hal_restore_interrupts(interrupt_state);
+
+        if (m.app_id < IR_MAX_ID) {
+            uint8_t type = m.data[0] & TYPE_MASK;
+            if (type == TYPE_DATA)
+                handle_data(&m);
+            else if (type == TYPE_ACK || type == TYPE_NACK)
+                handle_reply(&m, type);
+        }
+        interrupt_state = hal_disable_interrupts();
+    }
+    hal_restore_interrupts(interrupt_state);
+}
+
+static void process_timers(void)
+{
+    uint32_t now = now_ms();
+
+    for (int i = 0; i < IR_RELIABLE_MAX_OUTSTANDING; i++) {
+        struct outstanding_send *s = &outstanding[i];
+        if (!s->in_use || !time_reached(now, s->deadline_ms))
+            continue;
+        if (s->retries >= MAX_RETRIES) {
+            complete(s, IR_RELIABLE_TIMEOUT);
+            continue;
+        }
+        s->retries++;
+        s->rto_ms *= 2;
+        send_raw(s->app_id, s->message, s->length);
+        now = now_ms();
+        s->deadline_ms = now + s->rto_ms;
+    }
+}
+
+void ir_reliable_poll(void)
+{
+    process_received();
+    process_timers();
+}
@@ -0,0 +1,80 @@
+/*
+ * Acknowledged request/response messaging on top of the IR HAL.
+ *
+ * Plain IR messages are fire-and-forget, so apps end up rebroadcasting
+ * the same message every few frames until the user gives up. This module
+ * adds message IDs, ACK/NACK replies, retransmission with exponential
+ * backoff and duplicate suppression, so a message is sent until a receiver
+ * has taken it and then stops.  A message for one peer is only taken by
+ * that badge; one for IR_RELIABLE_ANY_PEER is taken by every badge that
+ * hears it, and the sender stops at the first ACK, so it says that someone
+ * has it, not that only one badge does.
+ *
+ * Everything runs from ir_reliable_poll(), which the app calls once per
+ * frame; received messages and completion callbacks are delivered from
+ * there, never from interrupt context.
+ *
+ * An app that opens a reliable session owns its IR app ID: plain messages
+ * sent to that ID are ignored.
+ */
+
+#ifndef BADGE_C_IR_RELIABLE_H
+#define BADGE_C_IR_RELIABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ir.h"
+
+/* Taken by every badge that hears it; the first ACK completes the send. */
+#define IR_RELIABLE_ANY_PEER (0)
+
+/* Largest payload; the rest of the IR message carries the reliable header. */
+#define IR_RELIABLE_MAX_PAYLOAD (MAX_IR_MESSAGE_SIZE - 6)
+
+/* Number of messages that can be waiting for an ACK at once, over all apps. */
+#define IR_RELIABLE_MAX_OUTSTANDING (4)
+
+typedef enum {
+    IR_RELIABLE_OK = 0,    /* A peer acknowledged the message. */
+    IR_RELIABLE_TIMEOUT,   /* No ACK after all retransmissions, or the peer kept NACKing it. */
+    IR_RELIABLE_CANCELLED, /* The session was closed before the message completed. */
+} IR_RELIABLE_STATUS;
+
+/*
+ * Called when a received message is delivered, with the address of the badge
+ * that sent it.  Return true to accept (and ACK) the message, or false to
+ * NACK it as busy, in which case the sender retries later.
+ */
+typedef bool (*ir_reliable_rx_callback)(uint16_t from, const uint8_t *data, uint8_t length);
+
+/* Called once a message sent with ir_reliable_send() has completed. */
+typedef void (*ir_reliable_done_callback)(uint8_t msg_id, IR_RELIABLE_STATUS status, void *cookie);
+
+/* Start a reliable session on app_id. Returns false if the IR HAL has no room for another handler. */
+bool ir_reliable_open(IR_APP_ID app_id, ir_reliable_rx_callback rx_cb);
+
+/* End the session on app_id. Outstanding sends complete with IR_RELIABLE_CANCELLED. */
+void ir_reliable_close(IR_APP_ID app_id);
+
+/*
+ * Queue a message for reliable delivery to the badge at address to, or to
+ * IR_RELIABLE_ANY_PEER.  The first transmission happens right away;
+ * retransmissions happen from ir_reliable_poll().  data is copied.
+ *
+ * Returns the message ID, or -1 if the session isn't open, the payload is
+ * too long or IR_RELIABLE_MAX_OUTSTANDING sends are already pending.
+ */
+int ir_reliable_send(IR_APP_ID app_id, uint16_t to, const uint8_t *data, uint8_t length,
+                     ir_reliable_done_callback done_cb, void *cookie);
+
+/* Whether any send on app_id is still waiting for an ACK. */
+bool ir_reliable_busy(IR_APP_ID app_id);
+
+/* Process received messages, ACKs and retransmission timers. Call once per frame. */
+void ir_reliable_poll(void);
+
+/* This badge's reliable-session address. */
+uint16_t ir_reliable_address(void);
+
+#endif //BADGE_C_IR_RELIABLE_H
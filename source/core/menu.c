@@ -3,6 +3,7 @@
    Author: Paul Bruggeman
    paul@Killercats.com
 */
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "menu.h"
@@ -36,6 +37,8 @@
 #include "rvasec_splash.h"
 #include "test-screensavers.h"
 #include "tank-vs-tank.h"
+#include "scheduler.h"
+#include "display_power.h"
 
 #define MAIN_MENU_BKG_COLOR GREY2
 
@@ -181,6 +184,174 @@ static void maybe_scroll_to(struct menu_t *selected, struct menu_t *current_menu
 		menu_scroll_start_item = position - MENU_MAX_ITEMS_DISPLAYABLE + 1;
 }
 
+/* Each item of a menu drawn one item a row takes this many rows, from the top of its text to the next item's */
+#define MENU_ROW_HEIGHT (CHAR_HEIGHT + 2 * SCAN_BLANK)
+#define MENU_TOP 2
+
+/*
+ * What display_menu() last put on the screen.  While it's still there and
+ * nothing else has drawn since, moving the cursor only needs the two items it
+ * moved between redrawn, and scrolling only needs the rows moved up or down
+ * and the items scrolled into view drawn; and then only the rows that changed
+ * sent to the display, instead of the whole screen.
+ */
+static struct {
+	struct menu_t *menu;
+	struct menu_t *selected;
+	int scroll_start;
+	MENU_STYLE style;
+	unsigned short background;
+	unsigned short *buffer;
+	unsigned short pushes;
+	bool valid;
+} drawn;
+
+/* Where the text of a menu drawn one item a row goes: a row below this */
+static unsigned char item_y(int row)
+{
+	return MENU_TOP + MENU_ROW_HEIGHT * (row + 1);
+}
+
+static void draw_item(struct menu_t *item, bool selected, MENU_STYLE style, unsigned char x, unsigned char y)
+{
+	switch (style) {
+	case MAIN_MENU_STYLE:
+		if (selected) {
+			FbColor(YELLOW);
+
+			FbMove(3, y + 1);
+			FbFilledRectangle(2, 8);
+
+			// Set the selected color for the coming writeline
+			FbColor(GREEN);
+		} else {
+			// unselected writeline color
+			FbColor(GREY16);
+		}
+		break;
+	case WHITE_ON_BLACK:
+		FbColor(selected ? GREEN : WHITE);
+		break;
+	case BLANK:
+	default:
+		break;
+	}
+
+	FbMove(x + 1, y + 1);
+	FbWriteLine(item->name);
+}
+
+/* Clear a row, inside the border if there is one */
+static void erase_row(int row)
+{
+	if (drawn.style == MAIN_MENU_STYLE) {
+		FbMove(3, item_y(row) + 1);
+		FbColor(drawn.background);
+		FbFilledRectangle(LCD_XSIZE - 7, MENU_ROW_HEIGHT);
+	} else {
+		FbMove(0, item_y(row) + 1);
+		FbColor(drawn.background);
+		FbFilledRectangle(LCD_XSIZE, MENU_ROW_HEIGHT);
+	}
+}
+
+/* The items on the screen from scroll_start on, the same ones display_menu() draws; returns how many */
+static int visible_items(struct menu_t *menu, int scroll_start, struct menu_t *item[])
+{
+	int n = 0, number = 0;
+
+	while (n < MENU_MAX_ITEMS_DISPLAYABLE) {
+		if (!(menu->attrib & HIDDEN_ITEM)) {
+			if (number >= scroll_start)
+				item[n++] = menu;
+			number++;
+		}
+		if (menu->attrib & LAST_ITEM)
+			break;
+		menu++;
+	}
+	return n;
+}
+
+static int row_of(struct menu_t *item[], int n, struct menu_t *menu)
+{
+	for (int i = 0; i < n; i++)
+		if (item[i] == menu)
+			return i;
+	return -1;
+}
+
+/*
+ * Bring the screen up to date from what display_menu() last drew, if that's
+ * still there and the menu is one item a row.  Returns false if the whole
+ * menu needs drawing.
+ */
+static bool update_menu(struct menu_t *menu, struct menu_t *selected, MENU_STYLE style)
+{
+	struct menu_t *item[MENU_MAX_ITEMS_DISPLAYABLE];
+	int n, shift, row, old_row;
+
+	if (!drawn.valid || menu != drawn.menu || style != drawn.style)
+		return false;
+	if (G_Fb.buffer != drawn.buffer || G_Fb.pushes != drawn.pushes || G_Fb.changed)
+		return false; /* someone else has drawn since */
+	if (!selected || (selected->attrib & (SKIP_ITEM | HIDDEN_ITEM)))
+		return false; /* leave finding the item to select to display_menu() */
+	shift = menu_scroll_start_item - drawn.scroll_start;
+	if (shift >= MENU_MAX_ITEMS_DISPLAYABLE || shift <= -MENU_MAX_ITEMS_DISPLAYABLE)
+		return false;
+	if (shift == 0 && selected == drawn.selected)
+		return false; /* asked to draw it again as it was, so something else about it has changed, e.g. a name */
+
+	n = visible_items(menu, menu_scroll_start_item, item);
+	for (int i = 0; i < n; i++)
+		if (!(item[i]->attrib & VERT_ITEM) || (item[i]->attrib & HORIZ_ITEM))
+			return false;
+	row = row_of(item, n, selected);
+	if (row < 0)
+		return false;
+
+	if (style == MAIN_MENU_STYLE) {
+		FbBackgroundColor(MAIN_MENU_BKG_COLOR);
+	} else {
+		FbBackgroundColor(BLACK);
+		FbTransparentIndex(0);
+	}
+
+	if (shift) {
+		int first = shift > 0 ? MENU_MAX_ITEMS_DISPLAYABLE - shift : 0;
+		int last = shift > 0 ? MENU_MAX_ITEMS_DISPLAYABLE : -shift;
+
+		FbScrollRows(item_y(0) + 1, MENU_MAX_ITEMS_DISPLAYABLE * MENU_ROW_HEIGHT, -shift * MENU_ROW_HEIGHT);
+		for (int i = first; i < last; i++) {
+			erase_row(i);
+			if (i < n)
+				draw_item(item[i], item[i] == selected, style, MENU_LEFT, item_y(i));
+		}
+	}
+
+	old_row = row_of(item, n, drawn.selected);
+	if (old_row >= 0 && old_row != row) {
+		erase_row(old_row);
+		draw_item(item[old_row], false, style, MENU_LEFT, item_y(old_row));
+	}
+	erase_row(row);
+	draw_item(selected, true, style, MENU_LEFT, item_y(row));
+
+	if (shift) {
+		FbPushRows(item_y(0) + 1, MENU_MAX_ITEMS_DISPLAYABLE * MENU_ROW_HEIGHT);
+	} else {
+		if (old_row >= 0 && old_row != row)
+			FbPushRows(item_y(old_row) + 1, MENU_ROW_HEIGHT);
+		FbPushRows(item_y(row) + 1, MENU_ROW_HEIGHT);
+	}
+
+	drawn.selected = selected;
+	drawn.scroll_start = menu_scroll_start_item;
+	drawn.pushes = G_Fb.pushes;
+	return true;
+}
+
 /* The reason that display_menu returns a menu_t * instead of void
    as you might expect is because sometimes it skips over unselectable
    items
@@ -193,11 +364,16 @@ struct menu_t *display_menu(struct menu_t *menu,
     struct menu_t *root_menu; /* keep a copy in case menu has a bad structure */
     int menu_item_number = 0;
 
+    if (update_menu(menu, selected, style))
+        return selected;
+
     root_menu = menu;
+    drawn.background = G_Fb.BGcolor;
 
     switch (style) {
         case MAIN_MENU_STYLE:
             FbBackgroundColor(MAIN_MENU_BKG_COLOR);
+            drawn.background = MAIN_MENU_BKG_COLOR;
             FbClear();
 
             FbColor(GREEN);
@@ -222,7 +398,7 @@ struct menu_t *display_menu(struct menu_t *menu,
 
     cursor_x = MENU_LEFT;
     //cursor_y = CHAR_HEIGHT;
-    cursor_y = 2; // CHAR_HEIGHT;
+    cursor_y = MENU_TOP; // CHAR_HEIGHT;
     FbMove(cursor_x, cursor_y);
 
     while (1) {
@@ -257,7 +433,7 @@ struct menu_t *display_menu(struct menu_t *menu,
 	}
 
         if (menu->attrib & VERT_ITEM) {
-            cursor_y += (CHAR_HEIGHT + 2 * SCAN_BLANK);
+            cursor_y += MENU_ROW_HEIGHT;
         }
 
         if (!(menu->attrib & HORIZ_ITEM)) {
@@ -275,32 +451,7 @@ struct menu_t *display_menu(struct menu_t *menu,
             selected = menu;
         }
 
-        // Determine selected item color
-        switch(style) {
-            case MAIN_MENU_STYLE:
-                if (menu == selected) {
-                    FbColor(YELLOW);
-
-                    FbMove(3, cursor_y + 1);
-                    FbFilledRectangle(2, 8);
-
-                    // Set the selected color for the coming writeline
-                    FbColor(GREEN);
-                } else {
-                    // unselected writeline color
-                    FbColor(GREY16);
-                }
-                break;
-            case WHITE_ON_BLACK:
-                FbColor((menu == selected) ? GREEN : WHITE);
-                break;
-            case BLANK:
-            default:
-                break;
-        }
-
-        FbMove(cursor_x+1, cursor_y+1);
-        FbWriteLine(menu->name);
+        draw_item(menu, menu == selected, style, cursor_x, cursor_y);
         cursor_x += (rect_w + CHAR_WIDTH);
         if (menu->attrib & LAST_ITEM) break;
         menu++;
@@ -316,6 +467,15 @@ struct menu_t *display_menu(struct menu_t *menu,
 
     // Write menu onto the screen
     FbPushBuffer();
+
+    drawn.menu = root_menu;
+    drawn.selected = selected;
+    drawn.scroll_start = menu_scroll_start_item;
+    drawn.style = style;
+    drawn.buffer = G_Fb.buffer;
+    drawn.pushes = G_Fb.pushes;
+    /* BLANK menus are drawn over whatever's there, so there's nothing to erase rows back to */
+    drawn.valid = (style == MAIN_MENU_STYLE || style == WHITE_ON_BLACK);
     return selected;
 }
 
@@ -352,8 +512,12 @@ void closeMenuAndReturn(void) {
     G_menuCnt--;
     G_currMenu = G_menuStack[G_menuCnt].currMenu ;
     G_selectedMenu = G_menuStack[G_menuCnt].selectedMenu ;
+    drawn.valid = false; /* the app may have changed anything, even the display mode, without drawing */
+    FbDirectMode();
     G_selectedMenu = display_menu(G_currMenu, G_selectedMenu, MAIN_MENU_STYLE);
     runningApp = NULL;
+    scheduler_set_frame_rate(SCHEDULER_DEFAULT_FPS);
+    scheduler_set_frame_owner("menus");
 }
 
 /*
@@ -362,8 +526,10 @@ void closeMenuAndReturn(void) {
      code will execute up the the fuction return()
 */
 void returnToMenus() {
-    /* Clear any stray buttons left over from the app */
+    /* Clear any stray buttons and encoder turns left over from the app */
     (void) button_down_latches();
+    (void) button_get_rotation(0);
+    (void) button_get_rotation(1);
 
     if (G_currMenu == NULL) {
         G_currMenu = (struct menu_t *) main_m;
@@ -372,19 +538,39 @@ void returnToMenus() {
         G_menuStack[G_menuCnt].selectedMenu = G_selectedMenu;
     }
 
+    drawn.valid = false; /* the app may have changed anything, even the display mode, without drawing */
+    FbDirectMode();
     G_selectedMenu = display_menu(G_currMenu, G_selectedMenu, MAIN_MENU_STYLE);
     runningApp = NULL;
+    scheduler_set_frame_rate(SCHEDULER_DEFAULT_FPS);
+    scheduler_set_frame_owner("menus");
 }
 
 static char *menu_item_description = NULL;
+static bool menu_item_description_drawn;
+
+/* How many rows of the screen a description takes, at 8 a line */
+static int description_rows(const char *description)
+{
+	int lines = 1;
+
+	for (const char *c = description; *c; c++)
+		if (*c == '\n')
+			lines++;
+	return lines * 8 < LCD_YSIZE ? lines * 8 : LCD_YSIZE;
+}
+
 static void display_menu_item_description(__attribute__((unused)) struct menu_t *item)
 {
-	FbColor(CYAN);
-	FbBackgroundColor(BLACK);
-	FbClear();
-	FbMove(0, 0);
-	FbWriteString(menu_item_description);
-	FbSwapBuffers();
+	if (!menu_item_description_drawn) {
+		FbColor(CYAN);
+		FbBackgroundColor(BLACK);
+		FbClear();
+		FbMove(0, 0);
+		FbWriteString(menu_item_description);
+		FbSwapBuffers();
+		menu_item_description_drawn = true;
+	}
 
 	int r0 = button_get_rotation(0);
 	int r1 = button_get_rotation(1);
@@ -458,12 +644,17 @@ void menus() {
             case FUNCTION: /* call the function pointer if clicked */
                 menu_beep(FUNC_FREQ); /* e */
                 runningApp = G_selectedMenu->data.func;
+                scheduler_set_frame_owner(G_selectedMenu->name);
                 break;
 
 	    case ITEM_DESC:
 		menu_beep(TEXT_FREQ);
 		menu_item_description = G_selectedMenu->data.description;
+		menu_item_description_drawn = false;
 		runningApp = display_menu_item_description;
+		/* The description doesn't change: it only needs frames for the buttons, and only its rows of the screen */
+		scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+		display_power_set_rows(0, description_rows(menu_item_description));
 		break;
 
             default:
@@ -1,46 +1,260 @@
-#include <stdio.h>
+#include <stddef.h>
 
 #include "music.h"
 #include "audio.h"
 
-static struct tune *current_tune;
-static int current_note = 0;
-static void (*finish_callback)(void) = NULL;
-static int stop_the_music = 0;
+/*
+ * The sequencer runs on the mixer's clock, so each tick happens at an exact
+ * sample however late the audio interrupt runs, and a tune takes exactly as
+ * many samples as its ticks add up to.  Channel n plays on voice
+ * TUNE_FIRST_VOICE + n, which is kept from sound effects while the tune plays.
+ *
+ * The mixer may run on another thread (in the simulator), so everything about
+ * the tune being played belongs to the clock: play_tune() leaves the tune in
+ * next_tune for start_tick() to set up, and stop_tune() only stops the clock
+ * and the voices.  current_tune is what the app asked for, and is all the two
+ * share.
+ */
 
-static void next_note(void)
+#define TUNE_FIRST_VOICE (AUDIO_VOICES - TUNE_MAX_CHANNELS)
+#define TUNE_REPEAT_DEPTH 2
+
+struct channel {
+	const uint8_t *pos;
+	const uint8_t *loop;
+	uint8_t length;		/* of notes and rests, in ticks */
+	uint8_t instrument;
+	uint8_t wait;		/* ticks until the next note or rest */
+	bool ended;
+	int depth;
+	struct {
+		const uint8_t *start;
+		uint8_t left;
+	} repeat[TUNE_REPEAT_DEPTH];
+};
+
+static const struct audio_sound default_instruments[] = {
+	[TUNE_SQUARE] = { .wave = AUDIO_WAVE_SQUARE, .volume = 192 },
+	[TUNE_TRIANGLE] = { .wave = AUDIO_WAVE_TRIANGLE, .volume = 255, .release_ms = 30 },
+	[TUNE_PULSE] = { .wave = AUDIO_WAVE_SQUARE, .volume = 128, .duty = 64, .decay_ms = 200, .sustain = 128 },
+	[TUNE_DRUM] = { .wave = AUDIO_WAVE_NOISE, .volume = 160, .decay_ms = 80 },
+};
+
+/* Octave 9, C to B, in sixteenths of a Hz; lower octaves are these halved */
+static const uint32_t octave9_freq[12] = {
+	133952, 141918, 150356, 159297, 168769, 178805,
+	189437, 200702, 212636, 225280, 238676, 252868,
+};
+
+static const struct tune *current_tune;
+static const struct tune *next_tune;
+static void (*next_callback)(void);
+
+/* Only for the clock */
+static const struct tune *tune;
+static struct channel channels[TUNE_MAX_CHANNELS];
+static int num_channels;
+static const struct audio_sound *instruments;
+static int num_instruments;
+static uint32_t tick_samples;	/* 16.16 */
+static uint32_t tick_fraction;
+static void (*finish_callback)(void);
+
+uint16_t tune_note_freq(uint8_t note)
 {
-	if (!current_tune)
-		return;
-	current_note++;
-	if (current_note >= current_tune->num_notes) {
-		if (finish_callback)
-			finish_callback();
-		current_tune = NULL;
-		return;
+	int shift = 10 - note / 12;
+
+	if (shift < 0)
+		shift = 0;
+	return (uint16_t) (((octave9_freq[note % 12] >> shift) + 8) >> 4);
+}
+
+static void set_tempo(uint16_t tick_ms)
+{
+	tick_samples = (uint32_t) (((uint64_t) tick_ms * audio_sample_rate() << 16) / 1000);
+}
+
+static void restart_channel(struct channel *ch)
+{
+	ch->wait = 1;
+	ch->ended = false;
+	ch->depth = 0;
+}
+
+static void play_note(int c, uint8_t note)
+{
+	struct channel *ch = &channels[c];
+
+	audio_voice_play(TUNE_FIRST_VOICE + c, &instruments[ch->instrument], tune_note_freq(note), 0);
+}
+
+/* Run channel c's commands up to its next note or rest, or its end */
+static void run_channel(int c)
+{
+	struct channel *ch = &channels[c];
+
+	for (;;) {
+		uint8_t op = *ch->pos++;
+
+		if (op < TUNE_REST && op != TUNE_END) {
+			play_note(c, op);
+			ch->wait = ch->length;
+			return;
+		}
+		switch (op) {
+		case TUNE_END:
+			ch->pos--;
+			audio_voice_release(TUNE_FIRST_VOICE + c);
+			ch->ended = true;
+			return;
+		case TUNE_REST:
+			audio_voice_release(TUNE_FIRST_VOICE + c);
+			ch->wait = ch->length;
+			return;
+		case TUNE_OP_LENGTH:
+			ch->length = *ch->pos++;
+			if (!ch->length)
+				ch->length = 1;
+			break;
+		case TUNE_OP_INSTRUMENT:
+			if (*ch->pos < num_instruments)
+				ch->instrument = *ch->pos;
+			ch->pos++;
+			break;
+		case TUNE_OP_REPEAT:
+			if (ch->depth < TUNE_REPEAT_DEPTH) {
+				ch->repeat[ch->depth].left = *ch->pos;
+				ch->repeat[ch->depth].start = ch->pos + 1;
+				ch->depth++;
+			}
+			ch->pos++;
+			break;
+		case TUNE_REPEAT_END:
+			if (!ch->depth)
+				break;
+			if (ch->repeat[ch->depth - 1].left > 1) {
+				ch->repeat[ch->depth - 1].left--;
+				ch->pos = ch->repeat[ch->depth - 1].start;
+			} else {
+				ch->depth--;
+			}
+			break;
+		case TUNE_LOOP_HERE:
+			ch->loop = ch->pos;
+			break;
+		case TUNE_OP_TEMPO:
+			set_tempo(ch->pos[0] | ch->pos[1] << 8);
+			ch->pos += 2;
+			break;
+		default:
+			break;
+		}
 	}
-	if (!stop_the_music) {
-		audio_out_beep_with_cb(current_tune->note[current_note].freq,
-			current_tune->note[current_note].duration, next_note);
+}
+
+static void release_voices(int n)
+{
+	for (int c = 0; c < n; c++) {
+		audio_voice_release(TUNE_FIRST_VOICE + c);
+		audio_voice_reserve(TUNE_FIRST_VOICE + c, false);
+	}
+}
+
+static uint32_t tune_tick(void)
+{
+	bool playing = false;
+	uint32_t samples;
+
+	/* Stopped or replaced, by the app, which has seen to the voices */
+	if (__atomic_load_n(&current_tune, __ATOMIC_ACQUIRE) != tune)
+		return 0;
+
+	for (int c = 0; c < num_channels; c++) {
+		if (!channels[c].ended && --channels[c].wait == 0)
+			run_channel(c);
+		playing |= !channels[c].ended;
+	}
+
+	if (!playing) {
+		if (!tune->loop) {
+			release_voices(num_channels);
+			if (__atomic_load_n(&current_tune, __ATOMIC_ACQUIRE) == tune)
+				__atomic_store_n(&current_tune, NULL, __ATOMIC_RELEASE);
+			if (finish_callback)
+				audio_post_callback(finish_callback);
+			return 0;
+		}
+		for (int c = 0; c < num_channels; c++) {
+			channels[c].pos = channels[c].loop;
+			restart_channel(&channels[c]);
+			run_channel(c);
+		}
+	}
+
+	tick_fraction += tick_samples;
+	samples = tick_fraction >> 16;
+	tick_fraction &= 0xffff;
+	return samples ? samples : 1;
+}
+
+/* The first tick of a tune, which sets it up */
+static uint32_t start_tick(void)
+{
+	uint32_t samples;
+
+	tune = __atomic_load_n(&next_tune, __ATOMIC_ACQUIRE);
+	finish_callback = next_callback;
+	num_channels = tune->num_channels < TUNE_MAX_CHANNELS ? tune->num_channels : TUNE_MAX_CHANNELS;
+	if (tune->instruments) {
+		instruments = tune->instruments;
+		num_instruments = tune->num_instruments;
 	} else {
-		current_tune = NULL;
-		current_note = 0;
-		stop_the_music = 0;
+		instruments = default_instruments;
+		num_instruments = sizeof(default_instruments) / sizeof(default_instruments[0]);
+	}
+	for (int c = 0; c < num_channels; c++) {
+		struct channel *ch = &channels[c];
+
+		ch->pos = tune->channel[c];
+		ch->loop = tune->channel[c];
+		ch->length = 1;
+		ch->instrument = 0;
+		restart_channel(ch);
 	}
+	set_tempo(tune->tick_ms);
+	tick_fraction = 0;
+
+	/* From now on the clock calls tune_tick() */
+	samples = tune_tick();
+	if (samples)
+		audio_clock_start(tune_tick, samples);
+	return 0;
 }
 
-void play_tune(struct tune *tune, void (*finished_callback)(void))
+void play_tune(const struct tune *new_tune, void (*finished_callback)(void))
 {
-	stop_the_music = 0;
-	current_note = 0;
-	current_tune = tune;
-	finish_callback = finished_callback;
-	audio_out_beep_with_cb(current_tune->note[current_note].freq,
-			current_tune->note[current_note].duration, next_note);
+	stop_tune();
+	if (!new_tune || !new_tune->num_channels)
+		return;
+
+	for (int c = 0; c < new_tune->num_channels && c < TUNE_MAX_CHANNELS; c++)
+		audio_voice_reserve(TUNE_FIRST_VOICE + c, true);
+	next_callback = finished_callback;
+	__atomic_store_n(&next_tune, new_tune, __ATOMIC_RELEASE);
+	__atomic_store_n(&current_tune, new_tune, __ATOMIC_RELEASE);
+	audio_clock_start(start_tick, 0);
 }
 
 void stop_tune(void)
 {
-	stop_the_music = 1;
+	audio_clock_stop();
+	if (__atomic_load_n(&current_tune, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&current_tune, NULL, __ATOMIC_RELEASE);
+		release_voices(TUNE_MAX_CHANNELS);
+	}
 }
 
+bool tune_is_playing(void)
+{
+	return __atomic_load_n(&current_tune, __ATOMIC_ACQUIRE) != NULL;
+}
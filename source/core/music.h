@@ -100,17 +100,90 @@
 #define NOTE_Ds8 7902
 #define NOTE_Ef8 7902
 
-struct note {
-	uint16_t freq, duration; // 0 frequency means rest
-};
+/*
+ * Tunes are tracker-style byte strings, one per channel, kept in flash.  Each
+ * channel plays on its own mixer voice, and time moves in ticks of the tune's
+ * tick_ms.  A channel is a list of:
+ *
+ *   TUNE_N(C, 4)          play middle C for the current length
+ *   TUNE_REST             silence for the current length
+ *   TUNE_LENGTH(n)        notes and rests after this last n ticks (1-255)
+ *   TUNE_INSTRUMENT(n)    play notes with instrument n
+ *   TUNE_REPEAT(n) ... TUNE_REPEAT_END
+ *                         play what's in between n times; these nest twice
+ *   TUNE_LOOP_HERE        where a looping tune starts again
+ *   TUNE_TEMPO(ms)        change tick_ms, for every channel
+ *   TUNE_END
+ *
+ * The tune ends when every channel has reached its TUNE_END, or, if it loops,
+ * they all go back to their TUNE_LOOP_HERE (or the start) and carry on.
+ * tools/tune-converter.py turns the old tables of struct note into tunes.
+ */
+#define TUNE_END 0x00
+#define TUNE_REST 0x80
+#define TUNE_OP_LENGTH 0x81
+#define TUNE_OP_INSTRUMENT 0x82
+#define TUNE_OP_REPEAT 0x83
+#define TUNE_REPEAT_END 0x84
+#define TUNE_LOOP_HERE 0x85
+#define TUNE_OP_TEMPO 0x86
+
+#define TUNE_LENGTH(n) TUNE_OP_LENGTH, (n)
+#define TUNE_INSTRUMENT(n) TUNE_OP_INSTRUMENT, (n)
+#define TUNE_REPEAT(n) TUNE_OP_REPEAT, (n)
+#define TUNE_TEMPO(ms) TUNE_OP_TEMPO, ((ms) & 0xff), ((ms) >> 8)
+
+/* A note as a MIDI note number, e.g. TUNE_N(Fs, 4) for F sharp 4 */
+#define TUNE_N(note, octave) (12 * ((octave) + 1) + TUNE_NOTE_##note)
+#define TUNE_NOTE_C 0
+#define TUNE_NOTE_Cs 1
+#define TUNE_NOTE_Df 1
+#define TUNE_NOTE_D 2
+#define TUNE_NOTE_Ds 3
+#define TUNE_NOTE_Ef 3
+#define TUNE_NOTE_E 4
+#define TUNE_NOTE_F 5
+#define TUNE_NOTE_Fs 6
+#define TUNE_NOTE_Gf 6
+#define TUNE_NOTE_G 7
+#define TUNE_NOTE_Gs 8
+#define TUNE_NOTE_Af 8
+#define TUNE_NOTE_A 9
+#define TUNE_NOTE_As 10
+#define TUNE_NOTE_Bf 10
+#define TUNE_NOTE_B 11
+
+#define TUNE_MAX_CHANNELS 4
+
+/* The instruments every tune has, unless it brings its own */
+#define TUNE_SQUARE 0
+#define TUNE_TRIANGLE 1
+#define TUNE_PULSE 2
+#define TUNE_DRUM 3
+
+struct audio_sound;
 
 struct tune {
-	int num_notes;
-	struct note *note;
+	uint16_t tick_ms;
+	bool loop;
+	uint8_t num_channels;
+	const uint8_t *channel[TUNE_MAX_CHANNELS];
+	const struct audio_sound *instruments;	/* NULL for TUNE_SQUARE and so on */
+	uint8_t num_instruments;
 };
 
-void play_tune(struct tune *tune, void (*finished_callback)(void));
+/*
+ * Play a tune, in place of any that's playing, calling finished_callback
+ * when it ends.  Sound effects and beeps play on top of it.  The callback is
+ * called from the audio interrupt, or the simulator's audio thread.
+ */
+void play_tune(const struct tune *tune, void (*finished_callback)(void));
 
 void stop_tune(void);
 
+bool tune_is_playing(void);
+
+/* Frequency in Hz of a MIDI note number */
+uint16_t tune_note_freq(uint8_t note);
+
 #endif
@@ -0,0 +1,213 @@
+#include <stddef.h>
+#include <stdio.h>
+
+#include "scheduler.h"
+#include "button.h"
+#include "delay.h"
+#include "ir.h"
+#include "rtc.h"
+
+/* After any input, SCHEDULER_ON_INPUT frames run at the default rate for this long */
+#define INPUT_LINGER_US 500000
+/* and otherwise this often, so the app and the screen saver still see time pass */
+#define IDLE_FRAME_US 1000000
+/* How often to look for input while frames are idle */
+#define INPUT_POLL_US 20000
+/* How often the simulator prints the statistics */
+#define STATS_REPORT_US 10000000
+
+static scheduler_fn frame_fn;
+static void *frame_context;
+static int frame_rate = SCHEDULER_DEFAULT_FPS;
+static uint64_t frame_due_us;		/* when the last frame was due */
+static uint64_t next_frame_us;
+static unsigned int last_input_timestamp;
+static int last_ir_count;
+static uint64_t last_input_us;
+
+static struct scheduler_task *pending;	/* in order of due time */
+
+static struct scheduler_stats stats = { .owner = "badge" };
+static uint64_t stats_since_us;
+
+static uint64_t frame_period_us(uint64_t now)
+{
+	if (frame_rate > 0)
+		return 1000000 / frame_rate;
+	if (now - last_input_us < INPUT_LINGER_US)
+		return 1000000 / SCHEDULER_DEFAULT_FPS;
+	return IDLE_FRAME_US;
+}
+
+void scheduler_set_frame(scheduler_fn frame, void *context)
+{
+	frame_fn = frame;
+	frame_context = context;
+}
+
+void scheduler_set_frame_rate(int fps)
+{
+	uint64_t now = rtc_get_us_since_boot();
+
+	if (fps == frame_rate)
+		return;
+	frame_rate = fps;
+	if (fps == SCHEDULER_ON_INPUT)
+		last_input_us = now; /* Whatever started the app counts */
+	next_frame_us = frame_due_us + frame_period_us(now);
+}
+
+int scheduler_frame_rate(void)
+{
+	return frame_rate;
+}
+
+static void report_stats(uint64_t now)
+{
+#ifdef TARGET_SIMULATOR
+	uint64_t elapsed = now - stats_since_us;
+
+	if (elapsed == 0 || stats.frames < 10)
+		return; /* e.g. a settings menu item, which returns straight away */
+	printf("%s: %u.%u fps, %u%% busy, %u late frames\n", stats.owner,
+		(unsigned int) (stats.frames * 10000000ull / elapsed / 10),
+		(unsigned int) (stats.frames * 10000000ull / elapsed % 10),
+		(unsigned int) (stats.busy_us * 100 / elapsed), (unsigned int) stats.late_frames);
+#else
+	(void) now;
+#endif
+}
+
+void scheduler_set_frame_owner(const char *name)
+{
+	report_stats(rtc_get_us_since_boot());
+	scheduler_reset_stats();
+	stats.owner = name;
+}
+
+static void insert_pending(struct scheduler_task *task)
+{
+	struct scheduler_task **p = &pending;
+
+	while (*p && (*p)->due_us <= task->due_us)
+		p = &(*p)->next;
+	task->next = *p;
+	*p = task;
+	task->pending = true;
+}
+
+void scheduler_stop(struct scheduler_task *task)
+{
+	struct scheduler_task **p;
+
+	if (!task->pending)
+		return;
+	for (p = &pending; *p; p = &(*p)->next) {
+		if (*p == task) {
+			*p = task->next;
+			break;
+		}
+	}
+	task->pending = false;
+}
+
+void scheduler_start(struct scheduler_task *task, uint32_t delay_us)
+{
+	scheduler_stop(task);
+	task->due_us = rtc_get_us_since_boot() + delay_us;
+	insert_pending(task);
+}
+
+static void run_tasks(uint64_t now)
+{
+	while (pending && pending->due_us <= now) {
+		struct scheduler_task *task = pending;
+
+		pending = task->next;
+		task->pending = false;
+		/* Reschedule first, so the task can stop itself */
+		if (task->period_us) {
+			task->due_us += task->period_us;
+			if (task->due_us <= now)
+				task->due_us = now + task->period_us; /* it's fallen behind; don't try to catch up */
+			insert_pending(task);
+		}
+		task->fn(task->context);
+		stats.tasks++;
+	}
+}
+
+uint64_t scheduler_run(void)
+{
+	uint64_t start = rtc_get_us_since_boot();
+	uint64_t now, next;
+
+	run_tasks(start);
+
+	if (frame_rate == SCHEDULER_ON_INPUT) {
+		unsigned int input = button_last_input_timestamp();
+		int ir_count = ir_message_count();
+
+		if (input != last_input_timestamp || ir_count != last_ir_count) {
+			last_input_timestamp = input;
+			last_ir_count = ir_count;
+			last_input_us = start;
+			next_frame_us = start;
+		}
+	}
+	if (frame_fn && start >= next_frame_us) {
+		frame_due_us = next_frame_us;
+		frame_fn(frame_context);
+		stats.frames++;
+		now = rtc_get_us_since_boot();
+		next_frame_us = frame_due_us + frame_period_us(now);
+		if (next_frame_us <= now) {
+			/* Too long a frame, or too long asleep: start again from now rather than hurry */
+			stats.late_frames++;
+			next_frame_us = now;
+			frame_due_us = now;
+		}
+	}
+
+	now = rtc_get_us_since_boot();
+	stats.busy_us += now - start;
+	if (now - stats_since_us >= STATS_REPORT_US) {
+		report_stats(now);
+		scheduler_reset_stats();
+	}
+
+	next = next_frame_us;
+	if (frame_rate == SCHEDULER_ON_INPUT && next > now + INPUT_POLL_US)
+		next = now + INPUT_POLL_US;
+	if (pending && pending->due_us < next)
+		next = pending->due_us;
+	return next;
+}
+
+void scheduler_main_loop(void)
+{
+	next_frame_us = rtc_get_us_since_boot();
+	frame_due_us = next_frame_us;
+	scheduler_reset_stats();
+	for (;;) {
+		uint64_t next = scheduler_run();
+		uint64_t now = rtc_get_us_since_boot();
+
+		if (next > now)
+			lp_sleep_us(next - now);
+	}
+}
+
+void scheduler_get_stats(struct scheduler_stats *out)
+{
+	*out = stats;
+	out->elapsed_us = rtc_get_us_since_boot() - stats_since_us;
+}
+
+void scheduler_reset_stats(void)
+{
+	const char *owner = stats.owner;
+
+	stats = (struct scheduler_stats) { .owner = owner };
+	stats_since_us = rtc_get_us_since_boot();
+}
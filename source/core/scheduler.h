@@ -0,0 +1,88 @@
+#ifndef SCHEDULER_H__
+#define SCHEDULER_H__
+
+/*
+ * The badge main loop: a cooperative scheduler that runs the frame (menus and
+ * the running app, see ProcessIO()) at the rate the app asks for, runs
+ * periodic and one-off tasks when they're due, and sleeps in between with
+ * lp_sleep_us().
+ *
+ * Apps that animate ask for a frame rate when they start, with
+ * scheduler_set_frame_rate(); the menus put it back to the default when the
+ * app exits.  Apps that only change when a button is pressed ask for
+ * SCHEDULER_ON_INPUT: their frames run at the default rate for a moment after
+ * any input, button or IR message, and otherwise once a second.
+ *
+ * Tasks are for work that doesn't belong to a frame: timers, and things worth
+ * putting off and doing once, like writing settings to flash.  Nothing runs
+ * concurrently, so tasks and frames can share data freely, but a task that
+ * takes long delays the next frame.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCHEDULER_DEFAULT_FPS 30
+#define SCHEDULER_ON_INPUT 0
+
+typedef void (*scheduler_fn)(void *context);
+
+struct scheduler_task {
+	const char *name;
+	scheduler_fn fn;
+	void *context;
+	uint32_t period_us;		/* 0 for a task that runs once each time it's started */
+	uint64_t due_us;
+	bool pending;
+	struct scheduler_task *next;	/* in the scheduler's list of pending tasks */
+};
+
+#define SCHEDULER_TASK(name, fn, context, period_us) { (name), (fn), (context), (period_us), 0, false, NULL }
+
+/* Set what each frame does */
+void scheduler_set_frame(scheduler_fn frame, void *context);
+
+/* Frames per second for the running app, or SCHEDULER_ON_INPUT */
+void scheduler_set_frame_rate(int fps);
+int scheduler_frame_rate(void);
+
+/* Who the frames are run for from now on, for the statistics; name must stay valid */
+void scheduler_set_frame_owner(const char *name);
+
+/**
+ * scheduler_start - run a task after delay_us
+ *
+ * A periodic task runs every period_us after that.  Starting a task that's
+ * already pending just moves it, so a one-off task can be started each time
+ * there's something for it to do and it will run once, delay_us after the
+ * last time.
+ */
+void scheduler_start(struct scheduler_task *task, uint32_t delay_us);
+
+/* Stop a pending task; does nothing if it isn't pending */
+void scheduler_stop(struct scheduler_task *task);
+
+/**
+ * scheduler_run - run whatever is due: tasks, then the frame
+ *
+ * Returns:
+ *   the time, in microseconds since boot, when something is next due.
+ */
+uint64_t scheduler_run(void);
+
+/* Run forever, sleeping whenever there's nothing to do */
+void scheduler_main_loop(void);
+
+struct scheduler_stats {
+	const char *owner;
+	uint64_t elapsed_us;	/* since the owner took over, or the statistics were last reset */
+	uint64_t busy_us;	/* running frames and tasks */
+	uint32_t frames;
+	uint32_t tasks;
+	uint32_t late_frames;	/* frames that ran into the time for the next one */
+};
+
+void scheduler_get_stats(struct scheduler_stats *stats);
+void scheduler_reset_stats(void);
+
+#endif
@@ -0,0 +1,223 @@
+#include <string.h>
+
+#include "framebuffer.h"
+#include "random.h"
+#include "trig.h"
+#include "xorshift.h"
+#include "screensaver_kernels.h"
+
+/* Clean rows between two runs of dirty ones, fewer than which the runs are sent as one */
+#define DIRTY_ROWS_GAP 4
+
+static uint32_t dirty[(LCD_YSIZE + 31) / 32];
+
+static bool row_dirty(int y)
+{
+	return dirty[y / 32] & (1u << (y % 32));
+}
+
+void dirty_rows_add(int y0, int y1)
+{
+	if (y0 > y1) {
+		int t = y0;
+
+		y0 = y1;
+		y1 = t;
+	}
+	if (y0 < 0)
+		y0 = 0;
+	if (y1 >= LCD_YSIZE)
+		y1 = LCD_YSIZE - 1;
+	for (int y = y0; y <= y1; y++)
+		dirty[y / 32] |= 1u << (y % 32);
+}
+
+void dirty_rows_all(void)
+{
+	dirty_rows_add(0, LCD_YSIZE - 1);
+}
+
+bool dirty_rows_any(void)
+{
+	for (unsigned int i = 0; i < sizeof(dirty) / sizeof(dirty[0]); i++)
+		if (dirty[i])
+			return true;
+	return false;
+}
+
+void dirty_rows_clear(void)
+{
+	memset(dirty, 0, sizeof(dirty));
+}
+
+int dirty_rows_flush(void)
+{
+	int sent = 0;
+	int y = 0;
+
+	while (y < LCD_YSIZE) {
+		int start, end;
+
+		if (!row_dirty(y)) {
+			y++;
+			continue;
+		}
+		start = y;
+		end = y + 1;
+		for (y = end; y < LCD_YSIZE && y - end < DIRTY_ROWS_GAP; y++)
+			if (row_dirty(y))
+				end = y + 1;
+		FbPushRows(start, end - start);
+		sent += end - start;
+		y = end;
+	}
+	dirty_rows_clear();
+	return sent;
+}
+
+int screensaver_random(int n)
+{
+	static unsigned int state;
+
+	if (!state)
+		random_insecure_bytes((uint8_t *) &state, sizeof(state));
+	if (!state)
+		state = 0xa5a5a5a5; /* xorshift stays at 0 */
+	return xorshift(&state) % n;
+}
+
+unsigned short rainbow_color(int angle)
+{
+	int r, g, b;
+
+	/* map each from [-256, 255] to [0, 511] */
+	r = sine(angle & 127) + 256;
+	g = sine((angle + 128 / 3) & 127) + 256;
+	b = sine((angle + 2 * (128 / 3)) & 127) + 256;
+
+	/* top 5, 6 and 5 bits */
+	return (r >> 4) << 11 | (g >> 3) << 5 | (b >> 4);
+}
+
+static void start_star(struct star *s)
+{
+	int x, y;
+
+	do {
+		x = screensaver_random(LCD_XSIZE);
+		y = screensaver_random(LCD_YSIZE);
+	} while (x == LCD_XSIZE / 2 && y == LCD_YSIZE / 2);
+
+	s->x = s->lx = x * 256;
+	s->y = s->ly = y * 256;
+	s->vx = (x - LCD_XSIZE / 2) * 20;
+	s->vy = (y - LCD_YSIZE / 2) * 20;
+}
+
+static void move_star(struct star *s)
+{
+	s->lx = s->x;
+	s->ly = s->y;
+	s->x += s->vx;
+	s->y += s->vy;
+	s->vx = (s->vx * 300) / 256; /* multiply by approximately 1.2 */
+	s->vy = (s->vy * 300) / 256;
+	if (s->x / 256 < 0 || s->x / 256 >= LCD_XSIZE || s->y / 256 < 0 || s->y / 256 >= LCD_YSIZE)
+		start_star(s);
+}
+
+static void draw_streak(const struct star *s)
+{
+	FbLine(s->x / 256, s->y / 256, s->lx / 256, s->ly / 256);
+	dirty_rows_add(s->y / 256, s->ly / 256);
+}
+
+void starfield_init(struct starfield *f, struct star *stars, int count)
+{
+	f->star = stars;
+	f->count = count;
+	for (int i = 0; i < count; i++)
+		start_star(&stars[i]);
+}
+
+void starfield_step(struct starfield *f, unsigned short color)
+{
+	/* Undraw them all before drawing any, so no star rubs out another */
+	FbColor(G_Fb.BGcolor);
+	for (int i = 0; i < f->count; i++)
+		draw_streak(&f->star[i]);
+	for (int i = 0; i < f->count; i++)
+		move_star(&f->star[i]);
+	FbColor(color);
+	for (int i = 0; i < f->count; i++)
+		draw_streak(&f->star[i]);
+}
+
+static void draw_trail_line(const struct trail_line *l)
+{
+	FbLine(l->x0, l->y0, l->x1, l->y1);
+	dirty_rows_add(l->y0, l->y1);
+}
+
+void line_trail_init(struct line_trail *t, struct trail_line *lines, int count)
+{
+	t->line = lines;
+	t->count = count;
+	t->used = 0;
+	t->next = 0;
+}
+
+void line_trail_add(struct line_trail *t, int x0, int y0, int x1, int y1, unsigned short color)
+{
+	struct trail_line *l = &t->line[t->next];
+
+	if (t->used == t->count) {
+		FbColor(G_Fb.BGcolor);
+		draw_trail_line(l);
+	} else {
+		t->used++;
+	}
+	l->x0 = x0;
+	l->y0 = y0;
+	l->x1 = x1;
+	l->y1 = y1;
+	FbColor(color);
+	draw_trail_line(l);
+	t->next = (t->next + 1) % t->count;
+}
+
+void palette_cycle_start(struct palette_cycle *p, const unsigned short *colors, int ncolors, int first, int count)
+{
+	p->first = first;
+	p->count = count;
+	FbIndexedMode(colors, ncolors);
+	dirty_rows_all();
+}
+
+void palette_cycle_fill(int x, int y, int w, int h, int color_index)
+{
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (w <= 0 || h <= 0 || x >= LCD_XSIZE || y >= LCD_YSIZE)
+		return;
+	if (w > LCD_XSIZE)
+		w = LCD_XSIZE;
+	if (h > LCD_YSIZE)
+		h = LCD_YSIZE;
+	FbColorIndex(color_index);
+	FbMove(x, y);
+	FbFilledRectangle(w, h);
+	dirty_rows_add(y, y + h - 1);
+}
+
+void palette_cycle_rotate(struct palette_cycle *p, int steps)
+{
+	FbPaletteRotate(p->first, p->count, steps);
+	dirty_rows_all();
+}
@@ -0,0 +1,105 @@
+#ifndef SCREENSAVER_KERNELS_H__
+#define SCREENSAVER_KERNELS_H__
+
+/*
+ * Drawing kernels shared by the screensavers in screensavers.c: a record of
+ * the rows that changed, a starfield, line trails, palette cycling and a
+ * random number generator.
+ *
+ * A screensaver keeps its picture in the framebuffer from one frame to the
+ * next, undraws (in the background color) whatever moves, and marks the rows
+ * it touched with dirty_rows_add().  At the end of the frame only those rows
+ * go to the display, so a frame that changes a few rows costs a few rows of
+ * SPI rather than the whole screen, and one that changes nothing costs
+ * nothing.  The kernels mark the rows they draw on themselves.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "framebuffer.h"
+
+/* Mark rows y0 to y1 (either way round) as changed; rows off the screen are ignored */
+void dirty_rows_add(int y0, int y1);
+void dirty_rows_all(void);
+bool dirty_rows_any(void);
+
+/**
+ * dirty_rows_flush - send the changed rows to the display and forget them
+ *
+ * Rows go in runs with FbPushRows(); runs only a few rows apart are sent as
+ * one, which is quicker than opening another window on the display.
+ *
+ * Returns:
+ *   the number of rows sent.
+ */
+int dirty_rows_flush(void);
+
+/* Forget the changed rows without sending them */
+void dirty_rows_clear(void);
+
+/* A random number from 0 to n - 1, for the screensavers to share */
+int screensaver_random(int n);
+
+/* A color that goes round the rainbow as angle goes from 0 to 127 (see trig.h) */
+unsigned short rainbow_color(int angle);
+
+/*
+ * Stars streaking out from the middle of the screen, faster as they go, and
+ * starting again somewhere random when they leave it.  Positions and
+ * velocities are 8.8 fixed point pixels.
+ */
+struct star {
+	int32_t x, y;
+	int32_t lx, ly;		/* where it was last frame; it's drawn as a streak from there */
+	int32_t vx, vy;
+};
+
+struct starfield {
+	struct star *star;
+	int count;
+};
+
+void starfield_init(struct starfield *f, struct star *stars, int count);
+
+/* Undraw the stars, move them, and draw them again in color */
+void starfield_step(struct starfield *f, unsigned short color);
+
+/*
+ * The last count lines drawn, like the trail of a qix: adding a line undraws
+ * the oldest once there are count of them.
+ */
+struct trail_line {
+	uint8_t x0, y0, x1, y1;
+};
+
+struct line_trail {
+	struct trail_line *line;
+	int count;
+	int used;
+	int next;		/* where the next line goes, and the oldest once they're all used */
+};
+
+void line_trail_init(struct line_trail *t, struct trail_line *lines, int count);
+void line_trail_add(struct line_trail *t, int x0, int y0, int x1, int y1, unsigned short color);
+
+/*
+ * Palette cycling, in the framebuffer's indexed mode (see framebuffer.h): a
+ * picture drawn once in palette entries, say a tunnel of rings each its own
+ * entry, is animated by rotating the entries, which moves their colors from
+ * ring to ring without drawing anything again.
+ */
+struct palette_cycle {
+	int first, count;	/* the entries that rotate */
+};
+
+/* Switch to indexed mode with colors as the first ncolors entries, rotating count of them from first */
+void palette_cycle_start(struct palette_cycle *p, const unsigned short *colors, int ncolors, int first, int count);
+
+/* Fill a rectangle, clipped to the screen, with palette entry color_index */
+void palette_cycle_fill(int x, int y, int w, int h, int color_index);
+
+/* Each rotating entry takes the color steps entries before it, wrapping round */
+void palette_cycle_rotate(struct palette_cycle *p, int steps);
+
+#endif
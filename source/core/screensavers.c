@@ -5,175 +5,61 @@
 #include "button.h"
 #include "framebuffer.h"
 #include "screensavers.h"
-#include "random.h"
+#include "screensaver_kernels.h"
+#include "scheduler.h"
 #include "led_pwm.h"
 #include "rtc.h"
-#include "xorshift.h"
-#include "trig.h"
 #include "new_badge_monsters/new_badge_monsters.h"
 #include <string.h>
 
-extern unsigned short popup_time;
+/* How long a popup lasts, and the 30ths of a second the screensavers time it in */
+#define POPUP_SECONDS 9
+#define POPUP_TICKS_PER_SECOND 30
+#define POPUP_LENGTH (POPUP_SECONDS * POPUP_TICKS_PER_SECOND)
 
-static unsigned short animation_count = 0;
-void screensaver_set_animation_count(unsigned short count)
-{
-	animation_count = count;
-}
-
-#define IB1 1
-#define IB2 2
-#define IB5 16
-#define IB18 131072
-
-#define MASK (IB1+IB2+IB5)
+/* Frames in a row over budget before the frame rate is halved */
+#define OVER_BUDGET_FRAMES 3
 
-static unsigned int irbit2(unsigned int iseed) {
-    if (iseed & IB18){
-        iseed = ((iseed ^ MASK) << 1) | IB1;
-    }
-    else{
-        iseed <<= 1;
-    }
-    return iseed;
-}
-
-static int random_num(int n)
-{
-	static unsigned int xorshift_state = 0;
-	if (xorshift_state == 0) {
-		random_insecure_bytes((uint8_t*)&xorshift_state, sizeof(xorshift_state));
-	}
-	return xorshift(&xorshift_state) % n;
-}
+/* Frames drawn since the screensaver started, for those that count them */
+static unsigned short animation_count = 0;
+/* 30ths of a second left of the popup, and since it started, whatever the frame rate */
+static unsigned short popup_time = POPUP_LENGTH;
+static unsigned short popup_ticks = 0;
 
 #define NHYPERSPACE_STARS 30
-static struct hyperspace_star {
-	int64_t lx, ly, x, y, vx, vy;
-} hyperspace_star[NHYPERSPACE_STARS] = { 0 };
-
-static void map_hyperspace_star(void (*func)(struct hyperspace_star *))
-{
-	for (int i = 0; i < NHYPERSPACE_STARS; i++)
-		func(&hyperspace_star[i]);
-}
-
-static void initialize_hyperspace_star(struct hyperspace_star *s)
-{
-	do {
-		s->x = random_num(LCD_XSIZE) * 256;
-		s->y = random_num(LCD_YSIZE) * 256;
-	} while (s->x == LCD_XSIZE / 2 && s->y == LCD_YSIZE / 2);
-
-	s->lx = s->x;
-	s->ly = s->y;
-	s->vx = -((LCD_XSIZE / 2) - (s->x / 256));
-	s->vy = -((LCD_YSIZE / 2) - (s->y / 256));
-	if (s->vx == 0 && s->vy == 0) {
-		s->vx = 1;
-		s->vy = 1;
-	}
-	s->vx = s->vx * 20;
-	s->vy = s->vy * 20;
-
-}
-
-static void draw_hyperspace_star(struct hyperspace_star *s)
-{
-	int x1, y1, x2, y2;
-	x1 = s->x / 256;
-	y1 = s->y / 256;
-	x2 = s->lx / 256;
-	y2 = s->ly / 256;
-	FbLine(x1, y1, x2, y2);
-}
-
-static void move_hyperspace_star(struct hyperspace_star *s)
-{
-	s->lx = s->x;
-	s->ly = s->y;
-	s->x += s->vx;
-	s->y += s->vy;
-	s->vx = (s->vx * 300) / 256; /* multiply by approximately 1.2 */
-	s->vy = (s->vy * 300) / 256; /* multiply by approximately 1.2 */
-	int sx = s->x / 256;
-	int sy = s->y / 256;
-	if (sx < 0 || sx >= LCD_XSIZE || sy < 0 || sy >= LCD_YSIZE)
-		initialize_hyperspace_star(s);
-}
-
-static void initialize_hyperspace_screen_saver(void)
-{
-	map_hyperspace_star(initialize_hyperspace_star);
-}
-
-static void draw_hyperspace_stars(void)
-{
-	static int angle = 0;
-	int r, g, b, ra, ga, ba, color;
-	angle += 1;
-	if (angle >= 128)
-		angle = 0;
-	ra = angle;
-	ga = ra + 42;
-	if (ga >= 128)
-		ga -= 128;
-	ba = ga + 42;
-	if (ba >= 128)
-		ba -= 128;
-	r = sine(ra);
-	b = sine(ba);
-	g = sine(ga);
-
-	/* map color values from [-256-255] to [0-512] */
-	r = (int) r + 256;
-	g = (int) g + 256;
-	b = (int) b + 256;
-
-	r = r >> 4; /* top 5 bits */
-	g = g >> 3; /* top 6 bits */
-	b = b >> 4; /* top 5 bits */
-
-	color = (r << 11) | (g << 5) | b;
-	FbColor(color);
-	map_hyperspace_star(draw_hyperspace_star);
-}
+static struct star hyperspace_star[NHYPERSPACE_STARS];
+static struct starfield hyperspace;
 
-static void move_hyperspace_stars(void)
+static void hyperspace_start(void)
 {
-	map_hyperspace_star(move_hyperspace_star);
+	starfield_init(&hyperspace, hyperspace_star, NHYPERSPACE_STARS);
 }
 
-static void draw_hyperspace_screensaver(void)
+static void hyperspace_screen_saver(void)
 {
-	static int initialized = 0;
-	if (!initialized) {
-		initialize_hyperspace_screen_saver();
-		initialized = 1;
-	}
-	move_hyperspace_stars();
-	draw_hyperspace_stars();
-}
-
-void hyperspace_screen_saver(void)
-{
-	draw_hyperspace_screensaver();
-	FbSwapBuffers();
+	starfield_step(&hyperspace, rainbow_color(animation_count + 1));
 	animation_count++;
 }
 
-void holly_screensaver(void)
+static void holly_screensaver(void)
 {
+	static int shown;
 	int n;
 
-	FbMove(0, 33);
 	n = 1;
-	if ((animation_count % 30) < 15)
+	if ((popup_ticks % 30) < 15)
 		n = 1;
 	else
 		n = 3;
-	if ((animation_count % 50) < 5)
+	if ((popup_ticks % 50) < 5)
 		n = 2;
+	if (animation_count && n == shown)
+		return;
+	shown = n;
+	animation_count++;
+
+	FbClear();
+	FbMove(0, 33);
 	switch (n) {
 		case 1:
 			FbImage(&assetList[HOLLY01], 0);
@@ -185,16 +71,16 @@ void holly_screensaver(void)
 			FbImage(&assetList[HOLLY03], 0);
 			break;
 	}
-	FbSwapBuffers();
-	animation_count++;
+	dirty_rows_add(33, LCD_YSIZE - 1);
 }
 
-void nametag_screensaver(void)
+static void nametag_screensaver(void)
 {
 	int len, y;
 	const char *name = badge_system_data()->name;
 
-	draw_hyperspace_screensaver();
+	hyperspace_screen_saver();
+	/* Drawn again over the stars, so it only changes the rows they did */
 	FbColor(YELLOW);
 	FbBackgroundColor(BLACK);
 	FbMove(LCD_XSIZE - 20, 10);
@@ -203,21 +89,11 @@ void nametag_screensaver(void)
 	y = ((LCD_YSIZE / 2) - (len * 9) / 2);
 	FbMove(64, y);
 	FbRotWriteLine(name);
-	FbSwapBuffers();
 }
 
-void disp_asset_saver(void)
+static void disp_asset_saver(void)
 {
-    static unsigned char imgnum = 0;
-    if(!animation_count){
-        uint8_t random;
-        random_insecure_bytes(&random, sizeof(int8_t));
-
-        imgnum = random % 4;
-        animation_count++;
-    }
-
-    switch(imgnum){
+    switch(screensaver_random(4)){
         case 0:
             FbMove(0,0);
             FbImage(&assetList[RVASEC_LOGO], 0);
@@ -237,198 +113,175 @@ void disp_asset_saver(void)
             render_screen_save_monsters();
             break;
     }
-
-    FbSwapBuffers();
 }
 
 const char drag_hack[] = "Checkout HackRVA!";
 const char drag_hack_num[] = "HackRVA.org";
-void hack_the_dragon(void)
+static void hack_the_dragon_start(void)
 {
     led_pwm_enable(BADGE_LED_RGB_RED, 255);
+}
+
+static void hack_the_dragon(void)
+{
+    FbClear();
     FbMove(120 - 20, 5);
     FbColor(RED);
     FbRotWriteLine(drag_hack);
 
     int i = 0;
-    for(i=0; i<(8 - popup_time%8); i++){
+    for(i=0; i<=(animation_count%8); i++){
         // FbMove(17, 35+ (i*10));
 	FbMove(128 - (i * 10) - 35, 17);
         FbRotWriteLine(drag_hack_num);
     }
-    FbSwapBuffers();
+    dirty_rows_all();
+    animation_count++;
 }
 
-void stupid_rects(void)
+static void stupid_rects(void)
 {
 	static const int colors[] = { RED, YELLOW, GREEN, CYAN, WHITE, BLUE, MAGENTA };
 	int x1, y1, x2, y2;
-	int color = random_num(sizeof(colors) / sizeof(colors[0]));
-
-	animation_count++;
-	if (animation_count == 1 || (animation_count % 5) == 0) {
-		x1 = random_num(LCD_XSIZE);
-		y1 = random_num(LCD_YSIZE);
-		x2 = random_num(LCD_XSIZE);
-		y2 = random_num(LCD_YSIZE);
-		if (x1 > x2) {
-			int t = x1;
-			x1 = x2;
-			x2 = t;
-		}
-		if (y1 > y2) {
-			int t = y1;
-			y1 = y2;
-			y2 = t;
-		}
-		switch (animation_count) {
-		case 1:
-			led_pwm_enable(BADGE_LED_RGB_RED, 255);
-			led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
-			led_pwm_disable(BADGE_LED_RGB_BLUE);
-			break;
-		case 5:
-			led_pwm_disable(BADGE_LED_RGB_RED);
-			led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
-			led_pwm_disable(BADGE_LED_RGB_BLUE);
-			break;
-		case 10:
-			led_pwm_disable(BADGE_LED_RGB_RED);
-			led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
-			led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
-			break;
-		case 15:
-			led_pwm_enable(BADGE_LED_RGB_RED, 255);
-			led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
-			led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
-			break;
-		case 20:
-			led_pwm_disable(BADGE_LED_RGB_RED);
-			led_pwm_disable(BADGE_LED_RGB_GREEN);
-			led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
-			break;
-		case 25:
-			led_pwm_enable(BADGE_LED_RGB_RED, 255/2);
-			led_pwm_disable(BADGE_LED_RGB_GREEN);
-			led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
-			break;
-		}
-		FbColor(colors[color]);
-		FbMove(x1, y1);
-		FbFilledRectangle(x2 - x1 + 1, y2 - y1 + 1);
-		FbPushBuffer();
-		if (animation_count > 25)
-			animation_count = 0;
+	int color = screensaver_random(sizeof(colors) / sizeof(colors[0]));
+
+	x1 = screensaver_random(LCD_XSIZE);
+	y1 = screensaver_random(LCD_YSIZE);
+	x2 = screensaver_random(LCD_XSIZE);
+	y2 = screensaver_random(LCD_YSIZE);
+	if (x1 > x2) {
+		int t = x1;
+		x1 = x2;
+		x2 = t;
+	}
+	if (y1 > y2) {
+		int t = y1;
+		y1 = y2;
+		y2 = t;
+	}
+	switch (animation_count % 6) {
+	case 0:
+		led_pwm_enable(BADGE_LED_RGB_RED, 255);
+		led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
+		led_pwm_disable(BADGE_LED_RGB_BLUE);
+		break;
+	case 1:
+		led_pwm_disable(BADGE_LED_RGB_RED);
+		led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
+		led_pwm_disable(BADGE_LED_RGB_BLUE);
+		break;
+	case 2:
+		led_pwm_disable(BADGE_LED_RGB_RED);
+		led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
+		led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
+		break;
+	case 3:
+		led_pwm_enable(BADGE_LED_RGB_RED, 255);
+		led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
+		led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
+		break;
+	case 4:
+		led_pwm_disable(BADGE_LED_RGB_RED);
+		led_pwm_disable(BADGE_LED_RGB_GREEN);
+		led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
+		break;
+	case 5:
+		led_pwm_enable(BADGE_LED_RGB_RED, 255/2);
+		led_pwm_disable(BADGE_LED_RGB_GREEN);
+		led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
+		break;
 	}
+	FbColor(colors[color]);
+	FbMove(x1, y1);
+	FbFilledRectangle(x2 - x1 + 1, y2 - y1 + 1);
+	dirty_rows_add(y1, y2);
+	animation_count++;
 }
 
+/*
+ * Square rings out from the middle, each TUNNEL_RING_WIDTH wide and colored
+ * by one of TUNNEL_RINGS palette entries in turn.  Rotating the palette sends
+ * a bright ring and its fading trail outwards.
+ */
 #define TUNNEL_COLOR CYAN
-void carzy_tunnel_animator(void)
+#define TUNNEL_RING_WIDTH 4
+#define TUNNEL_RINGS 8
+static const unsigned char tunnel_level[TUNNEL_RINGS] = { 0, 0, 8, 16, 32, 64, 128, 255 };
+static struct palette_cycle tunnel;
+
+static void carzy_tunnel_start(void)
 {
-    animation_count++;
+    unsigned short colors[TUNNEL_RINGS];
 
-    if(!animation_count){
-        FbColor(TUNNEL_COLOR);
-        FbMove(65,65);
+    for (int i = 0; i < TUNNEL_RINGS; i++) {
+        int level = tunnel_level[i];
 
-        FbRectangle(2, 2);
-        led_pwm_disable(BADGE_LED_RGB_RED);
-        led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
-        led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
-    }
-    else if(animation_count == 5){
-        FbColor(TUNNEL_COLOR);
-        FbMove(64,64);
-
-        FbRectangle(4, 4);
-        led_pwm_disable(BADGE_LED_RGB_RED);
-        led_pwm_enable(BADGE_LED_RGB_GREEN, 5*255/100);
-        led_pwm_enable(BADGE_LED_RGB_BLUE, 5*255/100);
+        colors[i] = ((TUNNEL_COLOR >> 11) * level / 255) << 11 |
+            (((TUNNEL_COLOR >> 5) & 0x3f) * level / 255) << 5 |
+            ((TUNNEL_COLOR & 0x1f) * level / 255);
     }
-    else if(animation_count == 10){
-        FbColor(TUNNEL_COLOR);
-        FbMove(62,62);
-
-        FbRectangle(8, 8);
-        led_pwm_disable(BADGE_LED_RGB_RED);
-        led_pwm_enable(BADGE_LED_RGB_GREEN, 20*255/100);
-        led_pwm_enable(BADGE_LED_RGB_BLUE, 20*255/100);
-    }
-    else if(animation_count == 15){
-        FbColor(TUNNEL_COLOR);
-        FbMove(58,58);
-
-        FbRectangle(16, 16);
-        led_pwm_disable(BADGE_LED_RGB_RED);
-        led_pwm_enable(BADGE_LED_RGB_GREEN, 45*255/100);
-        led_pwm_enable(BADGE_LED_RGB_BLUE, 45*255/100);
-    }
-    else if(animation_count == 20){
-        FbColor(TUNNEL_COLOR);
-        FbMove(50,50);
-
-        FbRectangle(32, 32);
-        led_pwm_disable(BADGE_LED_RGB_RED);
-        led_pwm_enable(BADGE_LED_RGB_GREEN, 75*255/100);
-        led_pwm_enable(BADGE_LED_RGB_BLUE, 75*255/100);
-    }
-    else if(animation_count == 25){
-        FbColor(TUNNEL_COLOR);
-        FbMove(34,34);
-
-        FbRectangle(64, 64);
-        led_pwm_disable(BADGE_LED_RGB_RED);
-        led_pwm_enable(BADGE_LED_RGB_GREEN, 255);
-        led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
-    }
-    else if(animation_count > 30)
-        animation_count = 0 - 1;
+    palette_cycle_start(&tunnel, colors, TUNNEL_RINGS, 0, TUNNEL_RINGS);
+    /* Largest first, each inside the last */
+    for (int r = LCD_YSIZE / 2 / TUNNEL_RING_WIDTH; r >= 0; r--) {
+        int half = (r + 1) * TUNNEL_RING_WIDTH;
 
-    FbSwapBuffers();
+        palette_cycle_fill(LCD_XSIZE / 2 - half, LCD_YSIZE / 2 - half, 2 * half, 2 * half, r % TUNNEL_RINGS);
+    }
+    led_pwm_disable(BADGE_LED_RGB_RED);
 }
 
-void dotty(void)
+static void carzy_tunnel_animator(void)
 {
+    int level = tunnel_level[animation_count % TUNNEL_RINGS];
 
-    unsigned int rnd;
-    random_insecure_bytes((uint8_t*)&rnd, sizeof(unsigned int));
-    if(animation_count == 0){
-        FbClear();
-    }
+    palette_cycle_rotate(&tunnel, 1);
+    led_pwm_enable(BADGE_LED_RGB_GREEN, level);
+    led_pwm_enable(BADGE_LED_RGB_BLUE, level);
+    animation_count++;
+}
 
-    //if(animation_count%5){
+static void dotty(void)
+{
     unsigned char i = 0;
+
+    /* Blue, then shifted up through the other colors, and off the top to black */
+    FbColor(animation_count / 16 < 16 ? (unsigned short) (BLUE << (animation_count / 16)) : BLACK);
     for(i = 0; i < 200; i++)
     {
-        FbColor(BLUE << (animation_count / 16));
-        //FbPoint(rnd%130, irbit2(~timestamp)%130);
-        //FbPoint(irbit2(get_rand_char(0, 132) + timestamp + i),
-        //        irbit2(get_rand_char(0, 132) + ~timestamp + i));
-        uint32_t random;
-        random_insecure_bytes((uint8_t*)&random, sizeof(uint32_t));
-        random %= 132;
-
-        int timestamp = rtc_get_ms_since_boot();
-        FbMove(irbit2(random + timestamp + i),
-               irbit2(random + ~timestamp + i));
+        int y = screensaver_random(LCD_YSIZE - 2);
+
+        FbMove(screensaver_random(LCD_XSIZE - 2), y);
         FbFilledRectangle(3, 3);
+        dirty_rows_add(y, y + 2);
     }
 
-    FbPushBuffer();
-    animation_count += 2;
+    animation_count += 4;
+}
 
+static void for_president_start(void)
+{
+    led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
 }
 
-void for_president(void)
+static void for_president(void)
 {
+    static int shown;
+    int stripes = popup_time > 6 ? (popup_ticks / 15) % 2 : -1;
+
+    if (animation_count && stripes == shown)
+        return;
+    shown = stripes;
+    animation_count++;
+
+    FbClear();
     FbMove(LCD_XSIZE - 8 - 17, 22);
     FbColor(WHITE);
     FbRotWriteString("HAL FOR\nPresident");
 
-    if(popup_time > 3){
+    if(stripes >= 0){
         unsigned char i = 0;
         for(i=0; i<8; i++){
-            FbColor((i+(animation_count/15))%2 ? WHITE: RED);
+            FbColor((i+stripes)%2 ? WHITE: RED);
             FbMove(LCD_XSIZE - (50 + (i*10)), 0);
             FbFilledRectangle(10, LCD_YSIZE);
         }
@@ -437,9 +290,7 @@ void for_president(void)
         FbMove(LCD_XSIZE - 8 - 70, 32);
 	FbRotWriteString("Badge for\nVice President");
     }
-    animation_count++;
-    FbSwapBuffers();
-    led_pwm_enable(BADGE_LED_RGB_BLUE, 255);
+    dirty_rows_all();
 }
 
 static void smiley_eye(int x, int y)
@@ -481,32 +332,37 @@ static void smiley_tongue(int x, int y)
 	FbFilledRectangle(5, 20);
 }
 
-void smiley(void)
+static void smiley(void)
 {
 	int dx = popup_time > 20 ? 20 : popup_time;
 
+	/* Nothing moves until the end */
+	if (animation_count && popup_time > 40)
+		return;
+	animation_count++;
+
+	FbClear();
 	smiley_eye(90, 20);
 	smiley_eye(90, 120);
 	smiley_mouth(45, 40);
 	smiley_tongue(30, 60 + dx);
-	FbSwapBuffers();
+	dirty_rows_all();
 }
 
-void matrix(void)
-{
 #define NUM_MATRIX_DOODADS 5
-	static int x[NUM_MATRIX_DOODADS], y[NUM_MATRIX_DOODADS];
-	static int started = 0;
-	if (!started) {
-		FbColor(x11_light_green);
-		FbBackgroundColor(BLACK);
-		FbClear();
-		for (int i = 0; i < NUM_MATRIX_DOODADS; i++) {
-			x[i] = random_num(LCD_XSIZE / 8);
-			y[i] = random_num(LCD_YSIZE / 8);
-		}
-		started = 1;
+static int matrix_x[NUM_MATRIX_DOODADS], matrix_y[NUM_MATRIX_DOODADS];
+
+static void matrix_start(void)
+{
+	for (int i = 0; i < NUM_MATRIX_DOODADS; i++) {
+		matrix_x[i] = screensaver_random(LCD_XSIZE / 8);
+		matrix_y[i] = screensaver_random(LCD_YSIZE / 8);
 	}
+}
+
+static void matrix(void)
+{
+	int *x = matrix_x, *y = matrix_y;
 
 	for (int i = 0; i < NUM_MATRIX_DOODADS; i++) {
 		if (x[i] > 0)
@@ -514,32 +370,32 @@ void matrix(void)
 		else
 			FbColor(x11_dark_green);
 		FbBackgroundColor(BLACK);
-		unsigned char ch = random_num(63) + 'A';
+		unsigned char ch = screensaver_random(63) + 'A';
 		FbMove(x[i] * 8, y[i] * 8);
 		FbRotCharacter(ch);
-		if (random_num(1000) < 900) {
+		dirty_rows_add(y[i] * 8, y[i] * 8 + 7);
+		if (screensaver_random(1000) < 900) {
 			int nx = x[i] + 1;
 			if (nx * 8 <= LCD_XSIZE - 8) {
 				FbColor(x11_dark_green);
 				FbMove(nx * 8, y[i] * 8);
-				ch = random_num(63) + 'A';
+				ch = screensaver_random(63) + 'A';
 				FbRotCharacter(ch);
 			}
 		}
 		x[i] -= 1;
 		if (x[i] < 0) {
 			x[i] = (LCD_XSIZE - 8) / 8;
-			y[i] = random_num(LCD_YSIZE / 8);
+			y[i] = screensaver_random(LCD_YSIZE / 8);
 		}
 	}
-	FbPushBuffer();
 }
 
 const char bs1[] = "Badgedows";
 const char bs2[] = "An error occurred";
 const char bs3[] = "Give up to";
 const char bs4[] = "continue";
-void bluescreen(void)
+static void bluescreen_draw(void)
 {
     FbColor(WHITE);
     FbBackgroundColor(BLUE);
@@ -562,22 +418,25 @@ void bluescreen(void)
 
     FbMove(26, 27);
     FbRotWriteLine(bs1);
-    FbSwapBuffers();
+    dirty_rows_all();
     FbColor(WHITE);
     FbBackgroundColor(BLACK);
 }
 
-const char badgetips_header[] = "--Badge Tip--";
-//const unsigned char badgetip_more_you_know = 
-void just_the_badge_tips(void)
-{
-    static unsigned char tipnum = 0;
-    if(!animation_count){
-        int random;
-        random_insecure_bytes((uint8_t*)&random, sizeof(int));
-        tipnum = random % 19;
+static void bluescreen(void)
+{
+    /* Once more at the end, to give up */
+    if(popup_time < 40 && !animation_count){
         animation_count++;
+        bluescreen_draw();
     }
+}
+
+const char badgetips_header[] = "--Badge Tip--";
+//const unsigned char badgetip_more_you_know =
+static void just_the_badge_tips(void)
+{
+    unsigned char tipnum = screensaver_random(19);
 
     FbBackgroundColor(BLACK);
     FbColor(GREEN);
@@ -646,49 +505,26 @@ void just_the_badge_tips(void)
             FbRotWriteString("Badges are\nhand crafted\nat hackrva");
             break;
     }
-
-    FbSwapBuffers();
 }
 
-#define QIX_LINE_COUNT 20 
-struct qixline {
-	int x[2], y[2];
-	uint16_t color;
-};
+#define QIX_LINE_COUNT 20
+static struct trail_line qix_line[QIX_LINE_COUNT];
 
 static struct qix {
-	struct qixline qline[QIX_LINE_COUNT];
+	struct line_trail trail;
+	int x[2], y[2];
 	int vx[2], vy[2];
-	int head, tail, initialized;
-	int color_angle;
-} the_qix = { 0 };
+} the_qix;
 
 static void init_qix(struct qix *q)
 {
-	q->head = 0;
-	q->tail = QIX_LINE_COUNT - 1;
-	q->qline[0].x[0] = random_num(LCD_XSIZE);
-	q->qline[0].y[0] = random_num(LCD_YSIZE);
-	q->qline[0].x[1] = random_num(LCD_XSIZE);
-	q->qline[0].y[1] = random_num(LCD_YSIZE);
-	q->qline[0].color = WHITE;
-	q->color_angle = 0;
-	q->vx[0] = random_num(17) - 8;
-	q->vy[0] = random_num(17) - 8;
-	q->vx[1] = random_num(17) - 8;
-	q->vy[1] = random_num(17) - 8;
-	q->initialized = 1;
-}
-
-static void draw_qix(struct qix *q)
-{
-	int h = q->head;
-	int t = q->tail;
-	FbColor(q->qline[h].color);
-	FbLine(q->qline[h].x[0], q->qline[h].y[0], q->qline[h].x[1], q->qline[h].y[1]);
-	FbColor(BLACK);
-	FbLine(q->qline[t].x[0], q->qline[t].y[0], q->qline[t].x[1], q->qline[t].y[1]);
-	FbPushBuffer();
+	line_trail_init(&q->trail, qix_line, QIX_LINE_COUNT);
+	for (int i = 0; i < 2; i++) {
+		q->x[i] = screensaver_random(LCD_XSIZE);
+		q->y[i] = screensaver_random(LCD_YSIZE);
+		q->vx[i] = screensaver_random(17) - 8;
+		q->vy[i] = screensaver_random(17) - 8;
+	}
 }
 
 static void qix_advance_point(int *p, int limit, int *vel)
@@ -700,61 +536,149 @@ static void qix_advance_point(int *p, int limit, int *vel)
 	}
 	if (*p >= limit) {
 		*vel = -*vel;
-		*p = limit - (*p - limit);
+		*p = 2 * (limit - 1) - *p;
 	}
 }
 
-static void qix_set_color(struct qixline *line, int color_angle)
+static void qix_start(void)
 {
-	short rs, gs, bs;
-	int r, g, b;
-	int rangle, gangle, bangle;
-	uint16_t color;
+	init_qix(&the_qix);
+}
 
-	rangle = color_angle;
-	gangle = color_angle + (128 / 3);
-	if (gangle > 127)
-		gangle -= 128;
-	bangle = gangle + (128 / 3);
-	if (bangle > 127)
-		bangle -= 128;
-	rs = sine(rangle);
-	gs = sine(gangle);
-	bs = sine(bangle);
+static void qix(void)
+{
+	struct qix *q = &the_qix;
 
-	/* map color values from [-256-255] to [0-512] */
-	r = (int) rs + 256;
-	g = (int) gs + 256;
-	b = (int) bs + 256;
+	line_trail_add(&q->trail, q->x[0], q->y[0], q->x[1], q->y[1],
+		animation_count ? rainbow_color(animation_count - 1) : WHITE);
+	for (int i = 0; i < 2; i++) {
+		qix_advance_point(&q->x[i], LCD_XSIZE, &q->vx[i]);
+		qix_advance_point(&q->y[i], LCD_YSIZE, &q->vy[i]);
+	}
+	animation_count++;
+}
 
-	r = r >> 4; /* top 5 bits */
-	g = g >> 3; /* top 6 bits */
-	b = b >> 4; /* top 5 bits */
+/*
+ * Smiley, the blue screen, the dragon and the president were picked 30% of
+ * the time between them, and the rest 70%.
+ */
+static const struct screensaver screensavers[] = {
+	{ "Badge tips", just_the_badge_tips, NULL, SCHEDULER_ON_INPUT, 50, 14 },
+	{ "Dotty", NULL, dotty, 15, 20, 14 },
+	{ "Pictures", disp_asset_saver, NULL, SCHEDULER_ON_INPUT, 50, 14 },
+	{ "Hack the dragon", hack_the_dragon_start, hack_the_dragon, 15, 20, 15 },
+	{ "Rectangles", NULL, stupid_rects, 6, 20, 14 },
+	{ "Tunnel", carzy_tunnel_start, carzy_tunnel_animator, 15, 20, 14 },
+	{ "For president", for_president_start, for_president, 10, 30, 15 },
+	{ "Smiley", NULL, smiley, 10, 30, 15 },
+	{ "Matrix", matrix_start, matrix, 30, 10, 14 },
+	{ "Blue screen", bluescreen_draw, bluescreen, SCHEDULER_ON_INPUT, 50, 15 },
+	{ "Qix", qix_start, qix, 30, 10, 14 },
+	{ "Hyperspace", hyperspace_start, hyperspace_screen_saver, 30, 10, 14 },
+	{ "Holly", NULL, holly_screensaver, 10, 30, 14 },
+	{ "Name tag", hyperspace_start, nametag_screensaver, 30, 10, 14 },
+};
+
+#define NSCREENSAVERS ((int) (sizeof(screensavers) / sizeof(screensavers[0])))
+
+static const struct screensaver *running;
+static int last_started = -1;
+static uint64_t started_us;
+static int frame_rate;
+static int over_budget;
 
-	color = (r << 11) | (g << 5) | b;
-	line->color = color;
+int screensaver_count(void)
+{
+	return NSCREENSAVERS;
 }
 
-static void move_qix(struct qix *q)
+const struct screensaver *screensaver_get(int n)
 {
-	q->qline[q->tail] = q->qline[q->head];
-	qix_advance_point(&q->qline[q->tail].x[0], LCD_XSIZE, &q->vx[0]);
-	qix_advance_point(&q->qline[q->tail].y[0], LCD_YSIZE, &q->vy[0]);
-	qix_advance_point(&q->qline[q->tail].x[1], LCD_XSIZE, &q->vx[1]);
-	qix_advance_point(&q->qline[q->tail].y[1], LCD_YSIZE, &q->vy[1]);
-	qix_set_color(&q->qline[q->tail], q->color_angle);
-	q->head = q->tail;
-	q->tail = (q->tail + 1) % QIX_LINE_COUNT;
-	q->color_angle++;
-	if (q->color_angle > 127)
-		q->color_angle = 0;
+	if (n < 0 || n >= NSCREENSAVERS)
+		return NULL;
+	return &screensavers[n];
 }
 
-void qix(void)
+int screensaver_pick(void)
 {
-	if (!the_qix.initialized)
-		init_qix(&the_qix);
-	draw_qix(&the_qix);
-	move_qix(&the_qix);
+	int total = 0, pick;
+
+	for (int n = 0; n < NSCREENSAVERS; n++)
+		if (n != last_started)
+			total += screensavers[n].weight;
+	pick = screensaver_random(total);
+	for (int n = 0; n < NSCREENSAVERS; n++) {
+		if (n == last_started)
+			continue;
+		if (pick < screensavers[n].weight)
+			return n;
+		pick -= screensavers[n].weight;
+	}
+	return 0;
 }
 
+void screensaver_start(int n)
+{
+	running = &screensavers[n];
+	last_started = n;
+	animation_count = 0;
+	popup_ticks = 0;
+	popup_time = POPUP_LENGTH;
+	over_budget = 0;
+	frame_rate = running->fps;
+	scheduler_set_frame_rate(frame_rate);
+
+	FbDirectMode();
+	FbBackgroundColor(BLACK);
+	FbColor(WHITE);
+	FbClear();
+	dirty_rows_all();
+	started_us = rtc_get_us_since_boot();
+	if (running->start)
+		running->start();
+}
+
+void screensaver_frame(void)
+{
+	uint64_t now = rtc_get_us_since_boot();
+	uint64_t ticks = (now - started_us) * POPUP_TICKS_PER_SECOND / 1000000;
+
+	if (!running)
+		return;
+	popup_ticks = ticks < POPUP_LENGTH ? ticks : POPUP_LENGTH;
+	popup_time = POPUP_LENGTH - popup_ticks;
+
+	if (running->frame)
+		running->frame();
+	dirty_rows_flush();
+
+	if (frame_rate == SCHEDULER_ON_INPUT || rtc_get_us_since_boot() - now <= running->budget_ms * 1000u) {
+		over_budget = 0;
+	} else if (++over_budget >= OVER_BUDGET_FRAMES && frame_rate > 1) {
+		frame_rate /= 2;
+		scheduler_set_frame_rate(frame_rate);
+		over_budget = 0;
+	}
+}
+
+bool screensaver_running(void)
+{
+	return running != NULL;
+}
+
+bool screensaver_finished(void)
+{
+	return running && rtc_get_us_since_boot() - started_us >= POPUP_SECONDS * 1000000ull;
+}
+
+void screensaver_stop(void)
+{
+	if (!running)
+		return;
+	running = NULL;
+	dirty_rows_clear();
+	FbDirectMode();
+	led_pwm_disable(BADGE_LED_RGB_RED);
+	led_pwm_disable(BADGE_LED_RGB_GREEN);
+	led_pwm_disable(BADGE_LED_RGB_BLUE);
+}
@@ -1,37 +1,57 @@
-/* 
+/*
  * File:   screensavers.h
  * Author: morgan
  *
  * Created on May 28, 2016, 11:42 AM
  */
 
-enum {
-    STUPID_RECTS_SAVER,
-    CARZY_TUNNEL_ANIMATOR_SAVER,
-    HACK_THE_DRAGON_SAVER,
-    FOR_PRESIDENT,
-    SMILEY,
-    MATRIX,
-    BLUESCREEN,
-    DISP_ASSET,
-    QIX,
-    HOLLY_SCREENSAVER,
-    NAMETAG_SCREENSAVER,
+#ifndef SCREENSAVERS_H__
+#define SCREENSAVERS_H__
+
+/*
+ * The screensavers that pop up while the badge is dormant (see badge.c), and
+ * what runs them.
+ *
+ * Each screensaver is an entry in a table: how to draw its first frame and
+ * each one after, the frame rate it wants, the time a frame may take to
+ * draw, and how likely it is to be picked.  Frames draw over the last one
+ * and mark the rows they changed (see screensaver_kernels.h), and only those
+ * rows go to the display.  A still picture asks for SCHEDULER_ON_INPUT,
+ * which while dormant is a frame a second, and draws nothing after its first.
+ *
+ * A screensaver that takes longer than its budget to draw a frame has its
+ * frame rate halved, so the CPU still spends most of the popup asleep.
+ * Popups last the same time whatever the frame rate.
+ */
+
+#include <stdbool.h>
+
+struct screensaver {
+	const char *name;
+	void (*start)(void);	/* draw the first frame; or NULL */
+	void (*frame)(void);	/* draw the next frame; or NULL for a still picture */
+	unsigned char fps;	/* or SCHEDULER_ON_INPUT */
+	unsigned char budget_ms;	/* for drawing a frame */
+	unsigned char weight;	/* how often screensaver_pick() picks it, relative to the others */
 };
 
-void just_the_badge_tips(void);
-void dotty(void);
-void disp_asset_saver(void);
-void hack_the_dragon(void);
-void stupid_rects(void);
-void carzy_tunnel_animator(void);
-void for_president(void);
-void smiley(void);
-void matrix(void);
-void bluescreen(void);
-void qix(void);
-void hyperspace_screen_saver(void);
-void screensaver_set_animation_count(unsigned short count);
-void holly_screensaver(void);
-void nametag_screensaver(void);
+int screensaver_count(void);
+const struct screensaver *screensaver_get(int n);
+
+/* A screensaver at random, by weight, but not the last one started */
+int screensaver_pick(void);
+
+/* Clear the screen, set the frame rate and draw screensaver n's first frame */
+void screensaver_start(int n);
+
+/* Draw the running screensaver's next frame and send the rows that changed */
+void screensaver_frame(void);
+
+/* Whether a screensaver has been started and not stopped, and whether its time is up */
+bool screensaver_running(void);
+bool screensaver_finished(void);
+
+/* Turn off the LEDs the screensaver lit; the screen keeps the last frame */
+void screensaver_stop(void);
 
+#endif
@@ -12,16 +12,25 @@
 #include "key_value_storage.h"
 #include "test-screensavers.h"
 #include "dynmenu.h"
+#include "scheduler.h"
 
 #define PING_REQUEST      0x1000
 #define PING_RESPONSE     0x2000
 
 #define ARRAYSIZE(x) (sizeof(x) / sizeof((x)[0]))
 
-static void save_settings(void) {
+static void write_settings(__attribute__((unused)) void *context) {
     flash_kv_store_binary("sysdata", badge_system_data(), sizeof(SYSTEM_DATA));
 }
 
+// Settings are written a couple of seconds after the last change, so trying out
+// several brightness levels in a row only costs one flash write.
+static struct scheduler_task write_settings_task = SCHEDULER_TASK("settings", write_settings, NULL, 0);
+
+static void save_settings(void) {
+    scheduler_start(&write_settings_task, 2000000);
+}
+
 void ping_cb(__attribute__((unused)) struct menu_t *menu)
 {
     static unsigned char num_pinged = 0;
@@ -316,8 +325,7 @@ static void clear_nvram_init(void)
 
 static void clear_nvram_run(void)
 {
-	dynmenu_draw(&clear_nvram_menu);
-	FbSwapBuffers();
+	dynmenu_show(&clear_nvram_menu);
 
 	int down_latches = button_down_latches();
 	int r0 = button_get_rotation(0);
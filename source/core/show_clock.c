@@ -0,0 +1,82 @@
+/*
+ * The shared show time base. See show_clock.h.
+ *
+ * Followers run a small phase-locked loop: each beacon's error moves the
+ * offset half way towards it, and the error divided by the time since the
+ * last beacon nudges the skew, so a crystal that runs fast or slow stops
+ * showing up as error after a few beacons.  Beacons only come every few
+ * seconds, and 50 ppm either way is a millisecond in ten seconds, so the skew
+ * matters as much as the offset.
+ */
+
+#include "show_clock.h"
+
+/* 2^24ths: 500 ppm, well past anything a crystal does */
+#define MAX_SKEW (500 * 16777 / 1000)
+
+void show_clock_init(struct show_clock *clock)
+{
+    clock->locked = false;
+    clock->outliers = 0;
+    clock->offset_us = 0;
+    clock->skew = 0;
+    clock->ref_us = 0;
+    clock->last_error_us = 0;
+}
+
+static int64_t offset_at(const struct show_clock *clock, uint64_t local_us)
+{
+    return clock->offset_us + ((int64_t) (local_us - clock->ref_us) * clock->skew >> 24);
+}
+
+void show_clock_lead(struct show_clock *clock, uint64_t local_us)
+{
+    clock->offset_us = clock->locked ? offset_at(clock, local_us) : 0;
+    clock->skew = 0;
+    clock->ref_us = local_us;
+    clock->outliers = 0;
+    clock->locked = true;
+}
+
+void show_clock_beacon(struct show_clock *clock, uint32_t show_us, uint64_t local_us)
+{
+    int32_t error = (int32_t) (show_us - show_clock_now(clock, local_us));
+    int64_t offset = offset_at(clock, local_us);
+    uint64_t interval = local_us - clock->ref_us;
+
+    clock->last_error_us = error;
+    if (clock->locked && (error > SHOW_CLOCK_STEP_US || error < -SHOW_CLOCK_STEP_US)) {
+        if (++clock->outliers < SHOW_CLOCK_MAX_OUTLIERS)
+            return;
+    } else if (clock->locked) {
+        int64_t skew = clock->skew;
+
+        if (interval)
+            skew += (int64_t) error * (1 << 24) / (int64_t) interval / 4;
+        clock->skew = skew > MAX_SKEW ? MAX_SKEW : skew < -MAX_SKEW ? -MAX_SKEW : (int32_t) skew;
+        clock->offset_us = offset + error / 2;
+        clock->ref_us = local_us;
+        clock->outliers = 0;
+        return;
+    }
+
+    /* First beacon, or a new time base: step to it */
+    clock->offset_us = offset + error;
+    clock->skew = 0;
+    clock->ref_us = local_us;
+    clock->outliers = 0;
+    clock->locked = true;
+}
+
+uint32_t show_clock_now(const struct show_clock *clock, uint64_t local_us)
+{
+    return (uint32_t) (local_us + offset_at(clock, local_us));
+}
+
+uint64_t show_clock_to_local(const struct show_clock *clock, uint32_t show_us, uint64_t local_us)
+{
+    int32_t ahead = (int32_t) (show_us - show_clock_now(clock, local_us));
+
+    /* ahead is in show time; take the skew out to get local time */
+    return local_us + ahead - ((int64_t) ahead * clock->skew >> 24);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file show_clock.h
+ * @brief a time base shared by a group of badges, kept in step by beacons
+ *
+ * Show time is a 32 bit count of microseconds that all the badges in a show
+ * agree on.  Each badge's show time is its own clock plus an offset: the
+ * leader picks its offset, and followers estimate theirs, and how much faster
+ * or slower their crystal runs than the leader's, from the leader's beacons.
+ * A beacon carries the leader's show time at the moment it was heard, which
+ * ir_send_timed_message() fills in, and the follower notes its own clock when
+ * the receive callback runs.
+ *
+ * This is only arithmetic, with no IR or timers, so that one process can
+ * run a clock for each of many badges (see test_show_sync.c); show_sync.c
+ * keeps the badge's own.  Show times wrap every 71 minutes, so compare them
+ * with show_time_before().
+ */
+
+#ifndef BADGE_C_SHOW_CLOCK_H
+#define BADGE_C_SHOW_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// A beacon further out than this is more likely delayed or from a new leader than a sign of drift.
+#define SHOW_CLOCK_STEP_US (20000)
+
+/// After this many in a row, the beacons are right and the clock steps to them.
+#define SHOW_CLOCK_MAX_OUTLIERS (3)
+
+struct show_clock {
+    bool locked;            ///< has heard a beacon, or is the leader
+    uint8_t outliers;       ///< beacons in a row more than SHOW_CLOCK_STEP_US out
+    int64_t offset_us;      ///< show time minus local time, at ref_us
+    int32_t skew;           ///< how much faster show time runs than local time, in 2^-24ths
+    uint64_t ref_us;        ///< local time of the last beacon
+    int32_t last_error_us;  ///< how far out the last beacon found the clock
+};
+
+/// Unlocked, with show time the same as local time.
+void show_clock_init(struct show_clock *clock);
+
+/// Become the time source. A locked clock keeps its show time going, so followers don't see a jump.
+void show_clock_lead(struct show_clock *clock, uint64_t local_us);
+
+/// A beacon said the show time was show_us when the local clock said local_us.
+void show_clock_beacon(struct show_clock *clock, uint32_t show_us, uint64_t local_us);
+
+/// The show time at local time local_us.
+uint32_t show_clock_now(const struct show_clock *clock, uint64_t local_us);
+
+/// The local time at which it will be (or was) show_us, given that it's now local_us.
+uint64_t show_clock_to_local(const struct show_clock *clock, uint32_t show_us, uint64_t local_us);
+
+static inline bool show_time_before(uint32_t a, uint32_t b)
+{
+    return (int32_t) (a - b) < 0;
+}
+
+#endif //BADGE_C_SHOW_CLOCK_H
@@ -0,0 +1,376 @@
+/*
+ * Group shows kept in step over IR. See show_sync.h.
+ *
+ * Wire format, in the data bytes of an IR_SHOW message:
+ *
+ *   byte 0:    0x50 magic in the high nibble, then the message type
+ *   byte 1:    the leader's epoch, a random number it picks when it starts
+ *              leading, so followers can tell when a different badge has
+ *              taken over and show time may have jumped
+ *   BEACON:    bytes 2-5, the leader's show time as the message was heard,
+ *              little endian, written by ir_send_timed_message()
+ *   CUE:       bytes 2-5, the show time to carry it out at, little endian,
+ *              then the cue type and its args
+ *
+ * Every byte is another NEC frame on the air, a little over 100 ms, so
+ * nothing is sent that the receivers can work out for themselves.
+ */
+
+#include <string.h>
+
+#include "show_sync.h"
+#include "show_clock.h"
+#include "scheduler.h"
+#include "ir.h"
+#include "rtc.h"
+#include "random.h"
+#include "led_pwm.h"
+#include "audio.h"
+
+#define MAGIC_MASK 0xF0
+#define MAGIC 0x50
+#define TYPE_BEACON 1
+#define TYPE_CUE 2
+
+#define BEACON_LENGTH 6
+#define CUE_HEADER_LENGTH 7
+#define MAX_MESSAGE (CUE_HEADER_LENGTH + SHOW_CUE_MAX_ARGS)
+
+/* Air time of one IR message byte (one NEC frame period) */
+#define FRAME_MS 108
+/* Ahead of the data bytes: a couple of backoff slots, then the HAL's throwaway frame and start frame */
+#define SEND_LEAD_MS (100 + 2 * FRAME_MS)
+/* After them, the HAL leaves its receiver off this long before it sends anything else */
+#define SEND_SETTLE_MS 200
+
+#define POLL_US 50000
+#define RX_QUEUE_SIZE 4
+#define MAX_PENDING_CUES 8
+/* A cue due this soon is carried out now rather than waking again for it */
+#define DUE_SLACK_US 200
+
+struct received_message {
+    uint64_t heard_us;
+    uint8_t length;
+    uint8_t data[MAX_MESSAGE];
+};
+
+struct pending_cue {
+    struct show_cue cue;
+    uint64_t due_us;    /* local time */
+};
+
+static struct show_clock clock;
+static uint8_t epoch;
+static bool have_epoch;
+static bool leading;
+static uint64_t lead_until_us;
+static show_cue_callback cue_callback;
+static struct show_sync_stats stats;
+/* Local time our last queued message will have gone out by */
+static uint64_t sent_by_us;
+
+static struct pending_cue pending[MAX_PENDING_CUES];
+static int num_pending;
+
+/* Filled from the IR interrupt, drained by poll() */
+static struct received_message rx_queue[RX_QUEUE_SIZE];
+static volatile int rx_queue_in;
+static volatile int rx_queue_out;
+
+static void poll(void *context);
+static void send_beacon(void *context);
+static void play_due(void *context);
+
+static struct scheduler_task poll_task = SCHEDULER_TASK("show", poll, NULL, POLL_US);
+static struct scheduler_task beacon_task = SCHEDULER_TASK("show beacon", send_beacon, NULL, SHOW_BEACON_PERIOD_MS * 1000);
+static struct scheduler_task cue_task = SCHEDULER_TASK("show cue", play_due, NULL, 0);
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t) (v >> (8 * i));
+}
+
+/* This is called in interrupt context (or from the IR thread in the simulator), as soon as the message is in. */
+static void show_ir_callback(const IR_DATA *data)
+{
+    uint64_t now = rtc_get_us_since_boot();
+
+    if (data->data_length < BEACON_LENGTH || data->data_length > MAX_MESSAGE ||
+        (data->data[0] & MAGIC_MASK) != MAGIC)
+        return;
+
+    int next_in = (rx_queue_in + 1) % RX_QUEUE_SIZE;
+    if (next_in == rx_queue_out)
+        return;
+
+    rx_queue[rx_queue_in].heard_us = now;
+    rx_queue[rx_queue_in].length = data->data_length;
+    memcpy(rx_queue[rx_queue_in].data, data->data, data->data_length);
+    rx_queue_in = next_in;
+}
+
+static void start_cue_task(uint64_t now)
+{
+    uint64_t first = UINT64_MAX;
+
+    for (int i = 0; i < num_pending; i++)
+        if (pending[i].due_us < first)
+            first = pending[i].due_us;
+    if (!num_pending)
+        scheduler_stop(&cue_task);
+    else
+        scheduler_start(&cue_task, first > now ? (uint32_t) (first - now) : 0);
+}
+
+static void play(const struct show_cue *cue)
+{
+    const uint8_t *a = cue->args;
+
+    switch (cue->type) {
+    case SHOW_CUE_LED_FADE:
+        led_effect_fade(a[0], a[1], a[2], a[3] * 10);
+        break;
+    case SHOW_CUE_LED_PULSE:
+        led_effect_pulse(a[0], a[1], a[2], a[3] * 10);
+        break;
+    case SHOW_CUE_LED_STROBE:
+        led_effect_strobe(a[0], a[1], a[2], a[3] * 10, a[4] * 10);
+        break;
+    case SHOW_CUE_LED_RAINBOW:
+        led_effect_rainbow((uint16_t) ((a[0] << 8 | a[1]) * 10));
+        break;
+    case SHOW_CUE_LED_OFF:
+        led_effect_stop();
+        break;
+    case SHOW_CUE_NOTE:
+        audio_out_beep((uint16_t) (a[0] << 8 | a[1]), a[2] * 10);
+        break;
+    default:
+        break;
+    }
+    if (cue_callback)
+        cue_callback(cue);
+}
+
+static void carry_out(const struct show_cue *cue, uint64_t now, int32_t late)
+{
+    if (late > stats.worst_late_us)
+        stats.worst_late_us = late;
+    stats.last_cue_at = cue->at;
+    stats.last_played_us = now;
+    stats.last_late_us = late;
+    stats.cues_played++;
+    play(cue);
+}
+
+static void play_due(__attribute__((unused)) void *context)
+{
+    uint64_t now = rtc_get_us_since_boot();
+
+    for (int i = 0; i < num_pending; ) {
+        if (pending[i].due_us > now + DUE_SLACK_US) {
+            i++;
+            continue;
+        }
+        int32_t late = (int32_t) (now - pending[i].due_us);
+        struct show_cue cue = pending[i].cue;
+
+        pending[i] = pending[--num_pending];
+        carry_out(&cue, now, late);
+    }
+    start_cue_task(rtc_get_us_since_boot());
+}
+
+/* Carry out cue at its show time, by the clock as it was at local time now */
+static void schedule(const struct show_cue *cue, uint64_t now)
+{
+    uint64_t due = show_clock_to_local(&clock, cue->at, now);
+
+    if (num_pending == MAX_PENDING_CUES || (due < now && now - due > SHOW_CUE_LATE_MS * 1000)) {
+        stats.cues_dropped++;
+        return;
+    }
+    pending[num_pending].cue = *cue;
+    pending[num_pending].due_us = due;
+    num_pending++;
+    start_cue_task(rtc_get_us_since_boot());
+}
+
+static void heard_beacon(const struct received_message *m)
+{
+    uint8_t from = m->data[1];
+
+    stats.beacons_heard++;
+    if (leading) {
+        if (from == epoch)
+            return;
+        /* Somebody else has started leading since: the newest leader wins */
+        leading = false;
+        scheduler_stop(&beacon_task);
+    }
+    if (!have_epoch || from != epoch)
+        clock.locked = false;
+    epoch = from;
+    have_epoch = true;
+    show_clock_beacon(&clock, get_le32(&m->data[2]), m->heard_us);
+    stats.last_error_us = clock.last_error_us;
+}
+
+static void heard_cue(const struct received_message *m)
+{
+    struct show_cue cue;
+
+    stats.cues_heard++;
+    if (leading || !clock.locked || !have_epoch || m->data[1] != epoch) {
+        stats.cues_dropped++;
+        return;
+    }
+    cue.at = get_le32(&m->data[2]);
+    cue.type = m->data[6];
+    cue.length = m->length - CUE_HEADER_LENGTH;
+    memset(cue.args, 0, sizeof(cue.args));
+    memcpy(cue.args, &m->data[CUE_HEADER_LENGTH], cue.length);
+    schedule(&cue, m->heard_us);
+}
+
+static void poll(__attribute__((unused)) void *context)
+{
+    while (rx_queue_out != rx_queue_in) {
+        const struct received_message *m = &rx_queue[rx_queue_out];
+
+        if ((m->data[0] & ~MAGIC_MASK) == TYPE_BEACON && m->length == BEACON_LENGTH)
+            heard_beacon(m);
+        else if ((m->data[0] & ~MAGIC_MASK) == TYPE_CUE && m->length >= CUE_HEADER_LENGTH)
+            heard_cue(m);
+        rx_queue_out = (rx_queue_out + 1) % RX_QUEUE_SIZE;
+    }
+}
+
+/* When other badges will have heard a message sent now, which goes out after whatever was sent before it */
+static uint64_t heard_by(uint64_t now, uint8_t length)
+{
+    return (sent_by_us > now ? sent_by_us : now) + (uint64_t) (SEND_LEAD_MS + length * FRAME_MS) * 1000;
+}
+
+/* The HAL queues it and returns straight away */
+static void send(uint8_t *message, uint8_t length, int stamp_at)
+{
+    IR_DATA ir_packet = {
+        .recipient_address = IR_BADGE_ID_BROADCAST,
+        .app_address = IR_SHOW,
+        .data_length = length,
+        .data = message,
+    };
+
+    if (stamp_at < 0)
+        ir_send_complete_message(&ir_packet);
+    else
+        ir_send_timed_message(&ir_packet, stamp_at, clock.offset_us);
+    sent_by_us = heard_by(rtc_get_us_since_boot(), length) + SEND_SETTLE_MS * 1000;
+}
+
+static void send_beacon(__attribute__((unused)) void *context)
+{
+    uint64_t now = rtc_get_us_since_boot();
+    uint8_t message[BEACON_LENGTH] = { MAGIC | TYPE_BEACON, epoch };
+
+    if (now > lead_until_us) {
+        leading = false;
+        scheduler_stop(&beacon_task);
+        return;
+    }
+    send(message, sizeof(message), 2);
+    stats.beacons_sent++;
+}
+
+static void lead(uint64_t now)
+{
+    lead_until_us = now + SHOW_LEAD_TIMEOUT_MS * 1000ULL;
+    if (leading)
+        return;
+    random_insecure_bytes(&epoch, 1);
+    have_epoch = true;
+    show_clock_lead(&clock, now);
+    leading = true;
+    send_beacon(NULL);
+    scheduler_start(&beacon_task, SHOW_BEACON_PERIOD_MS * 1000);
+}
+
+uint32_t show_sync_cue(uint8_t type, const uint8_t *args, uint8_t length, uint32_t delay_ms)
+{
+    uint8_t message[MAX_MESSAGE] = { MAGIC | TYPE_CUE };
+    struct show_cue cue;
+    uint64_t now, heard_us, due_us;
+    uint32_t at;
+
+    if (length > SHOW_CUE_MAX_ARGS)
+        length = SHOW_CUE_MAX_ARGS;
+    /* A cue with no args may come with no args pointer */
+    if (!length)
+        args = message;
+    now = rtc_get_us_since_boot();
+    lead(now);
+
+    due_us = now + delay_ms * 1000ULL;
+    cue.at = show_clock_now(&clock, due_us);
+    cue.type = type;
+    cue.length = length;
+    memset(cue.args, 0, sizeof(cue.args));
+    memcpy(cue.args, args, length);
+
+    /* The other badges can't carry it out before they've heard it, behind any beacon that's queued ahead of it */
+    heard_us = heard_by(now, CUE_HEADER_LENGTH + length);
+    at = show_clock_now(&clock, heard_us > due_us ? heard_us : due_us);
+
+    message[1] = epoch;
+    put_le32(&message[2], at);
+    message[6] = type;
+    memcpy(&message[CUE_HEADER_LENGTH], args, length);
+    send(message, CUE_HEADER_LENGTH + length, -1);
+
+    if (delay_ms)
+        schedule(&cue, now);
+    else
+        carry_out(&cue, now, 0);
+    return at;
+}
+
+void show_sync_init(void)
+{
+    show_clock_init(&clock);
+    ir_set_app_priority(IR_SHOW, IR_PRIORITY_INTERACTIVE);
+    ir_add_callback(show_ir_callback, IR_SHOW);
+    scheduler_start(&poll_task, POLL_US);
+}
+
+void show_sync_set_callback(show_cue_callback callback)
+{
+    cue_callback = callback;
+}
+
+bool show_sync_leading(void)
+{
+    return leading;
+}
+
+bool show_sync_locked(void)
+{
+    return clock.locked;
+}
+
+uint32_t show_sync_now(void)
+{
+    return show_clock_now(&clock, rtc_get_us_since_boot());
+}
+
+void show_sync_get_stats(struct show_sync_stats *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file show_sync.h
+ * @brief group light and sound shows, kept in step over IR
+ *
+ * Broadcasting "turn red" or "play this note" has every badge react whenever
+ * it happens to finish decoding the message, so a room of badges drifts and
+ * flickers out of step.  Instead, one badge leads: it sends a beacon with its
+ * show time (see show_clock.h) every SHOW_BEACON_PERIOD_MS, and cues, which
+ * say "do this at show time T".  Every badge carries out each cue when its own
+ * show time reaches T, so they all change color or start a note within a
+ * millisecond or two of each other.
+ *
+ * Every badge follows from show_sync_init() on; sending a cue makes a badge
+ * the leader until it has sent nothing for SHOW_LEAD_TIMEOUT_MS, or another
+ * badge starts leading.  A badge that hasn't heard a beacon ignores cues.
+ *
+ * Cues are carried out from a scheduler task (see scheduler.h), or straight
+ * from show_sync_cue() for one of this badge's own with no delay; never from
+ * interrupt context.
+ */
+
+#ifndef BADGE_C_SHOW_SYNC_H
+#define BADGE_C_SHOW_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SHOW_BEACON_PERIOD_MS (5000)
+#define SHOW_LEAD_TIMEOUT_MS (60000)
+
+/// A cue this late when it's heard (from a busy channel) is dropped rather than carried out out of step.
+#define SHOW_CUE_LATE_MS (200)
+
+#define SHOW_CUE_MAX_ARGS (5)
+
+/// What a cue does. Times are in hundredths of a second.
+enum show_cue_type {
+    SHOW_CUE_LED_FADE = 0,  ///< red, green, blue, fade time
+    SHOW_CUE_LED_PULSE,     ///< red, green, blue, period
+    SHOW_CUE_LED_STROBE,    ///< red, green, blue, on time, off time
+    SHOW_CUE_LED_RAINBOW,   ///< period, high byte then low
+    SHOW_CUE_LED_OFF,
+    SHOW_CUE_NOTE,          ///< frequency in Hz, high byte then low, then length
+    SHOW_CUE_APP,           ///< nothing built in, just the cue callback
+    SHOW_CUE_TYPES
+};
+
+struct show_cue {
+    uint32_t at;            ///< show time
+    uint8_t type;
+    uint8_t length;
+    uint8_t args[SHOW_CUE_MAX_ARGS];
+};
+
+/// Called as each cue is carried out, after the built in part.
+typedef void (*show_cue_callback)(const struct show_cue *cue);
+
+/// Start following beacons and carrying out cues.
+void show_sync_init(void);
+
+/** Send a cue, to be carried out here and on every badge that hears it.
+ *
+ * It's carried out here delay_ms from now, straight away for 0, and on the
+ * other badges then too, or as soon as they can have heard it if that's
+ * later: a little over a second for a cue with a few args, more if a beacon
+ * is going out ahead of it.  So for this badge to be in step with the rest,
+ * give it a delay that long; the rest are in step with each other either
+ * way.  The cue is queued to send, so this returns straight away.
+ *
+ * @return the show time the other badges will carry it out at
+ */
+uint32_t show_sync_cue(uint8_t type, const uint8_t *args, uint8_t length, uint32_t delay_ms);
+
+/// The callback is for the running app; set it back to NULL when the app exits.
+void show_sync_set_callback(show_cue_callback callback);
+
+bool show_sync_leading(void);
+
+/// Whether show time is shared: this badge leads, or has heard a beacon.
+bool show_sync_locked(void);
+
+uint32_t show_sync_now(void);
+
+struct show_sync_stats {
+    uint32_t beacons_sent;
+    uint32_t beacons_heard;
+    uint32_t cues_heard;
+    uint32_t cues_played;
+    uint32_t cues_dropped;      ///< too late, not locked, or no room
+    int32_t last_error_us;      ///< how far out the last beacon found show time
+    int32_t worst_late_us;      ///< the latest a cue has been carried out, by local clock
+    uint32_t last_cue_at;       ///< show time of the last cue carried out
+    int32_t last_late_us;       ///< how late it was
+    uint64_t last_played_us;    ///< and the local time it was carried out; the host's, in the simulator
+};
+
+void show_sync_get_stats(struct show_sync_stats *stats);
+
+#endif //BADGE_C_SHOW_SYNC_H
@@ -0,0 +1,111 @@
+#include "spatial_hash.h"
+
+#include <string.h>
+
+void spatial_hash_init(struct spatial_hash *h, int cell_shift, uint16_t *bucket, int nbuckets,
+		struct spatial_hash_entry *entry, int max_entries)
+{
+	h->cell_shift = cell_shift;
+	h->bucket = bucket;
+	h->bucket_mask = nbuckets - 1;
+	h->entry = entry;
+	h->max_entries = max_entries < SPATIAL_HASH_NONE ? max_entries : SPATIAL_HASH_NONE;
+	spatial_hash_clear(h);
+}
+
+void spatial_hash_clear(struct spatial_hash *h)
+{
+	memset(h->bucket, 0xff, (h->bucket_mask + 1) * sizeof(h->bucket[0]));
+	h->nentries = 0;
+}
+
+static unsigned int bucket_of(const struct spatial_hash *h, int cx, int cy)
+{
+	uint32_t k = (uint32_t) cx * 0x9e3779b1u ^ (uint32_t) cy * 0x85ebca77u;
+
+	return (k ^ (k >> 16)) & h->bucket_mask;
+}
+
+int spatial_hash_insert(struct spatial_hash *h, uint16_t id, int32_t x, int32_t y, int32_t radius)
+{
+	int cx0 = (x - radius) >> h->cell_shift, cx1 = (x + radius) >> h->cell_shift;
+	int cy0 = (y - radius) >> h->cell_shift, cy1 = (y + radius) >> h->cell_shift;
+
+	if (h->nentries + (cx1 - cx0 + 1) * (cy1 - cy0 + 1) > h->max_entries)
+		return -1;
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			struct spatial_hash_entry *e = &h->entry[h->nentries];
+			unsigned int b = bucket_of(h, cx, cy);
+
+			e->id = id;
+			e->cx = cx;
+			e->cy = cy;
+			e->first_cx = cx0;
+			e->first_cy = cy0;
+			e->next = h->bucket[b];
+			h->bucket[b] = h->nentries++;
+		}
+	}
+	return 0;
+}
+
+static int max_int(int a, int b)
+{
+	return a > b ? a : b;
+}
+
+/*
+ * An object and the query box overlap in a rectangle of cells, and the object
+ * is only reported from the top left one, so it's reported once however many
+ * cells they share.
+ */
+int spatial_hash_query(const struct spatial_hash *h, int32_t x, int32_t y, int32_t radius,
+		uint16_t *id, int max_ids)
+{
+	int cx0 = (x - radius) >> h->cell_shift, cx1 = (x + radius) >> h->cell_shift;
+	int cy0 = (y - radius) >> h->cell_shift, cy1 = (y + radius) >> h->cell_shift;
+	int n = 0;
+
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			for (uint16_t i = h->bucket[bucket_of(h, cx, cy)]; i != SPATIAL_HASH_NONE; i = h->entry[i].next) {
+				const struct spatial_hash_entry *e = &h->entry[i];
+
+				if (e->cx != cx || e->cy != cy)
+					continue; /* another cell in the same bucket */
+				if (cx != max_int(e->first_cx, cx0) || cy != max_int(e->first_cy, cy0))
+					continue; /* reported from another cell */
+				if (n < max_ids)
+					id[n] = e->id;
+				n++;
+			}
+		}
+	}
+	return n;
+}
+
+/* As for queries, each pair is only reported from the top left cell the two share. */
+int spatial_hash_pairs(const struct spatial_hash *h, spatial_hash_pair_fn fn, void *context)
+{
+	int n = 0;
+
+	for (unsigned int b = 0; b <= h->bucket_mask; b++) {
+		for (uint16_t i = h->bucket[b]; i != SPATIAL_HASH_NONE; i = h->entry[i].next) {
+			const struct spatial_hash_entry *e1 = &h->entry[i];
+
+			for (uint16_t j = e1->next; j != SPATIAL_HASH_NONE; j = h->entry[j].next) {
+				const struct spatial_hash_entry *e2 = &h->entry[j];
+
+				if (e1->cx != e2->cx || e1->cy != e2->cy)
+					continue;
+				if (e1->cx != max_int(e1->first_cx, e2->first_cx) ||
+				    e1->cy != max_int(e1->first_cy, e2->first_cy))
+					continue;
+				fn(context, e1->id, e2->id);
+				n++;
+			}
+		}
+	}
+	return n;
+}
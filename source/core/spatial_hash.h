@@ -0,0 +1,69 @@
+#ifndef SPATIAL_HASH_H__
+#define SPATIAL_HASH_H__
+
+/*
+ * Broad phase collision detection: which objects might be touching, without
+ * testing every object against every other.
+ *
+ * Space is divided into square cells, and each object is entered in every
+ * cell its bounding box (x, y +/- radius) touches.  Cells are hashed into a
+ * fixed number of buckets, so the world can be any size.  A query looks in
+ * the cells around a point and returns each object it finds there once; it
+ * is up to the caller to test those candidates properly.
+ *
+ * Coordinates are in whatever units the app uses, typically 8.8 fixed point,
+ * and cells are 1 << cell_shift of those units across.  Cells about the size
+ * of the objects, or of the distance being queried, work best.
+ *
+ * Nothing is allocated: the caller supplies the bucket and entry arrays.
+ * Objects that move are handled by clearing and re-inserting everything each
+ * frame, which is cheap.
+ */
+
+#include <stdint.h>
+
+#define SPATIAL_HASH_NONE 0xffff
+
+struct spatial_hash_entry {
+	uint16_t id;
+	uint16_t next;			/* next entry in the same bucket, or SPATIAL_HASH_NONE */
+	int16_t cx, cy;			/* the cell */
+	int16_t first_cx, first_cy;	/* the object's top left cell, so it's only reported once */
+};
+
+struct spatial_hash {
+	int cell_shift;
+	unsigned int bucket_mask;
+	uint16_t *bucket;		/* first entry in each bucket */
+	struct spatial_hash_entry *entry;
+	int nentries, max_entries;
+};
+
+/* nbuckets must be a power of two.  An object takes an entry per cell it touches. */
+void spatial_hash_init(struct spatial_hash *h, int cell_shift, uint16_t *bucket, int nbuckets,
+		struct spatial_hash_entry *entry, int max_entries);
+
+/* Remove everything */
+void spatial_hash_clear(struct spatial_hash *h);
+
+/* Add object id with a bounding box of x, y +/- radius.  Returns 0, or -1 if there's no room. */
+int spatial_hash_insert(struct spatial_hash *h, uint16_t id, int32_t x, int32_t y, int32_t radius);
+
+/**
+ * spatial_hash_query - objects that might be within radius of (x, y)
+ *
+ * Fills in id[] with up to max_ids objects whose cells overlap those of the
+ * box x, y +/- radius.
+ *
+ * Returns:
+ *   the number of objects found, which may be more than max_ids.
+ */
+int spatial_hash_query(const struct spatial_hash *h, int32_t x, int32_t y, int32_t radius,
+		uint16_t *id, int max_ids);
+
+typedef void (*spatial_hash_pair_fn)(void *context, uint16_t id1, uint16_t id2);
+
+/* Call fn once for each pair of objects which share a cell.  Returns the number of pairs. */
+int spatial_hash_pairs(const struct spatial_hash *h, spatial_hash_pair_fn fn, void *context);
+
+#endif
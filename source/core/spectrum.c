@@ -0,0 +1,77 @@
+#include <string.h>
+
+#include "spectrum.h"
+#include "fft.h"
+#include "fxp_math.h"
+
+static struct spectrum latest;
+static int16_t re[SPECTRUM_POINTS];
+static int16_t im[SPECTRUM_POINTS];
+
+void spectrum_start(void)
+{
+	memset(&latest, 0, sizeof(latest));
+	audio_in_start();
+}
+
+void spectrum_stop(void)
+{
+	audio_in_stop();
+}
+
+uint16_t spectrum_bin_freq(int bin)
+{
+	return (uint16_t) ((bin * AUDIO_IN_SAMPLE_RATE_HZ + SPECTRUM_POINTS / 2) / SPECTRUM_POINTS);
+}
+
+void spectrum_compute(int16_t *samples, struct spectrum *out)
+{
+	int32_t sum = 0, mean;
+	uint64_t squares = 0;
+	uint16_t peak = 0;
+
+	for (int i = 0; i < SPECTRUM_POINTS; i++)
+		sum += samples[i];
+	mean = sum / SPECTRUM_POINTS;
+	for (int i = 0; i < SPECTRUM_POINTS; i++) {
+		int32_t s = samples[i] - mean;
+
+		if (s > 32767)
+			s = 32767;
+		else if (s < -32767)
+			s = -32767;
+		samples[i] = (int16_t) s;
+		squares += (uint64_t) (s * s);
+		if ((uint16_t) (s < 0 ? -s : s) > peak)
+			peak = (uint16_t) (s < 0 ? -s : s);
+	}
+	out->level = (uint16_t) fxp_isqrt((uint32_t) (squares / SPECTRUM_POINTS));
+	out->peak = peak;
+
+	fft_window_hann(samples, SPECTRUM_POINTS);
+	memset(im, 0, sizeof(im));
+	fft_q15(samples, im, SPECTRUM_FFT_BITS);
+	fft_magnitudes(samples, im, out->bins, SPECTRUM_BINS);
+
+	out->loudest_bin = 1;
+	memset(out->bands, 0, sizeof(out->bands));
+	for (int i = 1, band = 0; i < SPECTRUM_BINS; i++) {
+		if (i == 2 << band)
+			band++;
+		if (out->bins[i] > out->bins[out->loudest_bin])
+			out->loudest_bin = (uint16_t) i;
+		if (out->bins[i] > out->bands[band])
+			out->bands[band] = out->bins[i];
+	}
+}
+
+const struct spectrum *spectrum_poll(void)
+{
+	uint32_t block = audio_in_read(re);
+
+	if (block && block != latest.block) {
+		spectrum_compute(re, &latest);
+		latest.block = block;
+	}
+	return &latest;
+}
@@ -0,0 +1,52 @@
+#ifndef SPECTRUM_H__
+#define SPECTRUM_H__
+
+/*
+ * What the microphone hears, for apps to poll each frame: how loud it is,
+ * and how that's spread over frequency.
+ *
+ *	spectrum_start();
+ *	...
+ *	const struct spectrum *s = spectrum_poll();
+ *	if (s->level > 1000)
+ *		something_heard(spectrum_bin_freq(s->loudest_bin));
+ *	...
+ *	spectrum_stop();
+ *
+ * spectrum_poll() does the work, a windowed FFT of the newest block from
+ * audio_in_read(), when there's a new block since the last call, so it costs
+ * nothing in between and an app that polls slower than blocks arrive just
+ * skips some.
+ */
+
+#include <stdint.h>
+
+#include "audio.h"
+
+#define SPECTRUM_FFT_BITS 8
+#define SPECTRUM_POINTS (1 << SPECTRUM_FFT_BITS)	/* AUDIO_IN_BLOCK_SAMPLES */
+#define SPECTRUM_BINS (SPECTRUM_POINTS / 2)
+#define SPECTRUM_BANDS 7	/* octaves: band b is bins 2^b to 2^(b + 1) - 1 */
+
+struct spectrum {
+	uint32_t block;		/* audio_in_read()'s number for the block; 0 before the first */
+	uint16_t level;		/* RMS, 0 to 32767, with any DC offset taken out */
+	uint16_t peak;		/* largest sample either side of 0 */
+	uint16_t loudest_bin;	/* of bins 1 and up */
+	uint16_t bins[SPECTRUM_BINS];	/* magnitudes, up to about a quarter of a sine's amplitude */
+	uint16_t bands[SPECTRUM_BANDS];	/* the largest bin in each */
+};
+
+void spectrum_start(void);
+void spectrum_stop(void);
+
+/* The newest block's spectrum; all zero until there is one */
+const struct spectrum *spectrum_poll(void);
+
+/* Frequency in Hz that bin is centered on */
+uint16_t spectrum_bin_freq(int bin);
+
+/* The FFT behind spectrum_poll(), for a block of SPECTRUM_POINTS samples from elsewhere; samples is overwritten */
+void spectrum_compute(int16_t *samples, struct spectrum *out);
+
+#endif
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
 
 #include "a_star.h"
 
@@ -86,7 +87,171 @@ static int maze_cost(void *context, void *first, void *second)
 	return d;
 }
 
-int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
+/*
+ * Benchmark on random mazes.  Each maze is a grid of cells, about a third of
+ * them walls.  Every search is checked against a breadth first search, and
+ * timed through both a_star() and a_star_indexed().  They share the search
+ * itself and differ only in how a node's index is found, so the times should
+ * be close; a_star_indexed() is there to save working space.
+ */
+#define BENCH_MAX_DIM 64
+#define BENCH_MAX_NODES (BENCH_MAX_DIM * BENCH_MAX_DIM)
+
+struct bench_maze {
+	int dim;
+	unsigned char cell[BENCH_MAX_NODES]; /* 1 = wall */
+};
+
+static unsigned int bench_seed = 12345;
+
+static unsigned int bench_random(void)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return bench_seed >> 8;
+}
+
+static void *bench_neighbor(void *context, void *p, int n)
+{
+	struct bench_maze *m = context;
+	unsigned char *c = p;
+	int i, count = 0, offset = c - m->cell;
+	int x = offset % m->dim;
+	int y = offset / m->dim;
+
+	for (i = 0; i < 4; i++) {
+		int tx = x + xoff[i];
+		int ty = y + yoff[i];
+		if (tx < 0 || ty < 0 || tx >= m->dim || ty >= m->dim)
+			continue;
+		if (m->cell[ty * m->dim + tx])
+			continue;
+		if (count == n)
+			return &m->cell[ty * m->dim + tx];
+		count++;
+	}
+	return NULL;
+}
+
+static int bench_distance(void *context, void *first, void *second)
+{
+	struct bench_maze *m = context;
+	int f = (unsigned char *) first - m->cell;
+	int s = (unsigned char *) second - m->cell;
+
+	return abs(f % m->dim - s % m->dim) + abs(f / m->dim - s / m->dim);
+}
+
+static int bench_index(void *context, void *node)
+{
+	struct bench_maze *m = context;
+
+	return (unsigned char *) node - m->cell;
+}
+
+/* Length of the shortest path in steps, or -1 */
+static int bench_bfs(struct bench_maze *m, int start, int goal)
+{
+	static int dist[BENCH_MAX_NODES];
+	static int queue[BENCH_MAX_NODES];
+	int head = 0, tail = 0, n = m->dim * m->dim;
+
+	for (int i = 0; i < n; i++)
+		dist[i] = -1;
+	dist[start] = 0;
+	queue[tail++] = start;
+	while (head < tail) {
+		int c = queue[head++];
+		void *next;
+		if (c == goal)
+			return dist[c];
+		for (int i = 0; (next = bench_neighbor(m, &m->cell[c], i)); i++) {
+			int ni = (unsigned char *) next - m->cell;
+			if (dist[ni] >= 0)
+				continue;
+			dist[ni] = dist[c] + 1;
+			queue[tail++] = ni;
+		}
+	}
+	return -1;
+}
+
+static int bench_check(struct bench_maze *m, struct a_star_path *path, int start, int goal, int expected)
+{
+	if (!path)
+		return expected == -1;
+	if (path->node_count - 1 != expected)
+		return 0;
+	if (path->path[0] != &m->cell[start] || path->path[path->node_count - 1] != &m->cell[goal])
+		return 0;
+	for (int i = 1; i < path->node_count; i++)
+		if (bench_distance(m, path->path[i - 1], path->path[i]) != 1)
+			return 0;
+	return 1;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int benchmark(int dim, int nmazes)
+{
+	static struct bench_maze m;
+	static unsigned char nodeset1[A_STAR_NODESET_SIZE(BENCH_MAX_NODES)];
+	static unsigned char nodeset2[A_STAR_NODESET_SIZE(BENCH_MAX_NODES)];
+	static unsigned char scoremap1[A_STAR_SCOREMAP_SIZE(BENCH_MAX_NODES)];
+	static unsigned char scoremap2[A_STAR_SCOREMAP_SIZE(BENCH_MAX_NODES)];
+	static unsigned char nodemap[A_STAR_NODEMAP_SIZE(BENCH_MAX_NODES)];
+	static unsigned char a_star_path1[A_STAR_PATH_SIZE(BENCH_MAX_NODES)];
+	static unsigned char a_star_path2[A_STAR_PATH_SIZE(BENCH_MAX_NODES)];
+	static void *indexed_ws[A_STAR_INDEXED_WORKSPACE_SIZE(BENCH_MAX_NODES) / sizeof(void *) + 1];
+	struct a_star_working_space ws = {
+		{ nodeset1, nodeset2 }, nodemap, { scoremap1, scoremap2 }, { a_star_path1, a_star_path2 },
+	};
+	int nnodes = dim * dim, failures = 0, found = 0;
+	double t, shim_time = 0, indexed_time = 0;
+
+	m.dim = dim;
+	for (int i = 0; i < nmazes; i++) {
+		int start, goal, expected;
+		struct a_star_path *path;
+
+		for (int j = 0; j < nnodes; j++)
+			m.cell[j] = bench_random() % 100 < 30;
+		do {
+			start = bench_random() % nnodes;
+			goal = bench_random() % nnodes;
+		} while (m.cell[start] || m.cell[goal]);
+		expected = bench_bfs(&m, start, goal);
+		found += expected >= 0;
+
+		t = now_seconds();
+		path = a_star(&m, &ws, &m.cell[start], &m.cell[goal], nnodes,
+				bench_distance, bench_distance, bench_neighbor);
+		shim_time += now_seconds() - t;
+		if (!bench_check(&m, path, start, goal, expected)) {
+			printf("a_star() gave a wrong answer on %dx%d maze %d\n", dim, dim, i);
+			failures++;
+		}
+
+		t = now_seconds();
+		path = a_star_indexed(&m, indexed_ws, &m.cell[start], &m.cell[goal], nnodes,
+				bench_distance, bench_distance, bench_neighbor, bench_index);
+		indexed_time += now_seconds() - t;
+		if (!bench_check(&m, path, start, goal, expected)) {
+			printf("a_star_indexed() gave a wrong answer on %dx%d maze %d\n", dim, dim, i);
+			failures++;
+		}
+	}
+	printf("%dx%d: %d mazes (%d solvable), a_star() %.1f us/search, a_star_indexed() %.1f us/search\n",
+		dim, dim, nmazes, found, 1e6 * shim_time / nmazes, 1e6 * indexed_time / nmazes);
+	return failures;
+}
+
+int main(int argc, char *argv[])
 {
 	static int maxnodes, i;
 	char *start, *goal;
@@ -127,5 +292,11 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
 
 	printf("%s\n", maze);
 
+	int nmazes = argc > 1 ? atoi(argv[1]) : 100;
+	int failures = benchmark(32, nmazes) + benchmark(BENCH_MAX_DIM, nmazes);
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
 	return 0;
 }
@@ -0,0 +1,111 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "accelerometer_motion.h"
+#include "test_helpers.h"
+
+/*
+ * Feeds the accelerometer filter made up movements at the sample rate and
+ * checks the tilt it works out and the taps and shakes it sees.
+ */
+
+#define RATE ACCELEROMETER_SAMPLE_RATE_HZ
+#define DEGREES(a) ((int) ((int16_t) (a) * 360L / 65536))
+
+static struct accelerometer_filter filter;
+
+static void add(int x, int y, int z, int n)
+{
+	union acceleration a = { .x = x, .y = y, .z = z };
+
+	for (int i = 0; i < n; i++)
+		accelerometer_filter_add(&filter, a);
+}
+
+static uint32_t take_events(void)
+{
+	uint32_t events = filter.events;
+
+	filter.events = 0;
+	return events;
+}
+
+static void test_tilt(void)
+{
+	struct accelerometer_motion m;
+
+	accelerometer_filter_init(&filter);
+	add(0, 0, 1000, RATE);
+	accelerometer_filter_motion(&filter, &m);
+	expect("pitch lying face up", DEGREES(m.pitch), -1, 1);
+	expect("roll lying face up", DEGREES(m.roll), -1, 1);
+	expect("gravity lying face up", m.gravity.z, 990, 1000);
+
+	/* Standing up, USB port at the bottom: the reading points up, which is -x */
+	add(-1000, 0, 0, RATE);
+	accelerometer_filter_motion(&filter, &m);
+	expect("pitch standing up", DEGREES(m.pitch), 89, 90);
+
+	/* Leaning 30 degrees to the right: the left edge, -y, is up */
+	add(-866, -500, 0, RATE);
+	accelerometer_filter_motion(&filter, &m);
+	expect("roll leaning right", DEGREES(m.roll), 29, 30);
+
+	add(0, 0, -1000, RATE);
+	accelerometer_filter_motion(&filter, &m);
+	expect("pitch face down", DEGREES((uint16_t) (m.pitch + 0x8000)), -1, 1);
+	expect("samples", m.samples, 4 * RATE, 4 * RATE);
+	expect("no events from tilting", take_events(), 0, 0);
+}
+
+static void test_tap(void)
+{
+	accelerometer_filter_init(&filter);
+	add(0, 0, 1000, RATE);
+
+	/* A knock on the face: 10 ms of 2.5 g, and some ringing after */
+	add(0, 0, 3500, 2);
+	add(0, 0, 300, 1);
+	add(0, 0, 1600, 2);
+	add(0, 0, 1000, RATE / 2);
+	expect("tap", take_events(), ACCELEROMETER_EVENT_TAP, ACCELEROMETER_EVENT_TAP);
+
+	/* Held down hard for a while isn't a tap */
+	add(0, 2000, 1000, RATE / 10);
+	add(0, 0, 1000, RATE);
+	expect("push", take_events(), 0, 0);
+}
+
+static void test_shake(void)
+{
+	struct accelerometer_motion m;
+
+	accelerometer_filter_init(&filter);
+	add(0, 0, 1000, RATE);
+
+	/* Shaken side to side at 4 Hz, 1.5 g each way, for a second */
+	for (int i = 0; i < RATE; i++)
+		add(0, (int) (1500 * sin(2 * M_PI * 4 * i / RATE)), 1000, 1);
+	expect("shake", take_events(), ACCELEROMETER_EVENT_SHAKE, ACCELEROMETER_EVENT_SHAKE);
+	accelerometer_filter_motion(&filter, &m);
+	expect("gravity through a shake", m.gravity.z, 950, 1050);
+
+	/* One long jolt, then another a second later, is two bumps, not a shake */
+	add(0, 0, 1000, RATE);
+	add(1500, 0, 1000, RATE / 10);
+	add(0, 0, 1000, RATE);
+	add(1500, 0, 1000, RATE / 10);
+	add(0, 0, 1000, RATE);
+	add(1500, 0, 1000, RATE / 10);
+	add(0, 0, 1000, RATE);
+	expect("separate bumps", take_events(), 0, 0);
+}
+
+int main(void)
+{
+	test_tilt();
+	test_tap();
+	test_shake();
+
+	return test_summary("accelerometer motion");
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "audio.h"
+#include "audio_mixer.h"
+#include "test_helpers.h"
+
+/*
+ * Mixes voices a block at a time, the way the audio HAL does, and checks
+ * their pitch, envelopes, lengths and mixing.
+ */
+
+#define RATE 22050
+
+static int16_t out[RATE];
+
+static void hal_start(void);
+
+/*
+ * The HAL's side of the mixer, all on the one thread.  With hal_idle set it
+ * works like audio_rp2040.c: output that's stopped is started by the first
+ * sound played, filling its first two blocks there and then.
+ */
+static bool hal_idle, hal_streaming;
+static int hal_starts;
+
+void audio_mixer_submit(const struct audio_command *cmd)
+{
+	audio_mixer_apply(cmd);
+	if (hal_idle && !hal_streaming && audio_mixer_active())
+		hal_start();
+}
+
+static int callback_depth, callback_depth_max;
+
+void audio_post_callback(void (*callback)(void))
+{
+	if (audio_mixer_hold_callback(callback))
+		return;
+	if (++callback_depth > callback_depth_max)
+		callback_depth_max = callback_depth;
+	callback();
+	callback_depth--;
+}
+
+/* Mix n samples in blocks of 256, like audio_rp2040.c */
+static void mix(int n)
+{
+	for (int i = 0; i < n; i += 256)
+		audio_mixer_fill(out + i, n - i < 256 ? n - i : 256);
+}
+
+static int rising_crossings(int n)
+{
+	int count = 0;
+
+	for (int i = 1; i < n; i++)
+		if (out[i - 1] < 0 && out[i] >= 0)
+			count++;
+	return count;
+}
+
+static int peak(int from, int to)
+{
+	int max = 0;
+
+	for (int i = from; i < to; i++)
+		if (abs(out[i]) > max)
+			max = abs(out[i]);
+	return max;
+}
+
+static void test_waves(void)
+{
+	static const int8_t sine[8] = { 0, 90, 127, 90, 0, -90, -127, -90 };
+	struct audio_sound square = { .wave = AUDIO_WAVE_SQUARE, .volume = 255 };
+	struct audio_sound triangle = { .wave = AUDIO_WAVE_TRIANGLE, .volume = 128 };
+	struct audio_sound table = { .wave = AUDIO_WAVE_TABLE, .volume = 255, .table = sine, .table_len = 8 };
+
+	audio_mixer_init(RATE);
+	expect("voice", audio_voice_play(3, &square, 440, 0), 3, 3);
+	mix(RATE);
+	expect("square wave cycles in a second", rising_crossings(RATE), 439, 441);
+	expect("square wave level", peak(0, RATE), 32000, 32767);
+	audio_voice_stop(3);
+
+	audio_voice_play(3, &triangle, 1000, 0);
+	mix(RATE);
+	expect("triangle wave cycles in a second", rising_crossings(RATE), 999, 1001);
+	expect("triangle wave at half volume", peak(0, RATE), 16000, 16384);
+	audio_voice_stop(3);
+
+	audio_voice_play(3, &table, 100, 0);
+	mix(RATE);
+	expect("wavetable cycles in a second", rising_crossings(RATE), 99, 101);
+	audio_voice_stop(3);
+	if (audio_mixer_active())
+		fail("voices playing after stopping them", 1);
+}
+
+static int finished_at;
+static int mixed;
+
+static void finished(void)
+{
+	finished_at = mixed;
+}
+
+static void test_envelope(void)
+{
+	struct audio_sound sound = {
+		.wave = AUDIO_WAVE_SQUARE, .volume = 255,
+		.attack_ms = 100, .decay_ms = 100, .sustain = 128, .release_ms = 200,
+	};
+	int release;
+
+	audio_mixer_init(RATE);
+	audio_mixer_play(1, &sound, 1000, 500, finished);
+	finished_at = -1;
+	for (mixed = 0; mixed < RATE; mixed++)
+		audio_mixer_fill(out + mixed, 1);
+	expect("start of the attack", peak(0, 100), 0, 32767 / 20);
+	expect("end of the attack", peak(RATE / 10 - 50, RATE / 10), 31000, 32767);
+	expect("sustain", peak(RATE * 3 / 10, RATE * 4 / 10), 16000, 16500);
+	release = RATE / 2;
+	expect("release", peak(release + RATE / 10 - 50, release + RATE / 10), 7500, 8500);
+	expect("finished after the release", finished_at, release + RATE / 5 - 2, release + RATE / 5 + 2);
+	expect("silent after the release", peak(release + RATE / 5 + 2, RATE), 0, 0);
+
+	/* Restarting it means the first never finishes */
+	finished_at = -1;
+	audio_mixer_play(1, &sound, 1000, 10, finished);
+	audio_voice_play(1, &sound, 1000, 10);
+	mix(RATE);
+	expect("finished after being played over", finished_at, -1, -1);
+}
+
+static int beeps;
+
+/* Plays the next note from the end of the last, like music.c */
+static void next_beep(void)
+{
+	static const struct audio_sound sound = { .volume = 255 };
+
+	if (++beeps < 10)
+		audio_mixer_play(AUDIO_VOICE_BEEP, &sound, 2205, 10, next_beep);
+}
+
+static void test_chaining(void)
+{
+	static const struct audio_sound sound = { .volume = 255 };
+
+	audio_mixer_init(RATE);
+	beeps = 0;
+	audio_mixer_play(AUDIO_VOICE_BEEP, &sound, 2205, 10, next_beep);
+	mix(RATE);
+	expect("notes played one after the other", beeps, 10, 10);
+	/* Ten notes of exactly 22 cycles with no gap between them */
+	expect("cycles in the notes", rising_crossings(RATE), 219, 220);
+	expect("silence after the notes", peak(2205, RATE), 0, 0);
+}
+
+static void hal_start(void)
+{
+	hal_starts++;
+	hal_streaming = true;
+	audio_mixer_hold_callbacks();
+	audio_mixer_fill(out, 256);
+	audio_mixer_fill(out + 256, 256);
+	audio_mixer_release_callbacks();
+}
+
+static int beeps_left;
+
+/* Like gulag.c's explosions, through audio_out_beep_with_cb(): a 1 ms beep that plays the next when it ends */
+static void random_1ms_beep(void)
+{
+	static const struct audio_sound sound = { .volume = 192 };
+
+	if (beeps_left <= 0)
+		return;
+	beeps_left--;
+	audio_mixer_play(AUDIO_VOICE_BEEP, &sound, 2000 + beeps_left * 10, 1, random_1ms_beep);
+}
+
+static void test_chaining_from_idle(void)
+{
+	int blocks;
+
+	audio_mixer_init(RATE);
+	hal_idle = true;
+	hal_streaming = false;
+	hal_starts = 0;
+	callback_depth_max = 0;
+	beeps_left = 201;
+	random_1ms_beep();
+	/* The DMA interrupt, until the output goes quiet */
+	for (blocks = 0; blocks < 100 && audio_mixer_active(); blocks++)
+		audio_mixer_fill(out, 256);
+	hal_idle = false;
+
+	expect("starts", hal_starts, 1, 1);
+	expect("callbacks inside callbacks", callback_depth_max, 1, 2);
+	expect("beeps played", beeps_left, 0, 0);
+	/* 201 beeps of 22 samples is 18 blocks; the first chained one waits a block */
+	expect("blocks played", blocks, 18, 20);
+}
+
+static void test_voices(void)
+{
+	static const int8_t ramp[4] = { 127, 64, -64, -127 };
+	struct audio_sound quiet = { .volume = 100 };
+	struct audio_sound sample = { .wave = AUDIO_WAVE_SAMPLE, .volume = 255, .table = ramp, .table_len = 4 };
+	int used = 0;
+
+	audio_mixer_init(RATE);
+	for (int i = 0; i < AUDIO_VOICES - 1; i++) {
+		int voice = audio_voice_play(AUDIO_VOICE_ANY, &quiet, 500, 0);
+
+		if (voice == AUDIO_VOICE_BEEP || voice < 0)
+			fail("voice picked", voice);
+		else
+			used |= 1 << voice;
+	}
+	expect("different voices", __builtin_popcount(used), AUDIO_VOICES - 1, AUDIO_VOICES - 1);
+	/* No voice free: the first one started goes */
+	expect("voice taken over", audio_voice_play(AUDIO_VOICE_ANY, &sample, RATE, 0), 1, 1);
+	mix(RATE);
+	expect("voices together clip", peak(0, RATE), 32767, 32768);
+	if (audio_voice_is_playing(1))
+		fail("sample playing after its end", 1);
+	if (!audio_voice_is_playing(2))
+		fail("other voices stopped", 2);
+
+	for (int i = 0; i < AUDIO_VOICES; i++)
+		audio_voice_release(i);
+	if (audio_mixer_active())
+		fail("voices playing after releasing them", 1);
+	expect("voice out of range", audio_voice_play(AUDIO_VOICES, &quiet, 500, 0), -1, -1);
+}
+
+int main(void)
+{
+	test_waves();
+	test_envelope();
+	test_chaining();
+	test_chaining_from_idle();
+	test_voices();
+
+	return test_summary("audio mixer");
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+
+#include "button.h"
+#include "button_events.h"
+#include "test_helpers.h"
+
+/*
+ * Checks the button event queue, and the repeat, long press and encoder
+ * helpers, feeding them events the way the button HAL would.
+ */
+
+static void test_queue(void)
+{
+	struct button_event e;
+	int n;
+
+	button_event_flush();
+	if (button_event_get(&e))
+		fail("event from an empty queue", e.button);
+
+	/* Two quick presses of one button are two presses, in order, with their times */
+	button_event_put(BADGE_BUTTON_A, BUTTON_EVENT_DOWN, 100);
+	button_event_put(BADGE_BUTTON_A, BUTTON_EVENT_UP, 200);
+	button_event_put(BADGE_BUTTON_A, BUTTON_EVENT_DOWN, 300);
+	button_event_put(BADGE_BUTTON_ENCODER_A, BUTTON_EVENT_CW, 400);
+	for (n = 0; button_event_get(&e); n++) {
+		expect_equal("event time", e.timestamp_us, 100 * (n + 1));
+		if (n == 1)
+			expect_equal("second event", e.type, BUTTON_EVENT_UP);
+		if (n == 3)
+			expect_equal("rotation", e.button, BADGE_BUTTON_ENCODER_A);
+	}
+	expect_equal("events queued", n, 4);
+
+	/* Once full, new events are dropped and counted, keeping the oldest */
+	for (int i = 0; i < BUTTON_EVENT_QUEUE_SIZE + 5; i++)
+		button_event_put(BADGE_BUTTON_B, BUTTON_EVENT_DOWN, i);
+	expect_equal("dropped events", button_events_dropped(), 5);
+	for (n = 0; button_event_get(&e); n++)
+		expect_equal("kept event", e.timestamp_us, n);
+	expect_equal("events in a full queue", n, BUTTON_EVENT_QUEUE_SIZE);
+
+	/* The queue keeps working around the wrap */
+	for (int i = 0; i < 3 * BUTTON_EVENT_QUEUE_SIZE; i++) {
+		button_event_put(BADGE_BUTTON_UP, BUTTON_EVENT_DOWN, i);
+		if (!button_event_get(&e) || e.timestamp_us != (uint32_t) i)
+			fail("event after wrapping", i);
+	}
+
+	button_event_put(BADGE_BUTTON_UP, BUTTON_EVENT_DOWN, 0);
+	button_event_flush();
+	if (button_event_get(&e))
+		fail("event after flushing", e.button);
+}
+
+static struct button_event event(BADGE_BUTTON button, enum button_event_type type, uint32_t t)
+{
+	return (struct button_event) { .timestamp_us = t, .button = button, .type = type };
+}
+
+static void test_repeat(void)
+{
+	struct button_repeat r = BUTTON_REPEAT(BADGE_BUTTON_LEFT, 400000, 100000);
+	struct button_event e;
+	int presses = 0;
+
+	e = event(BADGE_BUTTON_RIGHT, BUTTON_EVENT_DOWN, 0);
+	expect_equal("another button", button_repeat_event(&r, &e), 0);
+
+	e = event(BADGE_BUTTON_LEFT, BUTTON_EVENT_DOWN, 1000000);
+	presses += button_repeat_event(&r, &e);
+	expect_equal("press", presses, 1);
+	presses += button_repeat_poll(&r, 1399999);
+	expect_equal("before the delay", presses, 1);
+	presses += button_repeat_poll(&r, 1400000);
+	expect_equal("after the delay", presses, 2);
+	/* A slow frame catches up */
+	presses += button_repeat_poll(&r, 1750000);
+	expect_equal("repeats over a slow frame", presses, 5);
+	e = event(BADGE_BUTTON_LEFT, BUTTON_EVENT_UP, 1760000);
+	presses += button_repeat_event(&r, &e);
+	presses += button_repeat_poll(&r, 3000000);
+	expect_equal("after letting go", presses, 5);
+
+	/* Around the 32 bit clock wrapping */
+	e = event(BADGE_BUTTON_LEFT, BUTTON_EVENT_DOWN, 0xffff0000u);
+	button_repeat_event(&r, &e);
+	expect_equal("repeats across the wrap", button_repeat_poll(&r, 0xffff0000u + 600000), 3);
+}
+
+static void test_long_press(void)
+{
+	struct button_long_press p = BUTTON_LONG_PRESS(BADGE_BUTTON_A, 1000000);
+	struct button_event e;
+
+	e = event(BADGE_BUTTON_A, BUTTON_EVENT_DOWN, 5000000);
+	expect_equal("down", button_long_press_event(&p, &e), BUTTON_PRESS_NONE);
+	expect_equal("held a while", button_long_press_poll(&p, 5500000), BUTTON_PRESS_NONE);
+	e = event(BADGE_BUTTON_A, BUTTON_EVENT_UP, 5600000);
+	expect_equal("short press", button_long_press_event(&p, &e), BUTTON_PRESS_SHORT);
+
+	e = event(BADGE_BUTTON_A, BUTTON_EVENT_DOWN, 6000000);
+	button_long_press_event(&p, &e);
+	expect_equal("long press while held", button_long_press_poll(&p, 7000000), BUTTON_PRESS_LONG);
+	expect_equal("long press once", button_long_press_poll(&p, 7100000), BUTTON_PRESS_NONE);
+	e = event(BADGE_BUTTON_A, BUTTON_EVENT_UP, 7200000);
+	expect_equal("up after a long press", button_long_press_event(&p, &e), BUTTON_PRESS_NONE);
+
+	/* Nobody polled while it was held */
+	e = event(BADGE_BUTTON_A, BUTTON_EVENT_DOWN, 8000000);
+	button_long_press_event(&p, &e);
+	e = event(BADGE_BUTTON_A, BUTTON_EVENT_UP, 9500000);
+	expect_equal("long press seen on the way up", button_long_press_event(&p, &e), BUTTON_PRESS_LONG);
+}
+
+static void test_encoder(void)
+{
+	struct button_encoder enc = BUTTON_ENCODER(BADGE_BUTTON_ENCODER_A);
+	struct button_event e;
+	int steps = 0;
+
+	/* Slowly: a step a detent */
+	for (int i = 0; i < 10; i++) {
+		e = event(BADGE_BUTTON_ENCODER_A, BUTTON_EVENT_CW, 1000000 + i * 200000);
+		steps += button_encoder_event(&enc, &e);
+	}
+	expect_equal("slow turn", steps, 10);
+
+	/* The other encoder isn't this one */
+	e = event(BADGE_BUTTON_ENCODER_2_A, BUTTON_EVENT_CW, 3000000);
+	expect_equal("other encoder", button_encoder_event(&enc, &e), 0);
+
+	/* Quickly: more steps a detent, up to the limit */
+	steps = 0;
+	for (int i = 0; i < 20; i++) {
+		e = event(BADGE_BUTTON_ENCODER_A, BUTTON_EVENT_CCW, 4000000 + i * 5000);
+		steps = button_encoder_event(&enc, &e);
+	}
+	expect_equal("quick turn", steps, -BUTTON_ENCODER_MAX_STEPS);
+
+	/* Turning back is fine adjustment again */
+	e = event(BADGE_BUTTON_ENCODER_A, BUTTON_EVENT_CW, 4105000);
+	expect_equal("reversing", button_encoder_event(&enc, &e), 1);
+
+	/* Moderately quickly: somewhere in between */
+	for (int i = 1; i <= 10; i++) {
+		e = event(BADGE_BUTTON_ENCODER_A, BUTTON_EVENT_CW, 4105000 + i * 40000);
+		steps = button_encoder_event(&enc, &e);
+	}
+	if (steps <= 1 || steps >= BUTTON_ENCODER_MAX_STEPS)
+		fail("moderate turn", steps);
+}
+
+int main(void)
+{
+	test_queue();
+	test_repeat();
+	test_long_press();
+	test_encoder();
+
+	return test_summary("button event");
+}
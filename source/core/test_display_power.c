@@ -0,0 +1,194 @@
+#include <stdio.h>
+
+#include "display_power.h"
+#include "badge.h"
+#include "button.h"
+#include "delay.h"
+#include "framebuffer.h"
+#include "ir.h"
+#include "led_pwm.h"
+#include "rtc.h"
+#include "scheduler.h"
+#include "test_helpers.h"
+
+/*
+ * Runs the display power manager under the scheduler against a pretend
+ * clock, checking the controller modes and backlight it picks, and its
+ * wake times and savings.
+ */
+
+static uint64_t now_us = 1000000;
+static unsigned int input_ms;
+static int ir_count;
+static enum display_power power;
+static int partial_first, partial_count;
+static int backlight;
+static bool redraw;	/* push a frame next frame */
+
+struct framebuffer_t G_Fb;
+static SYSTEM_DATA sysdata = { .backlight = 255 };
+
+uint64_t rtc_get_us_since_boot(void)
+{
+	return now_us;
+}
+
+uint64_t rtc_get_ms_since_boot(void)
+{
+	return now_us / 1000;
+}
+
+unsigned int button_last_input_timestamp(void)
+{
+	return input_ms;
+}
+
+int ir_message_count(void)
+{
+	return ir_count;
+}
+
+void lp_sleep_us(uint64_t time)
+{
+	now_us += time;
+}
+
+SYSTEM_DATA *badge_system_data(void)
+{
+	return &sysdata;
+}
+
+void led_pwm_enable(BADGE_LED led, uint8_t duty)
+{
+	if (led == BADGE_LED_DISPLAY_BACKLIGHT)
+		backlight = duty;
+}
+
+void led_pwm_disable(BADGE_LED led)
+{
+	if (led == BADGE_LED_DISPLAY_BACKLIGHT)
+		backlight = 0;
+}
+
+void display_set_power(enum display_power new_power)
+{
+	/* Waking from sleep holds up the first frame, as on the badge */
+	if (power == DISPLAY_POWER_SLEEP && new_power != DISPLAY_POWER_SLEEP)
+		now_us += 120000;
+	power = new_power;
+}
+
+enum display_power display_get_power(void)
+{
+	return power;
+}
+
+void display_set_partial(int first, int count)
+{
+	partial_first = first;
+	partial_count = count;
+}
+
+static void frame(__attribute__((unused)) void *context)
+{
+	if (redraw) {
+		G_Fb.pushes++;
+		redraw = false;
+	}
+	display_power_update();
+}
+
+static void run_for(uint64_t us)
+{
+	uint64_t end = now_us + us;
+
+	while (now_us < end) {
+		uint64_t next = scheduler_run();
+
+		if (next > now_us)
+			lp_sleep_us(next - now_us);
+	}
+}
+
+static void press(void)
+{
+	input_ms = (unsigned int) (now_us / 1000);
+}
+
+static void test_static(void)
+{
+	run_for(1000000);
+	expect("animating", power, DISPLAY_POWER_NORMAL, DISPLAY_POWER_NORMAL);
+
+	/* An app that only draws on input, using the top 40 rows */
+	scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+	display_power_set_rows(0, 40);
+	press();
+	run_for(500000);
+	expect("just after input", power, DISPLAY_POWER_NORMAL, DISPLAY_POWER_NORMAL);
+	run_for(2000000);
+	expect("static", power, DISPLAY_POWER_STATIC, DISPLAY_POWER_STATIC);
+	expect("partial rows", partial_count, 40, 40);
+	press();
+	run_for(100000);
+	expect("static after input", power, DISPLAY_POWER_NORMAL, DISPLAY_POWER_NORMAL);
+	expect("partial after input", partial_count, 0, 0);
+
+	/* The next app's rows are its own */
+	scheduler_set_frame_rate(SCHEDULER_DEFAULT_FPS);
+	run_for(100000);
+	scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+	run_for(3000000);
+	expect("the next app", power, DISPLAY_POWER_STATIC, DISPLAY_POWER_STATIC);
+	expect("the next app's rows", partial_count, 0, 0);
+	scheduler_set_frame_rate(SCHEDULER_DEFAULT_FPS);
+	run_for(100000);
+}
+
+static void test_doze(void)
+{
+	struct display_power_stats stats;
+
+	scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+	display_power_doze();
+	expect("dozing", power, DISPLAY_POWER_IDLE, DISPLAY_POWER_IDLE);
+	expect("backlight dozing", backlight, 0, 0);
+	run_for(4000000);
+	expect("still dozing", power, DISPLAY_POWER_IDLE, DISPLAY_POWER_IDLE);
+	run_for(2000000);
+	expect("asleep", power, DISPLAY_POWER_SLEEP, DISPLAY_POWER_SLEEP);
+
+	/* Woken from sleep: the first frame waits for the controller */
+	scheduler_set_frame_rate(SCHEDULER_DEFAULT_FPS);
+	display_power_wake();
+	redraw = true;
+	run_for(200000);
+	expect("awake", power, DISPLAY_POWER_NORMAL, DISPLAY_POWER_NORMAL);
+	expect("backlight awake", backlight, 255, 255);
+	display_power_get_stats(&stats);
+	expect("wakes", stats.wakes, 1, 1);
+	expect("wake from sleep", stats.last_wake_us, 120000, 160000);
+
+	/* Woken from idle: straight away */
+	display_power_doze();
+	run_for(1000000);
+	display_power_wake();
+	redraw = true;
+	run_for(100000);
+	display_power_get_stats(&stats);
+	expect("wake from idle", stats.last_wake_us, 0, 40000);
+	expect("slowest wake", stats.max_wake_us, 120000, 160000);
+	expect("time asleep", (long) (stats.mode_us[DISPLAY_POWER_SLEEP] / 1000), 900, 1100);
+	expect("time dozing", (long) (stats.mode_us[DISPLAY_POWER_IDLE] / 1000), 5900, 6100);
+	/* Mostly the backlight: 23 mA for 7 s is 45 uAh, and the static screens save a little */
+	expect("saved", stats.saved_uah, 44, 50);
+}
+
+int main(void)
+{
+	scheduler_set_frame(frame, NULL);
+	test_static();
+	test_doze();
+
+	return test_summary("display power");
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "delay.h"
+#include "dynmenu.h"
+#include "framebuffer.h"
+#include "test_helpers.h"
+
+/*
+ * Checks that what dynmenu_show() leaves on a pretend screen, sending only
+ * what changed, is the same as drawing the whole menu and sending all of it.
+ */
+
+static unsigned short screen[LCD_YSIZE][LCD_XSIZE];
+static int rect_x, rect_y, rect_width, sent;
+static long pixels_sent;
+
+void display_rect(int x, int y, int width, __attribute__((unused)) int height)
+{
+	rect_x = x;
+	rect_y = y;
+	rect_width = width;
+	sent = 0;
+}
+
+void display_pixels(unsigned short *pixel, int number)
+{
+	for (int i = 0; i < number; i++, sent++)
+		screen[rect_y + sent / rect_width][rect_x + sent % rect_width] = pixel[i];
+	pixels_sent += number;
+}
+
+void display_pixel(unsigned short pixel)
+{
+	display_pixels(&pixel, 1);
+}
+
+int display_get_rotation(void)
+{
+	return 1;
+}
+
+/* framebuffer.c needs this for images, which this doesn't draw */
+void sleep_us(__attribute__((unused)) uint64_t time)
+{
+}
+
+static struct dynmenu menu;
+static struct dynmenu_item item[12];
+
+/* The screen as a full redraw of the menu leaves it */
+static void expect_screen_is_menu(const char *what)
+{
+	static unsigned short shown[LCD_YSIZE][LCD_XSIZE];
+
+	memcpy(shown, screen, sizeof(screen));
+	dynmenu_draw(&menu);
+	FbPushBuffer();
+	if (memcmp(shown, screen, sizeof(screen)))
+		fail(what, menu.current_item);
+}
+
+static void test_show(void)
+{
+	char name[DYNMENU_MAX_TITLE];
+	long full;
+
+	dynmenu_init(&menu, item, 12);
+	dynmenu_clear(&menu);
+	strcpy(menu.title, "TEST MENU");
+	for (int i = 0; i < 12; i++) {
+		snprintf(name, sizeof(name), "ITEM %c", 'A' + i);
+		dynmenu_add_item(&menu, name, i, i);
+	}
+
+	pixels_sent = 0;
+	dynmenu_show(&menu);
+	full = pixels_sent;
+	if (full != LCD_XSIZE * LCD_YSIZE)
+		fail("first show sends the whole screen", full);
+
+	/* Nothing changed, nothing sent */
+	pixels_sent = 0;
+	dynmenu_show(&menu);
+	if (pixels_sent)
+		fail("pixels sent for an unchanged menu", pixels_sent);
+
+	/* Moving the selection each way, and wrapping around the ends */
+	for (int step = 0; step < 30; step++) {
+		dynmenu_change_current_selection(&menu, step < 15 ? 1 : -1);
+		pixels_sent = 0;
+		dynmenu_show(&menu);
+		if (pixels_sent <= 0 || pixels_sent >= full / 2)
+			fail("pixels sent moving the selection", pixels_sent);
+		expect_screen_is_menu("screen after moving the selection");
+		/* expect_screen_is_menu() drew over it; start again from a fresh show */
+		dynmenu_show(&menu);
+	}
+
+	/* Someone else drew: the whole menu again */
+	FbMove(0, 0);
+	FbColor(0xffff);
+	FbFilledRectangle(10, 10);
+	pixels_sent = 0;
+	dynmenu_show(&menu);
+	if (pixels_sent != full)
+		fail("show after something else drew", pixels_sent);
+}
+
+static void test_scroll_rows(void)
+{
+	for (int y = 0; y < LCD_YSIZE; y++)
+		for (int x = 0; x < LCD_XSIZE; x++)
+			G_Fb.buffer[y * LCD_XSIZE + x] = y;
+	FbScrollRows(20, 50, -10);
+	if (G_Fb.buffer[20 * LCD_XSIZE] != 30 || G_Fb.buffer[59 * LCD_XSIZE + 5] != 69 ||
+	    G_Fb.buffer[60 * LCD_XSIZE] != 60 || G_Fb.buffer[70 * LCD_XSIZE] != 70 || G_Fb.buffer[19 * LCD_XSIZE] != 19)
+		fail("scrolling rows up", G_Fb.buffer[20 * LCD_XSIZE]);
+	FbScrollRows(20, 50, 10);
+	if (G_Fb.buffer[30 * LCD_XSIZE] != 30 || G_Fb.buffer[69 * LCD_XSIZE + 5] != 69 ||
+	    G_Fb.buffer[20 * LCD_XSIZE] != 30 || G_Fb.buffer[70 * LCD_XSIZE] != 70)
+		fail("scrolling rows down", G_Fb.buffer[30 * LCD_XSIZE]);
+
+	pixels_sent = 0;
+	FbPushRows(150, 20);
+	if (pixels_sent != 10 * LCD_XSIZE || screen[159][0] != 159)
+		fail("pushing rows off the bottom", pixels_sent);
+}
+
+int main(void)
+{
+	FbInit();
+	test_show();
+	test_scroll_rows();
+
+	return test_summary("dynmenu");
+}
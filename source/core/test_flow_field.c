@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flow_field.h"
+#include "test_helpers.h"
+
+/*
+ * Checks flow fields against fields computed from scratch, through random
+ * changes to the grid, and that following them gets to the target at the
+ * cost they promise.
+ */
+
+#define DIM 32
+#define NCELLS (DIM * DIM)
+
+static uint8_t cost[NCELLS];
+static uint16_t workspace[FLOW_FIELD_WORKSPACE_SIZE(NCELLS) / sizeof(uint16_t) + 1];
+static uint16_t reference_workspace[FLOW_FIELD_WORKSPACE_SIZE(NCELLS) / sizeof(uint16_t) + 1];
+
+static uint8_t random_cost(int weighted)
+{
+	if (test_random() % 100 < 25)
+		return GRID_PATH_WALL;
+	return weighted ? test_random() % 8 : 0;
+}
+
+/* Cost of the step from a to b, or -1; the same rules flow fields and grid_path_find() use */
+static int step_cost(int diagonal_ok, int a, int b)
+{
+	int ax = a % DIM, ay = a / DIM, bx = b % DIM, by = b / DIM;
+	int dx = abs(ax - bx), dy = abs(ay - by);
+
+	if (cost[b] == GRID_PATH_WALL || dx > 1 || dy > 1 || dx + dy == 0)
+		return -1;
+	if (dx && dy) {
+		if (!diagonal_ok || cost[ay * DIM + bx] == GRID_PATH_WALL || cost[by * DIM + ax] == GRID_PATH_WALL)
+			return -1;
+		return 3 + cost[b];
+	}
+	return 2 + cost[b];
+}
+
+/* Slow but simple: every cell's cost to reach the target */
+static int dijkstra_check(struct flow_field *f, int flags, const char *what)
+{
+	static int dist[NCELLS];
+	static char done[NCELLS];
+
+	for (int i = 0; i < NCELLS; i++) {
+		dist[i] = -1;
+		done[i] = 0;
+	}
+	if (cost[f->target] != GRID_PATH_WALL)
+		dist[f->target] = 0;
+	for (;;) {
+		int best = -1;
+		for (int i = 0; i < NCELLS; i++)
+			if (!done[i] && dist[i] >= 0 && (best < 0 || dist[i] < dist[best]))
+				best = i;
+		if (best < 0)
+			break;
+		done[best] = 1;
+		for (int i = 0; i < NCELLS; i++) {
+			if (cost[i] == GRID_PATH_WALL)
+				continue;
+			int c = step_cost(flags != 0, i, best);
+			if (c >= 0 && (dist[i] < 0 || dist[best] + c < dist[i]))
+				dist[i] = dist[best] + c;
+		}
+	}
+	for (int i = 0; i < NCELLS; i++) {
+		int expected = dist[i] < 0 ? FLOW_FIELD_UNREACHABLE : dist[i];
+		if (flow_field_distance(f, i) != expected) {
+			printf("%s: cell %d distance %d, Dijkstra says %d\n", what, i, flow_field_distance(f, i), expected);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int check(struct flow_field *f, int flags, const char *what)
+{
+	static struct grid_path_map map = { cost, DIM, DIM };
+	struct flow_field reference;
+	int wrong = 0;
+
+	flow_field_init(&reference, &map, flags, reference_workspace);
+	flow_field_set_target(&reference, f->target);
+	for (int i = 0; i < NCELLS; i++) {
+		if (flow_field_distance(f, i) != flow_field_distance(&reference, i)) {
+			printf("%s: cell %d distance %d, should be %d\n", what, i,
+				flow_field_distance(f, i), flow_field_distance(&reference, i));
+			return 1;
+		}
+	}
+
+	/* Walk from a few cells */
+	for (int i = 0; i < 10; i++) {
+		int cell = test_random() % NCELLS, total = 0, steps = 0;
+		int expected = flow_field_distance(f, cell);
+
+		if (cost[cell] == GRID_PATH_WALL || expected == FLOW_FIELD_UNREACHABLE)
+			continue;
+		while (cell != f->target && steps++ < NCELLS) {
+			int next = flow_field_next_step(f, cell);
+			int c = next < 0 ? -1 : step_cost(flags != 0, cell, next);
+			if (c < 0)
+				break;
+			total += c;
+			cell = next;
+		}
+		if (cell != f->target || total != expected) {
+			printf("%s: walking the field cost %d, should be %d\n", what, total, expected);
+			wrong++;
+		}
+	}
+	return wrong;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct grid_path_map map = { cost, DIM, DIM };
+	struct flow_field f;
+	int rounds = argc > 1 ? atoi(argv[1]) : 20;
+	double t, full_time = 0, update_time = 0;
+	int full_count = 0, update_count = 0;
+
+	test_seed = 2468;
+	for (int round = 0; round < rounds; round++) {
+		int weighted = round & 1;
+		int flags = (round & 2) ? GRID_PATH_8_CONNECTED : 0;
+		char what[40];
+
+		snprintf(what, sizeof(what), "round %d", round);
+		for (int i = 0; i < NCELLS; i++)
+			cost[i] = random_cost(weighted);
+
+		flow_field_init(&f, &map, flags, workspace);
+		t = now_seconds();
+		flow_field_set_target(&f, test_random() % NCELLS);
+		full_time += now_seconds() - t;
+		full_count++;
+		failures += dijkstra_check(&f, flags, what);
+		failures += check(&f, flags, what);
+
+		for (int change = 0; change < 50; change++) {
+			int cell = test_random() % NCELLS;
+			uint8_t old_cost = cost[cell];
+
+			cost[cell] = random_cost(weighted);
+			t = now_seconds();
+			flow_field_cell_changed(&f, cell, old_cost);
+			update_time += now_seconds() - t;
+			update_count++;
+			failures += check(&f, flags, what);
+		}
+	}
+	printf("%dx%d: full %.1f us, incremental update %.1f us\n", DIM, DIM,
+		1e6 * full_time / full_count, 1e6 * update_time / update_count);
+	return test_summary("flow field");
+}
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "fxp_math.h"
+#include "trig.h"
+#include "fxp_sqrt.h"
+#include "test_helpers.h"
+
+/*
+ * Checks fxp_math against the C library's floating point, and times it
+ * against the trig.h and fxp_sqrt.h functions it is meant to replace.
+ */
+
+static double angle_radians(fxp_angle a)
+{
+	return a * 2.0 * M_PI / 65536.0;
+}
+
+static void check(const char *what, double error, double limit)
+{
+	printf("%-24s max error %.3g (limit %.3g)\n", what, error, limit);
+	if (error > limit) {
+		printf("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+static double max_double(double a, double b)
+{
+	return a > b ? a : b;
+}
+
+static void test_sin_cos(void)
+{
+	double sin_error = 0.0, cos_error = 0.0, old_error = 0.0;
+
+	for (int a = 0; a < 65536; a++) {
+		sin_error = max_double(sin_error, fabs(fxp_sin(a) - sin(angle_radians(a)) * 65536.0));
+		cos_error = max_double(cos_error, fabs(fxp_cos(a) - cos(angle_radians(a)) * 65536.0));
+	}
+	for (int a = 0; a < 128; a++)
+		old_error = max_double(old_error, fabs(sine(a) * 256.0 - sin(a * 2.0 * M_PI / 128.0) * 65536.0));
+	check("fxp_sin (Q16 steps)", sin_error, 2.0);
+	check("fxp_cos (Q16 steps)", cos_error, 2.0);
+	printf("%-24s max error %.3g at its own 128 angles\n", "sine (Q16 steps)", old_error);
+
+	if (fxp_sin(FXP_DEGREES(90)) != FXP_ONE || fxp_cos(0) != FXP_ONE || fxp_sin(FXP_DEGREES(270)) != -FXP_ONE) {
+		printf("FAIL: sin and cos aren't exactly 1 at the quarter turns\n");
+		failures++;
+	}
+}
+
+/* Difference between two angles, in fxp_angle steps */
+static double angle_error(fxp_angle a, double radians)
+{
+	double d = a - radians * 65536.0 / (2.0 * M_PI);
+
+	d = fmod(d, 65536.0);
+	if (d > 32768.0)
+		d -= 65536.0;
+	if (d < -32768.0)
+		d += 65536.0;
+	return fabs(d);
+}
+
+static void test_atan2(void)
+{
+	double error = 0.0, old_error = 0.0;
+
+	for (int i = 0; i < 200000; i++) {
+		/* Vectors of all lengths, from a few units to the whole int32_t range */
+		int bits = 2 + test_random() % 29;
+		int32_t x = (int32_t) (test_random() % (1u << bits)) - (1 << (bits - 1));
+		int32_t y = (int32_t) (test_random() % (1u << bits)) - (1 << (bits - 1));
+
+		if (x == 0 && y == 0)
+			continue;
+		/* Tiny vectors only have a few possible angles; past that, precision should be good */
+		if (abs(x) + abs(y) >= 64)
+			error = max_double(error, angle_error(fxp_atan2(y, x), atan2(y, x)));
+	}
+	for (int y = -100; y <= 100; y += 7)
+		for (int x = -100; x <= 100; x += 5)
+			old_error = max_double(old_error, angle_error(FXP_ANGLE_FROM_TRIG(arctan2(y, x)), atan2(y, x)));
+	check("fxp_atan2 (angle steps)", error, 2.0);
+	printf("%-24s max error %.3g\n", "arctan2 (angle steps)", old_error);
+
+	if (fxp_atan2(0, 1) != 0 || fxp_atan2(1, 0) != FXP_DEGREES(90) ||
+	    fxp_atan2(0, -1) != FXP_DEGREES(180) || fxp_atan2(-1, 0) != FXP_DEGREES(270) ||
+	    fxp_atan2(INT32_MIN, INT32_MIN) != FXP_DEGREES(225)) {
+		printf("FAIL: fxp_atan2 is off along the axes\n");
+		failures++;
+	}
+}
+
+static void test_sqrt(void)
+{
+	double error = 0.0, relative = 0.0, small = 0.0;
+
+	for (uint32_t i = 0; i < 100000; i++) {
+		uint32_t x = i < 70000 ? i : test_random() * 256 + (test_random() & 0xff);
+		uint32_t r = fxp_isqrt(x);
+
+		if ((uint64_t) r * r > x || (uint64_t) (r + 1) * (r + 1) <= x) {
+			printf("FAIL: fxp_isqrt(%u) = %u\n", x, r);
+			failures++;
+			break;
+		}
+	}
+	for (int i = 0; i < 100000; i++) {
+		int32_t x = i < 1000 ? i : (int32_t) (test_random() >> (test_random() % 24)) & INT32_MAX;
+		double exact = sqrt(x / 65536.0);
+
+		error = max_double(error, fabs(fxp_sqrt16(x) / 65536.0 - exact) * 65536.0);
+		/*
+		 * Under 1.0, the answer is big, and should be good to a few
+		 * significant figures; over it, the answer is small, and
+		 * should be good to the Q16 step.  Under 16, the answer is
+		 * bigger than Q16 holds.
+		 */
+		if (x >= FXP_ONE)
+			small = max_double(small, fabs(fxp_rsqrt16(x) - 65536.0 / exact));
+		else if (x >= 16)
+			relative = max_double(relative, fabs(fxp_rsqrt16(x) / 65536.0 * exact - 1.0));
+	}
+	check("fxp_sqrt16 (Q16 steps)", error, 1.0);
+	check("fxp_rsqrt16 (relative)", relative, 1e-4);
+	check("fxp_rsqrt16 (Q16 steps)", small, 1.0);
+}
+
+static void test_rotations(void)
+{
+	double error = 0.0, drift = 0.0;
+	struct fxp_vec3 axis[] = { { FXP_ONE, 0, 0 }, { 0, FXP_ONE, 0 }, { 0, 0, FXP_ONE } };
+	void (*rotate[])(struct fxp_mat3 *, fxp_angle) = { fxp_mat3_rotate_x, fxp_mat3_rotate_y, fxp_mat3_rotate_z };
+	struct fxp_quat q, step, total = { FXP_ONE, 0, 0, 0 };
+	struct fxp_mat3 m, mq, product;
+	struct fxp_vec3 v = { 100 * FXP_ONE, -50 * FXP_ONE, 25 * FXP_ONE }, r;
+
+	/* The quaternion for a rotation about an axis gives the same matrix as the axis rotation */
+	for (int i = 0; i < 3; i++) {
+		for (int a = 0; a < 65536; a += 97) {
+			rotate[i](&m, a);
+			fxp_quat_from_axis_angle(&q, &axis[i], a);
+			fxp_quat_to_mat3(&mq, &q);
+			for (int j = 0; j < 9; j++)
+				error = max_double(error, abs(m.m[j / 3][j % 3] - mq.m[j / 3][j % 3]));
+		}
+	}
+	check("quaternion to matrix", error, 16.0);
+
+	/* y then x rotation of a point, checked against floating point */
+	fxp_mat3_rotate_y(&m, FXP_DEGREES(30));
+	fxp_mat3_rotate_x(&product, FXP_DEGREES(45));
+	fxp_mat3_mul(&product, &product, &m);
+	fxp_mat3_transform(&r, &product, &v);
+	{
+		double c = cos(M_PI / 6), s = sin(M_PI / 6);
+		double x = 100 * c + 25 * s, y = -50, z = -100 * s + 25 * c;
+		double c2 = cos(M_PI / 4), s2 = sin(M_PI / 4);
+		double y2 = y * c2 - z * s2, z2 = y * s2 + z * c2;
+
+		error = max_double(fabs(r.x / 65536.0 - x), max_double(fabs(r.y / 65536.0 - y2), fabs(r.z / 65536.0 - z2)));
+		check("matrix transform (units)", error, 0.01);
+	}
+
+	/* A thousand small rotations, renormalizing as a game would, should come back to a unit quaternion */
+	fxp_quat_from_axis_angle(&step, &axis[1], FXP_DEGREES(3.6));
+	for (int i = 0; i < 1000; i++) {
+		fxp_quat_mul(&total, &step, &total);
+		if ((i % 16) == 15)
+			fxp_quat_normalize(&total);
+	}
+	fxp_quat_normalize(&total);
+	drift = fabs(sqrt((double) total.w * total.w + (double) total.x * total.x +
+			(double) total.y * total.y + (double) total.z * total.z) / 65536.0 - 1.0);
+	check("quaternion length drift", drift, 1e-4);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Keeps the compiler from throwing the benchmarks away */
+static volatile uint32_t sink;
+
+static void benchmark(int iterations)
+{
+	double start, old_time, new_time;
+	uint32_t sum;	/* wraps, which unlike int32_t is defined */
+
+	start = seconds();
+	sum = 0;
+	for (int i = 0; i < iterations; i++)
+		sum += sine(i & 127) + cosine(i & 127);
+	old_time = seconds() - start;
+	sink = sum;
+	start = seconds();
+	sum = 0;
+	for (int i = 0; i < iterations; i++)
+		sum += fxp_sin(i * 97) + fxp_cos(i * 97);
+	new_time = seconds() - start;
+	sink = sum;
+	printf("sine+cosine %.1f ns, fxp_sin+fxp_cos %.1f ns\n", old_time * 1e9 / iterations, new_time * 1e9 / iterations);
+
+	start = seconds();
+	sum = 0;
+	for (int i = 0; i < iterations; i++)
+		sum += arctan2((i & 255) - 128, ((i >> 8) & 255) - 128);
+	old_time = seconds() - start;
+	sink = sum;
+	start = seconds();
+	sum = 0;
+	for (int i = 0; i < iterations; i++)
+		sum += fxp_atan2((i & 255) - 128, ((i >> 8) & 255) - 128);
+	new_time = seconds() - start;
+	sink = sum;
+	printf("arctan2 %.1f ns, fxp_atan2 %.1f ns\n", old_time * 1e9 / iterations, new_time * 1e9 / iterations);
+
+	start = seconds();
+	sum = 0;
+	for (int i = 0; i < iterations; i++)
+		sum += fxp_sqrt(i << 8);
+	old_time = seconds() - start;
+	sink = sum;
+	start = seconds();
+	sum = 0;
+	for (int i = 0; i < iterations; i++)
+		sum += fxp_sqrt16(i << 8);
+	new_time = seconds() - start;
+	sink = sum;
+	printf("fxp_sqrt %.1f ns, fxp_sqrt16 %.1f ns\n", old_time * 1e9 / iterations, new_time * 1e9 / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 1000000;
+
+	test_seed = 1234;
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	test_sin_cos();
+	test_atan2();
+	test_sqrt();
+	test_rotations();
+	benchmark(iterations);
+
+	return test_summary("fxp_math");
+}
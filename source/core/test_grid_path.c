@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "grid_path.h"
+#include "a_star.h"
+#include "test_helpers.h"
+
+/*
+ * Checks grid_path_find() against a plain Dijkstra search on random grids of
+ * wall and open cells, with and without jump point search, and times it.
+ */
+
+#define MAX_DIM 64
+#define MAX_CELLS (MAX_DIM * MAX_DIM)
+
+static uint8_t cost[MAX_CELLS];
+static uint16_t workspace[GRID_PATH_WORKSPACE_SIZE(MAX_CELLS) / sizeof(uint16_t) + 1];
+static uint16_t path[MAX_CELLS];
+
+static int is_open(const struct grid_path_map *m, int x, int y)
+{
+	return x >= 0 && y >= 0 && x < m->width && y < m->height && m->cost[y * m->width + x] != GRID_PATH_WALL;
+}
+
+/* Cost of the step from a to b, or -1 if it isn't a legal step */
+static int step_cost(const struct grid_path_map *m, int diagonal_ok, int a, int b)
+{
+	int ax = a % m->width, ay = a / m->width;
+	int bx = b % m->width, by = b / m->width;
+	int dx = abs(ax - bx), dy = abs(ay - by);
+
+	if (!is_open(m, bx, by) || dx > 1 || dy > 1 || dx + dy == 0)
+		return -1;
+	if (dx && dy) {
+		if (!diagonal_ok || !is_open(m, bx, ay) || !is_open(m, ax, by))
+			return -1;
+		return 3 + m->cost[b];
+	}
+	return 2 + m->cost[b];
+}
+
+static int dijkstra(const struct grid_path_map *m, int diagonal_ok, int start, int goal)
+{
+	static int dist[MAX_CELLS];
+	static char done[MAX_CELLS];
+	int n = m->width * m->height;
+
+	for (int i = 0; i < n; i++) {
+		dist[i] = -1;
+		done[i] = 0;
+	}
+	dist[start] = 0;
+	for (;;) {
+		int best = -1;
+		for (int i = 0; i < n; i++)
+			if (!done[i] && dist[i] >= 0 && (best < 0 || dist[i] < dist[best]))
+				best = i;
+		if (best < 0)
+			return -1;
+		if (best == goal)
+			return dist[best];
+		done[best] = 1;
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				int x = best % m->width + dx, y = best / m->width + dy;
+				if (x < 0 || y < 0 || x >= m->width || y >= m->height)
+					continue;
+				int c = step_cost(m, diagonal_ok, best, y * m->width + x);
+				if (c >= 0 && (dist[y * m->width + x] < 0 || dist[best] + c < dist[y * m->width + x]))
+					dist[y * m->width + x] = dist[best] + c;
+			}
+		}
+	}
+}
+
+/* Cost of the path, or -1 if it isn't a legal path from start to goal */
+static int path_cost(const struct grid_path_map *m, int diagonal_ok, int start, int goal, int length)
+{
+	int total = 0;
+
+	if (path[0] != start || path[length - 1] != goal)
+		return -1;
+	for (int i = 1; i < length; i++) {
+		int c = step_cost(m, diagonal_ok, path[i - 1], path[i]);
+		if (c < 0)
+			return -1;
+		total += c;
+	}
+	return total;
+}
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int run(int dim, int ngrids, int wall_percent, int weighted, int flags, const char *name)
+{
+	struct grid_path_map m = { cost, dim, dim };
+	int n = dim * dim, wrong = 0;
+	double t, total = 0;
+
+	for (int i = 0; i < ngrids; i++) {
+		int start, goal, expected, length;
+
+		for (int j = 0; j < n; j++) {
+			if (test_random() % 100 < (unsigned int) wall_percent)
+				cost[j] = GRID_PATH_WALL;
+			else
+				cost[j] = weighted ? test_random() % 8 : 0;
+		}
+		do {
+			start = test_random() % n;
+			goal = test_random() % n;
+		} while (cost[start] == GRID_PATH_WALL || cost[goal] == GRID_PATH_WALL);
+		expected = dijkstra(&m, flags != 0, start, goal);
+
+		t = now_seconds();
+		length = grid_path_find(&m, start, goal, flags, workspace, path, MAX_CELLS);
+		total += now_seconds() - t;
+
+		if (length < 0 ? expected != -1 : path_cost(&m, flags != 0, start, goal, length) != expected) {
+			printf("%s: wrong answer on %dx%d grid %d\n", name, dim, dim, i);
+			wrong++;
+		}
+	}
+	printf("%dx%d %s: %.1f us/search\n", dim, dim, name, 1e6 * total / ngrids);
+	return wrong;
+}
+
+int main(int argc, char *argv[])
+{
+	int ngrids = argc > 1 ? atoi(argv[1]) : 100;
+
+	test_seed = 4321;
+	for (int dim = 32; dim <= MAX_DIM; dim *= 2) {
+		failures += run(dim, ngrids, 30, 0, 0, "4 connected");
+		failures += run(dim, ngrids, 30, 1, 0, "4 connected, weighted");
+		failures += run(dim, ngrids, 30, 0, GRID_PATH_8_CONNECTED, "8 connected");
+		failures += run(dim, ngrids, 30, 1, GRID_PATH_8_CONNECTED, "8 connected, weighted");
+		failures += run(dim, ngrids, 30, 0, GRID_PATH_JUMP_POINTS, "jump points");
+		/* Mostly open, like a gulag room */
+		failures += run(dim, ngrids, 5, 0, GRID_PATH_8_CONNECTED, "8 connected, 5% walls");
+		failures += run(dim, ngrids, 5, 0, GRID_PATH_JUMP_POINTS, "jump points, 5% walls");
+	}
+
+	/* A truncated path still starts at the start */
+	struct grid_path_map m = { cost, 8, 1 };
+	memset(cost, 0, 8);
+	int length = grid_path_find(&m, 0, 7, GRID_PATH_JUMP_POINTS, workspace, path, 3);
+	if (length != 8 || path[0] != 0 || path[1] != 1 || path[2] != 2) {
+		printf("truncated path is wrong\n");
+		failures++;
+	}
+
+	printf("working space for 32x32: %d bytes, a_star_indexed() %d, a_star() %d\n",
+		(int) GRID_PATH_WORKSPACE_SIZE(1024), (int) A_STAR_INDEXED_WORKSPACE_SIZE(1024),
+		(int) (2 * A_STAR_NODESET_SIZE(1024) + A_STAR_NODEMAP_SIZE(1024) +
+			2 * A_STAR_SCOREMAP_SIZE(1024) + 2 * A_STAR_PATH_SIZE(1024)));
+	return test_summary("grid path");
+}
@@ -0,0 +1,64 @@
+#ifndef TEST_HELPERS_H__
+#define TEST_HELPERS_H__
+
+/*
+ * What the unit tests in core/test_*.c have in common: a count of the checks
+ * that failed, the checks themselves, a random number generator that gives
+ * the same numbers every run, and the summary main() ends with.
+ *
+ * Each test is a program of its own that includes this once, so it's all
+ * static, and a test that doesn't use some of it isn't warned about it.
+ */
+
+#include <stdio.h>
+
+/* Failures printed; a check that fails in a loop would print thousands */
+#define TEST_FAILURES_SHOWN 10
+
+static int failures;
+
+static inline void fail(const char *what, long got)
+{
+	if (failures < TEST_FAILURES_SHOWN)
+		printf("FAIL: %s (got %ld)\n", what, got);
+	failures++;
+}
+
+static inline void expect(const char *what, long got, long low, long high)
+{
+	if (got < low || got > high)
+		fail(what, got);
+}
+
+static inline void expect_equal(const char *what, long got, long want)
+{
+	expect(what, got, want, want);
+}
+
+/* Set the seed at the start of main() for the numbers the test was written with */
+static unsigned int test_seed = 1;
+
+static inline unsigned int test_random(void)
+{
+	test_seed = test_seed * 1103515245 + 12345;
+	return test_seed >> 8;
+}
+
+/* From 0 to n - 1 */
+static inline int test_random_n(int n)
+{
+	return test_random() % n;
+}
+
+/* Print how it went; main() returns this */
+static inline int test_summary(const char *name)
+{
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("All %s tests passed\n", name);
+	return 0;
+}
+
+#endif
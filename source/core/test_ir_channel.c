@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ir.h"
+#include "ir_channel.h"
+#include "test_helpers.h"
+
+/*
+ * Checks the IR channel's listen-before-talk on a pretend clock, which
+ * sleep_us() moves on instead of sleeping.
+ */
+
+static uint64_t now_us;
+static uint64_t slept_us;
+
+uint64_t rtc_get_us_since_boot(void)
+{
+	return now_us;
+}
+
+uint64_t rtc_get_ms_since_boot(void)
+{
+	return now_us / 1000;
+}
+
+void sleep_us(uint64_t time)
+{
+	now_us += time;
+	slept_us += time;
+}
+
+void random_insecure_bytes(uint8_t *bytes, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		bytes[i] = test_random();
+}
+
+static void start(uint64_t at)
+{
+	now_us = at;
+	slept_us = 0;
+	ir_reset_channel_stats();
+}
+
+static void test_busy(void)
+{
+	start(10000000);
+	if (ir_channel_busy())
+		fail("busy before hearing anything", 0);
+	ir_channel_note_rx(IR_NEC_FRAME_US, 100000, true);
+	if (!ir_channel_busy())
+		fail("quiet while hearing a message", 0);
+	now_us += 100001;
+	if (ir_channel_busy())
+		fail("busy after the message", 0);
+
+	/* Long after, where the low 32 bits of the clock come back round to just before the message ended */
+	now_us += (1ULL << 32) - 2000;
+	if (ir_channel_busy())
+		fail("busy again after 71.6 minutes", (long) (now_us / 1000000));
+	if (!ir_channel_acquire(IR_APP0, false))
+		fail("channel not free after 71.6 minutes", 0);
+}
+
+/* Something long is going on, like another badge's 64 byte message */
+static void hear_long_message(void)
+{
+	ir_channel_note_rx(IR_NEC_FRAME_US, 7000000, true);
+}
+
+static void test_bounded_wait(void)
+{
+	IR_CHANNEL_STATS stats;
+
+	start(20000000);
+	hear_long_message();
+	ir_set_app_priority(IR_APP0, IR_PRIORITY_INTERACTIVE);
+	if (!ir_channel_acquire(IR_APP0, true))
+		fail("interactive message dropped", 0);
+	expect("interactive wait", (long) slept_us, 1, IR_CHANNEL_MAX_BLOCK_US);
+
+	start(30000000);
+	hear_long_message();
+	ir_set_app_priority(IR_APP1, IR_PRIORITY_BACKGROUND);
+	if (ir_channel_acquire(IR_APP1, true))
+		fail("background message sent while busy", 0);
+	expect("background wait", (long) slept_us, 1, IR_CHANNEL_MAX_BLOCK_US);
+	ir_get_channel_stats(&stats);
+	expect_equal("dropped busy", stats.tx_dropped_busy, 1);
+
+	start(40000000);
+	hear_long_message();
+	if (ir_channel_acquire(IR_APP1, false))
+		fail("sent without blocking while busy", 0);
+	expect_equal("slept without blocking", (long) slept_us, 0);
+}
+
+static void test_backoff(void)
+{
+	IR_CHANNEL_ATTEMPT attempt;
+	uint32_t wait_us;
+	uint32_t longest = 0;
+	int waits = 0;
+
+	start(50000000);
+	ir_set_app_priority(IR_APP2, IR_PRIORITY_BACKGROUND);
+	if (!ir_channel_begin(&attempt, IR_APP2))
+		fail("begin", 0);
+	if (ir_channel_try(&attempt, &wait_us) != IR_CHANNEL_SEND)
+		fail("not sent on a free channel", 0);
+
+	start(60000000);
+	if (!ir_channel_begin(&attempt, IR_APP2))
+		fail("begin", 0);
+	for (;;) {
+		/* Someone talks in every gap we leave */
+		hear_long_message();
+		IR_CHANNEL_DECISION decision = ir_channel_try(&attempt, &wait_us);
+		if (decision != IR_CHANNEL_WAIT) {
+			expect_equal("gave up", decision, IR_CHANNEL_DROP);
+			break;
+		}
+		/* The wait covers what's left of the busy time, then a backoff on top */
+		expect("wait", (long) wait_us, 7000000 + IR_CHANNEL_SLOT_US, 7000000 + 32 * IR_CHANNEL_SLOT_US);
+		if (wait_us > longest)
+			longest = wait_us;
+		now_us += wait_us;
+		if (++waits > 20)
+			break;
+	}
+	expect("waits", waits, 2, 10);
+	expect("longest wait", (long) longest, 7000000 + IR_CHANNEL_SLOT_US, 7000000 + 32 * IR_CHANNEL_SLOT_US);
+}
+
+int main(void)
+{
+	test_seed = 1;
+	test_busy();
+	test_bounded_wait();
+	test_backoff();
+
+	return test_summary("IR channel");
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+
+#include "led_effect.h"
+#include "test_helpers.h"
+
+/*
+ * Steps LED effects the way the HALs do, asking for the color and then
+ * waiting as long as it says, and checks the colors and timing.
+ */
+
+static struct led_effect_state state;
+
+/* The HAL's side: start the effect from black */
+void led_effect_play(const struct led_effect *effect)
+{
+	static const uint8_t black[3] = { 0, 0, 0 };
+
+	led_effect_start(&state, effect, black);
+}
+
+static void test_fade(void)
+{
+	uint8_t rgb[3];
+
+	led_effect_fade(200, 100, 0, 1000);
+	expect("start of a fade", led_effect_color_at(&state, 0, rgb), LED_EFFECT_FADE_STEP_MS, LED_EFFECT_FADE_STEP_MS);
+	expect("red at the start", rgb[0], 0, 0);
+	led_effect_color_at(&state, 500, rgb);
+	expect("red half way", rgb[0], 99, 101);
+	expect("green half way", rgb[1], 49, 51);
+	expect("blue half way", rgb[2], 0, 0);
+	expect("step at the end of a fade", led_effect_color_at(&state, 995, rgb), 5, 5);
+	expect("end of a fade", led_effect_color_at(&state, 1000, rgb), LED_EFFECT_DONE, LED_EFFECT_DONE);
+	expect("red at the end", rgb[0], 200, 200);
+	expect("green at the end", rgb[1], 100, 100);
+}
+
+static void test_loop(void)
+{
+	static const struct led_keyframe keyframes[] = {
+		{ 255, 0, 0, 100, 50 },
+		{ 0, 0, 255, 100, 0 },
+	};
+	struct led_effect effect = { keyframes, 2, LED_EFFECT_LOOP };
+	uint8_t rgb[3];
+
+	led_effect_play(&effect);
+	expect("time left in a hold", led_effect_color_at(&state, 120, rgb), 30, 30);
+	expect("red held", rgb[0], 255, 255);
+	led_effect_color_at(&state, 200, rgb);
+	expect("red fading to blue", rgb[0], 127, 128);
+	expect("blue fading in", rgb[2], 127, 128);
+	/* The second pass fades from blue, not black */
+	led_effect_color_at(&state, 250 + 50, rgb);
+	expect("red on the second pass", rgb[0], 127, 128);
+	expect("blue on the second pass", rgb[2], 127, 128);
+	if (led_effect_color_at(&state, 250 * 1000 + 120, rgb) != 30 || rgb[0] != 255)
+		fail("looping for a long time", rgb[0]);
+}
+
+/* Counts the steps a HAL would take over a second of strobe */
+static void test_strobe(void)
+{
+	uint8_t rgb[3];
+	uint32_t ms = 0;
+	int steps = 0;
+	int flashes = 0;
+	int was_on = 0;
+
+	led_effect_strobe(255, 255, 255, 20, 80);
+	while (ms < 1000) {
+		uint32_t wait = led_effect_color_at(&state, ms, rgb);
+
+		if (wait == LED_EFFECT_DONE)
+			break;
+		if (rgb[0] && !was_on)
+			flashes++;
+		was_on = rgb[0] != 0;
+		ms += wait;
+		steps++;
+	}
+	expect("flashes in a second", flashes, 10, 10);
+	/* Holds take one step each, however long */
+	expect("steps in a second", steps, 20, 20);
+}
+
+static void test_empty(void)
+{
+	struct led_effect effect = { NULL, 0, LED_EFFECT_LOOP };
+	uint8_t rgb[3] = { 1, 1, 1 };
+
+	led_effect_play(&effect);
+	expect("no keyframes", led_effect_color_at(&state, 0, rgb), LED_EFFECT_DONE, LED_EFFECT_DONE);
+	expect("no keyframes is black", rgb[0] | rgb[1] | rgb[2], 0, 0);
+}
+
+int main(void)
+{
+	test_fade();
+	test_loop();
+	test_strobe();
+	test_empty();
+
+	return test_summary("LED effect");
+}
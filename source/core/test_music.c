@@ -0,0 +1,148 @@
+#include <stdio.h>
+
+#include "audio.h"
+#include "audio_mixer.h"
+#include "music.h"
+#include "test_helpers.h"
+
+/*
+ * Plays tunes through the mixer a sample at a time, checking that notes start
+ * and end on the samples their ticks say.
+ */
+
+#define RATE 22050
+/* 10ms ticks are 220.5 samples */
+#define TICK_MS 10
+#define FIRST_VOICE (AUDIO_VOICES - TUNE_MAX_CHANNELS)
+
+static long now;	/* samples mixed */
+static long finished_at;
+
+/* The HAL's side of the mixer, all on the one thread */
+void audio_mixer_submit(const struct audio_command *cmd)
+{
+	audio_mixer_apply(cmd);
+}
+
+void audio_post_callback(void (*callback)(void))
+{
+	callback();
+}
+
+static void finished(void)
+{
+	finished_at = now;
+}
+
+/* Mix until the tune finishes or n samples, counting notes started on channel 0 */
+static int run(long n)
+{
+	int16_t sample;
+	int starts = 0;
+	bool was_playing = false;
+
+	for (long end = now + n; now < end && (tune_is_playing() || audio_mixer_active()); now++) {
+		audio_mixer_fill(&sample, 1);
+		if (audio_voice_is_playing(FIRST_VOICE) && !was_playing)
+			starts++;
+		was_playing = audio_voice_is_playing(FIRST_VOICE);
+	}
+	return starts;
+}
+
+static void test_freqs(void)
+{
+	expect("A4", tune_note_freq(TUNE_N(A, 4)), 440, 440);
+	expect("C4", tune_note_freq(TUNE_N(C, 4)), 261, 262);
+	expect("A2", tune_note_freq(TUNE_N(A, 2)), 110, 110);
+	expect("Ef5", tune_note_freq(TUNE_N(Ef, 5)), 622, 622);
+	expect("C8", tune_note_freq(TUNE_N(C, 8)), 4186, 4186);
+}
+
+static void test_timing(void)
+{
+	static const uint8_t melody[] = {
+		TUNE_LENGTH(4), TUNE_N(C, 4), TUNE_N(D, 4), TUNE_REST,
+		TUNE_LENGTH(8), TUNE_N(E, 4),
+		TUNE_END,
+	};
+	static const uint8_t bass[] = {
+		TUNE_INSTRUMENT(TUNE_TRIANGLE), TUNE_LENGTH(10), TUNE_N(C, 2), TUNE_N(G, 2),
+		TUNE_END,
+	};
+	static const struct tune tune = { TICK_MS, false, 2, { melody, bass }, NULL, 0 };
+
+	audio_mixer_init(RATE);
+	now = 0;
+	finished_at = -1;
+	play_tune(&tune, finished);
+	/* The C, then the D straight after it, then the E after the rest */
+	expect("notes started", run(RATE), 2, 2);
+	/* 20 ticks of 220.5 samples, and the bass's release */
+	expect("tune finished", finished_at, 20 * 2205 / 10 - 1, 20 * 2205 / 10 + 1);
+	if (tune_is_playing() || audio_mixer_active())
+		fail("still playing", now);
+}
+
+static void test_repeats(void)
+{
+	static const uint8_t notes[] = {
+		TUNE_LENGTH(3),
+		TUNE_REPEAT(3), TUNE_N(A, 4),
+			TUNE_REPEAT(2), TUNE_REST, TUNE_REPEAT_END,
+		TUNE_REPEAT_END,
+		TUNE_TEMPO(20), TUNE_N(A, 4), TUNE_REST,
+		TUNE_END,
+	};
+	static const struct tune tune = { TICK_MS, false, 1, { notes }, NULL, 0 };
+
+	audio_mixer_init(RATE);
+	now = 0;
+	finished_at = -1;
+	play_tune(&tune, finished);
+	expect("notes in the repeats", run(RATE * 2), 4, 4);
+	/* 27 ticks of 10ms, then 6 of 20ms */
+	expect("repeats and tempo", finished_at, (27 * 10 + 6 * 20) * RATE / 1000 - 1, (27 * 10 + 6 * 20) * RATE / 1000 + 1);
+}
+
+static void test_loop(void)
+{
+	static const uint8_t notes[] = {
+		TUNE_LENGTH(5), TUNE_N(G, 3),
+		TUNE_LOOP_HERE, TUNE_N(A, 4), TUNE_REST,
+		TUNE_END,
+	};
+	static const struct tune tune = { TICK_MS, true, 1, { notes }, NULL, 0 };
+	static const struct audio_sound effect = { .volume = 255 };
+
+	audio_mixer_init(RATE);
+	now = 0;
+	finished_at = -1;
+	play_tune(&tune, finished);
+	/* G then A, then A again every 100ms */
+	expect("notes while looping", run(RATE), 10, 11);
+	if (!tune_is_playing() || finished_at >= 0)
+		fail("tune stopped looping", finished_at);
+
+	/* Sound effects play on top of the tune, and don't take its voice */
+	for (int i = 0; i < AUDIO_VOICES; i++)
+		if (audio_voice_play(AUDIO_VOICE_ANY, &effect, 1000, 50) == FIRST_VOICE)
+			fail("effect took the tune's voice", i);
+
+	stop_tune();
+	run(RATE);
+	if (tune_is_playing() || audio_voice_is_playing(FIRST_VOICE))
+		fail("playing after stop_tune()", now);
+	expect("callback after stop_tune()", finished_at, -1, -1);
+	expect("voice free again", audio_voice_play(AUDIO_VOICE_ANY, &effect, 1000, 50), 1, AUDIO_VOICES - 1);
+}
+
+int main(void)
+{
+	test_freqs();
+	test_timing();
+	test_repeats();
+	test_loop();
+
+	return test_summary("music");
+}
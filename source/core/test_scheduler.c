@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scheduler.h"
+#include "button.h"
+#include "delay.h"
+#include "ir.h"
+#include "rtc.h"
+#include "test_helpers.h"
+
+/*
+ * Runs the scheduler against a pretend clock, checking frame rates, input
+ * only frames, and tasks.
+ */
+
+static uint64_t now_us = 1000000;
+static unsigned int input_timestamp;
+static int ir_count;
+static uint64_t frame_cost_us;
+static int frames, wakeups;
+
+uint64_t rtc_get_us_since_boot(void)
+{
+	return now_us;
+}
+
+unsigned int button_last_input_timestamp(void)
+{
+	return input_timestamp;
+}
+
+int ir_message_count(void)
+{
+	return ir_count;
+}
+
+void lp_sleep_us(uint64_t time)
+{
+	now_us += time;
+	wakeups++;
+}
+
+static void frame(__attribute__((unused)) void *context)
+{
+	now_us += frame_cost_us;
+	frames++;
+}
+
+/* What scheduler_main_loop() does, for a while */
+static void run_for(uint64_t us)
+{
+	uint64_t end = now_us + us;
+
+	frames = 0;
+	wakeups = 0;
+	while (now_us < end) {
+		uint64_t next = scheduler_run();
+
+		if (next > now_us)
+			lp_sleep_us(next - now_us);
+	}
+}
+
+static void test_frame_rates(void)
+{
+	struct scheduler_stats stats;
+
+	frame_cost_us = 5000;
+	scheduler_reset_stats();
+	run_for(10000000);
+	expect("frames at the default rate", frames, 299, 301);
+	scheduler_get_stats(&stats);
+	expect("busy percent at the default rate", (long) (stats.busy_us * 100 / stats.elapsed_us), 14, 16);
+
+	scheduler_set_frame_rate(60);
+	run_for(10000000);
+	expect("frames at 60 fps", frames, 599, 601);
+
+	/* Frames that take too long just run back to back */
+	frame_cost_us = 50000;
+	scheduler_reset_stats();
+	run_for(1000000);
+	expect("frames that take too long", frames, 20, 21);
+	scheduler_get_stats(&stats);
+	expect("late frames", stats.late_frames, 19, 21);
+	frame_cost_us = 5000;
+}
+
+static void test_input_only(void)
+{
+	scheduler_set_frame_rate(SCHEDULER_ON_INPUT);
+	if (scheduler_frame_rate() != SCHEDULER_ON_INPUT)
+		fail("frame rate", scheduler_frame_rate());
+	run_for(500000); /* the linger after starting */
+	run_for(10000000);
+	expect("idle frames", frames, 9, 11);
+	expect("wakeups while idle", wakeups, 400, 520);
+
+	input_timestamp++;
+	run_for(500000);
+	expect("frames after input", frames, 15, 17);
+	run_for(10000000);
+	expect("idle frames after input", frames, 9, 11);
+
+	/* An IR message counts as input too */
+	ir_count++;
+	run_for(500000);
+	expect("frames after an IR message", frames, 15, 17);
+	scheduler_set_frame_rate(SCHEDULER_DEFAULT_FPS);
+}
+
+static int ticks, flushes, last_flush_us;
+
+static void tick(__attribute__((unused)) void *context)
+{
+	ticks++;
+}
+
+static void flush(void *context)
+{
+	flushes++;
+	last_flush_us = (int) (now_us - *(uint64_t *) context);
+}
+
+static void test_tasks(void)
+{
+	static uint64_t start;
+	struct scheduler_task ticker = SCHEDULER_TASK("tick", tick, NULL, 100000);
+	struct scheduler_task flusher = SCHEDULER_TASK("flush", flush, &start, 0);
+
+	scheduler_start(&ticker, 0);
+	run_for(10000000);
+	expect("periodic task runs", ticks, 100, 101);
+	expect("frames alongside a task", frames, 299, 301);
+	scheduler_stop(&ticker);
+	ticks = 0;
+	run_for(1000000);
+	expect("stopped task runs", ticks, 0, 0);
+
+	/* Started three times, 300ms apart: runs once, 2s after the last, or after a frame due then */
+	for (int i = 0; i < 3; i++) {
+		start = now_us;
+		scheduler_start(&flusher, 2000000);
+		run_for(300000);
+	}
+	run_for(3000000);
+	expect("one-off task runs", flushes, 1, 1);
+	expect("one-off task time", last_flush_us, 2000000, 2000000 + frame_cost_us);
+
+	/* Tasks run in order of due time */
+	ticks = 0;
+	flushes = 0;
+	scheduler_start(&flusher, 200000);
+	scheduler_start(&ticker, 150000);
+	run_for(175000);
+	expect("earlier task", ticks, 1, 1);
+	expect("later task", flushes, 0, 0);
+	run_for(50000);
+	expect("later task", flushes, 1, 1);
+	scheduler_stop(&ticker);
+}
+
+int main(void)
+{
+	scheduler_set_frame(frame, NULL);
+	test_frame_rates();
+	test_input_only();
+	test_tasks();
+
+	return test_summary("scheduler");
+}
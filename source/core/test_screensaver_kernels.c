@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "colors.h"
+#include "framebuffer.h"
+#include "screensaver_kernels.h"
+#include "test_helpers.h"
+
+/*
+ * Runs the screensaver kernels on the real framebuffer, sending only the rows
+ * they mark as changed to a pretend screen, and checks the screen ends up
+ * the same as the framebuffer.
+ */
+
+static unsigned short screen[LCD_YSIZE][LCD_XSIZE];
+static int rect_x, rect_y, rect_width, sent;
+static int rects;
+static long pixels_sent;
+
+void display_rect(int x, int y, int width, __attribute__((unused)) int height)
+{
+	rect_x = x;
+	rect_y = y;
+	rect_width = width;
+	sent = 0;
+	rects++;
+}
+
+void display_pixels(unsigned short *pixel, int number)
+{
+	for (int i = 0; i < number; i++, sent++)
+		screen[rect_y + sent / rect_width][rect_x + sent % rect_width] = pixel[i];
+	pixels_sent += number;
+}
+
+void display_pixel(unsigned short pixel)
+{
+	display_pixels(&pixel, 1);
+}
+
+int display_get_rotation(void)
+{
+	return 0;
+}
+
+/* framebuffer.c needs this for images, which this doesn't draw */
+void sleep_us(__attribute__((unused)) uint64_t time)
+{
+}
+
+void random_insecure_bytes(uint8_t *bytes, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		bytes[i] = 0x5a + i;
+}
+
+static void expect_screen_is_framebuffer(const char *what, int frame)
+{
+	if (memcmp(screen, G_Fb.buffer, sizeof(screen)))
+		fail(what, frame);
+}
+
+/* A black framebuffer, and screen, with nothing to send */
+static void start(void)
+{
+	FbInit();
+	FbBackgroundColor(BLACK);
+	FbClear();
+	FbPushBuffer();
+	dirty_rows_clear();
+	rects = 0;
+	pixels_sent = 0;
+}
+
+static void test_dirty_rows(void)
+{
+	start();
+	if (dirty_rows_any())
+		fail("dirty rows after clearing them", 0);
+	dirty_rows_add(12, 10);
+	dirty_rows_add(14, 14);		/* close enough to go with 10 to 12 */
+	dirty_rows_add(100, 100);
+	dirty_rows_add(200, 150);	/* the bottom 10 */
+	expect("rows sent", dirty_rows_flush(), 16, 16);
+	expect("runs sent", rects, 3, 3);
+	expect("pixels sent", pixels_sent, 16 * LCD_XSIZE, 16 * LCD_XSIZE);
+	expect("rows sent again", dirty_rows_flush(), 0, 0);
+
+	dirty_rows_add(-5, 3);
+	expect("rows above the screen", dirty_rows_flush(), 4, 4);
+	dirty_rows_all();
+	expect("all rows", dirty_rows_flush(), LCD_YSIZE, LCD_YSIZE);
+}
+
+static void test_starfield(void)
+{
+	static struct star star[30];
+	struct starfield field;
+
+	start();
+	starfield_init(&field, star, 30);
+	for (int i = 0; i < 200; i++) {
+		starfield_step(&field, rainbow_color(i));
+		dirty_rows_flush();
+		expect_screen_is_framebuffer("stars on the screen", i);
+	}
+}
+
+static void test_line_trail(void)
+{
+	static unsigned short expected[LCD_YSIZE][LCD_XSIZE];
+	struct trail_line line[4];
+	struct line_trail trail;
+
+	start();
+	line_trail_init(&trail, line, 4);
+	for (int i = 0; i < 10; i++) {
+		pixels_sent = 0;
+		line_trail_add(&trail, 5, 10 * i + 3, 100, 10 * i + 3, RED + i);
+		dirty_rows_flush();
+		expect_screen_is_framebuffer("trail on the screen", i);
+	}
+	/* The new line's row and the oldest's, undrawn */
+	expect("pixels for a line", pixels_sent, 2 * LCD_XSIZE, 2 * LCD_XSIZE);
+
+	/* Only the last 4 are left */
+	FbClear();
+	for (int i = 6; i < 10; i++) {
+		FbColor(RED + i);
+		FbLine(5, 10 * i + 3, 100, 10 * i + 3);
+	}
+	memcpy(expected, G_Fb.buffer, sizeof(expected));
+	if (memcmp(expected, screen, sizeof(screen)))
+		fail("lines left in the trail", trail.used);
+}
+
+static void test_palette_cycle(void)
+{
+	static const unsigned short colors[4] = { WHITE, RED, GREEN, BLUE };
+	struct palette_cycle p;
+
+	start();
+	palette_cycle_start(&p, colors, 4, 1, 3);
+	palette_cycle_fill(0, 0, LCD_XSIZE, LCD_YSIZE, 1);
+	palette_cycle_fill(11, 20, 5, 7, 2);
+	palette_cycle_fill(120, 150, 20, 20, 3);	/* off the edge */
+	palette_cycle_fill(-10, -10, 12, 11, 0);	/* and the other */
+	dirty_rows_flush();
+	expect("first color", screen[0][0], WHITE, WHITE);
+	expect("clipped corner", screen[1][2], RED, RED);
+	expect("left of the rectangle", screen[20][10], RED, RED);
+	expect("rectangle", screen[20][11], GREEN, GREEN);
+	expect("rectangle", screen[26][15], GREEN, GREEN);
+	expect("right of the rectangle", screen[26][16], RED, RED);
+	expect("corner", screen[LCD_YSIZE - 1][LCD_XSIZE - 1], BLUE, BLUE);
+
+	palette_cycle_rotate(&p, 1);
+	expect("rows sent for a rotation", dirty_rows_flush(), LCD_YSIZE, LCD_YSIZE);
+	expect("entry left alone", screen[0][0], WHITE, WHITE);
+	expect("rotated color", screen[20][11], RED, RED);
+	expect("rotated color", screen[20][10], BLUE, BLUE);
+	expect("rotated color", screen[LCD_YSIZE - 1][LCD_XSIZE - 1], GREEN, GREEN);
+
+	palette_cycle_rotate(&p, -1);
+	palette_cycle_rotate(&p, 3);
+	dirty_rows_flush();
+	expect("rotated all the way round", screen[20][10], RED, RED);
+	expect("rotated all the way round", screen[20][11], GREEN, GREEN);
+	FbDirectMode();
+}
+
+/* Lines, rectangles, circles and text in a few colors */
+static void draw_picture(void)
+{
+	FbColor(RED);
+	FbLine(0, 0, LCD_XSIZE - 1, LCD_YSIZE - 1);
+	FbColor(GREEN);
+	FbMove(30, 40);
+	FbFilledRectangle(50, 20);
+	FbColor(BLUE);
+	FbCircle(64, 64, 30);
+	FbColor(YELLOW);
+	FbMove(5, 100);
+	FbWriteLine("INDEXED");
+	FbColor(RED);
+	FbClippedLine(-20, 50, 200, 60);
+}
+
+static void test_indexed_mode(void)
+{
+	static unsigned short direct[LCD_YSIZE][LCD_XSIZE];
+	size_t size;
+
+	start();
+	if (FbSpareBuffer(&size))
+		fail("spare buffer in direct mode", 0);
+	draw_picture();
+	FbPushBuffer();
+	memcpy(direct, screen, sizeof(direct));
+
+	FbIndexedMode(NULL, 0);
+	FbBackgroundColor(BLACK);
+	FbClear();
+	draw_picture();
+	FbPushBuffer();
+	if (memcmp(direct, screen, sizeof(screen)))
+		fail("indexed picture the same as direct", 0);
+	if (!FbSpareBuffer(&size))
+		fail("no spare buffer in indexed mode", 0);
+	expect("spare buffer size", size, LCD_XSIZE * LCD_YSIZE, sizeof(direct));
+
+	/* Only the rows asked for */
+	memset(screen, 0, sizeof(screen));
+	FbPushRows(10, 3);
+	if (memcmp(screen[10], direct[10], 3 * sizeof(direct[0])))
+		fail("rows pushed", 10);
+	if (!memcmp(screen[13], direct[13], sizeof(direct[0])))
+		fail("row not pushed", 13);
+
+	/* Once the palette is full, the nearest color */
+	for (int i = 0; i < 300; i++)
+		FbColor(i * 211);
+	FbColor(RED + 1);
+	FbPoint(0, 1);
+	FbPushRows(1, 1);
+	expect("nearest color", screen[1][0], RED + 1 - 3, RED + 1 + 3);
+
+	FbDirectMode();
+	if (FbSpareBuffer(&size))
+		fail("spare buffer after direct mode", 0);
+}
+
+static void test_screensaver_random(void)
+{
+	int seen = 0;
+
+	for (int i = 0; i < 1000; i++) {
+		int n = screensaver_random(10);
+
+		expect("random number", n, 0, 9);
+		seen |= 1 << n;
+	}
+	expect("random numbers seen", seen, 0x3ff, 0x3ff);
+	expect("rainbow wraps round", rainbow_color(130), rainbow_color(2), rainbow_color(2));
+}
+
+int main(void)
+{
+	test_dirty_rows();
+	test_starfield();
+	test_line_trail();
+	test_palette_cycle();
+	test_indexed_mode();
+	test_screensaver_random();
+
+	return test_summary("screensaver kernel");
+}
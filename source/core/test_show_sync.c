@@ -0,0 +1,560 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "show_clock.h"
+#include "show_sync.h"
+#include "scheduler.h"
+#include "ir.h"
+#include "led_pwm.h"
+#include "audio.h"
+#include "random.h"
+#include "test_helpers.h"
+
+/*
+ * A room of simulated badges, each with its own clock: booted at a different
+ * time and running up to 80 ppm fast or slow.  Badge 0 leads, sending a
+ * beacon every 5 seconds and a cue every few seconds; the others hear most of
+ * the beacons a little late, and each works out when to carry out each cue.
+ * The spread of the real times they do it at is what the test measures.
+ */
+
+#define BADGES 16
+#define BEACON_US 5000000LL
+#define CUE_US 3100000LL
+#define CUE_LEAD_US 1500000LL
+#define RUN_US (20 * 60 * 1000000LL)
+#define SETTLE_US (30 * 1000000LL)
+/* What ir_send_timed_message() can't know: decoding, and interrupt latency */
+#define RX_JITTER_US 300
+/* and when the scheduler gets round to a cue */
+#define FIRE_JITTER_US 500
+#define MAX_SPREAD_US 2500
+
+struct badge {
+	struct show_clock clock;
+	int64_t boot_us;	/* real time at which its clock read 0 */
+	double ppm;
+	uint64_t due_us;	/* local time of the pending cue */
+	int64_t fired_at;	/* real time */
+};
+
+static struct badge badges[BADGES];
+
+static uint64_t local_at(const struct badge *b, int64_t real_us)
+{
+	return (uint64_t) (real_us - b->boot_us + (int64_t) ((real_us - b->boot_us) * b->ppm / 1e6));
+}
+
+static int64_t real_at(const struct badge *b, uint64_t local_us)
+{
+	return b->boot_us + (int64_t) (local_us / (1 + b->ppm / 1e6));
+}
+
+static void setup(void)
+{
+	for (int i = 0; i < BADGES; i++) {
+		show_clock_init(&badges[i].clock);
+		badges[i].boot_us = -(int64_t) test_random_n(600) * 1000000 - test_random_n(1000000);
+		badges[i].ppm = (int) test_random_n(161) - 80;
+	}
+	/* Start the leader's show time just short of wrapping */
+	show_clock_beacon(&badges[0].clock, 0xffffffffu - 60000000u, local_at(&badges[0], 0));
+	show_clock_lead(&badges[0].clock, local_at(&badges[0], 0));
+}
+
+/* The leader sends at real time now: its timestamp is for when the message will have arrived */
+static void beacon(int64_t now, int64_t airtime)
+{
+	uint32_t stamp = show_clock_now(&badges[0].clock, local_at(&badges[0], now + airtime));
+
+	for (int i = 1; i < BADGES; i++) {
+		if (test_random_n(10) == 0)
+			continue; /* didn't hear it */
+		int64_t heard = now + airtime + test_random_n(RX_JITTER_US);
+		show_clock_beacon(&badges[i].clock, stamp, local_at(&badges[i], heard));
+	}
+}
+
+/* Returns the spread of the real times the badges carried the cue out at */
+static int64_t cue(int64_t now, int64_t airtime)
+{
+	uint32_t at = show_clock_now(&badges[0].clock, local_at(&badges[0], now)) + CUE_LEAD_US;
+	int64_t first = INT64_MAX, last = INT64_MIN;
+
+	for (int i = 0; i < BADGES; i++) {
+		struct badge *b = &badges[i];
+		int64_t heard = i ? now + airtime + test_random_n(RX_JITTER_US) : now;
+
+		b->due_us = show_clock_to_local(&b->clock, at, local_at(b, heard));
+		b->fired_at = real_at(b, b->due_us) + test_random_n(FIRE_JITTER_US);
+		if (b->fired_at < first)
+			first = b->fired_at;
+		if (b->fired_at > last)
+			last = b->fired_at;
+	}
+	return last - first;
+}
+
+static void test_show(void)
+{
+	int64_t next_beacon = 0, next_cue = SETTLE_US, worst = 0, total = 0;
+	int cues = 0;
+
+	setup();
+	for (int64_t now = 0; now < RUN_US; now += 1000) {
+		if (now >= next_beacon) {
+			/* 6 bytes, and the odd backoff that the leader's timestamp allows for */
+			beacon(now, 8 * 108000 + test_random_n(4) * 27000);
+			next_beacon += BEACON_US;
+		}
+		if (now >= next_cue) {
+			int64_t spread = cue(now, 10 * 108000);
+
+			if (spread > worst)
+				worst = spread;
+			total += spread;
+			cues++;
+			next_cue += CUE_US + test_random_n(1000000);
+		}
+	}
+	printf("%d badges, %d cues: spread %lld us on average, %lld us at worst\n", BADGES, cues,
+	       (long long) (total / cues), (long long) worst);
+	expect("worst spread", (long) worst, 0, MAX_SPREAD_US);
+	for (int i = 1; i < BADGES; i++)
+		if (!badges[i].clock.locked)
+			fail("badge never locked", i);
+}
+
+static void test_outliers(void)
+{
+	struct show_clock clock;
+	uint32_t show = 1000000;
+
+	show_clock_init(&clock);
+	show_clock_beacon(&clock, show, 5000000);
+	expect("locked on the first beacon", clock.locked, 1, 1);
+	expect("show time from the first beacon", (long) show_clock_now(&clock, 6000000), 2000000, 2000000);
+
+	/* A beacon 100ms out, once, is ignored */
+	show_clock_beacon(&clock, show + 5100000, 10000000);
+	expect("after an outlier", (long) show_clock_now(&clock, 10000000), 6000000, 6000000);
+
+	/* but a new time base takes over after a few */
+	for (int i = 0; i < SHOW_CLOCK_MAX_OUTLIERS; i++)
+		show_clock_beacon(&clock, 50000000 + i * 1000000, 11000000 + i * 1000000);
+	expect("stepped to the new time base", (long) show_clock_now(&clock, 13500000), 52500000, 52500000);
+
+	/* Cues in the past come out in the past */
+	expect("local time of a past show time", (long) show_clock_to_local(&clock, 52000000, 13500000),
+	       13000000, 13000000);
+}
+
+static void test_handover(void)
+{
+	struct show_clock clock;
+	uint32_t before;
+
+	show_clock_init(&clock);
+	show_clock_beacon(&clock, 7000000, 1000000);
+	show_clock_beacon(&clock, 12000500, 6000000);
+	before = show_clock_now(&clock, 8000000);
+	show_clock_lead(&clock, 8000000);
+	expect("show time carries on when a follower leads", (long) (show_clock_now(&clock, 8000000) - before), 0, 0);
+}
+
+/*
+ * The rest is show_sync.c itself, on one badge, with a pretend clock and the
+ * IR, LED, audio and scheduler calls it makes stubbed out below.  The tests
+ * run in order, each carrying on from the state the last one left.
+ */
+
+#define POLL_US 50000
+#define LEADER_EPOCH 0x42
+
+static uint64_t now_us;
+static ir_data_callback show_callback;
+
+struct sent_message {
+	uint8_t data[MAX_IR_MESSAGE_SIZE];
+	uint8_t length;
+	int stamp_at;
+};
+
+static struct sent_message sent[8];
+static int num_sent;
+
+struct played_cue {
+	struct show_cue cue;
+	uint64_t at_us;
+};
+
+static struct played_cue played[16];
+static int num_played;
+static uint16_t beep_freq, beep_ms;
+static uint64_t beep_at_us;
+
+static struct scheduler_task *tasks[4];
+static int num_tasks;
+
+uint64_t rtc_get_us_since_boot(void)
+{
+	return now_us;
+}
+
+void random_insecure_bytes(uint8_t *bytes, size_t len)
+{
+	memset(bytes, LEADER_EPOCH, len);
+}
+
+void ir_set_app_priority(__attribute__((unused)) IR_APP_ID app_id, __attribute__((unused)) IR_PRIORITY priority)
+{
+}
+
+bool ir_add_callback(ir_data_callback data_cb, IR_APP_ID app_id)
+{
+	if (app_id == IR_SHOW)
+		show_callback = data_cb;
+	return true;
+}
+
+static void record_send(const IR_DATA *data, int stamp_at, int64_t clock_offset_us)
+{
+	struct sent_message *m = &sent[num_sent++ % 8];
+
+	memcpy(m->data, data->data, data->data_length);
+	m->length = data->data_length;
+	m->stamp_at = stamp_at;
+	/* As if it were heard the moment it was sent */
+	if (stamp_at >= 0)
+		for (int i = 0; i < 4; i++)
+			m->data[stamp_at + i] = (uint8_t) ((now_us + clock_offset_us) >> (8 * i));
+}
+
+void ir_send_complete_message(const IR_DATA *data)
+{
+	record_send(data, -1, 0);
+}
+
+void ir_send_timed_message(const IR_DATA *data, uint8_t stamp_at, int64_t clock_offset_us)
+{
+	record_send(data, stamp_at, clock_offset_us);
+}
+
+void led_effect_fade(__attribute__((unused)) uint8_t red, __attribute__((unused)) uint8_t green,
+		     __attribute__((unused)) uint8_t blue, __attribute__((unused)) uint16_t ms)
+{
+}
+
+void led_effect_pulse(__attribute__((unused)) uint8_t red, __attribute__((unused)) uint8_t green,
+		      __attribute__((unused)) uint8_t blue, __attribute__((unused)) uint16_t period_ms)
+{
+}
+
+void led_effect_strobe(__attribute__((unused)) uint8_t red, __attribute__((unused)) uint8_t green,
+		       __attribute__((unused)) uint8_t blue, __attribute__((unused)) uint16_t on_ms,
+		       __attribute__((unused)) uint16_t off_ms)
+{
+}
+
+void led_effect_rainbow(__attribute__((unused)) uint16_t period_ms)
+{
+}
+
+void led_effect_stop(void)
+{
+}
+
+int audio_out_beep(uint16_t freq, uint16_t duration)
+{
+	beep_freq = freq;
+	beep_ms = duration;
+	beep_at_us = now_us;
+	return 0;
+}
+
+void scheduler_start(struct scheduler_task *task, uint32_t delay_us)
+{
+	int i;
+
+	for (i = 0; i < num_tasks && tasks[i] != task; i++)
+		;
+	if (i == num_tasks)
+		tasks[num_tasks++] = task;
+	task->due_us = now_us + delay_us;
+	task->pending = true;
+}
+
+void scheduler_stop(struct scheduler_task *task)
+{
+	task->pending = false;
+}
+
+/* Run each task when it's due, up to until_us */
+static void run_until(uint64_t until_us)
+{
+	for (;;) {
+		struct scheduler_task *next = NULL;
+
+		for (int i = 0; i < num_tasks; i++)
+			if (tasks[i]->pending && tasks[i]->due_us <= until_us &&
+			    (!next || tasks[i]->due_us < next->due_us))
+				next = tasks[i];
+		if (!next)
+			break;
+		if (next->due_us > now_us)
+			now_us = next->due_us;
+		if (next->period_us)
+			next->due_us += next->period_us;
+		else
+			next->pending = false;
+		next->fn(next->context);
+	}
+	now_us = until_us;
+}
+
+static void record_cue(const struct show_cue *cue)
+{
+	if (num_played < 16) {
+		played[num_played].cue = *cue;
+		played[num_played].at_us = now_us;
+	}
+	num_played++;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (uint8_t) (v >> (8 * i));
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+/* The IR interrupt hands over a message from another badge, just in */
+static void hear(uint8_t *data, uint8_t length)
+{
+	IR_DATA packet = {
+		.recipient_address = IR_BADGE_ID_BROADCAST,
+		.app_address = IR_SHOW,
+		.data_length = length,
+		.data = data,
+	};
+
+	show_callback(&packet);
+}
+
+static void hear_beacon(uint8_t epoch, uint32_t show_us)
+{
+	uint8_t data[6] = { 0x51, epoch };
+
+	put_le32(&data[2], show_us);
+	hear(data, sizeof(data));
+}
+
+static void hear_cue(uint8_t epoch, uint32_t at, uint8_t type, const uint8_t *args, uint8_t length)
+{
+	uint8_t data[7 + SHOW_CUE_MAX_ARGS] = { 0x52, epoch };
+
+	put_le32(&data[2], at);
+	data[6] = type;
+	if (length)
+		memcpy(&data[7], args, length);
+	hear(data, 7 + length);
+}
+
+static struct show_sync_stats get_stats(void)
+{
+	struct show_sync_stats stats;
+
+	show_sync_get_stats(&stats);
+	return stats;
+}
+
+static void test_follow(void)
+{
+	const uint8_t note[3] = { 440 >> 8, 440 & 0xff, 40 };
+	uint64_t heard_at;
+
+	show_sync_init();
+	show_sync_set_callback(record_cue);
+	if (!show_callback)
+		fail("no IR callback", 0);
+	now_us = 1000000000;
+
+	/* Nothing to go by yet */
+	hear_cue(7, 6000000, SHOW_CUE_APP, NULL, 0);
+	run_until(now_us + POLL_US);
+	expect_equal("cue before a beacon dropped", get_stats().cues_dropped, 1);
+	expect_equal("cue before a beacon played", num_played, 0);
+
+	heard_at = now_us;
+	hear_beacon(7, 5000000);
+	run_until(now_us + POLL_US);
+	expect_equal("beacons heard", get_stats().beacons_heard, 1);
+	expect_equal("locked", show_sync_locked(), 1);
+	expect_equal("leading", show_sync_leading(), 0);
+
+	/* Show time 6 s is a second after the beacon was heard */
+	hear_cue(7, 6000000, SHOW_CUE_NOTE, note, sizeof(note));
+	run_until(heard_at + 2000000);
+	expect_equal("cues heard", get_stats().cues_heard, 2);
+	expect_equal("cues played", num_played, 1);
+	expect("played at", (long) (played[0].at_us - heard_at), 1000000 - 200, 1000000 + 200);
+	expect_equal("cue type", played[0].cue.type, SHOW_CUE_NOTE);
+	expect_equal("cue length", played[0].cue.length, 3);
+	expect_equal("cue show time", (long) played[0].cue.at, 6000000);
+	expect_equal("note", beep_freq, 440);
+	expect_equal("note length", beep_ms, 400);
+	expect_equal("note played with the cue", (long) (beep_at_us - played[0].at_us), 0);
+}
+
+static void test_late(void)
+{
+	uint32_t show = show_sync_now();
+	uint32_t dropped = get_stats().cues_dropped;
+
+	num_played = 0;
+	/* Heard too late to be in step: dropped */
+	hear_cue(7, show - (SHOW_CUE_LATE_MS + 100) * 1000, SHOW_CUE_APP, NULL, 0);
+	/* A little late: carried out at once */
+	hear_cue(7, show - 100000, SHOW_CUE_APP, NULL, 0);
+	run_until(now_us + POLL_US);
+	expect_equal("late cue dropped", get_stats().cues_dropped, dropped + 1);
+	expect_equal("slightly late cue played", num_played, 1);
+	expect("slightly late", get_stats().last_late_us, 100000, 100000 + POLL_US);
+	expect("worst late", get_stats().worst_late_us, 100000, 100000 + POLL_US);
+}
+
+static void test_handover_sync(void)
+{
+	uint32_t dropped = get_stats().cues_dropped;
+	uint64_t heard_at;
+
+	num_played = 0;
+	/* A cue from a leader we haven't heard a beacon from */
+	hear_cue(9, show_sync_now() + 500000, SHOW_CUE_APP, NULL, 0);
+	run_until(now_us + POLL_US);
+	expect_equal("other leader's cue dropped", get_stats().cues_dropped, dropped + 1);
+
+	/* It takes over, with a show time of its own */
+	heard_at = now_us;
+	hear_beacon(9, 90000000);
+	hear_cue(7, show_sync_now() + 500000, SHOW_CUE_APP, NULL, 0);
+	hear_cue(9, 90500000, SHOW_CUE_APP, NULL, 0);
+	run_until(heard_at + 1000000);
+	expect_equal("old leader's cue dropped", get_stats().cues_dropped, dropped + 2);
+	expect_equal("new leader's cue played", num_played, 1);
+	expect("new leader's cue time", (long) (played[0].at_us - heard_at), 500000 - 200, 500000 + 200);
+}
+
+static void test_rx_queue(void)
+{
+	uint32_t heard = get_stats().cues_heard;
+	uint32_t show = show_sync_now();
+
+	num_played = 0;
+	/* More than fit between polls: the last is lost */
+	for (int i = 0; i < 4; i++)
+		hear_cue(9, show + 500000, SHOW_CUE_APP, NULL, 0);
+	run_until(now_us + 1000000);
+	expect_equal("cues queued", get_stats().cues_heard, heard + 3);
+	expect_equal("queued cues played", num_played, 3);
+}
+
+static void test_max_pending(void)
+{
+	uint32_t dropped = get_stats().cues_dropped;
+	uint32_t show = show_sync_now();
+	uint8_t n;
+
+	num_played = 0;
+	for (n = 0; n < 9; n++) {
+		/* Due in reverse order */
+		hear_cue(9, show + 5000000 - n * 100000, SHOW_CUE_APP, &n, 1);
+		run_until(now_us + POLL_US);
+	}
+	expect_equal("too many pending", get_stats().cues_dropped, dropped + 1);
+	run_until(now_us + 6000000);
+	expect_equal("pending cues played", num_played, 8);
+	for (int i = 0; i < 8 && i < num_played; i++)
+		expect_equal("pending cue order", played[i].cue.args[0], 7 - i);
+}
+
+static void test_lead(void)
+{
+	const uint8_t note[3] = { 880 >> 8, 880 & 0xff, 20 };
+	uint32_t at, show;
+	uint64_t cued_at;
+
+	num_played = 0;
+	num_sent = 0;
+	cued_at = now_us;
+	show = show_sync_now();
+	at = show_sync_cue(SHOW_CUE_NOTE, note, sizeof(note), 0);
+	expect_equal("leading", show_sync_leading(), 1);
+
+	/* Played here straight away, not once it's been sent */
+	expect_equal("local cue played", num_played, 1);
+	expect_equal("local note", beep_freq, 880);
+	expect_equal("local note played at", (long) (beep_at_us - cued_at), 0);
+
+	/* A beacon, so the others can follow, then the cue; it's for once both have gone out */
+	expect_equal("messages sent", num_sent, 2);
+	expect_equal("beacon length", sent[0].length, 6);
+	expect_equal("beacon type", sent[0].data[0], 0x51);
+	expect_equal("beacon epoch", sent[0].data[1], LEADER_EPOCH);
+	expect_equal("beacon stamp at", sent[0].stamp_at, 2);
+	expect_equal("beacon show time", (long) get_le32(&sent[0].data[2]), (long) show);
+	expect_equal("cue length", sent[1].length, 10);
+	expect_equal("cue type", sent[1].data[0], 0x52);
+	expect_equal("cue epoch", sent[1].data[1], LEADER_EPOCH);
+	expect_equal("cue show time", (long) get_le32(&sent[1].data[2]), (long) at);
+	expect_equal("cue's cue type", sent[1].data[6], SHOW_CUE_NOTE);
+	expect_equal("cue args", memcmp(&sent[1].data[7], note, sizeof(note)), 0);
+	expect("behind the beacon", (long) (at - show), 2000000, 3000000);
+
+	/* With the channel clear and time enough, here and everywhere else play it together */
+	run_until(now_us + 3000000);
+	num_played = 0;
+	show = show_sync_now();
+	cued_at = now_us;
+	at = show_sync_cue(SHOW_CUE_APP, NULL, 0, 2000);
+	expect_equal("cue for later played", num_played, 0);
+	expect_equal("cue for later show time", (long) (at - show), 2000000);
+	expect_equal("sent cue show time", (long) get_le32(&sent[2].data[2]), (long) at);
+	run_until(now_us + 2500000);
+	expect_equal("cue for later played later", num_played, 1);
+	expect_equal("cue for later played at", (long) (played[0].at_us - cued_at), 2000000);
+
+	/* Its own beacons, and cues from anyone, are ignored while it leads */
+	hear_beacon(LEADER_EPOCH, show);
+	hear_cue(LEADER_EPOCH, show_sync_now() + 500000, SHOW_CUE_APP, NULL, 0);
+	run_until(now_us + 1000000);
+	expect_equal("still leading", show_sync_leading(), 1);
+	expect_equal("own cue played twice", num_played, 1);
+
+	/* until another badge starts */
+	hear_beacon(11, 1000);
+	run_until(now_us + POLL_US);
+	expect_equal("handed over", show_sync_leading(), 0);
+}
+
+int main(void)
+{
+	test_seed = 12345;
+	test_show();
+	test_outliers();
+	test_handover();
+
+	test_follow();
+	test_late();
+	test_handover_sync();
+	test_rx_queue();
+	test_max_pending();
+	test_lead();
+
+	return test_summary("show sync");
+}
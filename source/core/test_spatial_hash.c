@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "spatial_hash.h"
+#include "test_helpers.h"
+
+/*
+ * Checks spatial_hash queries and pairs against testing every object against
+ * every other, and times the two.
+ */
+
+#define MAX_OBJECTS 1000
+#define NBUCKETS 1024
+#define MAX_ENTRIES (4 * MAX_OBJECTS)
+#define CELL_SHIFT (4 + 8)	/* 16 pixel cells, in 8.8 */
+
+static struct object {
+	int32_t x, y, radius;
+} object[MAX_OBJECTS];
+
+static uint16_t bucket[NBUCKETS];
+static struct spatial_hash_entry entry[MAX_ENTRIES];
+static uint16_t found[MAX_OBJECTS];
+static unsigned char pair_seen[MAX_OBJECTS][MAX_OBJECTS];
+
+static int boxes_overlap(const struct object *a, int32_t x, int32_t y, int32_t radius)
+{
+	return abs(a->x - x) <= a->radius + radius && abs(a->y - y) <= a->radius + radius;
+}
+
+static void random_objects(int n, int world)
+{
+	for (int i = 0; i < n; i++) {
+		object[i].x = test_random_n(world << 8) - (world << 7);
+		object[i].y = test_random_n(world << 8) - (world << 7);
+		object[i].radius = test_random_n(12 << 8);
+	}
+}
+
+static void build(struct spatial_hash *h, int n)
+{
+	spatial_hash_clear(h);
+	for (int i = 0; i < n; i++)
+		if (spatial_hash_insert(h, i, object[i].x, object[i].y, object[i].radius))
+			fail("insert", i);
+}
+
+static void test_queries(struct spatial_hash *h, int n, int world)
+{
+	for (int q = 0; q < 1000; q++) {
+		int32_t x = test_random_n(world << 8) - (world << 7);
+		int32_t y = test_random_n(world << 8) - (world << 7);
+		int32_t radius = test_random_n(20 << 8);
+		int count = spatial_hash_query(h, x, y, radius, found, MAX_OBJECTS);
+		static unsigned char hit[MAX_OBJECTS];
+
+		memset(hit, 0, sizeof(hit));
+		for (int i = 0; i < count; i++) {
+			if (hit[found[i]])
+				fail("object found twice", found[i]);
+			hit[found[i]] = 1;
+		}
+		for (int i = 0; i < n; i++)
+			if (boxes_overlap(&object[i], x, y, radius) && !hit[i])
+				fail("overlapping object not found", i);
+	}
+}
+
+static void record_pair(void *context, uint16_t a, uint16_t b)
+{
+	(void) context;
+	if (pair_seen[a][b] || pair_seen[b][a])
+		fail("pair reported twice", a);
+	pair_seen[a][b] = 1;
+}
+
+static void test_pairs(struct spatial_hash *h, int n)
+{
+	memset(pair_seen, 0, sizeof(pair_seen));
+	spatial_hash_pairs(h, record_pair, NULL);
+	for (int i = 0; i < n; i++)
+		for (int j = i + 1; j < n; j++)
+			if (boxes_overlap(&object[i], object[j].x, object[j].y, object[j].radius) &&
+			    !pair_seen[i][j] && !pair_seen[j][i])
+				fail("overlapping pair not reported", i);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* Keeps the compiler from throwing the benchmarks away */
+static volatile int sink;
+
+/* n objects each asking what they overlap, as asteroids does with bullets */
+static void benchmark(struct spatial_hash *h, int n, int world, int iterations)
+{
+	double start, brute, hashed;
+	int hits = 0;
+
+	random_objects(n, world);
+	start = seconds();
+	for (int k = 0; k < iterations; k++)
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < n; j++)
+				hits += boxes_overlap(&object[j], object[i].x, object[i].y, 0);
+	brute = seconds() - start;
+	start = seconds();
+	for (int k = 0; k < iterations; k++) {
+		build(h, n);
+		for (int i = 0; i < n; i++) {
+			int count = spatial_hash_query(h, object[i].x, object[i].y, 0, found, MAX_OBJECTS);
+			for (int j = 0; j < count; j++)
+				hits += boxes_overlap(&object[found[j]], object[i].x, object[i].y, 0);
+		}
+	}
+	hashed = seconds() - start;
+	sink = hits;
+	printf("%4d objects: every pair %8.1f us, spatial hash %6.1f us a frame\n", n,
+		brute * 1e6 / iterations, hashed * 1e6 / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+	struct spatial_hash h;
+	int iterations = 200;
+
+	test_seed = 2468;
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	spatial_hash_init(&h, CELL_SHIFT, bucket, NBUCKETS, entry, MAX_ENTRIES);
+	for (int round = 0; round < 20; round++) {
+		int n = 1 + test_random_n(MAX_OBJECTS);
+		int world = 128 + test_random_n(1000);
+
+		random_objects(n, world);
+		build(&h, n);
+		test_queries(&h, n, world);
+		test_pairs(&h, n);
+	}
+
+	benchmark(&h, 25, 160, iterations);
+	benchmark(&h, 100, 160, iterations);
+	benchmark(&h, 400, 320, iterations);
+
+	return test_summary("spatial_hash");
+}
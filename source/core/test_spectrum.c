@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "fft.h"
+#include "spectrum.h"
+#include "test_helpers.h"
+
+/*
+ * Checks the FFT against a floating point DFT, and the spectrum of tones fed
+ * in through stand-ins for the audio HAL's microphone, then times a block.
+ */
+
+/* The microphone: blocks of whatever tones are set, numbered from 1 */
+static double tone_hz[2], tone_amplitude[2];
+static uint32_t blocks;
+
+void audio_in_start(void)
+{
+	blocks = 0;
+}
+
+void audio_in_stop(void)
+{
+}
+
+uint32_t audio_in_read(int16_t *samples)
+{
+	for (int i = 0; i < AUDIO_IN_BLOCK_SAMPLES; i++) {
+		double t = (double) (blocks * AUDIO_IN_BLOCK_SAMPLES + i) / AUDIO_IN_SAMPLE_RATE_HZ;
+		double s = 0.0;
+
+		for (int k = 0; k < 2; k++)
+			s += tone_amplitude[k] * sin(2.0 * M_PI * tone_hz[k] * t);
+		samples[i] = (int16_t) lrint(s);
+	}
+	return ++blocks;
+}
+
+/* A random sample */
+static int random_sample(void)
+{
+	return (int) (test_random() & 0xffff) - 32768;
+}
+
+static void test_fft(void)
+{
+	static int16_t re[1 << FFT_MAX_BITS], im[1 << FFT_MAX_BITS];
+	static double in_re[1 << FFT_MAX_BITS], in_im[1 << FFT_MAX_BITS];
+
+	for (int bits = 1; bits <= FFT_MAX_BITS; bits++) {
+		int n = 1 << bits;
+		double error = 0.0;
+
+		for (int i = 0; i < n; i++) {
+			in_re[i] = re[i] = (int16_t) (random_sample() / 2);
+			in_im[i] = im[i] = (int16_t) (random_sample() / 2);
+		}
+		fft_q15(re, im, bits);
+		for (int k = 0; k < n; k++) {
+			double sum_re = 0.0, sum_im = 0.0;
+
+			for (int i = 0; i < n; i++) {
+				double a = -2.0 * M_PI * i * k / n;
+
+				sum_re += in_re[i] * cos(a) - in_im[i] * sin(a);
+				sum_im += in_re[i] * sin(a) + in_im[i] * cos(a);
+			}
+			error = fmax(error, fabs(re[k] - sum_re / n));
+			error = fmax(error, fabs(im[k] - sum_im / n));
+		}
+		/* Rounding at each stage, up to about one step a stage */
+		if (error > bits + 1.0) {
+			printf("FAIL: %d point FFT off by %.1f\n", n, error);
+			failures++;
+		}
+	}
+}
+
+static void test_tones(void)
+{
+	const struct spectrum *s;
+	int bin = 1000 * SPECTRUM_POINTS / AUDIO_IN_SAMPLE_RATE_HZ;
+
+	tone_hz[0] = spectrum_bin_freq(bin);
+	tone_amplitude[0] = 16000;
+	spectrum_start();
+	s = spectrum_poll();
+	expect("block", s->block, 1, 1);
+	expect("loudest bin", s->loudest_bin, bin, bin);
+	expect("sine level", s->level, 16000 / sqrt(2) - 50, 16000 / sqrt(2) + 50);
+	expect("sine peak", s->peak, 15900, 16000);
+	/* A quarter of the amplitude, from the two sides of the transform and the window */
+	expect("sine bin", s->bins[bin], 3900, 4100);
+	expect("next bins", s->bins[bin + 1], 1900, 2100);
+	expect("far bins", s->bins[bin + 8], 0, 20);
+	expect("band", s->bands[4], 3900, 4100);
+	expect("other bands", s->bands[2], 0, 20);
+
+	/* A loud low tone and a quieter high one between two bins */
+	tone_hz[0] = 200;
+	tone_hz[1] = 3031;
+	tone_amplitude[1] = 4000;
+	s = spectrum_poll();
+	expect("next block", s->block, 2, 2);
+	expect("loud tone", s->loudest_bin, 3, 3);
+	expect("quiet tone", s->bands[5] > 500 && s->bins[48] > 500, 1, 1);
+	expect("still the newest block", spectrum_poll()->block, 3, 3);
+
+	tone_amplitude[0] = tone_amplitude[1] = 0;
+	s = spectrum_poll();
+	expect("silence", s->level + s->peak + s->bins[bin], 0, 0);
+	spectrum_stop();
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void benchmark(int iterations)
+{
+	static int16_t samples[SPECTRUM_POINTS];
+	static struct spectrum s;
+	double start, time;
+
+	tone_amplitude[0] = 10000;
+	audio_in_read(samples);
+	start = seconds();
+	for (int i = 0; i < iterations; i++) {
+		int16_t block[SPECTRUM_POINTS];
+
+		memcpy(block, samples, sizeof(block));
+		spectrum_compute(block, &s);
+	}
+	time = seconds() - start;
+	printf("spectrum of a %d sample block %.1f us\n", SPECTRUM_POINTS, time * 1e6 / iterations);
+}
+
+int main(void)
+{
+	test_seed = 1234;
+	test_fft();
+	test_tones();
+	benchmark(10000);
+
+	return test_summary("spectrum");
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "transform3d.h"
+#include "framebuffer.h"
+#include "test_helpers.h"
+
+/*
+ * Checks transform3d's projection and clipping against floating point, and
+ * that culled objects really are out of sight, and times the vertex
+ * transform.
+ */
+
+#define WIDTH LCD_XSIZE
+#define HEIGHT LCD_YSIZE
+
+static int nlines;
+static int line_x0, line_y0, line_x1, line_y1;
+
+/* transform3d_draw_edges() draws with this */
+void FbLine(unsigned char x0, unsigned char y0, unsigned char x1, unsigned char y1)
+{
+	line_x0 = x0;
+	line_y0 = y0;
+	line_x1 = x1;
+	line_y1 = y1;
+	nlines++;
+}
+
+static void random_transform(struct transform3d *t)
+{
+	struct fxp_mat3 view, model;
+	struct fxp_vec3 offset;
+
+	fxp_mat3_rotate_y(&view, test_random_n(65536));
+	fxp_mat3_rotate_x(&model, test_random_n(65536));
+	offset.x = test_random_n(40000) - 20000;
+	offset.y = test_random_n(40000) - 20000;
+	offset.z = test_random_n(40000) - 10000;
+	transform3d_set(t, &view, &model, &offset);
+}
+
+static void float_project(const struct transform3d_view *v, double x, double y, double z, double *sx, double *sy)
+{
+	*sx = (v->cx + v->focal * x / z) / 256.0;
+	*sy = (v->cy - v->focal * y / z) / 256.0;
+}
+
+/* Distance of (px, py) from the line through (x0, y0) and (x1, y1) */
+static double line_distance(double px, double py, double x0, double y0, double x1, double y1)
+{
+	double dx = x1 - x0, dy = y1 - y0, len = sqrt(dx * dx + dy * dy);
+
+	if (len < 1e-9)
+		return sqrt((px - x0) * (px - x0) + (py - y0) * (py - y0));
+	return fabs((px - x0) * dy - (py - y0) * dx) / len;
+}
+
+static void test_projection(const struct transform3d_view *v)
+{
+	double error = 0.0;
+
+	for (int i = 0; i < 100000; i++) {
+		struct transform3d t;
+		struct fxp_vec3 p = { test_random_n(4000) - 2000, test_random_n(4000) - 2000, test_random_n(4000) - 2000 };
+		struct transform3d_vertex out;
+		double sx, sy;
+
+		random_transform(&t);
+		transform3d_vertices(v, &t, &p, &out, 1);
+		if (out.z < v->near)
+			continue;
+		float_project(v, out.x, out.y, out.z, &sx, &sy);
+		if (fabs(sx) > 1000 || fabs(sy) > 1000)
+			continue;
+		sx = fabs(out.sx / 256.0 - sx);
+		sy = fabs(out.sy / 256.0 - sy);
+		if (sx > error)
+			error = sx;
+		if (sy > error)
+			error = sy;
+	}
+	printf("projection max error %.3g pixels\n", error);
+	if (error > 2.0 / 256)
+		fail("projection", 0);
+}
+
+/* Any vertex of a culled object must be off screen or behind the near plane */
+static void test_culling(const struct transform3d_view *v)
+{
+	struct fxp_vec3 vertex[8];
+	struct transform3d_vertex out[8];
+	int32_t radius;
+	int culled = 0;
+
+	for (int i = 0; i < 8; i++) {
+		vertex[i].x = (i & 1) ? 1500 : -1500;
+		vertex[i].y = (i & 2) ? 1500 : -1500;
+		vertex[i].z = (i & 4) ? 1500 : -1500;
+	}
+	radius = transform3d_radius(vertex, 8);
+	if (radius < 2598 || radius > 2610)
+		fail("radius", radius);
+
+	for (int i = 0; i < 100000; i++) {
+		struct transform3d t;
+
+		random_transform(&t);
+		if (transform3d_sphere_visible(v, &t, radius))
+			continue;
+		culled++;
+		transform3d_vertices(v, &t, vertex, out, 8);
+		for (int j = 0; j < 8; j++) {
+			if (out[j].z >= v->near && out[j].sx >= 0 && out[j].sx < WIDTH * 256 &&
+			    out[j].sy >= 0 && out[j].sy < HEIGHT * 256)
+				fail("culled object is visible", i);
+		}
+	}
+	printf("culled %d of 100000 objects\n", culled);
+}
+
+/* Clipped lines must be on the screen, and on the line the edge projects to */
+static void test_clipping(const struct transform3d_view *v)
+{
+	static const int16_t vlist[] = { 0, 1 };
+	double error = 0.0;
+	int drawn = 0;
+
+	for (int i = 0; i < 100000; i++) {
+		struct transform3d t;
+		struct fxp_vec3 p[2];
+		struct transform3d_vertex out[2];
+		double x0, y0, x1, y1, z0, z1;
+
+		for (int j = 0; j < 2; j++) {
+			p[j].x = test_random_n(40000) - 20000;
+			p[j].y = test_random_n(40000) - 20000;
+			p[j].z = test_random_n(40000) - 20000;
+		}
+		random_transform(&t);
+		transform3d_vertices(v, &t, p, out, 2);
+		nlines = 0;
+		transform3d_draw_edges(v, out, vlist, 2);
+		if (!nlines)
+			continue;
+		drawn++;
+		if (line_x0 >= WIDTH || line_x1 >= WIDTH || line_y0 >= HEIGHT || line_y1 >= HEIGHT)
+			fail("line off screen", i);
+
+		/* Clip to the near plane in floating point, and see the ends are on the projected line */
+		x0 = out[0].x; y0 = out[0].y; z0 = out[0].z;
+		x1 = out[1].x; y1 = out[1].y; z1 = out[1].z;
+		if (z0 < v->near) {
+			double f = (v->near - z1) / (z0 - z1);
+			x0 = x1 + (x0 - x1) * f;
+			y0 = y1 + (y0 - y1) * f;
+			z0 = v->near;
+		} else if (z1 < v->near) {
+			double f = (v->near - z0) / (z1 - z0);
+			x1 = x0 + (x1 - x0) * f;
+			y1 = y0 + (y1 - y0) * f;
+			z1 = v->near;
+		}
+		float_project(v, x0, y0, z0, &x0, &y0);
+		float_project(v, x1, y1, z1, &x1, &y1);
+		error = fmax(error, line_distance(line_x0, line_y0, x0, y0, x1, y1));
+		error = fmax(error, line_distance(line_x1, line_y1, x0, y0, x1, y1));
+	}
+	printf("drew %d clipped lines, max distance from the true line %.3g pixels\n", drawn, error);
+	/* Up to a pixel's diagonal off, since the ends are rounded down to whole pixels */
+	if (error > 1.5)
+		fail("clipped line is off the edge", 0);
+}
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void benchmark(const struct transform3d_view *v, int iterations)
+{
+	static struct fxp_vec3 in[32];
+	static struct transform3d_vertex out[32];
+	struct transform3d t;
+	double start;
+
+	for (int i = 0; i < 32; i++) {
+		in[i].x = test_random_n(4000) - 2000;
+		in[i].y = test_random_n(4000) - 2000;
+		in[i].z = test_random_n(4000) - 2000;
+	}
+	random_transform(&t);
+	t.translation.z = 20000;
+	start = seconds();
+	for (int i = 0; i < iterations; i++)
+		transform3d_vertices(v, &t, in, out, 32);
+	printf("transform3d_vertices: %.1f ns per vertex\n", (seconds() - start) * 1e9 / iterations / 32);
+}
+
+int main(int argc, char *argv[])
+{
+	struct transform3d_view v;
+	int iterations = 100000;
+
+	test_seed = 5678;
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+
+	transform3d_view_init(&v, 100 * 256, WIDTH, HEIGHT, 256);
+	test_projection(&v);
+	test_culling(&v);
+	test_clipping(&v);
+	benchmark(&v, iterations);
+
+	return test_summary("transform3d");
+}
@@ -0,0 +1,216 @@
+#include "transform3d.h"
+
+#include "framebuffer.h"
+
+#define SCREEN_LIMIT (1 << 30)
+
+void transform3d_view_init(struct transform3d_view *v, int32_t focal, int width, int height, int32_t near)
+{
+	int32_t hw = width * 128, hh = height * 128;
+	int32_t a, b, len;
+
+	v->focal = focal;
+	v->cx = hw;
+	v->cy = hh;
+	v->near = near < 2 ? 2 : near;
+	v->width = width;
+	v->height = height;
+
+	/* Unit normals of the planes through the eye and the screen's edges */
+	a = focal;
+	b = hw;
+	while (a >= (1 << 15) || b >= (1 << 15)) {
+		a >>= 1;
+		b >>= 1;
+	}
+	len = fxp_isqrt(a * a + b * b);
+	v->side_x = (a << 16) / len;
+	v->side_z = (b << 16) / len;
+	a = focal;
+	b = hh;
+	while (a >= (1 << 15) || b >= (1 << 15)) {
+		a >>= 1;
+		b >>= 1;
+	}
+	len = fxp_isqrt(a * a + b * b);
+	v->top_y = (a << 16) / len;
+	v->top_z = (b << 16) / len;
+}
+
+void transform3d_set(struct transform3d *t, const struct fxp_mat3 *view_rotation,
+		const struct fxp_mat3 *model_rotation, const struct fxp_vec3 *offset)
+{
+	if (model_rotation)
+		fxp_mat3_mul(&t->rotation, view_rotation, model_rotation);
+	else
+		t->rotation = *view_rotation;
+	fxp_mat3_transform(&t->translation, view_rotation, offset);
+}
+
+int transform3d_sphere_visible(const struct transform3d_view *v, const struct transform3d *t, int32_t radius)
+{
+	const struct fxp_vec3 *c = &t->translation;
+	int64_t r = (int64_t) radius << 16;
+	int64_t ax = c->x < 0 ? -(int64_t) c->x : c->x;
+	int64_t ay = c->y < 0 ? -(int64_t) c->y : c->y;
+
+	if (c->z + radius < v->near)
+		return 0;
+	/* Signed distance outside the nearer side plane, and the nearer top or bottom one */
+	if (ax * v->side_x - (int64_t) c->z * v->side_z > r)
+		return 0;
+	if (ay * v->top_y - (int64_t) c->z * v->top_z > r)
+		return 0;
+	return 1;
+}
+
+int32_t transform3d_radius(const struct fxp_vec3 *vertex, int n)
+{
+	uint64_t max = 0;
+	int shift = 0;
+
+	for (int i = 0; i < n; i++) {
+		uint64_t d = (int64_t) vertex[i].x * vertex[i].x + (int64_t) vertex[i].y * vertex[i].y +
+				(int64_t) vertex[i].z * vertex[i].z;
+		if (d > max)
+			max = d;
+	}
+	while (max >> 32) {
+		max >>= 2;
+		shift++;
+	}
+	/* Rounded up, so the sphere really does hold every vertex */
+	return (int32_t) ((fxp_isqrt((uint32_t) max) + 1) << shift);
+}
+
+/*
+ * One divide for a reciprocal of z, in 0.32 fixed point, and then multiplies
+ * for x and y; the divide is 32 bits, which the RP2040 does in hardware.
+ */
+static void project(const struct transform3d_view *v, struct transform3d_vertex *p)
+{
+	uint32_t rz = 0xffffffffu / (uint32_t) p->z;
+	int64_t x = ((int64_t) p->x * rz) >> 16;	/* x / z, Q16 */
+	int64_t y = ((int64_t) p->y * rz) >> 16;
+
+	x = v->cx + ((x * v->focal) >> 16);
+	y = v->cy - ((y * v->focal) >> 16);
+	/* Only points far off to the side and almost in the near plane get this far out */
+	p->sx = (int32_t) (x > SCREEN_LIMIT ? SCREEN_LIMIT : x < -SCREEN_LIMIT ? -SCREEN_LIMIT : x);
+	p->sy = (int32_t) (y > SCREEN_LIMIT ? SCREEN_LIMIT : y < -SCREEN_LIMIT ? -SCREEN_LIMIT : y);
+}
+
+void transform3d_vertices(const struct transform3d_view *v, const struct transform3d *t,
+		const struct fxp_vec3 *in, struct transform3d_vertex *out, int n)
+{
+	const int32_t (*m)[3] = t->rotation.m;
+	const int32_t tx = t->translation.x, ty = t->translation.y, tz = t->translation.z;
+
+	for (int i = 0; i < n; i++) {
+		const int64_t x = in[i].x, y = in[i].y, z = in[i].z;
+
+		out[i].x = (int32_t) ((m[0][0] * x + m[0][1] * y + m[0][2] * z + (1 << 15)) >> 16) + tx;
+		out[i].y = (int32_t) ((m[1][0] * x + m[1][1] * y + m[1][2] * z + (1 << 15)) >> 16) + ty;
+		out[i].z = (int32_t) ((m[2][0] * x + m[2][1] * y + m[2][2] * z + (1 << 15)) >> 16) + tz;
+		if (out[i].z >= v->near)
+			project(v, &out[i]);
+	}
+}
+
+/* Where the edge from in (in front of the near plane) to out (behind it) crosses the near plane */
+static void near_intersection(const struct transform3d_view *v, const struct transform3d_vertex *in,
+		const struct transform3d_vertex *out, struct transform3d_vertex *p)
+{
+	int64_t num = v->near - in->z, den = (int64_t) out->z - in->z;
+
+	p->x = in->x + (int32_t) (((int64_t) out->x - in->x) * num / den);
+	p->y = in->y + (int32_t) (((int64_t) out->y - in->y) * num / den);
+	p->z = v->near;
+	project(v, p);
+}
+
+/* Cohen-Sutherland outcodes */
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_TOP 4
+#define CLIP_BOTTOM 8
+
+static int outcode(const struct transform3d_view *v, int32_t x, int32_t y)
+{
+	int code = 0;
+
+	if (x < 0)
+		code |= CLIP_LEFT;
+	else if (x >= v->width << 8)
+		code |= CLIP_RIGHT;
+	if (y < 0)
+		code |= CLIP_TOP;
+	else if (y >= v->height << 8)
+		code |= CLIP_BOTTOM;
+	return code;
+}
+
+/* Clip a line, in pixels * 256, to the screen and draw whatever is left of it */
+static void clipped_line(const struct transform3d_view *v, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+	int code0 = outcode(v, x0, y0), code1 = outcode(v, x1, y1);
+
+	while (code0 | code1) {
+		int code;
+		int64_t x, y;
+
+		if (code0 & code1)
+			return;
+		code = code0 ? code0 : code1;
+		if (code & CLIP_LEFT) {
+			x = 0;
+			y = y0 + ((int64_t) y1 - y0) * (x - x0) / ((int64_t) x1 - x0);
+		} else if (code & CLIP_RIGHT) {
+			x = (v->width << 8) - 1;
+			y = y0 + ((int64_t) y1 - y0) * (x - x0) / ((int64_t) x1 - x0);
+		} else if (code & CLIP_TOP) {
+			y = 0;
+			x = x0 + ((int64_t) x1 - x0) * (y - y0) / ((int64_t) y1 - y0);
+		} else {
+			y = (v->height << 8) - 1;
+			x = x0 + ((int64_t) x1 - x0) * (y - y0) / ((int64_t) y1 - y0);
+		}
+		if (code == code0) {
+			x0 = (int32_t) x;
+			y0 = (int32_t) y;
+			code0 = outcode(v, x0, y0);
+		} else {
+			x1 = (int32_t) x;
+			y1 = (int32_t) y;
+			code1 = outcode(v, x1, y1);
+		}
+	}
+	FbLine(x0 >> 8, y0 >> 8, x1 >> 8, y1 >> 8);
+}
+
+static void draw_edge(const struct transform3d_view *v, const struct transform3d_vertex *a,
+		const struct transform3d_vertex *b)
+{
+	struct transform3d_vertex p;
+
+	if (a->z < v->near && b->z < v->near)
+		return;
+	if (a->z < v->near) {
+		near_intersection(v, b, a, &p);
+		a = &p;
+	} else if (b->z < v->near) {
+		near_intersection(v, a, b, &p);
+		b = &p;
+	}
+	clipped_line(v, a->sx, a->sy, b->sx, b->sy);
+}
+
+void transform3d_draw_edges(const struct transform3d_view *v, const struct transform3d_vertex *vertex,
+		const int16_t *vlist, int n)
+{
+	for (int i = 0; i < n - 1; i++) {
+		if (vlist[i] < 0 || vlist[i + 1] < 0)
+			continue;
+		draw_edge(v, &vertex[vlist[i]], &vertex[vlist[i + 1]]);
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef TRANSFORM3D_H__
+#define TRANSFORM3D_H__
+
+/*
+ * Transforming and drawing wireframe models.
+ *
+ * For each object, transform3d_set() folds the camera and object rotations
+ * and the object's offset from the camera into one fxp_math matrix and
+ * translation.  transform3d_vertices() then takes the object's whole vertex
+ * array into view space and onto the screen in one pass, and
+ * transform3d_draw_edges() draws the model's edges, clipped to the near
+ * plane and the screen, with FbLine().
+ *
+ * View space has x to the right, y up and z into the screen, so a point is
+ * in front of the camera when its z is positive.  Apps with other
+ * conventions fold a flip of the axes into their view rotation.  Model and
+ * view coordinates are in whatever fixed point units the app likes, as long
+ * as they stay within about +/- 2^23.
+ */
+
+#include <stdint.h>
+
+#include "fxp_math.h"
+
+struct transform3d_view {
+	int32_t focal;		/* screen pixels * 256 per unit of x / z, as in sx = focal * x / z */
+	int32_t cx, cy;		/* where the z axis meets the screen, pixels * 256 */
+	int32_t near;		/* closest z drawn, in view space units; at least 2 */
+	int width, height;	/* screen size in pixels */
+	/* Unit normals of the frustum's side planes, Q16, from transform3d_view_init() */
+	int32_t side_x, side_z, top_y, top_z;
+};
+
+/* Model space to view space: view = rotation * model + translation */
+struct transform3d {
+	struct fxp_mat3 rotation;
+	struct fxp_vec3 translation;
+};
+
+/* A vertex after transform3d_vertices() */
+struct transform3d_vertex {
+	int32_t x, y, z;	/* view space */
+	int32_t sx, sy;		/* screen position, pixels * 256, if z >= near */
+};
+
+/* A view with the centre of the screen on the z axis */
+void transform3d_view_init(struct transform3d_view *v, int32_t focal, int width, int height, int32_t near);
+
+/**
+ * transform3d_set - the transform for one object
+ *
+ * @view_rotation: world to view rotation, the same for every object in a frame
+ * @model_rotation: the object's orientation, model to world, or NULL if none
+ * @offset: the object's position minus the camera's, in world space
+ */
+void transform3d_set(struct transform3d *t, const struct fxp_mat3 *view_rotation,
+		const struct fxp_mat3 *model_rotation, const struct fxp_vec3 *offset);
+
+/*
+ * Whether any of a sphere of radius around the model's origin is inside the
+ * view frustum.  Worth calling before transform3d_vertices(); radius is
+ * usually transform3d_radius() of the model's vertices.
+ */
+int transform3d_sphere_visible(const struct transform3d_view *v, const struct transform3d *t, int32_t radius);
+
+/* The distance of the furthest of n vertices from the model's origin */
+int32_t transform3d_radius(const struct fxp_vec3 *vertex, int n);
+
+/* Transform and project n vertices */
+void transform3d_vertices(const struct transform3d_view *v, const struct transform3d *t,
+		const struct fxp_vec3 *in, struct transform3d_vertex *out, int n);
+
+/**
+ * transform3d_draw_edges - draw a model's edges in the current color
+ *
+ * @vlist: runs of vertex indices, each run drawn as lines from vertex to
+ *	   vertex, with -1 between runs.
+ * @n: number of entries in vlist
+ */
+void transform3d_draw_edges(const struct transform3d_view *v, const struct transform3d_vertex *vertex,
+		const int16_t *vlist, int n);
+
+#endif
@@ -41,8 +41,127 @@ void fb_mark_row_changed(int x, int y)
 
 #define BUFFER( ADDR ) G_Fb.buffer[(ADDR)]
 
+/*
+ * Indexed mode (see FbIndexedMode()): the picture is a byte a pixel in the
+ * first half of LCDbufferA, and LCDbufferB is spare.  The first
+ * palette_reserved entries of the palette are the app's; FbColor() and the
+ * images find their colors in the rest, giving out entries as they go, and
+ * palette_cache remembers where recent colors were.  Pixels go through the
+ * palette a few rows at a time on their way to the display, into one bounce
+ * buffer while the other is being sent.
+ */
+#define FB_PALETTE_CACHE 64
+#define FB_BOUNCE_PIXELS (4 * LCD_XSIZE)
+
+static unsigned short palette[FB_PALETTE_SIZE];
+static int palette_reserved, palette_used;
+static unsigned char palette_cache[FB_PALETTE_CACHE];
+static unsigned short bounce[2][FB_BOUNCE_PIXELS];
+static int bounce_next;
+
+static unsigned char palette_index(unsigned short color)
+{
+    unsigned int hash = (color ^ (color >> 5) ^ (color >> 11)) % FB_PALETTE_CACHE;
+    int i = palette_cache[hash];
+    int best_distance = 0x7fffffff;
+
+    if (i >= palette_reserved && i < palette_used && palette[i] == color)
+        return i;
+    for (i = palette_reserved; i < palette_used; i++)
+        if (palette[i] == color)
+            break;
+    if (i == palette_used) {
+        if (palette_used < FB_PALETTE_SIZE) {
+            palette[palette_used++] = color;
+        } else {
+            /* Full: the nearest there is */
+            for (int j = palette_reserved; j < FB_PALETTE_SIZE; j++) {
+                int dr = (palette[j] >> 11) - (color >> 11);
+                int dg = ((palette[j] >> 5) & 0x3f) - ((color >> 5) & 0x3f);
+                int db = (palette[j] & 0x1f) - (color & 0x1f);
+                int distance = 4 * dr * dr + dg * dg + 4 * db * db;
+
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    i = j;
+                }
+            }
+            if (best_distance == 0x7fffffff)
+                return 0; /* all reserved */
+        }
+    }
+    palette_cache[hash] = i;
+    return i;
+}
+
+/* Store a pixel, as RGB565 or in indexed mode as a palette index */
+static inline void fb_put_color(int addr)
+{
+    if (G_Fb.indexes)
+        G_Fb.indexes[addr] = G_Fb.color_index;
+    else
+        BUFFER(addr) = G_Fb.color;
+}
+
+static inline void fb_put_rgb(int addr, unsigned short color)
+{
+    if (G_Fb.indexes)
+        G_Fb.indexes[addr] = palette_index(color);
+    else
+        BUFFER(addr) = color;
+}
+
+/* The same through the transparency mask, which indexed mode ignores */
+static inline void fb_put_masked(int addr, unsigned short color, unsigned char index)
+{
+    if (G_Fb.indexes)
+        G_Fb.indexes[addr] = index;
+    else if (G_Fb.transMask > 0)
+        BUFFER(addr) = (BUFFER(addr) & (~G_Fb.transMask)) | (color & G_Fb.transMask);
+    else
+        BUFFER(addr) = color;
+}
+
+static inline void fb_put_masked_rgb(int addr, unsigned short color)
+{
+    if (G_Fb.indexes)
+        G_Fb.indexes[addr] = palette_index(color);
+    else
+        fb_put_masked(addr, color, 0);
+}
+
+/* Send n pixels of the picture from addr, after a display_rect() */
+static void fb_send(int addr, int n)
+{
+    if (!G_Fb.indexes) {
+        display_pixels(&BUFFER(addr), n);
+        return;
+    }
+    while (n > 0) {
+        int count = n < FB_BOUNCE_PIXELS ? n : FB_BOUNCE_PIXELS;
+        unsigned short *out = bounce[bounce_next];
+        const unsigned char *in = &G_Fb.indexes[addr];
+
+        for (int i = 0; i < count; i++)
+            out[i] = palette[in[i]];
+        /* This waits for the last lot to go, so the other bounce buffer is free to fill */
+        display_pixels(out, count);
+        bounce_next ^= 1;
+        addr += count;
+        n -= count;
+    }
+}
+
+static void fb_mark_all_changed(void)
+{
+    memset(max_changed_x, LCD_XSIZE - 1, sizeof(max_changed_x));
+    memset(min_changed_x, 0, sizeof(min_changed_x));
+    G_Fb.changed = 1;
+}
+
 void FbInit() {
     G_Fb.buffer = LCDbufferA;
+    G_Fb.indexes = NULL;
     G_Fb.pos.x = 0;
     G_Fb.pos.y = 0;
     G_Fb.font = FONT;
@@ -88,14 +207,16 @@ void FbClear()
 {
 
     unsigned short i;
-    G_Fb.changed = 1;
 
-    for (i=0; i<(LCD_XSIZE * LCD_YSIZE); i++) {
-        BUFFER(i) = G_Fb.BGcolor;
+    if (G_Fb.indexes) {
+        memset(G_Fb.indexes, G_Fb.BGcolor_index, FBSIZE);
+    } else {
+        for (i=0; i<(LCD_XSIZE * LCD_YSIZE); i++) {
+            BUFFER(i) = G_Fb.BGcolor;
+        }
     }
     // Mark everything as changed
-    memset(max_changed_x, LCD_XSIZE - 1, sizeof(max_changed_x));
-    memset(min_changed_x, 0, sizeof(min_changed_x));
+    fb_mark_all_changed();
 }
 
 void FbTransparency(unsigned short transparencyMask)
@@ -106,11 +227,93 @@ void FbTransparency(unsigned short transparencyMask)
 void FbColor(unsigned short color)
 {
     G_Fb.color = color;
+    if (G_Fb.indexes)
+        G_Fb.color_index = palette_index(color);
 }
 
 void FbBackgroundColor(unsigned short color)
 {
     G_Fb.BGcolor = color;
+    if (G_Fb.indexes)
+        G_Fb.BGcolor_index = palette_index(color);
+}
+
+void FbColorIndex(unsigned char index)
+{
+    G_Fb.color_index = index;
+    G_Fb.color = palette[index];
+}
+
+void FbBackgroundColorIndex(unsigned char index)
+{
+    G_Fb.BGcolor_index = index;
+    G_Fb.BGcolor = palette[index];
+}
+
+void FbIndexedMode(const unsigned short *colors, int ncolors)
+{
+    if (ncolors > FB_PALETTE_SIZE)
+        ncolors = FB_PALETTE_SIZE;
+    if (ncolors < 0)
+        ncolors = 0;
+    if (ncolors)
+        memcpy(palette, colors, ncolors * sizeof(palette[0]));
+    palette_reserved = ncolors;
+    palette_used = ncolors;
+    G_Fb.buffer = LCDbufferA;
+    G_Fb.indexes = (unsigned char *) LCDbufferA;
+    G_Fb.color_index = palette_index(G_Fb.color);
+    G_Fb.BGcolor_index = palette_index(G_Fb.BGcolor);
+    FbClear();
+}
+
+void FbDirectMode(void)
+{
+    if (!G_Fb.indexes)
+        return;
+    G_Fb.indexes = NULL;
+    G_Fb.buffer = LCDbufferA;
+    FbClear();
+}
+
+void *FbSpareBuffer(size_t *size)
+{
+    if (!G_Fb.indexes) {
+        *size = 0;
+        return NULL;
+    }
+    *size = sizeof(LCDbufferB);
+    return LCDbufferB;
+}
+
+unsigned short FbPaletteColor(unsigned char index)
+{
+    return palette[index];
+}
+
+void FbPaletteSet(unsigned char index, unsigned short color)
+{
+    palette[index] = color;
+    if (G_Fb.indexes)
+        fb_mark_all_changed();
+}
+
+void FbPaletteRotate(unsigned char first, int count, int steps)
+{
+    unsigned short was[FB_PALETTE_SIZE];
+
+    if (count > FB_PALETTE_SIZE - first)
+        count = FB_PALETTE_SIZE - first;
+    if (count <= 0)
+        return;
+    steps %= count;
+    if (steps < 0)
+        steps += count;
+    memcpy(was, &palette[first], count * sizeof(was[0]));
+    for (int i = 0; i < count; i++)
+        palette[first + (i + steps) % count] = was[i];
+    if (G_Fb.indexes)
+        fb_mark_all_changed();
 }
 
 void FbImage(const struct asset* asset, unsigned char seqNum)
@@ -160,7 +363,7 @@ void FbImage16bit(const struct asset* asset, unsigned char seqNum) {
             if ((x + G_Fb.pos.x) >= LCD_XSIZE) break; /* clip x */
             pixel = *pixdata; /* 1 pixel per byte */
             fb_mark_row_changed(x + G_Fb.pos.x, y);
-            BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+            fb_put_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             pixdata++;
         }
     }
@@ -222,10 +425,7 @@ void FbImage8bit(const struct asset* asset, unsigned char seqNum)
                          |  (((b >> 3) & 0b11111)       )) ;
 
                 fb_mark_row_changed(x + G_Fb.pos.x, y);
-                if (G_Fb.transMask > 0)
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = (BUFFER(x + G_Fb.pos.x) & (~G_Fb.transMask)) | (pixel & G_Fb.transMask);
-                else
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+                fb_put_masked_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             }
             pixdata++;
         }
@@ -268,10 +468,7 @@ void FbImage4bit(const struct asset* asset, unsigned char seqNum)
 
                 /* G_Fb.pos.x == offset into scan buffer */
                 fb_mark_row_changed(x + G_Fb.pos.x, y);
-                if (G_Fb.transMask > 0)
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = (BUFFER(x + G_Fb.pos.x) & (~G_Fb.transMask)) | (pixel & G_Fb.transMask);
-                else
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+                fb_put_masked_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             }
             x++;
             if (x >= asset->x) {
@@ -295,10 +492,7 @@ void FbImage4bit(const struct asset* asset, unsigned char seqNum)
 
                 /* G_Fb.pos.x == offset into scan buffer */
                 fb_mark_row_changed(x + G_Fb.pos.x, y);
-                if (G_Fb.transMask > 0)
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = (BUFFER(x + G_Fb.pos.x) & (~G_Fb.transMask)) | (pixel & G_Fb.transMask);
-                else
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+                fb_put_masked_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             }
             x++;
             if (x >= asset->x) {
@@ -345,10 +539,7 @@ void FbImage2bit(const struct asset* asset, unsigned char seqNum)
 
                 /* G_Fb.pos.x == offset into scan buffer */
                 fb_mark_row_changed(x + G_Fb.pos.x, y);
-                if (G_Fb.transMask > 0)
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = (BUFFER(x + G_Fb.pos.x) & (~G_Fb.transMask)) | (pixel & G_Fb.transMask);
-                else
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+                fb_put_masked_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             }
             x++;
             if (x >= asset->x) {
@@ -372,10 +563,7 @@ void FbImage2bit(const struct asset* asset, unsigned char seqNum)
 
                 /* G_Fb.pos.x == offset into scan buffer */
                 fb_mark_row_changed(x + G_Fb.pos.x, y);
-                if (G_Fb.transMask > 0)
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = (BUFFER(x + G_Fb.pos.x) & (~G_Fb.transMask)) | (pixel & G_Fb.transMask);
-                else
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+                fb_put_masked_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             }
             x++;
             if (x >= asset->x) {
@@ -399,10 +587,7 @@ void FbImage2bit(const struct asset* asset, unsigned char seqNum)
 
                 /* G_Fb.pos.x == offset into scan buffer */
                 fb_mark_row_changed(x + G_Fb.pos.x, y);
-                if (G_Fb.transMask > 0)
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = (BUFFER(x + G_Fb.pos.x) & (~G_Fb.transMask)) | (pixel & G_Fb.transMask);
-                else
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+                fb_put_masked_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             }
             x++;
             if (x >= asset->x) {
@@ -426,10 +611,7 @@ void FbImage2bit(const struct asset* asset, unsigned char seqNum)
 
                 /* G_Fb.pos.x == offset into scan buffer */
                 fb_mark_row_changed(x + G_Fb.pos.x, y);
-                if (G_Fb.transMask > 0)
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = (BUFFER(x + G_Fb.pos.x) & (~G_Fb.transMask)) | (pixel & G_Fb.transMask);
-                else
-                    BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x) = pixel;
+                fb_put_masked_rgb(y * LCD_XSIZE + x + G_Fb.pos.x, pixel);
             }
             x++;
             if (x >= asset->x) {
@@ -469,17 +651,10 @@ void FbImage1bit(const struct asset *asset, unsigned char seqNum)
                 ci = ((pixbyte >> bit) & 0x1); /* ci = color index */
                 if (ci != G_Fb.transIndex) { // transparent?
                     fb_mark_row_changed(x + G_Fb.pos.x + bit, y);
-                    if (ci == 0) {
-                        if (G_Fb.transMask > 0)
-                            BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x + bit) = (BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x + bit) & (~G_Fb.transMask)) | (G_Fb.BGcolor & G_Fb.transMask);
-                        else
-                            BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x + bit) = G_Fb.BGcolor;
-                    } else {
-                        if (G_Fb.transMask > 0)
-                            BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x + bit) = (BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x + bit) & (~G_Fb.transMask)) | (G_Fb.color & G_Fb.transMask);
-                        else
-                            BUFFER(y * LCD_XSIZE + x + G_Fb.pos.x + bit) = G_Fb.color;
-                    }
+                    if (ci == 0)
+                        fb_put_masked(y * LCD_XSIZE + x + G_Fb.pos.x + bit, G_Fb.BGcolor, G_Fb.BGcolor_index);
+                    else
+                        fb_put_masked(y * LCD_XSIZE + x + G_Fb.pos.x + bit, G_Fb.color, G_Fb.color_index);
                 }
             }
         }
@@ -533,7 +708,7 @@ void FbFilledRectangle(unsigned char width, unsigned char height)
 
     for (y=G_Fb.pos.y; y < endY; y++) {
         for (x=G_Fb.pos.x; x < endX; x++) {
-            BUFFER(y * LCD_XSIZE + x) = G_Fb.color;
+            fb_put_color(y * LCD_XSIZE + x);
         }
     }
     FbMove(endX, endY);
@@ -545,7 +720,7 @@ void FbPoint(unsigned char x, unsigned char y)
     if (x >= LCD_XSIZE) x = LCD_XSIZE-1;
     if (y >= LCD_YSIZE) y = LCD_YSIZE-1;
 
-    BUFFER(y * LCD_XSIZE + x) = G_Fb.color;
+    fb_put_color(y * LCD_XSIZE + x);
     fb_mark_row_changed(x, y);
 
     FbMove(x, y);
@@ -754,17 +929,23 @@ void FbSwapBuffers()
     if (G_Fb.changed == 0) return;
 
     display_rect(0, 0, LCD_XSIZE, LCD_YSIZE);
-    display_pixels(G_Fb.buffer, LCD_XSIZE*LCD_YSIZE);
+    fb_send(0, LCD_XSIZE*LCD_YSIZE);
 
-    if (G_Fb.buffer == LCDbufferA) {
-        G_Fb.buffer = LCDbufferB;
+    if (G_Fb.indexes) {
+        /* What's sent is in the bounce buffers, so there's no need to swap */
+        memset(G_Fb.indexes, G_Fb.BGcolor_index, FBSIZE);
     } else {
-        G_Fb.buffer = LCDbufferA;
-    }
-    for (int i=0; i<LCD_XSIZE*LCD_YSIZE; i++) {
-        G_Fb.buffer[i] = G_Fb.BGcolor;
+        if (G_Fb.buffer == LCDbufferA) {
+            G_Fb.buffer = LCDbufferB;
+        } else {
+            G_Fb.buffer = LCDbufferA;
+        }
+        for (int i=0; i<LCD_XSIZE*LCD_YSIZE; i++) {
+            G_Fb.buffer[i] = G_Fb.BGcolor;
+        }
     }
     G_Fb.changed = 0;
+    G_Fb.pushes++;
 
     G_Fb.pos.x = 0;
     G_Fb.pos.y = 0;
@@ -791,10 +972,11 @@ void FbPaintNewRows(void)
             display_rect(i, min_changed_x[i], 1, num_pixels);
         else
             display_rect(min_changed_x[i], i, num_pixels, 1);
-        display_pixels(&G_Fb.buffer[i*LCD_XSIZE+min_changed_x[i]], num_pixels);
+        fb_send(i*LCD_XSIZE+min_changed_x[i], num_pixels);
         MARK_ROW_UNCHANGED(i);
     }
     G_Fb.changed = 0;
+    G_Fb.pushes++;
     G_Fb.pos.x = 0;
     G_Fb.pos.y = 0;
 }
@@ -806,8 +988,37 @@ void FbPushBuffer()
     if (G_Fb.changed == 0)
         return;
     display_rect(0, 0, LCD_XSIZE, LCD_YSIZE);
-    display_pixels(G_Fb.buffer, LCD_XSIZE*LCD_YSIZE);
+    fb_send(0, LCD_XSIZE*LCD_YSIZE);
     G_Fb.changed = 0;
+    G_Fb.pushes++;
+}
+
+// The same as FbPushBuffer(), for a band of whole rows: the pixels are sent in the same order, just fewer of them
+void FbPushRows(unsigned char y, unsigned char height)
+{
+    if (y >= LCD_YSIZE || height == 0)
+        return;
+    if (height > LCD_YSIZE - y)
+        height = LCD_YSIZE - y;
+    display_rect(0, y, LCD_XSIZE, height);
+    fb_send(y * LCD_XSIZE, height * LCD_XSIZE);
+    G_Fb.changed = 0;
+    G_Fb.pushes++;
+}
+
+void FbScrollRows(unsigned char y, unsigned char height, int dy)
+{
+    int rows = height - abs(dy);
+    int from = dy < 0 ? y - dy : y;
+    int to = dy < 0 ? y : y + dy;
+
+    if (rows <= 0 || y + height > LCD_YSIZE)
+        return;
+    if (G_Fb.indexes)
+        memmove(&G_Fb.indexes[to * LCD_XSIZE], &G_Fb.indexes[from * LCD_XSIZE], rows * LCD_XSIZE);
+    else
+        memmove(&G_Fb.buffer[to * LCD_XSIZE], &G_Fb.buffer[from * LCD_XSIZE], rows * LCD_XSIZE * sizeof(G_Fb.buffer[0]));
+    G_Fb.changed = 1;
 }
 
 void FbDrawVectors(short points[][2],
@@ -1,6 +1,8 @@
 #ifndef fb_h
 #define fb_h
 
+#include <stddef.h>
+
 #include "assetList.h"
 
 /*
@@ -43,6 +45,11 @@ struct framebuffer_t {
     unsigned short transMask;
     unsigned short transIndex;
     unsigned short changed;
+    unsigned short pushes; /* frames sent to the display, so a caller can tell whether anyone else has since */
+
+    unsigned char *indexes; /* in indexed mode, the picture as palette indexes, and buffer isn't used; otherwise NULL */
+    unsigned char color_index; /* color's and BGcolor's palette entries, in indexed mode */
+    unsigned char BGcolor_index;
 };
 
 extern struct framebuffer_t G_Fb;
@@ -56,7 +63,7 @@ void FbClear(void);
 void FbColor(unsigned short color);
 void FbBackgroundColor(unsigned short color);
 // void FbPicture(unsigned char assetId, unsigned char seqNum);
-void FbTransparency(unsigned short transparencyMask);
+void FbTransparency(unsigned short transparencyMask); /* ignored in indexed mode */
 void FbTransparentIndex(unsigned short color);
 // void FbSprite(unsigned char picId, unsigned char imageNo);
 void FbCharacter(unsigned char charin);
@@ -103,6 +110,50 @@ void FbImage1bit(const struct asset* asset, unsigned char seqNum);
  */
 void FbDrawObject(const struct point drawing[], int npoints, int color, int x, int y, int scale);
 void FbPushBuffer(void);
+
+/*
+ * Indexed mode: the picture is a byte a pixel, each an entry in a palette of
+ * FB_PALETTE_SIZE RGB565 colors, and goes through the palette on its way to
+ * the display.  It takes half the memory, and leaves LCDbufferB spare for the
+ * app (see FbSpareBuffer()).  Changing the palette changes every pixel of
+ * that entry without drawing them again, so colors can be cycled for the
+ * price of sending the screen.
+ *
+ * Everything draws as it does in direct mode: FbColor(), FbBackgroundColor()
+ * and the images find their colors in the palette, giving out free entries
+ * as they go, and use the nearest once it's full.  Apps that cycle colors
+ * give FbIndexedMode() the entries they want to control, which are left
+ * alone, and draw with them using FbColorIndex().
+ *
+ * Apps in indexed mode mustn't use G_Fb.buffer.  The menus and the
+ * screensavers put the framebuffer back in direct mode when they take over.
+ */
+#define FB_PALETTE_SIZE 256
+
+/* Switch to indexed mode, with colors as the first ncolors palette entries, and clear the screen */
+void FbIndexedMode(const unsigned short *colors, int ncolors);
+/* Switch back to RGB565 and clear the screen, if it's in indexed mode */
+void FbDirectMode(void);
+
+/* In indexed mode the memory indexed mode saves, until FbDirectMode(); otherwise NULL */
+void *FbSpareBuffer(size_t *size);
+
+/* Draw in palette entry index, whatever color it is now */
+void FbColorIndex(unsigned char index);
+void FbBackgroundColorIndex(unsigned char index);
+
+unsigned short FbPaletteColor(unsigned char index);
+void FbPaletteSet(unsigned char index, unsigned short color);
+/* Each of count entries from first takes the color steps entries before it, wrapping round */
+void FbPaletteRotate(unsigned char first, int count, int steps);
+
+/* Send just rows y to y + height - 1 of the buffer to the display, leaving the buffer as it is.
+ * For callers that know which rows they changed; much quicker than FbPushBuffer() for a few rows. */
+void FbPushRows(unsigned char y, unsigned char height);
+
+/* Move rows y to y + height - 1 of the buffer by dy rows, up if dy is negative, within those rows.
+ * The rows uncovered keep what was there; the caller draws over them. */
+void FbScrollRows(unsigned char y, unsigned char height, int dy);
 void FbSwapBuffers(void); // Currently does not swap buffers, just writes the current one.
 
 #endif
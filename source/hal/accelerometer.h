@@ -22,6 +22,9 @@ typedef int32_t mG_t;
 #include <fxp_sqrt.h>
 #endif
 
+#include <stdbool.h>
+#include <fxp_math.h>
+
 enum acceleration_direction {
     ACCLERATION_X = 0,
     ACCLERATION_Y = 1,
@@ -56,8 +59,50 @@ void accelerometer_init(void);
 uint8_t accelerometer_whoami(void);
 union acceleration accelerometer_last_sample(void);
 
+/*
+ * Motion. The accelerometer samples into its own FIFO and interrupts when
+ * it's part full; the samples are read in a burst and filtered as they
+ * arrive, so apps get which way is down, how the badge is being moved, and
+ * taps and shakes, without polling the accelerometer or filtering for
+ * themselves.
+ */
+#define ACCELEROMETER_SAMPLE_RATE_HZ (200)
+
+#define ACCELEROMETER_EVENT_TAP     (1 << 0)    /* a short sharp knock */
+#define ACCELEROMETER_EVENT_SHAKE   (1 << 1)    /* several jolts back and forth within a second */
+
+struct accelerometer_motion {
+    union acceleration gravity;     /* low-pass filtered: which way is up, steadily */
+    union acceleration movement;    /* high-pass filtered: the latest sample with gravity taken out */
+    /*
+     * Tilt, worked out from gravity. Pitch is the face's angle to the
+     * horizontal, tipping the top of the badge up: 0 lying face up, a
+     * quarter turn standing up with the USB port at the bottom, a half turn
+     * face down. Roll is how far the badge leans to the right, from minus to
+     * plus a quarter turn.
+     */
+    fxp_angle pitch;
+    fxp_angle roll;
+    uint32_t samples;               /* since the accelerometer started */
+};
+
+/* Cheap enough to call every frame */
+void accelerometer_get_motion(struct accelerometer_motion *motion);
+
+/* The ACCELEROMETER_EVENT_x bits seen since the last call */
+uint32_t accelerometer_take_events(void);
+
 #if TARGET_SIMULATOR
 void set_simulated_accelerometer_values(float x, float y, float z);
+
+/*
+ * Play samples from a trace instead of the orientation widget. A trace is
+ * text, a sample a line: time in milliseconds from the start, then x, y and
+ * z in mG, separated by spaces or commas; lines starting with # are
+ * ignored. Each sample holds until the next one's time. Returns false if the
+ * trace can't be read.
+ */
+bool accelerometer_sim_trace(const char *path, bool loop);
 #endif
 
 
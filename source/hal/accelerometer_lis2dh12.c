@@ -4,24 +4,58 @@
  *  @date   April 13, 2023
  *
  *  @brief  RVASec Badge accelerometer driver for RP2040 and LIS2DH
+ *
+ *  The LIS2DH12 samples into its 32 entry FIFO in stream mode and pulls INT1
+ *  low once FIFO_WATERMARK samples are waiting. The INT1 interrupt starts a
+ *  burst read of them over SPI by DMA, and the DMA interrupt, once it's done,
+ *  runs them through the filter in accelerometer_motion.c. So the processor
+ *  is interrupted 10 times a second rather than for every sample, and never
+ *  waits for SPI.
  */
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 
 #include <pinout_rp2040.h>
 
 #include <hardware/gpio.h>
 #include <hardware/spi.h>
 #include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
 
 #include <utils.h>
 
 #include <accelerometer.h>
+#include <accelerometer_motion.h>
+
+#define WHOAMI_LIS2DH12 (0x33)
+
+#define REG_WHO_AM_I (0x0f)
+#define REG_CTRL_REG1 (0x20)
+#define REG_OUT_X_L (0x28)
+#define REG_FIFO_CTRL_REG (0x2e)
+#define REG_FIFO_SRC_REG (0x2f)
+
+#define FIFO_SRC_WTM (0x80)
+#define FIFO_SRC_FSS_MASK (0x1f)
+
+/* Samples per burst: 10 bursts a second, with room in the FIFO to spare if one is late */
+#define FIFO_WATERMARK (ACCELEROMETER_SAMPLE_RATE_HZ / 10)
+#define SAMPLE_BYTES (6)
+#define BURST_BYTES (1 + FIFO_WATERMARK * SAMPLE_BYTES)
 
 uint8_t whoami;
-size_t sample;
-union acceleration samples[32];
+static union acceleration last_sample;
+static struct accelerometer_filter filter;
+
+static int dma_tx = -1;
+static int dma_rx = -1;
+static volatile bool burst_running;
+/* The command byte, then zeros to clock the samples in with */
+static uint8_t burst_tx[BURST_BYTES];
+static uint8_t burst_rx[BURST_BYTES];
 
 static int read(uint8_t addr, bool multiple, uint8_t *dst, size_t len)
 {
@@ -60,24 +94,54 @@ static mG_t raw2mG(int16_t raw)
     return mG;
 }
 
-static void int1_cb(uint gpio, uint32_t event_mask)
+/* Read the watermark's worth of samples; the DMA interrupt finishes up */
+static void start_burst(void)
 {
-    (void) gpio;
-    (void) event_mask;
-
-    size_t next_sample = (sample + 1) % ARRAY_SIZE(samples);
+    if (burst_running) {
+        return;
+    }
+    burst_running = true;
+    gpio_put(BADGE_GPIO_ACCEL_CS, false);
+    dma_channel_set_read_addr(dma_tx, burst_tx, false);
+    dma_channel_set_write_addr(dma_rx, burst_rx, false);
+    dma_channel_set_trans_count(dma_tx, BURST_BYTES, false);
+    dma_channel_set_trans_count(dma_rx, BURST_BYTES, false);
+    dma_start_channel_mask((1u << dma_tx) | (1u << dma_rx));
+}
 
-    int16_t raw[3];
-    int br = read(0x28, true, (uint8_t *) raw, sizeof(raw));
-    if (br != sizeof(raw)) {
+static void accel_dma_irq_handler(void)
+{
+    if (!dma_channel_get_irq1_status(dma_rx)) {
         return;
     }
+    dma_channel_acknowledge_irq1(dma_rx);
+    gpio_put(BADGE_GPIO_ACCEL_CS, true);
+
+    for (int s = 0; s < FIFO_WATERMARK; s++) {
+        const uint8_t *raw = &burst_rx[1 + s * SAMPLE_BYTES];
+
+        for (int i = 0; i < 3; i++) {
+            last_sample.a[i] = raw2mG((int16_t) (raw[2 * i] | raw[2 * i + 1] << 8));
+        }
+        accelerometer_filter_add(&filter, last_sample);
+    }
+    burst_running = false;
 
-    for (size_t i = 0; i < ARRAY_SIZE(raw); i++) {
-        samples[next_sample].a[i] = raw2mG(raw[i]); /* 4 mG / LSB in normal mode */
+    /* INT1 only interrupts on its falling edge, so if a late burst left it low, go again now */
+    uint8_t fifo_src = 0;
+    read(REG_FIFO_SRC_REG, false, &fifo_src, sizeof(fifo_src));
+    if (fifo_src & FIFO_SRC_WTM) {
+        start_burst();
     }
+}
 
-    sample = next_sample;
+/* A raw handler, as the buttons have the one GPIO callback to themselves */
+static void int1_irq_handler(void)
+{
+    if (gpio_get_irq_event_mask(BADGE_GPIO_ACCEL_INT1) & GPIO_IRQ_EDGE_FALL) {
+        gpio_acknowledge_irq(BADGE_GPIO_ACCEL_INT1, GPIO_IRQ_EDGE_FALL);
+        start_burst();
+    }
 }
 
 void accelerometer_init_gpio(void)
@@ -87,10 +151,6 @@ void accelerometer_init_gpio(void)
     gpio_set_dir(BADGE_GPIO_ACCEL_INT1, false);
     gpio_set_pulls(BADGE_GPIO_ACCEL_INT1, true, false);
 
-    /* Enable interrupt line */
-    // gpio_set_irq_enabled_with_callback(BADGE_GPIO_ACCEL_INT1,
-    //                                    GPIO_IRQ_EDGE_FALL, true, int1_cb);
-
     /* SPI line initialization */
     gpio_init(BADGE_GPIO_ACCEL_CS);
     gpio_set_dir(BADGE_GPIO_ACCEL_CS, true);
@@ -117,24 +177,65 @@ void accelerometer_init_gpio(void)
     spi_set_format(BADGE_SPI_ACCEL, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
 }
 
+static void dma_init(void)
+{
+    dma_channel_config config;
+
+    memset(burst_tx, 0, sizeof(burst_tx));
+    burst_tx[0] = 0x80 | 0x40 | REG_OUT_X_L;  /* read, auto-increment */
+
+    /* One channel feeds the SPI the bytes to send, and the other takes the bytes that come back */
+    dma_tx = dma_claim_unused_channel(true);
+    config = dma_channel_get_default_config(dma_tx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, spi_get_dreq(BADGE_SPI_ACCEL, true));
+    dma_channel_configure(dma_tx, &config, &spi_get_hw(BADGE_SPI_ACCEL)->dr, burst_tx, BURST_BYTES, false);
+
+    dma_rx = dma_claim_unused_channel(true);
+    config = dma_channel_get_default_config(dma_rx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, spi_get_dreq(BADGE_SPI_ACCEL, false));
+    dma_channel_configure(dma_rx, &config, burst_rx, &spi_get_hw(BADGE_SPI_ACCEL)->dr, BURST_BYTES, false);
+
+    dma_channel_set_irq1_enabled(dma_rx, true);
+    irq_add_shared_handler(DMA_IRQ_1, accel_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+}
+
 void accelerometer_init(void)
 {
-    int br = read(0x0f, false, &whoami, sizeof(whoami));
+    int br = read(REG_WHO_AM_I, false, &whoami, sizeof(whoami));
 
-    if ((br != sizeof(whoami)) || (whoami != 0x33)) {
+    if ((br != sizeof(whoami)) || (whoami != WHOAMI_LIS2DH12)) {
         return;
     }
 
     static const uint8_t ctrl_regs[] = {
-        0x47,   /* CTRL_REG1 (20h) */
+        0x67,   /* CTRL_REG1 (20h): 200 Hz, normal mode, X, Y and Z */
         0x00,   /* CTRL_REG2 (21h) */
-        0x00,   /* CTRL_REG3 (22h) */
-        0x80,   /* CTRL_REG4 (23h) */
-        0x00,   /* CTRL_REG5 (24h) */
-        0x00,   /* CTRL_REG6 (25h) */
+        0x04,   /* CTRL_REG3 (22h): FIFO watermark on INT1 */
+        0x80,   /* CTRL_REG4 (23h): block data update, +/- 2 g */
+        0x40,   /* CTRL_REG5 (24h): FIFO enabled */
+        0x02,   /* CTRL_REG6 (25h): interrupts active low */
     };
+    /* Bypass mode first empties the FIFO; then stream mode, with the watermark */
+    static const uint8_t fifo_bypass = 0x00;
+    static const uint8_t fifo_stream = 0x80 | FIFO_WATERMARK;
+
+    accelerometer_filter_init(&filter);
+    dma_init();
 
-    write(0x20, true, ctrl_regs, sizeof(ctrl_regs));
+    write(REG_CTRL_REG1, true, ctrl_regs, sizeof(ctrl_regs));
+    write(REG_FIFO_CTRL_REG, false, &fifo_bypass, sizeof(fifo_bypass));
+    write(REG_FIFO_CTRL_REG, false, &fifo_stream, sizeof(fifo_stream));
+
+    gpio_add_raw_irq_handler(BADGE_GPIO_ACCEL_INT1, int1_irq_handler);
+    gpio_set_irq_enabled(BADGE_GPIO_ACCEL_INT1, GPIO_IRQ_EDGE_FALL, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
 }
 
 uint8_t accelerometer_whoami(void)
@@ -144,9 +245,29 @@ uint8_t accelerometer_whoami(void)
 
 union acceleration accelerometer_last_sample(void)
 {
-    if (whoami == 0x33) {
-        int1_cb(0, 0);
-    }
+    uint32_t irq_state = save_and_disable_interrupts();
+    union acceleration sample = last_sample;
+
+    restore_interrupts(irq_state);
+    return sample;
+}
+
+void accelerometer_get_motion(struct accelerometer_motion *motion)
+{
+    struct accelerometer_filter copy;
+    uint32_t irq_state = save_and_disable_interrupts();
+
+    copy = filter;
+    restore_interrupts(irq_state);
+    accelerometer_filter_motion(&copy, motion);
+}
+
+uint32_t accelerometer_take_events(void)
+{
+    uint32_t irq_state = save_and_disable_interrupts();
+    uint32_t events = filter.events;
 
-    return samples[sample];
+    filter.events = 0;
+    restore_interrupts(irq_state);
+    return events;
 }
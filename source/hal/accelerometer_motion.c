@@ -0,0 +1,75 @@
+//
+// Accelerometer filtering and gestures, in fixed point, a sample at a time.
+//
+// Gravity is a one-pole low-pass filter with a time constant of 32 samples (160 ms), which follows the badge being
+// tilted but hardly moves for a tap or a shake; movement is the sample less gravity. A jolt is the movement going over
+// ACCELEROMETER_JOLT_MG and back under half of that: short ones are taps, and a quick run of long ones is a shake.
+//
+
+#include <stdlib.h>
+
+#include "accelerometer_motion.h"
+
+#define GRAVITY_SHIFT (5)
+#define MS_TO_SAMPLES(ms) ((ms) * ACCELEROMETER_SAMPLE_RATE_HZ / 1000)
+
+void accelerometer_filter_init(struct accelerometer_filter *filter) {
+    *filter = (struct accelerometer_filter) { 0 };
+}
+
+static void end_jolt(struct accelerometer_filter *filter) {
+    if (filter->jolt_samples <= MS_TO_SAMPLES(ACCELEROMETER_TAP_MAX_MS)) {
+        if (!filter->tap_quiet) {
+            filter->events |= ACCELEROMETER_EVENT_TAP;
+        }
+        filter->tap_quiet = MS_TO_SAMPLES(ACCELEROMETER_TAP_QUIET_MS);
+    } else if (++filter->jolts >= ACCELEROMETER_SHAKE_JOLTS) {
+        filter->events |= ACCELEROMETER_EVENT_SHAKE;
+        filter->jolts = 0;
+    } else {
+        filter->shake_gap = MS_TO_SAMPLES(ACCELEROMETER_SHAKE_GAP_MS);
+    }
+    filter->jolt_samples = 0;
+}
+
+void accelerometer_filter_add(struct accelerometer_filter *filter, union acceleration sample) {
+    int32_t size = 0;
+
+    for (int i = 0; i < 3; i++) {
+        if (!filter->samples) {
+            filter->gravity[i] = sample.a[i] * 256;
+        } else {
+            filter->gravity[i] += (sample.a[i] * 256 - filter->gravity[i]) >> GRAVITY_SHIFT;
+        }
+        filter->movement.a[i] = sample.a[i] - (filter->gravity[i] >> 8);
+        size += abs(filter->movement.a[i]);
+    }
+    filter->samples++;
+
+    if (filter->tap_quiet) {
+        filter->tap_quiet--;
+    }
+    if (filter->jolt_samples) {
+        filter->jolt_samples++;
+        if (size < ACCELEROMETER_JOLT_MG / 2) {
+            end_jolt(filter);
+        }
+    } else if (size > ACCELEROMETER_JOLT_MG) {
+        filter->jolt_samples = 1;
+    } else if (filter->shake_gap && !--filter->shake_gap) {
+        filter->jolts = 0;
+    }
+}
+
+void accelerometer_filter_motion(const struct accelerometer_filter *filter, struct accelerometer_motion *motion) {
+    for (int i = 0; i < 3; i++) {
+        motion->gravity.a[i] = filter->gravity[i] >> 8;
+    }
+    motion->movement = filter->movement;
+    motion->samples = filter->samples;
+
+    int32_t x = motion->gravity.x, y = motion->gravity.y, z = motion->gravity.z;
+    // Up is -x, towards the top of the badge, and the face is +z
+    motion->pitch = fxp_atan2(-x, z);
+    motion->roll = fxp_atan2(-y, (int32_t) fxp_isqrt((uint32_t) (x * x + z * z)));
+}
@@ -0,0 +1,42 @@
+//
+// Filtering and gesture detection for accelerometer samples, shared by accelerometer_lis2dh12.c and the simulator,
+// which each keep one accelerometer_filter and feed it samples at ACCELEROMETER_SAMPLE_RATE_HZ. Apps should not include
+// this; the public API is in accelerometer.h.
+//
+
+#ifndef BADGE_C_ACCELEROMETER_MOTION_H
+#define BADGE_C_ACCELEROMETER_MOTION_H
+
+#include <stdint.h>
+
+#include "accelerometer.h"
+
+// Movement (the sum over the axes, in mG) above this starts a jolt, and below half of it ends one
+#define ACCELEROMETER_JOLT_MG (800)
+// A jolt this short is a tap; longer ones count towards a shake
+#define ACCELEROMETER_TAP_MAX_MS (30)
+// Time after a tap before another counts, so that the badge ringing doesn't tap again
+#define ACCELEROMETER_TAP_QUIET_MS (150)
+// This many long jolts, each within this long of the last, are a shake
+#define ACCELEROMETER_SHAKE_JOLTS (3)
+#define ACCELEROMETER_SHAKE_GAP_MS (500)
+
+struct accelerometer_filter {
+    int32_t gravity[3];             // mG, 24.8 fixed point
+    union acceleration movement;
+    uint32_t samples;
+    uint32_t events;                // not yet taken
+    uint16_t jolt_samples;          // so far, in the current jolt; 0 if not in one
+    uint16_t tap_quiet;             // samples until another tap counts
+    uint16_t shake_gap;             // samples left for the next jolt of a shake
+    uint8_t jolts;
+};
+
+void accelerometer_filter_init(struct accelerometer_filter *filter);
+
+void accelerometer_filter_add(struct accelerometer_filter *filter, union acceleration sample);
+
+// Fill in motion, working out the tilt, which is only done here since apps only need it once a frame.
+void accelerometer_filter_motion(const struct accelerometer_filter *filter, struct accelerometer_motion *motion);
+
+#endif //BADGE_C_ACCELEROMETER_MOTION_H
@@ -1,7 +1,36 @@
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 #include <accelerometer.h>
+#include <accelerometer_motion.h>
+#include <rtc.h>
 
+/*
+ * The simulator has no FIFO to interrupt it, so whenever an app asks, the
+ * filter catches up on the samples it would have had since the last time,
+ * at the accelerometer's rate, from the orientation widget or a trace.
+ */
+
+#define SAMPLE_US (1000000 / ACCELEROMETER_SAMPLE_RATE_HZ)
+/* Catching up after the app's been away a long time only needs the last second */
+#define MAX_CATCH_UP (ACCELEROMETER_SAMPLE_RATE_HZ)
+
+struct trace_sample {
+	uint32_t ms;
+	union acceleration a;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 static union acceleration a = {0};
+static struct accelerometer_filter filter;
+static uint64_t next_sample_us;
+
+static struct trace_sample *trace;
+static int trace_len;
+static bool trace_loop;
+static uint64_t trace_start_us;
+static int trace_pos;
 
 static int convert_to_accel_value(float gees)
 {
@@ -16,12 +45,97 @@ static int convert_to_accel_value(float gees)
 #if TARGET_SIMULATOR
 void set_simulated_accelerometer_values(float x, float y, float z)
 {
+	pthread_mutex_lock(&lock);
 	a.x = convert_to_accel_value(x);
 	a.y = convert_to_accel_value(y);
 	a.z = convert_to_accel_value(z);
+	pthread_mutex_unlock(&lock);
+}
+
+bool accelerometer_sim_trace(const char *path, bool loop)
+{
+	FILE *f = fopen(path, "r");
+	struct trace_sample *samples = NULL;
+	int len = 0, size = 0;
+	char line[128];
+
+	if (!f) {
+		perror(path);
+		return false;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long ms;
+		int x, y, z;
+
+		if (line[0] == '#')
+			continue;
+		for (char *c = line; *c; c++)
+			if (*c == ',')
+				*c = ' ';
+		if (sscanf(line, "%lu %d %d %d", &ms, &x, &y, &z) != 4)
+			continue;
+		if (len == size) {
+			size = size ? size * 2 : 256;
+			samples = realloc(samples, size * sizeof(*samples));
+			if (!samples) {
+				fclose(f);
+				return false;
+			}
+		}
+		samples[len].ms = ms;
+		samples[len].a.x = x;
+		samples[len].a.y = y;
+		samples[len].a.z = z;
+		len++;
+	}
+	fclose(f);
+	if (!len) {
+		fprintf(stderr, "%s: no samples in the accelerometer trace\n", path);
+		free(samples);
+		return false;
+	}
+
+	pthread_mutex_lock(&lock);
+	free(trace);
+	trace = samples;
+	trace_len = len;
+	trace_loop = loop;
+	trace_start_us = rtc_get_us_since_boot();
+	trace_pos = 0;
+	pthread_mutex_unlock(&lock);
+	return true;
 }
 #endif
 
+/* The sample at time now: the widget's, or the trace's, which holds its last sample once it's over */
+static union acceleration sample_at(uint64_t now)
+{
+	uint32_t ms;
+
+	if (!trace)
+		return a;
+	ms = (uint32_t) ((now - trace_start_us) / 1000);
+	if (trace_loop && trace_len > 1 && ms >= trace[trace_len - 1].ms) {
+		trace_start_us += (uint64_t) trace[trace_len - 1].ms * 1000;
+		ms -= trace[trace_len - 1].ms;
+		trace_pos = 0;
+	}
+	while (trace_pos + 1 < trace_len && trace[trace_pos + 1].ms <= ms)
+		trace_pos++;
+	return trace[trace_pos].a;
+}
+
+/* Call with the lock held */
+static void catch_up(void)
+{
+	uint64_t now = rtc_get_us_since_boot();
+
+	if (now > next_sample_us + (uint64_t) MAX_CATCH_UP * SAMPLE_US)
+		next_sample_us = now - (uint64_t) MAX_CATCH_UP * SAMPLE_US;
+	for (; next_sample_us <= now; next_sample_us += SAMPLE_US)
+		accelerometer_filter_add(&filter, sample_at(next_sample_us));
+}
+
 void accelerometer_init_gpio(void)
 {
     return;
@@ -29,7 +143,10 @@ void accelerometer_init_gpio(void)
 
 void accelerometer_init(void)
 {
-    return;
+	pthread_mutex_lock(&lock);
+	accelerometer_filter_init(&filter);
+	next_sample_us = rtc_get_us_since_boot();
+	pthread_mutex_unlock(&lock);
 }
 
 uint8_t accelerometer_whoami(void)
@@ -39,5 +156,31 @@ uint8_t accelerometer_whoami(void)
 
 union acceleration accelerometer_last_sample(void)
 {
-    return a;
+	union acceleration sample;
+
+	pthread_mutex_lock(&lock);
+	catch_up();
+	sample = sample_at(rtc_get_us_since_boot());
+	pthread_mutex_unlock(&lock);
+	return sample;
+}
+
+void accelerometer_get_motion(struct accelerometer_motion *motion)
+{
+	pthread_mutex_lock(&lock);
+	catch_up();
+	accelerometer_filter_motion(&filter, motion);
+	pthread_mutex_unlock(&lock);
+}
+
+uint32_t accelerometer_take_events(void)
+{
+	uint32_t events;
+
+	pthread_mutex_lock(&lock);
+	catch_up();
+	events = filter.events;
+	filter.events = 0;
+	pthread_mutex_unlock(&lock);
+	return events;
 }
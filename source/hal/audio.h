@@ -13,11 +13,14 @@
 #ifndef BADGE_C_AUDIO_H
 #define BADGE_C_AUDIO_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 /*! @defgroup   BADGE_AUDIO Audio Driver
  *  @{
  */
 
-#define AUDIO_DEPTH_BITS        (8U)                            //!< Audio driver bit depth
+#define AUDIO_DEPTH_BITS        (10U)                           //!< Audio driver bit depth
 #define AUDIO_SAMPLE_MAX        ((1 << AUDIO_DEPTH_BITS) - 1)   //!< Audio driver maximum sample value
 
 #define AUDIO_BEEP_FREQ_HZ_MIN  (120)
@@ -25,6 +28,43 @@
 #define AUDIO_BEEP_DUR_MS_MIN   (1)
 #define AUDIO_BEEP_DUR_MS_MAX   (30000)
 
+#define AUDIO_SAMPLE_RATE_HZ    (22050U)    //!< Rate the mixer runs at on the badge
+#define AUDIO_VOICES            (8)         //!< Sounds that can play at once
+#define AUDIO_VOICE_ANY         (-1)        //!< Let audio_voice_play() pick a voice
+#define AUDIO_VOICE_BEEP        (0)         //!< The voice audio_out_beep() plays on
+
+#define AUDIO_IN_SAMPLE_RATE_HZ (16000U)    //!< Rate the microphone is sampled at
+#define AUDIO_IN_BLOCK_SAMPLES  (256)       //!< Samples in each block audio_in_read() returns
+
+/*!
+ *  @brief  What a voice plays
+ */
+enum audio_wave {
+    AUDIO_WAVE_SQUARE = 0,
+    AUDIO_WAVE_TRIANGLE,
+    AUDIO_WAVE_NOISE,       //!< Pseudo-random; the frequency is how often it changes
+    AUDIO_WAVE_TABLE,       //!< One cycle from table, repeated at the frequency
+    AUDIO_WAVE_SAMPLE,      //!< The whole table once; the frequency is its sample rate
+};
+
+/*!
+ *  @brief  A sound: a waveform, its volume, and its envelope
+ *
+ *  Fields left zero give a square wave at 50% duty that starts and stops
+ *  at full volume.
+ */
+struct audio_sound {
+    enum audio_wave wave;
+    uint8_t volume;         //!< 0-255; several voices at full volume clip
+    uint8_t duty;           //!< Square waves: 0-255 of each cycle high, 0 for 50%
+    uint16_t attack_ms;     //!< Rise from silence to full volume
+    uint16_t decay_ms;      //!< Then fall to the sustain level; 0 to stay at full
+    uint8_t sustain;        //!< 0-255 of full volume
+    uint16_t release_ms;    //!< Fade out once the note's duration is up
+    const int8_t *table;    //!< AUDIO_WAVE_TABLE and AUDIO_WAVE_SAMPLE
+    uint16_t table_len;
+};
+
 /*!
  *  @brief  Initialize and configure audio gpio
  *
@@ -56,6 +96,104 @@ int audio_out_beep(uint16_t freq, uint16_t duration);
  */
 int audio_out_beep_with_cb(uint16_t freq, uint16_t duration, void (*beep_finished)(void));
 
+/*!
+ *  @brief  Play a sound on one of the mixer's voices.
+ *
+ *  Sound effects and music can play at the same time on different voices;
+ *  playing on a voice that's busy starts it again with the new sound.
+ *
+ *  @param  voice       0 to AUDIO_VOICES - 1, or AUDIO_VOICE_ANY for one
+ *                      that's free (or else the one that started longest ago)
+ *  @param  sound       What to play; it's copied, so needn't stay around
+ *  @param  freq_hz     Frequency in Hertz
+ *  @param  duration_ms How long before the release, or 0 to play until
+ *                      audio_voice_release()
+ *
+ *  @return The voice playing the sound, or -1 if voice is out of range
+ */
+int audio_voice_play(int voice, const struct audio_sound *sound, uint16_t freq_hz, uint16_t duration_ms);
+
+/*!
+ *  @brief  Change the frequency of a playing voice, for slides and vibrato.
+ */
+void audio_voice_set_freq(int voice, uint16_t freq_hz);
+
+/*!
+ *  @brief  Let a voice fade out over its sound's release time.
+ */
+void audio_voice_release(int voice);
+
+/*!
+ *  @brief  Silence a voice straight away.
+ */
+void audio_voice_stop(int voice);
+
+/*!
+ *  @brief  Whether a voice is still making a sound.
+ */
+bool audio_voice_is_playing(int voice);
+
+/*!
+ *  @brief  Keep a voice for yourself: AUDIO_VOICE_ANY won't pick it.
+ */
+void audio_voice_reserve(int voice, bool reserved);
+
+/*!
+ *  @brief  Have the mixer call a function between two samples, every so often.
+ *
+ *  For sequencers: tick is called at exactly the sample it's due, from
+ *  wherever the mixer runs (an interrupt on the badge), so the notes it
+ *  starts are in time however late that is. It may use the audio_voice_*()
+ *  functions, but should hand anything for the app to audio_post_callback().
+ *  There is one clock; starting it again replaces tick.
+ *
+ *  @param  tick            Returns how many samples until it's next due,
+ *                          or 0 to stop the clock
+ *  @param  delay_samples   How long until it's first called
+ */
+void audio_clock_start(uint32_t (*tick)(void), uint32_t delay_samples);
+
+/*!
+ *  @brief  Stop calling the clock's tick function.
+ */
+void audio_clock_stop(void);
+
+/*!
+ *  @brief  Samples a second the mixer makes, for timing in samples.
+ */
+uint32_t audio_sample_rate(void);
+
+/*!
+ *  @brief  Call an app's function the way audio_out_beep_with_cb() calls
+ *          beep_finished: from the audio interrupt on the badge, and on the
+ *          app's thread in the simulator, the next time it sleeps.
+ */
+void audio_post_callback(void (*callback)(void));
+
+/*!
+ *  @brief  Start capturing from the microphone.
+ *
+ *  Blocks of AUDIO_IN_BLOCK_SAMPLES are captured one after the other until
+ *  audio_in_stop(), by DMA on the badge. In the simulator they come from the
+ *  WAV file or tones given on the command line, or are silent.
+ */
+void audio_in_start(void);
+
+/*!
+ *  @brief  Stop capturing from the microphone.
+ */
+void audio_in_stop(void);
+
+/*!
+ *  @brief  Copy the newest complete block from the microphone.
+ *
+ *  @param  samples     AUDIO_IN_BLOCK_SAMPLES signed samples, 0 for silence
+ *
+ *  @return How many blocks have been captured since audio_in_start(), so a
+ *          caller can tell a new block from one it's seen, or 0 if none has
+ */
+uint32_t audio_in_read(int16_t *samples);
+
 /*!
  *  @brief  Request the opamp standby pin take a certain state.
  *
@@ -0,0 +1,151 @@
+//
+// The simulator's microphone: blocks of samples from a WAV file given with --mic-wav, or tones given with
+// --mic-tone, as if they had been captured since audio_in_start() at AUDIO_IN_SAMPLE_RATE_HZ. Nothing runs in the
+// background; audio_in_read() works out which block is newest from the time, and makes it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "audio_sim.h"
+#include "fxp_math.h"
+#include "rtc.h"
+
+#define MIC_MAX_TONES (4)
+#define MIC_TONE_AMPLITUDE (16000)
+
+static int16_t *wav;
+static uint32_t wav_samples;
+static uint32_t wav_rate;
+static uint16_t tones[MIC_MAX_TONES];
+static int num_tones;
+
+static bool capturing;
+static uint64_t started_us;
+
+static uint32_t read_le(const uint8_t *p, int bytes) {
+    uint32_t v = 0;
+
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = v << 8 | p[i];
+    }
+    return v;
+}
+
+// 16 bit PCM only; of several channels, the first
+int audio_sim_mic_wav(const char *path) {
+    FILE *f = fopen(path, "rb");
+    uint8_t *data = NULL;
+    long size;
+    uint32_t channels = 0, bits = 0;
+
+    if (!f) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > 12) {
+        data = malloc(size);
+    }
+    if (!data || fread(data, 1, size, f) != (size_t) size
+        || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s isn't a WAV file\n", path);
+        goto fail;
+    }
+
+    for (long pos = 12; pos + 8 <= size; ) {
+        uint32_t len = read_le(data + pos + 4, 4);
+        const uint8_t *chunk = data + pos + 8;
+
+        if (len > (uint32_t) (size - pos - 8)) {
+            len = (uint32_t) (size - pos - 8);
+        }
+        if (memcmp(data + pos, "fmt ", 4) == 0 && len >= 16) {
+            channels = read_le(chunk + 2, 2);
+            wav_rate = read_le(chunk + 4, 4);
+            bits = read_le(chunk + 14, 2);
+            if (read_le(chunk, 2) != 1 || bits != 16 || !channels || !wav_rate) {
+                fprintf(stderr, "%s isn't 16 bit PCM\n", path);
+                goto fail;
+            }
+        } else if (memcmp(data + pos, "data", 4) == 0 && channels) {
+            wav_samples = len / (2 * channels);
+            wav = malloc(wav_samples * sizeof(*wav) + 1);
+            if (!wav) {
+                goto fail;
+            }
+            for (uint32_t i = 0; i < wav_samples; i++) {
+                wav[i] = (int16_t) read_le(chunk + i * 2 * channels, 2);
+            }
+            break;
+        }
+        pos += 8 + len + (len & 1);
+    }
+    if (!wav || !wav_samples) {
+        fprintf(stderr, "No samples in %s\n", path);
+        goto fail;
+    }
+    free(data);
+    fclose(f);
+    printf("Microphone: %u samples at %u Hz from %s\n", wav_samples, wav_rate, path);
+    return 0;
+
+fail:
+    free(wav);
+    wav = NULL;
+    free(data);
+    fclose(f);
+    return -1;
+}
+
+void audio_sim_mic_tone(uint16_t freq_hz) {
+    if (num_tones < MIC_MAX_TONES) {
+        tones[num_tones++] = freq_hz;
+    }
+}
+
+static int16_t mic_sample(uint64_t n) {
+    int32_t sum = 0;
+
+    if (wav) {
+        // Looped, and resampled to the nearest sample
+        return wav[n * wav_rate / AUDIO_IN_SAMPLE_RATE_HZ % wav_samples];
+    }
+    for (int t = 0; t < num_tones; t++) {
+        fxp_angle a = (fxp_angle) (n * tones[t] * 65536 / AUDIO_IN_SAMPLE_RATE_HZ);
+
+        sum += fxp_sin(a) * (MIC_TONE_AMPLITUDE / num_tones) >> 16;
+    }
+    return (int16_t) sum;
+}
+
+void audio_in_start(void) {
+    started_us = rtc_get_us_since_boot();
+    capturing = true;
+}
+
+void audio_in_stop(void) {
+    capturing = false;
+}
+
+uint32_t audio_in_read(int16_t *samples) {
+    uint64_t captured;
+    uint32_t blocks;
+
+    if (!capturing) {
+        return 0;
+    }
+    captured = (rtc_get_us_since_boot() - started_us) * AUDIO_IN_SAMPLE_RATE_HZ / 1000000;
+    blocks = (uint32_t) (captured / AUDIO_IN_BLOCK_SAMPLES);
+    if (!blocks) {
+        return 0;
+    }
+    for (int i = 0; i < AUDIO_IN_BLOCK_SAMPLES; i++) {
+        samples[i] = mic_sample((uint64_t) (blocks - 1) * AUDIO_IN_BLOCK_SAMPLES + i);
+    }
+    return blocks;
+}
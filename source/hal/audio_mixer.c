@@ -0,0 +1,461 @@
+//
+// Voice mixer shared between audio_rp2040.c and the simulator.
+//
+// Each voice is a 32 bit phase accumulator driving a waveform, scaled by a linear attack/decay/sustain/release
+// envelope and the sound's volume. Everything is integer arithmetic, so the badge can mix all the voices for a block
+// of samples in an interrupt. The mix is clipped to 16 bits; the HAL scales it to whatever the speaker takes.
+//
+// The clock splits a block at the sample its tick function is due, and calls it there, so whatever it plays starts
+// on that sample.
+//
+// The audio_voice_*() and audio_clock_*() functions turn into commands that the HAL gets to audio_mixer_apply() in
+// between fills. What they tell the caller about the voices comes from copies the mixer keeps up to date, since the
+// caller may be on another thread from the mixer. Those are written whole with single loads and stores, which the
+// RP2040 can do atomically, unlike read-modify-writes.
+//
+
+#include <stddef.h>
+#include <string.h>
+
+#include "audio.h"
+#include "audio_mixer.h"
+
+// Envelope levels are fractions of this
+#define LEVEL_FULL (1u << 24)
+// Largest block audio_mixer_fill() mixes at once; it does bigger ones a piece at a time
+#define MIX_BLOCK (256)
+
+enum stage {
+    STAGE_OFF = 0,
+    STAGE_ATTACK,
+    STAGE_DECAY,
+    STAGE_SUSTAIN,
+    STAGE_RELEASE,
+};
+
+struct voice {
+    struct audio_sound sound;
+    enum stage stage;
+    uint32_t phase;         // AUDIO_WAVE_SAMPLE: position in the table, 16.16
+    uint32_t step;
+    uint32_t duty_phase;    // square waves are high while phase is below this
+    uint32_t level;
+    uint32_t attack_step, decay_step, release_step;
+    uint32_t sustain_level;
+    uint32_t samples_left;  // until the release, or 0 to wait for audio_voice_release()
+    uint16_t lfsr;
+    void (*finished)(void);
+};
+
+static struct voice voices[AUDIO_VOICES];
+static uint32_t rate = AUDIO_SAMPLE_RATE_HZ;
+
+// Written by the mixer: a bit for each voice making a sound
+static uint32_t playing;
+// Written by the caller: played but not applied yet, kept from sound effects, and when each was played, in
+// audio_mixer_play() calls, for picking a voice to take over
+static uint8_t pending[AUDIO_VOICES];
+static uint8_t reserved[AUDIO_VOICES];
+static uint32_t started[AUDIO_VOICES];
+static uint32_t plays;
+
+static uint32_t (*clock_tick)(void);
+static uint32_t clock_left;     // samples until clock_tick is due
+
+// Callbacks held back while the HAL starts the output; a voice's finished function is posted once per play, so one
+// each and a few for the clock is plenty
+#define HELD_CALLBACKS (AUDIO_VOICES + 4)
+static void (*held[HELD_CALLBACKS])(void);
+static int held_count;
+static bool holding;
+
+void audio_mixer_init(uint32_t sample_rate) {
+    memset(voices, 0, sizeof(voices));
+    memset(pending, 0, sizeof(pending));
+    memset(reserved, 0, sizeof(reserved));
+    rate = sample_rate;
+    clock_tick = NULL;
+    held_count = 0;
+    holding = false;
+    __atomic_store_n(&playing, 0, __ATOMIC_RELEASE);
+}
+
+static uint32_t ms_to_samples(uint16_t ms) {
+    uint32_t samples = ms * rate / 1000;
+
+    return ms && !samples ? 1 : samples;
+}
+
+static void set_freq(struct voice *v, uint16_t freq_hz) {
+    if (v->sound.wave == AUDIO_WAVE_SAMPLE) {
+        v->step = ((uint32_t) freq_hz << 16) / rate;
+    } else {
+        v->step = (uint32_t) (((uint64_t) freq_hz << 32) / rate);
+    }
+}
+
+static void start_release(struct voice *v) {
+    uint32_t samples = ms_to_samples(v->sound.release_ms);
+
+    v->samples_left = 0;
+    if (!samples || !v->level) {
+        v->level = 0;
+        v->stage = STAGE_OFF;
+        return;
+    }
+    v->release_step = v->level / samples;
+    if (!v->release_step) {
+        v->release_step = 1;
+    }
+    v->stage = STAGE_RELEASE;
+}
+
+static bool voice_busy(int i) {
+    return __atomic_load_n(&pending[i], __ATOMIC_ACQUIRE) || (__atomic_load_n(&playing, __ATOMIC_ACQUIRE) >> i & 1);
+}
+
+static int pick_voice(void) {
+    uint32_t now = __atomic_load_n(&plays, __ATOMIC_RELAXED);
+    int oldest = -1;
+
+    // A free voice, or the one that's been going longest. The beep voice is left to audio_out_beep().
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        if (i == AUDIO_VOICE_BEEP || __atomic_load_n(&reserved[i], __ATOMIC_RELAXED)) {
+            continue;
+        }
+        if (!voice_busy(i)) {
+            return i;
+        }
+        if (oldest < 0 || now - __atomic_load_n(&started[i], __ATOMIC_RELAXED)
+                          > now - __atomic_load_n(&started[oldest], __ATOMIC_RELAXED)) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+static void start_voice(struct voice *v, const struct audio_command *cmd) {
+    const struct audio_sound *sound = &cmd->sound;
+    uint32_t attack, decay;
+
+    v->sound = *sound;
+    v->finished = NULL;
+    if (sound->wave == AUDIO_WAVE_TABLE || sound->wave == AUDIO_WAVE_SAMPLE) {
+        if (!sound->table || !sound->table_len) {
+            v->stage = STAGE_OFF;
+            return;
+        }
+    }
+    v->phase = 0;
+    set_freq(v, cmd->freq_hz);
+    v->duty_phase = (uint32_t) (sound->duty ? sound->duty : 128) << 24;
+    v->lfsr = 0xace1;
+    v->sustain_level = sound->decay_ms ? (LEVEL_FULL >> 8) * sound->sustain : LEVEL_FULL;
+
+    attack = ms_to_samples(sound->attack_ms);
+    decay = ms_to_samples(sound->decay_ms);
+    v->attack_step = attack ? LEVEL_FULL / attack : 0;
+    v->decay_step = decay ? (LEVEL_FULL - v->sustain_level) / decay + 1 : 0;
+    if (attack) {
+        v->level = 0;
+        v->stage = STAGE_ATTACK;
+    } else {
+        v->level = LEVEL_FULL;
+        v->stage = decay ? STAGE_DECAY : STAGE_SUSTAIN;
+    }
+    v->samples_left = ms_to_samples(cmd->duration_ms);
+    v->finished = cmd->finished;
+}
+
+static void publish_playing(void) {
+    uint32_t mask = 0;
+
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        if (voices[i].stage != STAGE_OFF) {
+            mask |= 1u << i;
+        }
+    }
+    __atomic_store_n(&playing, mask, __ATOMIC_RELEASE);
+}
+
+void audio_mixer_apply(const struct audio_command *cmd) {
+    struct voice *v = NULL;
+
+    if (cmd->voice >= 0 && cmd->voice < AUDIO_VOICES) {
+        v = &voices[cmd->voice];
+    }
+    switch (cmd->op) {
+    case AUDIO_OP_PLAY:
+        if (v) {
+            start_voice(v, cmd);
+            __atomic_store_n(&pending[cmd->voice], 0, __ATOMIC_RELEASE);
+        }
+        break;
+    case AUDIO_OP_SET_FREQ:
+        if (v) {
+            set_freq(v, cmd->freq_hz);
+        }
+        break;
+    case AUDIO_OP_RELEASE:
+        if (v && v->stage != STAGE_OFF && v->stage != STAGE_RELEASE) {
+            start_release(v);
+        }
+        break;
+    case AUDIO_OP_STOP:
+        if (v) {
+            v->stage = STAGE_OFF;
+            v->finished = NULL;
+        }
+        break;
+    case AUDIO_OP_CLOCK_START:
+        clock_tick = cmd->tick;
+        clock_left = cmd->delay_samples;
+        break;
+    case AUDIO_OP_CLOCK_STOP:
+        clock_tick = NULL;
+        break;
+    }
+    publish_playing();
+}
+
+int audio_mixer_play(int voice, const struct audio_sound *sound, uint16_t freq_hz, uint16_t duration_ms,
+                     void (*finished)(void)) {
+    struct audio_command cmd = {
+        .op = AUDIO_OP_PLAY,
+        .freq_hz = freq_hz,
+        .duration_ms = duration_ms,
+        .sound = *sound,
+        .finished = finished,
+    };
+    uint32_t now;
+
+    if (voice == AUDIO_VOICE_ANY) {
+        voice = pick_voice();
+    }
+    if (voice < 0 || voice >= AUDIO_VOICES) {
+        return -1;
+    }
+    cmd.voice = (int8_t) voice;
+    now = __atomic_load_n(&plays, __ATOMIC_RELAXED);
+    __atomic_store_n(&plays, now + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&started[voice], now, __ATOMIC_RELAXED);
+    __atomic_store_n(&pending[voice], 1, __ATOMIC_RELEASE);
+    audio_mixer_submit(&cmd);
+    return voice;
+}
+
+static int32_t wave(struct voice *v) {
+    uint32_t phase = v->phase;
+    uint32_t x;
+
+    v->phase += v->step;
+    switch (v->sound.wave) {
+    case AUDIO_WAVE_SQUARE:
+        return phase < v->duty_phase ? 32767 : -32767;
+    case AUDIO_WAVE_TRIANGLE:
+        x = phase >> 16;
+        if (x & 0x8000) {
+            x ^= 0xffff;
+        }
+        return (int32_t) x * 2 - 32767;
+    case AUDIO_WAVE_NOISE:
+        // A new random level each time the phase wraps around
+        if (v->phase < phase) {
+            v->lfsr = (v->lfsr >> 1) ^ (-(v->lfsr & 1u) & 0xb400u);
+        }
+        return v->lfsr & 1 ? 32767 : -32767;
+    case AUDIO_WAVE_TABLE:
+        return v->sound.table[((phase >> 16) * v->sound.table_len) >> 16] * 256;
+    case AUDIO_WAVE_SAMPLE:
+        if ((phase >> 16) >= v->sound.table_len) {
+            v->stage = STAGE_OFF;
+            return 0;
+        }
+        return v->sound.table[phase >> 16] * 256;
+    }
+    return 0;
+}
+
+static void envelope(struct voice *v) {
+    switch (v->stage) {
+    case STAGE_ATTACK:
+        v->level += v->attack_step;
+        if (v->level >= LEVEL_FULL) {
+            v->level = LEVEL_FULL;
+            v->stage = v->decay_step ? STAGE_DECAY : STAGE_SUSTAIN;
+        }
+        break;
+    case STAGE_DECAY:
+        if (v->level <= v->sustain_level + v->decay_step) {
+            v->level = v->sustain_level;
+            v->stage = STAGE_SUSTAIN;
+        } else {
+            v->level -= v->decay_step;
+        }
+        break;
+    case STAGE_RELEASE:
+        if (v->level <= v->release_step) {
+            v->level = 0;
+            v->stage = STAGE_OFF;
+        } else {
+            v->level -= v->release_step;
+        }
+        return;
+    default:
+        return;
+    }
+}
+
+static void mix_voice(struct voice *v, int32_t *mix, int n) {
+    for (int i = 0; i < n && v->stage != STAGE_OFF; i++) {
+        int32_t gain = (int32_t) ((v->level >> 9) * v->sound.volume >> 8);
+
+        mix[i] += wave(v) * gain >> 15;
+        envelope(v);
+        if (v->samples_left && --v->samples_left == 0) {
+            start_release(v);
+        }
+        if (v->stage == STAGE_OFF && v->finished) {
+            void (*finished)(void) = v->finished;
+
+            v->finished = NULL;
+            audio_post_callback(finished);
+        }
+    }
+}
+
+static void run_clock(void) {
+    uint32_t (*tick)(void) = clock_tick;
+    uint32_t next = tick();
+
+    // Unless tick started or stopped the clock itself
+    if (clock_tick == tick) {
+        clock_left = next;
+        if (!next) {
+            clock_tick = NULL;
+        }
+    }
+}
+
+void audio_mixer_fill(int16_t *out, int n) {
+    static int32_t mix[MIX_BLOCK];
+
+    while (n > 0) {
+        int count = n < MIX_BLOCK ? n : MIX_BLOCK;
+
+        if (clock_tick && !clock_left) {
+            run_clock();
+            continue;
+        }
+        if (clock_tick && (uint32_t) count > clock_left) {
+            count = (int) clock_left;
+        }
+        if (clock_tick) {
+            clock_left -= count;
+        }
+
+        memset(mix, 0, count * sizeof(mix[0]));
+        for (int i = 0; i < AUDIO_VOICES; i++) {
+            mix_voice(&voices[i], mix, count);
+        }
+        for (int i = 0; i < count; i++) {
+            int32_t sample = mix[i];
+
+            out[i] = (int16_t) (sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample);
+        }
+        out += count;
+        n -= count;
+    }
+    publish_playing();
+}
+
+void audio_mixer_hold_callbacks(void) {
+    holding = true;
+}
+
+bool audio_mixer_hold_callback(void (*callback)(void)) {
+    if (!holding) {
+        return false;
+    }
+    // Dropped rather than called: calling it here is what holding is for
+    if (held_count < HELD_CALLBACKS) {
+        held[held_count++] = callback;
+    }
+    return true;
+}
+
+void audio_mixer_release_callbacks(void) {
+    holding = false;
+    // Each one may play another sound, which is mixed from now on; none is held again
+    for (int i = 0; i < held_count; i++) {
+        audio_post_callback(held[i]);
+    }
+    held_count = 0;
+}
+
+bool audio_mixer_active(void) {
+    if (clock_tick) {
+        return true;
+    }
+    for (int i = 0; i < AUDIO_VOICES; i++) {
+        if (voices[i].stage != STAGE_OFF) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int audio_voice_play(int voice, const struct audio_sound *sound, uint16_t freq_hz, uint16_t duration_ms) {
+    return audio_mixer_play(voice, sound, freq_hz, duration_ms, NULL);
+}
+
+static void submit_to_voice(enum audio_op op, int voice, uint16_t freq_hz) {
+    struct audio_command cmd = { .op = op, .voice = (int8_t) voice, .freq_hz = freq_hz };
+
+    if (voice < 0 || voice >= AUDIO_VOICES) {
+        return;
+    }
+    audio_mixer_submit(&cmd);
+}
+
+void audio_voice_set_freq(int voice, uint16_t freq_hz) {
+    submit_to_voice(AUDIO_OP_SET_FREQ, voice, freq_hz);
+}
+
+void audio_voice_release(int voice) {
+    submit_to_voice(AUDIO_OP_RELEASE, voice, 0);
+}
+
+void audio_voice_stop(int voice) {
+    submit_to_voice(AUDIO_OP_STOP, voice, 0);
+}
+
+bool audio_voice_is_playing(int voice) {
+    if (voice < 0 || voice >= AUDIO_VOICES) {
+        return false;
+    }
+    return voice_busy(voice);
+}
+
+void audio_voice_reserve(int voice, bool reserve) {
+    if (voice < 0 || voice >= AUDIO_VOICES) {
+        return;
+    }
+    __atomic_store_n(&reserved[voice], reserve, __ATOMIC_RELEASE);
+}
+
+void audio_clock_start(uint32_t (*tick)(void), uint32_t delay_samples) {
+    struct audio_command cmd = { .op = AUDIO_OP_CLOCK_START, .tick = tick, .delay_samples = delay_samples };
+
+    audio_mixer_submit(&cmd);
+}
+
+void audio_clock_stop(void) {
+    struct audio_command cmd = { .op = AUDIO_OP_CLOCK_STOP };
+
+    audio_mixer_submit(&cmd);
+}
+
+uint32_t audio_sample_rate(void) {
+    return rate;
+}
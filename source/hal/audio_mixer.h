@@ -0,0 +1,68 @@
+//
+// Voice mixer shared by the audio HAL implementations, which feed its output to the speaker. Apps should not include
+// this; the public API is in audio.h.
+//
+
+#ifndef BADGE_C_AUDIO_MIXER_H
+#define BADGE_C_AUDIO_MIXER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "audio.h"
+
+// Forget all voices and run at sample_rate from now on.
+void audio_mixer_init(uint32_t sample_rate);
+
+// Fill out with the next n samples of all the voices mixed together. Voices that end pass their finished function to
+// audio_post_callback() at the sample they end on; one that plays the same voice again from there carries on from the
+// next sample.
+void audio_mixer_fill(int16_t *out, int n);
+
+// Whether any voice is making a sound, or the clock is running. Only for where the mixer runs.
+bool audio_mixer_active(void);
+
+// audio_voice_play(), with a function to call when the voice ends. Restarting or stopping the voice first means it's
+// never called.
+int audio_mixer_play(int voice, const struct audio_sound *sound, uint16_t freq_hz, uint16_t duration_ms,
+                     void (*finished)(void));
+
+enum audio_op {
+    AUDIO_OP_PLAY = 0,
+    AUDIO_OP_SET_FREQ,
+    AUDIO_OP_RELEASE,
+    AUDIO_OP_STOP,
+    AUDIO_OP_CLOCK_START,
+    AUDIO_OP_CLOCK_STOP,
+};
+
+// What the audio_voice_*() and audio_clock_*() functions ask the mixer to do. The sound is copied in, so a command
+// can be queued after the caller's sound has gone.
+struct audio_command {
+    uint8_t op;             // enum audio_op
+    int8_t voice;
+    uint16_t freq_hz;
+    uint16_t duration_ms;
+    struct audio_sound sound;
+    void (*finished)(void);
+    uint32_t (*tick)(void);
+    uint32_t delay_samples;
+};
+
+// For starting the output from idle, where the first blocks are filled before it's running: from
+// audio_mixer_hold_callbacks() until audio_mixer_release_callbacks(), audio_post_callback() gives each callback to
+// audio_mixer_hold_callback(), which keeps it, and release calls them. Otherwise a callback that plays another sound
+// would be called from inside the fill, find the output still stopped, and start it again, as deep as the sounds
+// chain. audio_mixer_hold_callback() returns false when callbacks aren't being held, for the HAL to call it itself.
+void audio_mixer_hold_callbacks(void);
+bool audio_mixer_hold_callback(void (*callback)(void));
+void audio_mixer_release_callbacks(void);
+
+// Carry out a command. Only for where the mixer runs, like audio_mixer_fill().
+void audio_mixer_apply(const struct audio_command *cmd);
+
+// Implemented by each audio HAL, along with audio_post_callback(): get cmd to audio_mixer_apply() in between calls to
+// audio_mixer_fill(), now or before the next one, and make sure the mixer is being run.
+void audio_mixer_submit(const struct audio_command *cmd);
+
+#endif //BADGE_C_AUDIO_MIXER_H
@@ -7,7 +7,17 @@
  *
  *------------------------------------------------------------------------------
  *
- *  @note   Only basic output beep implemented!
+ *  The mixer in audio_mixer.c fills blocks of samples, which DMA copies to
+ *  the PWM compare register one sample at a time, paced by a DMA timer. Two
+ *  channels chained to each other take turns, each with its own block: when
+ *  one finishes, the other starts playing and the DMA interrupt fills the
+ *  finished block again. The stream stops once the mixer has been silent for
+ *  both blocks, so the badge can sleep.
+ *
+ *  The microphone works the same way backwards: the ADC free-runs at
+ *  AUDIO_IN_SAMPLE_RATE_HZ and two more chained channels take turns copying
+ *  its FIFO into two blocks, so there's one interrupt a block rather than one
+ *  a sample.
  *
  */
 
@@ -21,11 +31,13 @@
 #include <hardware/dma.h>
 #include <hardware/adc.h>
 #include <hardware/clocks.h>
+#include <hardware/sync.h>
 
 #include "pinout_rp2040.h"
 #include "badge.h"
 
 #include "audio.h"
+#include "audio_mixer.h"
 
 /*! @addtogroup BADGE_AUDIO Audio Driver
  *  @{
@@ -37,52 +49,82 @@ static unsigned chan;
 
 static volatile enum audio_out_mode_ {
     AUDIO_OUT_MODE_OFF = 0,
-    AUDIO_OUT_MODE_BEEP,
+    AUDIO_OUT_MODE_STREAM,
 } audio_out_mode;
 
-#ifdef EXPERIMENTAL_TEST_CODE
-static uint16_t test_wave[] =
-{
-    127,133,140,146,152,158,163,169,173,177,181,184,187,189,190,
-    190,190,189,188,186,183,179,175,171,166,161,155,149,143,136,
-    130,123,117,110,104, 98, 92, 87, 82, 78, 74, 70, 67, 65, 64,
-     63, 63, 63, 64, 66, 69, 72, 76, 80, 84, 90, 95,101,107,113,
-    120
-};
-static int test_pos = 0;
-#endif
+#define AUDIO_BLOCK_SAMPLES     (256)   //!< 11.6 ms a block at 22.05 kHz
+#define AUDIO_BEEP_VOLUME       (192)
+
+static int dma_chan[2] = { -1, -1 };
+static int dma_timer = -1;
+static dma_channel_config dma_config[2];
+static uint32_t block[2][AUDIO_BLOCK_SAMPLES];
+static int16_t mix[AUDIO_BLOCK_SAMPLES];
+static int silent_blocks;
+
+#define AUDIO_IN_ADC_INPUT      (2)     //!< BADGE_GPIO_AUDIO_INPUT is ADC2
+#define AUDIO_IN_ADC_MIDPOINT   (2048)
+
+static int in_dma_chan[2] = { -1, -1 };
+static dma_channel_config in_dma_config[2];
+static uint16_t in_block[2][AUDIO_IN_BLOCK_SAMPLES];
+static volatile int in_latest;
+static volatile uint32_t in_blocks;     //!< finished since audio_in_start()
+
+static void audio_out_stop(void);
 
 /*- IRQ Handlers -------------------------------------------------------------*/
 
-static void audio_out_pwm_irq_handler(void)
+static void audio_out_fill_block(int b)
 {
-    pwm_clear_irq(slice);
-    switch (audio_out_mode)
+    if (audio_mixer_active())
+        silent_blocks = 0;
+    else
+        silent_blocks++;
+
+    audio_mixer_fill(mix, AUDIO_BLOCK_SAMPLES);
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
     {
-        case AUDIO_OUT_MODE_OFF:
-        case AUDIO_OUT_MODE_BEEP:
-            /* this irq shouldn't be here anyway */
-            pwm_set_irq_enabled(slice, false);
-            return;
+        uint32_t level = (uint32_t) (mix[i] + 32768) >> (16 - AUDIO_DEPTH_BITS);
+
+        /* The DMA writes the whole compare register; the slice's other
+         * channel doesn't drive a pin, so it gets the same level. */
+        block[b][i] = level | (level << 16);
+    }
+}
 
-        default:
+static void audio_out_dma_irq_handler(void)
+{
+    for (int b = 0; b < 2; b++)
+    {
+        if (dma_chan[b] < 0 || !dma_channel_get_irq1_status(dma_chan[b]))
+            continue;
+        dma_channel_acknowledge_irq1(dma_chan[b]);
+
+        /* The other block is playing now; fill this one to follow it */
+        dma_channel_set_read_addr(dma_chan[b], block[b], false);
+        audio_out_fill_block(b);
+        if (silent_blocks >= 2)
+        {
+            audio_out_stop();
             return;
+        }
     }
-#ifdef EXPERIMENTAL_TEST_CODE
-    int sample = test_wave[(test_pos++)>>0];
-    // sample -= 127; // remove bias
-    // sample *= 32;
-    // sample /= 16;
-    // sample += 128; // add bias
-    pwm_set_chan_level(slice, chan, sample);
-    if (test_pos >= (sizeof(test_wave)*1/sizeof(test_wave[0]))) test_pos = 0;
-#endif
 }
 
-static void audio_in_iqr_handler(void)
+static void audio_in_dma_irq_handler(void)
 {
-    uint16_t sample = adc_fifo_get();
-    pwm_set_chan_level(slice, chan, sample);
+    for (int b = 0; b < 2; b++)
+    {
+        if (in_dma_chan[b] < 0 || !dma_channel_get_irq1_status(in_dma_chan[b]))
+            continue;
+        dma_channel_acknowledge_irq1(in_dma_chan[b]);
+
+        /* The other block is filling now; this one follows it */
+        dma_channel_set_write_addr(in_dma_chan[b], in_block[b], false);
+        in_latest = b;
+        in_blocks++;
+    }
 }
 
 /*- Initialization -----------------------------------------------------------*/
@@ -109,50 +151,48 @@ void audio_init_gpio(void)
     gpio_set_dir(BADGE_GPIO_AUDIO_STANDBY, true);
 }
 
-static void audio_in_init(void)
+static void audio_out_init(void)
 {
-    adc_init();
-    adc_gpio_init(BADGE_GPIO_AUDIO_INPUT);
-    adc_select_input(2);
-    adc_fifo_setup(true, false, 1, false, true);
-    adc_set_clkdiv(1000.0f); // 48 MHz / 1000 = 48kHz
-
-    adc_irq_set_enabled(true);
-    irq_set_exclusive_handler(ADC_IRQ_FIFO, &audio_in_iqr_handler);
-    irq_set_enabled(ADC_IRQ_FIFO, true);
-
-    // g_adc_dma_chan = dma_claim_unused_channel(true);
-    // dma_channel_config config = dma_channel_get_default_config(g_adc_dma_chan);
-    // channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
-    // channel_config_set_read_increment(&config, false);
-    // channel_config_set_write_increment(&config, false);
-    // channel_config_set_dreq(&config, DREQ_ADC);
-    // dma_channel_configure(g_adc_dma_chan, &config, ((void *) pwm_hw->slice[slice].cc) + 2, &adc_hw->fifo, UINT32_MAX / 2, true);
-
-    adc_run(true);
+    if (dma_chan[0] < 0)
+    {
+        dma_timer = dma_claim_unused_timer(true);
+        for (int b = 0; b < 2; b++)
+        {
+            dma_chan[b] = dma_claim_unused_channel(true);
+            dma_config[b] = dma_channel_get_default_config(dma_chan[b]);
+            channel_config_set_transfer_data_size(&dma_config[b], DMA_SIZE_32);
+            channel_config_set_read_increment(&dma_config[b], true);
+            channel_config_set_write_increment(&dma_config[b], false);
+            channel_config_set_dreq(&dma_config[b], dma_get_timer_dreq(dma_timer));
+            dma_channel_set_irq1_enabled(dma_chan[b], true);
+        }
+        irq_add_shared_handler(DMA_IRQ_1, audio_out_dma_irq_handler,
+                               PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+    }
+    else if (audio_out_mode != AUDIO_OUT_MODE_OFF)
+    {
+        /* Called again to mute, from the hard fault handler */
+        audio_out_stop();
+    }
 
-    return;
-}
+    /* One sample each time the timer fires: clk_sys * 1 / (clk_sys / rate) */
+    dma_timer_set_fraction(dma_timer, 1, clock_get_hz(clk_sys) / AUDIO_SAMPLE_RATE_HZ);
 
-static void audio_out_init(void)
-{
+    /* A PWM cycle of 2^AUDIO_DEPTH_BITS system clocks: 122 kHz, far above
+     * anything the speaker can reproduce */
     pwm_set_enabled(slice, false);
     pwm_set_clkdiv_mode(slice, PWM_DIV_FREE_RUNNING);
-    pwm_set_wrap(slice, AUDIO_SAMPLE_MAX - 1);
-    pwm_set_chan_level(slice, chan, AUDIO_SAMPLE_MAX / 2);
-    pwm_set_irq_enabled(slice, true);
-    irq_set_exclusive_handler(PWM_IRQ_WRAP, audio_out_pwm_irq_handler);
-    //irq_set_enabled(PWM_IRQ_WRAP, true);
-    //pwm_set_enabled(slice, true);
+    pwm_set_clkdiv(slice, 1.0f);
+    pwm_set_wrap(slice, AUDIO_SAMPLE_MAX);
+    pwm_set_chan_level(slice, chan, (AUDIO_SAMPLE_MAX + 1) / 2);
 
-    /* Used for beep */
-    alarm_pool_init_default();
+    audio_mixer_init(AUDIO_SAMPLE_RATE_HZ);
 }
 
 void audio_init(void)
 {
     audio_out_init();
-    //audio_in_init();
 }
 
 /*- Standby Pin Control ------------------------------------------------------*/
@@ -170,39 +210,162 @@ void audio_stby_ctl(bool enable)
     }
 }
 
-/*- Output -------------------------------------------------------------------*/
-static int64_t audio_out_beep_alarm(__attribute__((unused)) alarm_id_t id,
-                                    void* user_data)
+/*- Input --------------------------------------------------------------------*/
+
+/* Unchain the channels before aborting them, or aborting one can start the
+ * other, and keep the abort from raising an interrupt (RP2040-E13) */
+static void dma_pair_abort(const int *chans, dma_channel_config *config)
 {
-    void (*beep_finished)(void) = user_data;
+    for (int b = 0; b < 2; b++)
+    {
+        dma_channel_set_irq1_enabled(chans[b], false);
+        channel_config_set_chain_to(&config[b], chans[b]);
+        dma_channel_set_config(chans[b], &config[b], false);
+    }
+    for (int b = 0; b < 2; b++)
+    {
+        dma_channel_abort(chans[b]);
+        dma_channel_acknowledge_irq1(chans[b]);
+        dma_channel_set_irq1_enabled(chans[b], true);
+    }
+}
 
-    if (audio_out_mode != AUDIO_OUT_MODE_BEEP)
+void audio_in_start(void)
+{
+    if (in_dma_chan[0] < 0)
     {
-	if (beep_finished)
-		beep_finished();
-        return 0;
+        for (int b = 0; b < 2; b++)
+        {
+            in_dma_chan[b] = dma_claim_unused_channel(true);
+            in_dma_config[b] = dma_channel_get_default_config(in_dma_chan[b]);
+            channel_config_set_transfer_data_size(&in_dma_config[b], DMA_SIZE_16);
+            channel_config_set_read_increment(&in_dma_config[b], false);
+            channel_config_set_write_increment(&in_dma_config[b], true);
+            channel_config_set_dreq(&in_dma_config[b], DREQ_ADC);
+            dma_channel_set_irq1_enabled(in_dma_chan[b], true);
+        }
+        irq_add_shared_handler(DMA_IRQ_1, audio_in_dma_irq_handler,
+                               PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+
+        adc_init();
+        adc_gpio_init(BADGE_GPIO_AUDIO_INPUT);
+    }
+    else
+    {
+        audio_in_stop();
     }
 
-    audio_out_mode = AUDIO_OUT_MODE_OFF;
+    adc_select_input(AUDIO_IN_ADC_INPUT);
+    /* Each sample into the FIFO raises DREQ_ADC; 12 bits, no error flag */
+    adc_fifo_setup(true, true, 1, false, false);
+    /* A sample every clkdiv + 1 cycles of the 48 MHz ADC clock */
+    adc_set_clkdiv((float) (clock_get_hz(clk_adc) / AUDIO_IN_SAMPLE_RATE_HZ - 1));
+
+    in_blocks = 0;
+    for (int b = 0; b < 2; b++)
+    {
+        channel_config_set_chain_to(&in_dma_config[b], in_dma_chan[!b]);
+        dma_channel_configure(in_dma_chan[b], &in_dma_config[b], in_block[b],
+                              &adc_hw->fifo, AUDIO_IN_BLOCK_SAMPLES, false);
+    }
+    dma_channel_start(in_dma_chan[0]);
+    adc_run(true);
+}
+
+void audio_in_stop(void)
+{
+    if (in_dma_chan[0] < 0)
+        return;
+
+    adc_run(false);
+    dma_pair_abort(in_dma_chan, in_dma_config);
+    adc_fifo_drain();
+}
+
+uint32_t audio_in_read(int16_t *samples)
+{
+    uint32_t n;
+
+    /* Again if the block was started over while it was being copied */
+    do
+    {
+        const uint16_t *from;
+
+        n = in_blocks;
+        if (!n)
+            return 0;
+        from = in_block[in_latest];
+        for (int i = 0; i < AUDIO_IN_BLOCK_SAMPLES; i++)
+            samples[i] = (int16_t) ((from[i] - AUDIO_IN_ADC_MIDPOINT) << 4);
+    } while (n != in_blocks);
+    return n;
+}
+
+/*- Output -------------------------------------------------------------------*/
+
+/* With interrupts disabled, or from the DMA interrupt */
+static void audio_out_start(void)
+{
+    if (audio_out_mode != AUDIO_OUT_MODE_OFF)
+        return;
+
+    /* Streaming already, so a sound played from here on doesn't start it
+     * again, and callbacks wait until it's running (see audio_mixer.h) */
+    audio_out_mode = AUDIO_OUT_MODE_STREAM;
+    audio_mixer_hold_callbacks();
+    silent_blocks = 0;
+    audio_out_fill_block(0);
+    audio_out_fill_block(1);
+    for (int b = 0; b < 2; b++)
+    {
+        channel_config_set_chain_to(&dma_config[b], dma_chan[!b]);
+        dma_channel_configure(dma_chan[b], &dma_config[b], &pwm_hw->slice[slice].cc,
+                              block[b], AUDIO_BLOCK_SAMPLES, false);
+    }
+
+    audio_stby_ctl(false);
+    pwm_set_enabled(slice, true);
+    dma_channel_start(dma_chan[0]);
+    audio_mixer_release_callbacks();
+}
+
+static void audio_out_stop(void)
+{
+    dma_pair_abort(dma_chan, dma_config);
+
+    pwm_set_chan_level(slice, chan, (AUDIO_SAMPLE_MAX + 1) / 2);
     pwm_set_enabled(slice, false);
+    audio_out_mode = AUDIO_OUT_MODE_OFF;
     audio_stby_ctl(true);
-    if (beep_finished)
-        beep_finished();
-    return 0;
+}
+
+/* The mixer runs in the DMA interrupt, so commands are applied straight away
+ * with interrupts off, and callbacks are called from the interrupt, or from
+ * audio_out_start() once the output is running */
+void audio_mixer_submit(const struct audio_command *cmd)
+{
+    uint32_t irq_state = save_and_disable_interrupts();
+
+    audio_mixer_apply(cmd);
+    if (audio_mixer_active())
+        audio_out_start();
+    restore_interrupts(irq_state);
+}
+
+void audio_post_callback(void (*callback)(void))
+{
+    if (!audio_mixer_hold_callback(callback))
+        callback();
 }
 
 int audio_out_beep_with_cb(uint16_t freqHz, uint16_t durMs, void (*beep_finished)(void))
 {
-    static alarm_id_t prev_alarm;
+    static const struct audio_sound beep = { .wave = AUDIO_WAVE_SQUARE, .volume = AUDIO_BEEP_VOLUME };
+    static const struct audio_sound rest = { .wave = AUDIO_WAVE_SQUARE, .volume = 0 };
+
     if (freqHz == 0 && beep_finished != NULL) { /* we're being asked to play a rest?  Ok. */
-        audio_out_mode = AUDIO_OUT_MODE_OFF;
-        pwm_set_enabled(slice, false);
-        audio_stby_ctl(true);
-        prev_alarm = alarm_pool_add_alarm_in_ms(alarm_pool_get_default(),
-                                            durMs,
-                                            audio_out_beep_alarm,
-                                            beep_finished,
-                                            true);
+        audio_mixer_play(AUDIO_VOICE_BEEP, &rest, 0, durMs ? durMs : 1, beep_finished);
         return 0;
     }
 
@@ -214,22 +377,7 @@ int audio_out_beep_with_cb(uint16_t freqHz, uint16_t durMs, void (*beep_finished
         return -1;
     }
 
-    if (AUDIO_OUT_MODE_BEEP == audio_out_mode)
-    {
-        alarm_pool_cancel_alarm(alarm_pool_get_default(), prev_alarm);
-    }
-    audio_out_mode = AUDIO_OUT_MODE_BEEP;
-    audio_stby_ctl(false);
-    pwm_set_enabled(slice, false);
-    pwm_set_wrap(slice, 4096);
-    pwm_set_clkdiv(slice, (float) clock_get_hz(clk_sys) / (float) freqHz / 4096.0f);
-    pwm_set_chan_level(slice, chan, 4096 / 2);
-    pwm_set_enabled(slice, true);
-    prev_alarm = alarm_pool_add_alarm_in_ms(alarm_pool_get_default(),
-                                            durMs,
-                                            audio_out_beep_alarm,
-                                            beep_finished,
-                                            true);
+    audio_mixer_play(AUDIO_VOICE_BEEP, &beep, freqHz, durMs, beep_finished);
     return 0;
 }
 
@@ -239,7 +387,7 @@ int audio_out_beep(uint16_t freqHz, uint16_t durMs)
 }
 
 bool audio_is_playing(void) {
-    return audio_out_mode == AUDIO_OUT_MODE_BEEP;
+    return audio_out_mode != AUDIO_OUT_MODE_OFF;
 }
 
 /*! @} */ // BADGE_AUDIO
@@ -9,27 +9,59 @@
 #ifdef SIMULATOR_AUDIO
 #include <portaudio.h>
 #endif
-#include <string.h>
-#include <pthread.h>
+#include <unistd.h>
 
 #include "badge.h"
 #include "audio.h"
+#include "audio_mixer.h"
+#include "audio_sim.h"
+#include "rtc.h"
+
+/*
+ * The mixer runs in PortAudio's callback, on PortAudio's thread, and makes
+ * just the samples each callback asks for. Nothing is shared through a lock,
+ * which the callback mustn't wait on: the app's commands come to it through
+ * one ring, and the callbacks for the app go back through another, to be
+ * called on the app's thread while it sleeps. Each ring has one thread
+ * putting things in and one taking them out.
+ */
 
 #ifdef SIMULATOR_AUDIO
 #define SAMPLE_RATE (48000)
 /* 48 frames = 1 ms */
 #define FRAMES_PER_BUFFER (48)
+/* Full scale from the mixer, about as loud as the old beep */
+#define OUTPUT_SCALE (0.033f / 32768.0f)
+#define COMMAND_RING_SIZE (64)
+#define CALLBACK_RING_SIZE (32)
+#define REPORT_INTERVAL_US (5000000)
+
 static int sound_device;
 static int sound_working;
 static PaStream *stream = NULL;
-static void (*user_callback_fn)(void) = NULL;
-
-/* 1 second worth of audio */
-#define AUDIO_BUFFER_SIZE 48000
-static float audio_buffer[AUDIO_BUFFER_SIZE] = { 0 };
-static int audio_buffer_index = 0;
-static int samples_left_to_play = 0;
-static pthread_mutex_t audio_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local bool on_audio_thread;
+
+/* From the app to the callback */
+static struct {
+	struct audio_command cmd;
+	uint64_t submitted_us;
+} commands[COMMAND_RING_SIZE];
+static uint32_t command_head, command_tail;
+
+/* From the callback to the app */
+static void (*callbacks[CALLBACK_RING_SIZE])(void);
+static uint32_t callback_head, callback_tail;
+
+/* Written by the callback, read by the app */
+static struct {
+	uint32_t underflows;
+	uint32_t commands_dropped;
+	uint32_t callbacks_dropped;
+	uint32_t latency_count;
+	uint64_t latency_total_us;
+	uint32_t latency_max_us;
+} stats;
+static bool measuring_latency;
 #endif
 
 void audio_init_gpio(void)
@@ -53,6 +85,32 @@ static void terminate_portaudio(int rc)
         decode_paerror(rc);
 }
 
+static void count(uint32_t *counter, uint32_t n)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/* Apply the commands the app has sent, timing how long they took to be heard */
+static void apply_commands(uint64_t output_delay_us)
+{
+	uint32_t t = command_tail;
+	uint32_t head = __atomic_load_n(&command_head, __ATOMIC_ACQUIRE);
+	uint64_t now = measuring_latency ? rtc_get_us_since_boot() : 0;
+
+	for (; t != head; t++) {
+		audio_mixer_apply(&commands[t % COMMAND_RING_SIZE].cmd);
+		if (measuring_latency) {
+			uint64_t latency = now - commands[t % COMMAND_RING_SIZE].submitted_us + output_delay_us;
+
+			count(&stats.latency_count, 1);
+			__atomic_store_n(&stats.latency_total_us, stats.latency_total_us + latency, __ATOMIC_RELAXED);
+			if (latency > stats.latency_max_us)
+				__atomic_store_n(&stats.latency_max_us, (uint32_t) latency, __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_store_n(&command_tail, t, __ATOMIC_RELEASE);
+}
+
 /* This routine will be called by the PortAudio engine when audio is needed.
 ** It may called at interrupt level on some machines so don't do anything
 ** that could mess up the system like calling malloc() or free().
@@ -60,43 +118,99 @@ static void terminate_portaudio(int rc)
 static int mixer_loop(__attribute__ ((unused)) const void *inputBuffer,
 	void *outputBuffer,
 	unsigned long framesPerBuffer,
-	__attribute__ ((unused)) const PaStreamCallbackTimeInfo* timeInfo,
-	__attribute__ ((unused)) PaStreamCallbackFlags statusFlags,
+	const PaStreamCallbackTimeInfo* timeInfo,
+	PaStreamCallbackFlags statusFlags,
 	__attribute__ ((unused)) void *userData )
 {
 	float *out = outputBuffer;
+	int16_t samples[FRAMES_PER_BUFFER];
+	double output_delay = timeInfo->outputBufferDacTime - timeInfo->currentTime;
 
-	pthread_mutex_lock(&audio_lock);
-	if (samples_left_to_play == 0 && user_callback_fn) {
-		void (*temp_callback_fn)(void) = user_callback_fn;
-		user_callback_fn = NULL;
-		pthread_mutex_unlock(&audio_lock);
-		temp_callback_fn();
-		pthread_mutex_lock(&audio_lock);
-	}
-	if (badge_system_data()->mute) {
-		memset(out, 0, sizeof(*out) * framesPerBuffer);
-	} else {
-		for (size_t i = 0; i < framesPerBuffer; i++) {
-			out[i] = audio_buffer[audio_buffer_index];
-			audio_buffer_index++;
-			if (audio_buffer_index >= AUDIO_BUFFER_SIZE)
-				audio_buffer_index = 0;
-		}
-	}
-	samples_left_to_play -= framesPerBuffer;
-	if (samples_left_to_play <= 0) {
-		memset(audio_buffer, 0, sizeof(audio_buffer));
-		samples_left_to_play = 0;
+	on_audio_thread = true;
+	if (statusFlags & paOutputUnderflow)
+		count(&stats.underflows, 1);
+	apply_commands(output_delay > 0 ? (uint64_t) (output_delay * 1e6) : 0);
+
+	for (size_t i = 0; i < framesPerBuffer; i += FRAMES_PER_BUFFER) {
+		int n = framesPerBuffer - i < FRAMES_PER_BUFFER ? framesPerBuffer - i : FRAMES_PER_BUFFER;
+
+		audio_mixer_fill(samples, n);
+		for (int j = 0; j < n; j++)
+			out[i + j] = badge_system_data()->mute ? 0.0f : samples[j] * OUTPUT_SCALE;
 	}
-	pthread_mutex_unlock(&audio_lock);
 	return 0; /* we're never finished */
 }
+
+static void report(void)
+{
+	static uint64_t next_report;
+	static uint32_t last_dropped;
+	uint64_t now = rtc_get_us_since_boot();
+	uint32_t dropped, n;
+
+	if (now < next_report)
+		return;
+	next_report = now + REPORT_INTERVAL_US;
+
+	dropped = __atomic_load_n(&stats.commands_dropped, __ATOMIC_RELAXED)
+		+ __atomic_load_n(&stats.callbacks_dropped, __ATOMIC_RELAXED);
+	if (!measuring_latency && dropped == last_dropped)
+		return;
+	last_dropped = dropped;
+
+	n = __atomic_load_n(&stats.latency_count, __ATOMIC_RELAXED);
+	fprintf(stderr, "audio: %u underflows, %u commands and %u callbacks dropped",
+		__atomic_load_n(&stats.underflows, __ATOMIC_RELAXED),
+		__atomic_load_n(&stats.commands_dropped, __ATOMIC_RELAXED),
+		__atomic_load_n(&stats.callbacks_dropped, __ATOMIC_RELAXED));
+	if (measuring_latency && n)
+		fprintf(stderr, ", latency %llu us average, %u us worst over %u commands",
+			(unsigned long long) (__atomic_load_n(&stats.latency_total_us, __ATOMIC_RELAXED) / n),
+			__atomic_load_n(&stats.latency_max_us, __ATOMIC_RELAXED), n);
+	fprintf(stderr, "\n");
+}
+#endif
+
+void audio_sim_measure_latency(bool measure)
+{
+#ifdef SIMULATOR_AUDIO
+	measuring_latency = measure;
+#else
+	(void) measure;
 #endif
+}
+
+void audio_sim_sleep_us(uint64_t time)
+{
+#ifdef SIMULATOR_AUDIO
+	uint64_t end = rtc_get_us_since_boot() + time;
+
+	/* A millisecond at a time, so a chain of beeps isn't held up by a frame */
+	for (;;) {
+		uint64_t now;
+		uint32_t t = callback_tail;
+
+		while (t != __atomic_load_n(&callback_head, __ATOMIC_ACQUIRE)) {
+			void (*callback)(void) = callbacks[t % CALLBACK_RING_SIZE];
+
+			__atomic_store_n(&callback_tail, ++t, __ATOMIC_RELEASE);
+			callback();
+		}
+		now = rtc_get_us_since_boot();
+		if (now >= end)
+			break;
+		usleep(end - now < 1000 ? end - now : 1000);
+	}
+	report();
+#else
+	usleep(time);
+#endif
+}
 
 void audio_init(void)
 {
 #ifdef SIMULATOR_AUDIO
+	audio_mixer_init(SAMPLE_RATE);
 	printf("Initializing portaudio..."); fflush(stdout);
 
 	PaStreamParameters outparams;
@@ -149,45 +263,68 @@ void audio_init(void)
 		goto error;
 	return;
 error:
+	stream = NULL;
 	terminate_portaudio(rc);
 	return;
 #endif
 }
 
-int audio_out_beep_with_cb(uint16_t freq,  uint16_t duration, void (*beep_finished)(void))
+/* Straight to the mixer while there's no PortAudio thread running it, or
+ * from the clock, which runs on that thread */
+void audio_mixer_submit(const struct audio_command *cmd)
+{
+#ifdef SIMULATOR_AUDIO
+	uint32_t h = command_head;
+
+	if (!stream || on_audio_thread) {
+		audio_mixer_apply(cmd);
+		return;
+	}
+	if (h - __atomic_load_n(&command_tail, __ATOMIC_ACQUIRE) >= COMMAND_RING_SIZE) {
+		count(&stats.commands_dropped, 1);
+		return;
+	}
+	commands[h % COMMAND_RING_SIZE].cmd = *cmd;
+	commands[h % COMMAND_RING_SIZE].submitted_us = measuring_latency ? rtc_get_us_since_boot() : 0;
+	__atomic_store_n(&command_head, h + 1, __ATOMIC_RELEASE);
+#else
+	audio_mixer_apply(cmd);
+#endif
+}
+
+void audio_post_callback(void (*callback)(void))
 {
 #ifdef SIMULATOR_AUDIO
-	float value = -0.025;
+	uint32_t h = callback_head;
+
+	if (!on_audio_thread) {
+		callback();
+		return;
+	}
+	if (h - __atomic_load_n(&callback_tail, __ATOMIC_ACQUIRE) >= CALLBACK_RING_SIZE) {
+		count(&stats.callbacks_dropped, 1);
+		return;
+	}
+	callbacks[h % CALLBACK_RING_SIZE] = callback;
+	__atomic_store_n(&callback_head, h + 1, __ATOMIC_RELEASE);
+#else
+	callback();
+#endif
+}
+
+int audio_out_beep_with_cb(uint16_t freq, uint16_t duration, void (*beep_finished)(void))
+{
+	static const struct audio_sound beep = { .wave = AUDIO_WAVE_SQUARE, .volume = 192 };
+	static const struct audio_sound rest = { .wave = AUDIO_WAVE_SQUARE, .volume = 0 };
 
 	if (duration <= 0)
 		return 0;
 
 	if (freq == 0 && beep_finished != NULL) { /* We're being asked to play a rest? Ok. */
-		pthread_mutex_lock(&audio_lock);
-		memset(audio_buffer, 0, sizeof(audio_buffer));
-		user_callback_fn = beep_finished;
-		audio_buffer_index = 0;
-		samples_left_to_play = (duration * 48);
-		if (samples_left_to_play > AUDIO_BUFFER_SIZE)
-			samples_left_to_play = AUDIO_BUFFER_SIZE;
-		pthread_mutex_unlock(&audio_lock);
+		audio_mixer_play(AUDIO_VOICE_BEEP, &rest, 0, duration, beep_finished);
 		return 0;
 	}
-
-	int count = AUDIO_BUFFER_SIZE / freq / 2;
-	pthread_mutex_lock(&audio_lock);
-	for (int i = 0; i < AUDIO_BUFFER_SIZE; i++) {
-		audio_buffer[i] = value;
-		if ((i % count) == 0)
-			value = -value;
-	}
-	user_callback_fn = beep_finished;
-	audio_buffer_index = 0;
-	samples_left_to_play = (duration * 48);
-	if (samples_left_to_play > AUDIO_BUFFER_SIZE)
-		samples_left_to_play = AUDIO_BUFFER_SIZE;
-	pthread_mutex_unlock(&audio_lock);
-#endif
+	audio_mixer_play(AUDIO_VOICE_BEEP, &beep, freq, duration, beep_finished);
 	return 0;
 }
 
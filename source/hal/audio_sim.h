@@ -0,0 +1,23 @@
+//
+// Audio functions only the simulator has, for the rest of the simulator HAL.
+//
+
+#ifndef BADGE_C_AUDIO_SIM_H
+#define BADGE_C_AUDIO_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Sleep on the app's thread, calling the callbacks the audio thread posts for it as they come in.
+void audio_sim_sleep_us(uint64_t time);
+
+// Time how long the app's audio commands take to reach the speaker, and print it every few seconds along with the
+// underflow and dropped command counts.
+void audio_sim_measure_latency(bool measure);
+
+// What the microphone hears: a 16 bit PCM WAV file, looped, or else up to four tones mixed together. 0 if the file
+// could be read.
+int audio_sim_mic_wav(const char *path);
+void audio_sim_mic_tone(uint16_t freq_hz);
+
+#endif //BADGE_C_AUDIO_SIM_H
@@ -6,6 +6,7 @@
 #define BADGE_C_BUTTON_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     BADGE_BUTTON_A = 0,
@@ -52,4 +53,92 @@ int button_get_rotation(unsigned which_rotary);
 /**  Tell us if we're busy debouncing a button input. */
 bool button_debouncing(void);
 
+// Button events.
+//
+// Every debounced edge and every encoder detent is also queued with the time it happened, so an app that reads the
+// events sees two quick presses as two presses, and knows how far apart they were. The latches above still work as
+// before; an app uses one or the other. The queue is filled from the button interrupt and read without locking, and
+// holds BUTTON_EVENT_QUEUE_SIZE events: an app that starts reading events should call button_event_flush() first to
+// discard whatever piled up while nobody was reading them.
+//
+// Timestamps are the low 32 bits of rtc_get_us_since_boot(); compare them by signed difference.
+
+#define BUTTON_EVENT_QUEUE_SIZE (32)
+
+enum button_event_type {
+    BUTTON_EVENT_UP,
+    BUTTON_EVENT_DOWN,
+    BUTTON_EVENT_CW,    // one detent clockwise
+    BUTTON_EVENT_CCW,   // one detent counterclockwise
+};
+
+struct button_event {
+    uint32_t timestamp_us;
+    uint8_t button;     // BADGE_BUTTON_..., or for rotations BADGE_BUTTON_ENCODER_A (right) or BADGE_BUTTON_ENCODER_2_A (left)
+    uint8_t type;       // enum button_event_type
+};
+
+// Take the oldest event off the queue. Returns false if there are none.
+bool button_event_get(struct button_event *event);
+
+// Throw away everything queued.
+void button_event_flush(void);
+
+// How many events were thrown away because the queue was full.
+unsigned int button_events_dropped(void);
+
+// Auto-repeat: feed every event to button_repeat_event(), and call button_repeat_poll() each frame. Between them they
+// count one press when the button goes down, another delay_us later if it's still held, and then one every
+// interval_us, however the frames happen to fall.
+struct button_repeat {
+    uint32_t delay_us;
+    uint32_t interval_us;
+    uint32_t next_us;
+    uint8_t button;
+    bool held;
+};
+
+#define BUTTON_REPEAT(button, delay_us, interval_us) { (delay_us), (interval_us), 0, (button), false }
+
+int button_repeat_event(struct button_repeat *repeat, const struct button_event *event);
+int button_repeat_poll(struct button_repeat *repeat, uint32_t now_us);
+
+// Long presses: feed every event to button_long_press_event(), which reports a short press when the button comes up
+// before hold_us. button_long_press_poll(), called each frame, reports a long press as soon as the button has been
+// held that long, without waiting for it to come up. Each press is reported once.
+enum button_press {
+    BUTTON_PRESS_NONE,
+    BUTTON_PRESS_SHORT,
+    BUTTON_PRESS_LONG,
+};
+
+struct button_long_press {
+    uint32_t hold_us;
+    uint32_t down_us;
+    uint8_t button;
+    bool held;
+    bool reported;
+};
+
+#define BUTTON_LONG_PRESS(button, hold_us) { (hold_us), 0, (button), false, false }
+
+enum button_press button_long_press_event(struct button_long_press *press, const struct button_event *event);
+enum button_press button_long_press_poll(struct button_long_press *press, uint32_t now_us);
+
+// Encoder acceleration: feed every event to button_encoder_event(), which returns the signed number of steps a detent
+// of this encoder should count for. Turned slowly, that's one step a detent; turned quickly, up to
+// BUTTON_ENCODER_MAX_STEPS, so a long way can be covered in a flick without losing fine control.
+#define BUTTON_ENCODER_MAX_STEPS (8)
+
+struct button_encoder {
+    uint32_t last_us;
+    uint32_t detents_per_sec;   // smoothed speed of the current turn
+    uint8_t button;             // BADGE_BUTTON_ENCODER_A or BADGE_BUTTON_ENCODER_2_A
+    int8_t direction;
+};
+
+#define BUTTON_ENCODER(button) { 0, 0, (button), 0 }
+
+int button_encoder_event(struct button_encoder *encoder, const struct button_event *event);
+
 #endif //BADGE_C_BUTTON_H
@@ -0,0 +1,156 @@
+//
+// Button event queue and the helpers that interpret it, shared between button_rp2040.c and the simulators.
+//
+// The queue is a ring with one writer (the button interrupt, or the simulator's event loop) and one reader (the app).
+// The writer only ever moves head and the reader only ever moves tail, so neither needs a lock: an event is written
+// before head is published with a release store, and the reader loads head with acquire before reading the event.
+// When the ring is full new events are dropped and counted, rather than overwriting ones the reader may be copying.
+//
+
+#include "button.h"
+#include "button_events.h"
+
+#define QUEUE_MASK (BUTTON_EVENT_QUEUE_SIZE - 1)
+
+_Static_assert((BUTTON_EVENT_QUEUE_SIZE & QUEUE_MASK) == 0, "BUTTON_EVENT_QUEUE_SIZE must be a power of two");
+
+// After this long between detents, the encoder is being turned afresh, and starts again at one step a detent
+#define ENCODER_PAUSE_US (250000)
+// Each this many detents a second add another step
+#define ENCODER_DETENTS_PER_STEP (12)
+
+static struct button_event queue[BUTTON_EVENT_QUEUE_SIZE];
+static uint32_t head;   // written only by button_event_put()
+static uint32_t tail;   // written only by the reader
+static volatile uint32_t dropped;
+
+void button_event_put(BADGE_BUTTON button, enum button_event_type type, uint32_t timestamp_us) {
+    uint32_t h = head;
+
+    if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= BUTTON_EVENT_QUEUE_SIZE) {
+        dropped++;
+        return;
+    }
+    queue[h & QUEUE_MASK] = (struct button_event) {
+        .timestamp_us = timestamp_us,
+        .button = (uint8_t) button,
+        .type = (uint8_t) type,
+    };
+    __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+}
+
+bool button_event_get(struct button_event *event) {
+    uint32_t t = tail;
+
+    if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *event = queue[t & QUEUE_MASK];
+    __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void button_event_flush(void) {
+    __atomic_store_n(&tail, __atomic_load_n(&head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+unsigned int button_events_dropped(void) {
+    return dropped;
+}
+
+int button_repeat_event(struct button_repeat *repeat, const struct button_event *event) {
+    if (event->button != repeat->button) {
+        return 0;
+    }
+    if (event->type == BUTTON_EVENT_DOWN) {
+        repeat->held = true;
+        repeat->next_us = event->timestamp_us + repeat->delay_us;
+        return 1;
+    }
+    if (event->type == BUTTON_EVENT_UP) {
+        repeat->held = false;
+    }
+    return 0;
+}
+
+int button_repeat_poll(struct button_repeat *repeat, uint32_t now_us) {
+    int count = 0;
+
+    if (!repeat->held || repeat->interval_us == 0) {
+        return 0;
+    }
+    while ((int32_t) (now_us - repeat->next_us) >= 0) {
+        repeat->next_us += repeat->interval_us;
+        count++;
+    }
+    return count;
+}
+
+enum button_press button_long_press_event(struct button_long_press *press, const struct button_event *event) {
+    if (event->button != press->button) {
+        return BUTTON_PRESS_NONE;
+    }
+    if (event->type == BUTTON_EVENT_DOWN) {
+        press->held = true;
+        press->reported = false;
+        press->down_us = event->timestamp_us;
+        return BUTTON_PRESS_NONE;
+    }
+    if (event->type != BUTTON_EVENT_UP || !press->held) {
+        return BUTTON_PRESS_NONE;
+    }
+    press->held = false;
+    if (press->reported) {
+        return BUTTON_PRESS_NONE;
+    }
+    press->reported = true;
+    // Held long enough, but nobody polled in time to see it
+    if (event->timestamp_us - press->down_us >= press->hold_us) {
+        return BUTTON_PRESS_LONG;
+    }
+    return BUTTON_PRESS_SHORT;
+}
+
+enum button_press button_long_press_poll(struct button_long_press *press, uint32_t now_us) {
+    if (!press->held || press->reported || (int32_t) (now_us - press->down_us) < (int32_t) press->hold_us) {
+        return BUTTON_PRESS_NONE;
+    }
+    press->reported = true;
+    return BUTTON_PRESS_LONG;
+}
+
+int button_encoder_event(struct button_encoder *encoder, const struct button_event *event) {
+    int direction, steps;
+    uint32_t interval;
+
+    if (event->button != encoder->button) {
+        return 0;
+    }
+    if (event->type == BUTTON_EVENT_CW) {
+        direction = 1;
+    } else if (event->type == BUTTON_EVENT_CCW) {
+        direction = -1;
+    } else {
+        return 0;
+    }
+
+    interval = event->timestamp_us - encoder->last_us;
+    encoder->last_us = event->timestamp_us;
+    if (direction != encoder->direction || interval >= ENCODER_PAUSE_US) {
+        // Turning back the other way is always fine adjustment
+        encoder->direction = (int8_t) direction;
+        encoder->detents_per_sec = 0;
+        return direction;
+    }
+    if (interval == 0) {
+        interval = 1;
+    }
+    // Average with the speed so far, so one quick pair of detents doesn't jump ahead
+    encoder->detents_per_sec = (encoder->detents_per_sec + 1000000 / interval) / 2;
+
+    steps = 1 + (int) (encoder->detents_per_sec / ENCODER_DETENTS_PER_STEP);
+    if (steps > BUTTON_ENCODER_MAX_STEPS) {
+        steps = BUTTON_ENCODER_MAX_STEPS;
+    }
+    return direction * steps;
+}
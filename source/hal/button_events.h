@@ -0,0 +1,17 @@
+//
+// The button event queue, shared by the button HAL implementations.
+// Apps should not include this; the public API is in button.h.
+//
+
+#ifndef BADGE_C_BUTTON_EVENTS_H
+#define BADGE_C_BUTTON_EVENTS_H
+
+#include <stdint.h>
+
+#include "button.h"
+
+// Queue an event. Called from the one place each HAL learns about input: the debounce alarm on the badge, the SDL
+// event loop in the simulator. There must only ever be one such caller at a time.
+void button_event_put(BADGE_BUTTON button, enum button_event_type type, uint32_t timestamp_us);
+
+#endif //BADGE_C_BUTTON_EVENTS_H
@@ -3,6 +3,7 @@
 //
 
 #include "button.h"
+#include "button_events.h"
 #include "pinout_rp2040.h"
 #include "pico/time.h"
 #include "pico/sync.h"
@@ -45,6 +46,8 @@ static uint32_t down_latches;
 static uint32_t up_latches;
 static uint32_t last_change;
 static int rotation_count[2];
+// when each button's pin first changed, before debouncing, for its event
+static uint32_t edge_us[BADGE_BUTTON_MAX];
 
 // callback
 static user_gpio_callback user_cb;
@@ -52,6 +55,12 @@ static user_gpio_callback user_cb;
 // forward declaration of GPIO callback since the alarm and GPIO handlers need to refer to each other
 static void gpio_callback(uint gpio_pin, uint32_t events);
 
+// The encoders' A and B pins are queued as rotations, not as presses
+static bool is_quadrature_pin(uint badge_button) {
+    return badge_button == BADGE_BUTTON_ENCODER_A || badge_button == BADGE_BUTTON_ENCODER_B ||
+           badge_button == BADGE_BUTTON_ENCODER_2_A || badge_button == BADGE_BUTTON_ENCODER_2_B;
+}
+
 static void process_rotary_pin_state(uint badge_button, int state) {
     int idx;
     int b;
@@ -67,7 +76,10 @@ static void process_rotary_pin_state(uint badge_button, int state) {
     }
 
     if (state == 0) {
-        rotation_count[idx] += button_poll(b) ? 1 : -1;
+        int direction = button_poll(b) ? 1 : -1;
+
+        rotation_count[idx] += direction;
+        button_event_put(badge_button, direction > 0 ? BUTTON_EVENT_CW : BUTTON_EVENT_CCW, edge_us[badge_button]);
     }
 }
 
@@ -92,6 +104,9 @@ int64_t alarm_callback(__attribute__((unused)) alarm_id_t id, void* user_data) {
         if (user_cb) {
             user_cb(badge_button, state);
         }
+        if (!is_quadrature_pin(badge_button)) {
+            button_event_put(badge_button, state ? BUTTON_EVENT_UP : BUTTON_EVENT_DOWN, edge_us[badge_button]);
+        }
         process_rotary_pin_state(badge_button, state);
         last_change = rtc_get_ms_since_boot();
     }
@@ -112,6 +127,7 @@ void gpio_callback(uint gpio, __attribute__((unused)) uint32_t events) {
         uint gpio_pin = (uint)(button_to_gpio_pin[button]);
         if (gpio_pin == gpio) {
             gpio_set_irq_enabled(gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, false);
+            edge_us[button] = (uint32_t) rtc_get_us_since_boot();
             // After time delay, check for bounce being done.
             debounce_alarm_count++;
 
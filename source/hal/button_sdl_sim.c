@@ -3,6 +3,7 @@
 //
 #include <SDL.h>
 #include "button.h"
+#include "button_events.h"
 #include "rtc.h"
 #include "sim_lcd_params.h"
 #include "button_sdl_ui.h"
@@ -34,14 +35,33 @@ static void countdown_to_zero(int *x)
 		(*x)--;
 }
 
+static uint32_t now_us(void)
+{
+	return (uint32_t) rtc_get_us_since_boot();
+}
+
+/* Queue an event for each button that went up or down, the same as the badge would */
+static void queue_button_changes(int old_states)
+{
+	int changed = old_states ^ button_states;
+
+	for (int i = 0; i < BADGE_BUTTON_MAX; i++)
+		if (changed & (1 << i))
+			button_event_put(i, (button_states & (1 << i)) ? BUTTON_EVENT_DOWN : BUTTON_EVENT_UP, now_us());
+}
+
+/* Every simulated turn of an encoder comes through here, so queue its event too */
 static void rotary_angle_delta(int which_rotary, int amount)
 {
+	BADGE_BUTTON encoder = which_rotary ? BADGE_BUTTON_ENCODER_2_A : BADGE_BUTTON_ENCODER_A;
 	int new_angle = rotary_angle[which_rotary] + amount * 8;
 	if (new_angle < 0)
 		new_angle += 128;
 	if (new_angle > 127)
 		new_angle -= 128;
 	rotary_angle[which_rotary] = new_angle;
+
+	button_event_put(encoder, amount > 0 ? BUTTON_EVENT_CW : BUTTON_EVENT_CCW, now_us());
 }
 
 void sim_button_status_countdown(void)
@@ -114,6 +134,7 @@ int mouse_button_down_cb(SDL_MouseButtonEvent *event, struct button_coord_list *
 {
 	int x, y;
 	BADGE_BUTTON button = BADGE_BUTTON_MAX;
+	int old_states = button_states;
 
 	if (event->button < 1 || event->button > 3)
 		return 1;
@@ -165,6 +186,7 @@ int mouse_button_down_cb(SDL_MouseButtonEvent *event, struct button_coord_list *
 		}
 		last_change = rtc_get_ms_since_boot();
 	}
+	queue_button_changes(old_states);
 	return 1;
 }
 
@@ -181,8 +203,11 @@ int mouse_button_up_cb(__attribute__((unused)) SDL_MouseButtonEvent *event)
 	}
 	/* Release whichever mouse-pressed simulated button was last pressed */
 	if (last_mouse_pressed_button >= 0 && last_mouse_pressed_button < BADGE_BUTTON_MAX) {
+		int old_states = button_states;
+
 		down_latches &= ~(1 << last_mouse_pressed_button);
 		button_states &= ~(1 << last_mouse_pressed_button);
+		queue_button_changes(old_states);
 		last_change = rtc_get_ms_since_boot();
 		last_mouse_pressed_button = BADGE_BUTTON_MAX;
 	}
@@ -329,8 +354,11 @@ int key_press_cb(SDL_Keysym *keysym)
             break;
     }
     if (button != BADGE_BUTTON_MAX) {
+        int old_states = button_states;
+
         down_latches |= 1<<button;
         button_states |= 1<<button;
+        queue_button_changes(old_states); /* nothing, for a key repeating */
         if (callback) {
             callback(button, true);
         }
@@ -390,8 +418,11 @@ int key_release_cb(SDL_Keysym *keysym)
             break;
     }
     if (button != BADGE_BUTTON_MAX) {
+        int old_states = button_states;
+
         up_latches |= 1<<button;
         button_states &= ~(1<<button);
+        queue_button_changes(old_states);
         if (callback) {
             callback(button, false);
         }
@@ -473,6 +504,7 @@ int joystick_event_cb(__attribute__((unused)) SDL_Window *window, SDL_Event even
 	 */
 	BADGE_BUTTON button = BADGE_BUTTON_MAX;
 	int button_pressed = 0;
+	int old_states = button_states;
 	switch (event.type) {
 	case SDL_JOYAXISMOTION: {
 			SDL_JoyAxisEvent e = event.jaxis;
@@ -613,6 +645,7 @@ int joystick_event_cb(__attribute__((unused)) SDL_Window *window, SDL_Event even
 			}
 		}
 	}
+	queue_button_changes(old_states);
 	return 1;
 }
 
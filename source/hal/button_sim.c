@@ -10,6 +10,7 @@
 //
 
 #include "button.h"
+#include "button_events.h"
 #include "rtc.h"
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
@@ -54,15 +55,20 @@ gint key_press_cb(UNUSED GtkWidget* widget, GdkEventKey* event, UNUSED gpointer
         case GDK_comma:
         case GDK_less:
             rotation_count -= 1;
+            button_event_put(BADGE_BUTTON_ENCODER_A, BUTTON_EVENT_CCW, (uint32_t) rtc_get_us_since_boot());
         break;
         case GDK_period:
         case GDK_greater:
             rotation_count += 1;
+            button_event_put(BADGE_BUTTON_ENCODER_A, BUTTON_EVENT_CW, (uint32_t) rtc_get_us_since_boot());
         break;
         default:
             break;
     }
     if (button != BADGE_BUTTON_MAX) {
+        if (!(button_states & (1<<button))) { /* not a key repeating */
+            button_event_put(button, BUTTON_EVENT_DOWN, (uint32_t) rtc_get_us_since_boot());
+        }
         down_latches |= 1<<button;
         button_states |= 1<<button;
         if (callback) {
@@ -105,6 +111,9 @@ gint key_release_cb(UNUSED GtkWidget* widget, GdkEventKey* event, UNUSED gpointe
             break;
     }
     if (button != BADGE_BUTTON_MAX) {
+        if (button_states & (1<<button)) {
+            button_event_put(button, BUTTON_EVENT_UP, (uint32_t) rtc_get_us_since_boot());
+        }
         up_latches |= 1<<button;
         button_states &= ~(1<<button);
         if (callback) {
@@ -17,5 +17,33 @@ void sleep_us(uint64_t time);
  */
 void lp_sleep_us(uint64_t time);
 
+// Peripherals that can keep lp_sleep_us() from going low power, in which case it polls until they're done.
+typedef enum {
+    LP_SLEEP_BLOCKER_USB = 0,   // USB connected; the whole sleep is spent at full speed
+    LP_SLEEP_BLOCKER_DISPLAY,
+    LP_SLEEP_BLOCKER_AUDIO,
+    LP_SLEEP_BLOCKER_BUTTON,
+    LP_SLEEP_BLOCKER_IR,        // transmitting; receiving doesn't prevent low power sleep
+    LP_SLEEP_BLOCKER_LED,
+    LP_SLEEP_BLOCKER_COUNT
+} LP_SLEEP_BLOCKER;
+
+// lp_sleep_us() is called from the main loop whenever there's nothing to do (see core/scheduler.h), so
+// these are per-sleep figures; "frames" counts the sleeps.
+typedef struct {
+    uint64_t since_us;          // time the counters were last reset
+    uint32_t frames;            // calls to lp_sleep_us()
+    uint64_t requested_us;
+    uint64_t slept_us;          // time spent in low power sleep
+    uint64_t spun_us;           // time spent at full speed, waiting for a blocker
+    uint32_t blocked_frames[LP_SLEEP_BLOCKER_COUNT];
+    uint32_t last_slept_us;     // the same for the most recent frame
+    uint32_t last_spun_us;
+    uint32_t last_blockers;     // bit mask of (1 << LP_SLEEP_BLOCKER_x)
+} LP_SLEEP_STATS;
+
+void lp_sleep_get_stats(LP_SLEEP_STATS *stats);
+void lp_sleep_reset_stats(void);
+
 
 #endif //badge_c_DELAY_H
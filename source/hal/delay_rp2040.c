@@ -4,10 +4,13 @@
 
 #include "delay.h"
 
+#include <string.h>
+
 #include "pico/sleep.h"
 #include "hardware/clocks.h"
 #include "hardware/rosc.h"
 #include "hardware/structs/scb.h"
+#include "hardware/regs/m0plus.h"
 
 #include "pico/time.h"
 
@@ -23,6 +26,21 @@
 // sleep_ms function implemented by SDK (pico/time.h)
 // sleep_us function implemented by SDK (pico/time.h)
 
+// Clocks left running while the processor is in deep sleep: the timer that ends the sleep, PIO0 for the IR receiver
+// and its GPIO, PWM for the backlight, and the bus so their interrupts get through. SPI0, DMA and SRAM keep the
+// accelerometer's FIFO bursts going without waking the processor until they're done.
+#define LP_SLEEP_EN0 (CLOCKS_SLEEP_EN0_CLK_SYS_PIO0_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_PWM_BITS | \
+                      CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS | \
+                      CLOCKS_SLEEP_EN0_CLK_SYS_BUSFABRIC_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_BUSCTRL_BITS | \
+                      CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_DMA_BITS | \
+                      CLOCKS_SLEEP_EN0_CLK_SYS_SPI0_BITS | CLOCKS_SLEEP_EN0_CLK_PERI_SPI0_BITS | \
+                      CLOCKS_SLEEP_EN0_CLK_SYS_SRAM0_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_SRAM1_BITS | \
+                      CLOCKS_SLEEP_EN0_CLK_SYS_SRAM2_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_SRAM3_BITS)
+#define LP_SLEEP_EN1 (CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS | CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS | \
+                      CLOCKS_SLEEP_EN1_CLK_SYS_XOSC_BITS)
+
+static LP_SLEEP_STATS stats;
+
 void recover_from_sleep(uint scb_orig, uint clock0_orig, uint clock1_orig){
 
     //Re-enable ring Oscillator control
@@ -36,8 +54,47 @@ void recover_from_sleep(uint scb_orig, uint clock0_orig, uint clock1_orig){
     //reset clocks
     clocks_init();
 
+    // The IR receiver was listening throughout; put it back on the full speed clock.
+    ir_sys_clock_changed();
+
 }
 
+static uint32_t sleep_blockers(void) {
+    uint32_t blockers = 0;
+
+    if (display_busy()) {
+        blockers |= 1 << LP_SLEEP_BLOCKER_DISPLAY;
+    }
+    if (audio_is_playing()) {
+        blockers |= 1 << LP_SLEEP_BLOCKER_AUDIO;
+    }
+    if (button_debouncing()) {
+        blockers |= 1 << LP_SLEEP_BLOCKER_BUTTON;
+    }
+    if (!ir_can_sleep()) {
+        blockers |= 1 << LP_SLEEP_BLOCKER_IR;
+    }
+    if (led_pwm_is_on(BADGE_LED_RGB_RED) || led_pwm_is_on(BADGE_LED_RGB_BLUE) ||
+        led_pwm_is_on(BADGE_LED_RGB_GREEN)) {
+        blockers |= 1 << LP_SLEEP_BLOCKER_LED;
+    }
+    return blockers;
+}
+
+static void record_frame(uint64_t requested_us, uint64_t slept_us, uint64_t spun_us, uint32_t blockers) {
+    stats.frames++;
+    stats.requested_us += requested_us;
+    stats.slept_us += slept_us;
+    stats.spun_us += spun_us;
+    for (int i=0; i<LP_SLEEP_BLOCKER_COUNT; i++) {
+        if (blockers & (1 << i)) {
+            stats.blocked_frames[i]++;
+        }
+    }
+    stats.last_slept_us = slept_us;
+    stats.last_spun_us = spun_us;
+    stats.last_blockers = blockers;
+}
 
 void lp_sleep_us(uint64_t us_to_sleep) {
 
@@ -47,19 +104,21 @@ void lp_sleep_us(uint64_t us_to_sleep) {
         // No need to go low power, and disabling clocks with USB connected
         // is probably a bad idea anyway
         sleep_us(us_to_sleep);
+        record_frame(us_to_sleep, 0, us_to_sleep, 1 << LP_SLEEP_BLOCKER_USB);
         return;
     }
 
-    while (((display_busy() || audio_is_playing() || button_debouncing() || ir_listening()) ||
-             led_pwm_is_on(BADGE_LED_RGB_RED) || led_pwm_is_on(BADGE_LED_RGB_BLUE) ||
-             led_pwm_is_on(BADGE_LED_RGB_GREEN)) &&
-            (rtc_get_us_since_boot() < time_at_call+us_to_sleep)) {
+    uint32_t blockers_seen = 0;
+    uint32_t blockers;
+    while ((blockers = sleep_blockers()) && (rtc_get_us_since_boot() < time_at_call+us_to_sleep)) {
+        blockers_seen |= blockers;
         sleep_us(10);
     }
 
     uint64_t time_before_lpsleep = rtc_get_us_since_boot() - time_at_call;
 
     if (time_before_lpsleep >= us_to_sleep) {
+        record_frame(us_to_sleep, 0, time_before_lpsleep, blockers_seen);
         return;
     }
 
@@ -67,8 +126,27 @@ void lp_sleep_us(uint64_t us_to_sleep) {
     uint clock0_orig = clocks_hw->sleep_en0;
     uint clock1_orig = clocks_hw->sleep_en1;
 
+    // Switching clk_sys to the crystal would slow the IR receiver down by the same factor, so rescale it straight
+    // away; the demodulator keeps its place in whatever frame it's in the middle of. Its RX interrupt wakes the
+    // processor out of deep sleep, gets handled, and sleep_us() goes back to waiting for the timer.
     sleep_run_from_xosc();
+    ir_sys_clock_changed();
+    clocks_hw->sleep_en0 = LP_SLEEP_EN0;
+    clocks_hw->sleep_en1 = LP_SLEEP_EN1;
+    scb_hw->scr = scb_orig | M0PLUS_SCR_SLEEPDEEP_BITS;
+
     sleep_us(us_to_sleep-time_before_lpsleep);
     recover_from_sleep(scb_orig, clock0_orig, clock1_orig);
 
-}
\ No newline at end of file
+    record_frame(us_to_sleep, rtc_get_us_since_boot() - time_at_call - time_before_lpsleep, time_before_lpsleep,
+                 blockers_seen);
+}
+
+void lp_sleep_get_stats(LP_SLEEP_STATS *out) {
+    *out = stats;
+}
+
+void lp_sleep_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+    stats.since_us = rtc_get_us_since_boot();
+}
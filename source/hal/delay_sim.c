@@ -3,10 +3,15 @@
 //
 
 #include "delay.h"
+#include "rtc.h"
+#include "audio_sim.h"
+#include <string.h>
 #include <unistd.h>
 
+static LP_SLEEP_STATS stats;
+
 void sleep_ms(uint32_t time) {
-    usleep(time*1000);
+    audio_sim_sleep_us(time * 1000ULL);
 }
 
 void sleep_us(uint64_t time) {
@@ -14,5 +19,19 @@ void sleep_us(uint64_t time) {
 }
 
 void lp_sleep_us(uint64_t time) {
-    usleep(time);
-}
\ No newline at end of file
+    audio_sim_sleep_us(time);
+    // There's no low power mode to speak of, so every frame counts as slept.
+    stats.frames++;
+    stats.requested_us += time;
+    stats.slept_us += time;
+    stats.last_slept_us = time;
+}
+
+void lp_sleep_get_stats(LP_SLEEP_STATS *out) {
+    *out = stats;
+}
+
+void lp_sleep_reset_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+    stats.since_us = rtc_get_us_since_boot();
+}
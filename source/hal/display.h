@@ -37,4 +37,23 @@ void display_color(unsigned short pixel);
 /** @brief Tell us if we're busy sending data to the display */
 bool display_busy(void);
 
+/* Controller power modes, most power first; the backlight is separate, see led_pwm.h */
+enum display_power {
+    DISPLAY_POWER_NORMAL,   /* full colour at the full refresh rate */
+    DISPLAY_POWER_STATIC,   /* full colour, refreshed slowly: for screens that aren't animating */
+    DISPLAY_POWER_IDLE,     /* the controller's idle mode: eight colours, refreshed slowly */
+    DISPLAY_POWER_SLEEP,    /* display off and the controller asleep, keeping its RAM */
+    DISPLAY_POWER_MODES
+};
+
+/** @brief Change the controller's power mode. Waking from sleep takes a while; drawing waits for it. */
+void display_set_power(enum display_power power);
+enum display_power display_get_power(void);
+
+/**
+ * @brief Only drive framebuffer rows first to first + count - 1, leaving the rest of the panel blank.
+ * A count of 0 drives the whole panel again. Ignored while the display is rotated, as the rows are then columns.
+ */
+void display_set_partial(int first, int count);
+
 #endif //BADGE_C_DISPLAY_H
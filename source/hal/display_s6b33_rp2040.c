@@ -372,3 +372,42 @@ void display_color(unsigned short pixel) {
 bool display_busy(void) {
     return spi_is_busy(spi0);
 }
+
+/* The S6B33 has no idle mode or refresh rate worth changing, so static and idle are the same as normal */
+static enum display_power power = DISPLAY_POWER_NORMAL;
+
+void display_set_power(enum display_power new_power)
+{
+    if (new_power == power)
+        return;
+    wait_until_ready();
+    if (new_power == DISPLAY_POWER_SLEEP) {
+        display_send_command(DISPLAY_OFF);
+        display_send_command(STANDBY_ON); /* standby on == display clocks off */
+    } else if (power == DISPLAY_POWER_SLEEP) {
+        display_send_command(STANDBY_OFF);
+        display_send_command(DISPLAY_ON);
+    }
+    power = new_power;
+}
+
+enum display_power display_get_power(void)
+{
+    return power;
+}
+
+void display_set_partial(int first, int count)
+{
+    wait_until_ready();
+    if (count <= 0 || first < 0 || first + count > 132 || display_get_rotation()) {
+        display_send_command(PARTIAL_DISPLAY_MODE);
+        display_send_command(0x0); /* partial display mode off */
+        return;
+    }
+    display_send_command(PARTIAL_START_LINE);
+    display_send_command(first);
+    display_send_command(PARTIAL_END_LINE);
+    display_send_command(first + count - 1);
+    display_send_command(PARTIAL_DISPLAY_MODE);
+    display_send_command(0x1); /* partial display mode on */
+}
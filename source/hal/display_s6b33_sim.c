@@ -122,3 +122,17 @@ void display_color(unsigned short pixel) {
         }
     }
 }
+
+/* Nothing to save in the simulator, but apps see the same as on the badge */
+static enum display_power power = DISPLAY_POWER_NORMAL;
+
+void display_set_power(enum display_power new_power) {
+    power = new_power;
+}
+
+enum display_power display_get_power(void) {
+    return power;
+}
+
+void display_set_partial(__attribute__((unused)) int first, __attribute__((unused)) int count) {
+}
@@ -8,11 +8,38 @@
 #include <display.h>
 #include <st7735s.h>
 
+#define LCD_HEIGHT 160
+
+// Commands the driver has no call for, or waits after: sleep out has to be left to finish in the background
+#define ST7735S_SLPIN   0x10
+#define ST7735S_SLPOUT  0x11
+#define ST7735S_PTLON   0x12
+#define ST7735S_NORON   0x13
+#define ST7735S_PTLAR   0x30
+#define ST7735S_IDMOFF  0x38
+#define ST7735S_IDMON   0x39
+#define ST7735S_FRMCTR1 0xB1    // frame rate in normal mode
+#define ST7735S_FRMCTR2 0xB2    // in idle mode
+#define ST7735S_FRMCTR3 0xB3    // in partial mode, twice over: for dot inversion, then column inversion
+
+// The controller needs this long after sleep out before it'll take another command, and after sleep in
+#define SLEEP_OUT_US 120000
+#define SLEEP_IN_US 5000
+
 /*- ST7735S Driver Glue ------------------------------------------------------*/
 static bool dma_transfer_started = true;
 static int dma_channel = -1;
 static bool writing_pixels;
 
+static bool inverted = false;
+static bool rotated = false;
+
+static enum display_power power = DISPLAY_POWER_NORMAL;
+static uint64_t ready_at_us;        // after sleep in or out
+static bool display_on_pending;     // display on once it's awake
+static bool refresh_slow;           // normal mode's refresh rate
+static int partial_first, partial_count;
+
 static void wait_until_ready() {
     if (dma_transfer_started) {
         dma_channel_wait_for_finish_blocking(dma_channel);
@@ -51,6 +78,37 @@ void lcd_spiWrite(unsigned char* buffer, size_t length) {
     }
 }
 
+static void wait_until_awake(void) {
+    uint64_t now = time_us_64();
+
+    if (now < ready_at_us) {
+        sleep_us(ready_at_us - now);
+    }
+    if (display_on_pending) {
+        display_on_pending = false;
+        lcd_setDisplayMode(LCD_DISPLAY_ON);
+    }
+}
+
+static void send_command(uint8_t command, const uint8_t *data, size_t length) {
+    wait_until_ready();
+    wait_until_awake();
+    lcd_digitalWrite(BADGE_GPIO_DISPLAY_DC, 0);
+    lcd_spiWrite(&command, 1);
+    if (length) {
+        lcd_digitalWrite(BADGE_GPIO_DISPLAY_DC, 1);
+        lcd_spiWrite((unsigned char *) data, length);
+    }
+}
+
+/*
+ * Refresh rates: 850 kHz / ((RTNA * 2 + 40) * (160 lines + FPA + BPA + 2)). The driver's 80 Hz for moving
+ * pictures, and the slowest there is, 42 Hz, for everything else; the panel's current goes with the rate.
+ */
+static const uint8_t frame_rate_normal[] = { 0x01, 0x2c, 0x2d };
+static const uint8_t frame_rate_slow[] = { 0x0f, 0x3f, 0x3f };
+static const uint8_t frame_rate_slow_partial[] = { 0x0f, 0x3f, 0x3f, 0x0f, 0x3f, 0x3f };
+
 /** set important internal registers for the LCD display */
 void display_init_device(void) {
 
@@ -76,6 +134,14 @@ void display_init_device(void) {
     lcd_setDisplayInversion(LCD_INVERSION_OFF);
     lcd_setTearingEffectLine(LCD_TEARING_OFF);
     lcd_setDisplayMode(LCD_DISPLAY_ON);
+
+    // Idle and partial modes are only used for screens that aren't animating
+    send_command(ST7735S_FRMCTR2, frame_rate_slow, sizeof(frame_rate_slow));
+    send_command(ST7735S_FRMCTR3, frame_rate_slow_partial, sizeof(frame_rate_slow_partial));
+    power = DISPLAY_POWER_NORMAL;
+    refresh_slow = false;
+    partial_first = 0;
+    partial_count = 0;
 }
 
 /** set GPIO configuration for the LCD display */
@@ -118,8 +184,87 @@ void display_reset(void) {
 
     display_init_device();
 }
+
+static void set_partial_area(void) {
+    if (partial_count == 0 || rotated) {
+        send_command(ST7735S_NORON, NULL, 0);
+        return;
+    }
+
+    // Inverted, the framebuffer's rows run from the bottom of the panel
+    int start = inverted ? LCD_HEIGHT - partial_first - partial_count : partial_first;
+    int end = start + partial_count - 1;
+    uint8_t area[] = { start >> 8, start & 0xff, end >> 8, end & 0xff };
+
+    send_command(ST7735S_PTLAR, area, sizeof(area));
+    send_command(ST7735S_PTLON, NULL, 0);
+}
+
+void display_set_power(enum display_power new_power) {
+    if (new_power == power) {
+        return;
+    }
+
+    if (power == DISPLAY_POWER_SLEEP) {
+        send_command(ST7735S_SLPOUT, NULL, 0);
+        ready_at_us = time_us_64() + SLEEP_OUT_US;
+        display_on_pending = true;
+    } else if (power == DISPLAY_POWER_IDLE) {
+        send_command(ST7735S_IDMOFF, NULL, 0);
+    }
+
+    // The controller keeps its settings while it sleeps, so there's usually nothing to wait for it to wake to send
+    switch (new_power) {
+    case DISPLAY_POWER_NORMAL:
+        if (refresh_slow) {
+            send_command(ST7735S_FRMCTR1, frame_rate_normal, sizeof(frame_rate_normal));
+            refresh_slow = false;
+        }
+        break;
+    case DISPLAY_POWER_STATIC:
+        if (!refresh_slow) {
+            send_command(ST7735S_FRMCTR1, frame_rate_slow, sizeof(frame_rate_slow));
+            refresh_slow = true;
+        }
+        break;
+    case DISPLAY_POWER_IDLE:
+        send_command(ST7735S_IDMON, NULL, 0);
+        break;
+    case DISPLAY_POWER_SLEEP:
+        display_on_pending = false;
+        wait_until_ready();
+        wait_until_awake();
+        lcd_setDisplayMode(LCD_DISPLAY_OFF);
+        send_command(ST7735S_SLPIN, NULL, 0);
+        ready_at_us = time_us_64() + SLEEP_IN_US;
+        break;
+    default:
+        return;
+    }
+    power = new_power;
+}
+
+enum display_power display_get_power(void) {
+    return power;
+}
+
+void display_set_partial(int first, int count) {
+    if (first < 0 || count <= 0 || first + count > LCD_HEIGHT) {
+        first = 0;
+        count = 0;
+    }
+    if (first == partial_first && count == partial_count) {
+        return;
+    }
+    partial_first = first;
+    partial_count = count;
+    set_partial_area();
+}
+
 /** sets the current display region for calls to display_pixel() */
 void display_rect(int x, int y, int width, int height) {
+    wait_until_ready();
+    wait_until_awake();
     lcd_setWindowPosition(x, y, width+x, height+y);
     lcd_activateMemoryWrite();
 }
@@ -135,8 +280,6 @@ void display_pixels(unsigned short *pixel, int number) {
     writing_pixels = false;
 }
 /** invert display */
-static bool inverted = false;
-static bool rotated = false;
 
 static void update_madctl(void) {
 
@@ -151,6 +294,9 @@ static void update_madctl(void) {
     }
 
     lcd_setMemoryAccessControl(flags);
+    if (partial_count) {
+        set_partial_area();
+    }
 }
 
 void display_set_display_mode_inverted(void) {
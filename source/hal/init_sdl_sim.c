@@ -28,6 +28,7 @@
 #include "accelerometer.h"
 #include "uid.h"
 #include "audio.h"
+#include "audio_sim.h"
 
 #define UNUSED __attribute__((unused))
 #define ARRAYSIZE(x) (sizeof(x) / sizeof((x)[0]))
@@ -58,12 +59,19 @@ void *main_in_thread(void* params) {
 
 static struct option long_options[] = {
 	{ "badge-id", required_argument, NULL, 'i' },
+	{ "audio-latency", no_argument, NULL, 'a' },
+	{ "mic-wav", required_argument, NULL, 'w' },
+	{ "mic-tone", required_argument, NULL, 't' },
+	{ "accel-trace", required_argument, NULL, 'g' },
+	{ "accel-loop", no_argument, NULL, 'l' },
 	{ NULL, 0, 0, 0 },
 };
 
 static void usage(void)
 {
-	fprintf(stderr, "usage: badge [--badge-id 0x1234567812345678 ]\n");
+	fprintf(stderr, "usage: badge [--badge-id 0x1234567812345678 ] [--audio-latency ]\n"
+		"             [--mic-wav file.wav | --mic-tone hz ... ]\n"
+		"             [--accel-trace trace.txt [--accel-loop ] ]\n");
 	exit(1);
 }
 
@@ -71,10 +79,12 @@ static void process_options(int argc, char **argv)
 {
 	int c, rc;
 	uint64_t badge_id;
+	const char *accel_trace = NULL;
+	bool accel_loop = false;
 
 	while (1) {
 		int option_index;
-		c = getopt_long(argc, argv, "i:", long_options, &option_index);
+		c = getopt_long(argc, argv, "i:aw:t:g:l", long_options, &option_index);
 		if (c == -1)
 			break;
 		switch (c) {
@@ -87,12 +97,30 @@ static void process_options(int argc, char **argv)
 				set_custom_badge_id(badge_id);
 			}
 			break;
+		case 'a':
+			audio_sim_measure_latency(true);
+			break;
+		case 'w':
+			if (audio_sim_mic_wav(optarg) != 0)
+				exit(1);
+			break;
+		case 't':
+			audio_sim_mic_tone((uint16_t) atoi(optarg));
+			break;
+		case 'g':
+			accel_trace = optarg;
+			break;
+		case 'l':
+			accel_loop = true;
+			break;
 		default:
 			usage();
 			__builtin_unreachable();
 			break;
 		}
 	}
+	if (accel_trace && !accelerometer_sim_trace(accel_trace, accel_loop))
+		exit(1);
 }
 
 int hal_run_main(int (*main_func)(int, char**), int argc, char** argv) {
@@ -100,11 +128,13 @@ int hal_run_main(int (*main_func)(int, char**), int argc, char** argv) {
     sim_argc = argc;
     sim_argv = argv;
 
+    // Before the app starts, so it can play sounds straight away
+    process_options(argc, argv);
+    audio_init();
+
     pthread_t app_thread;
     pthread_create(&app_thread, NULL, main_in_thread, main_func);
 
-    process_options(argc, argv);
-    audio_init();
     hal_start_sdl(&argc, &argv);
 
     return 0;
@@ -361,6 +391,7 @@ static void draw_flare_led(struct sim_lcd_params *slp)
 	char *p;
 
 	/* Draw simulated flare LED */
+	led_pwm_sdl_step_effect();
 	SDL_GetWindowSize(window, &x, &y);
 	x = x - 100;
 	y = 50;
@@ -96,6 +96,7 @@ static char *program_title;
 
 extern int lcd_brightness;
 extern GdkColor led_color;
+void led_pwm_sim_step_effect(void);
 
 const GdkColor white = {.blue = 65535, .green = 65535, .red = 65535};
 const GdkColor black = {};
@@ -219,6 +220,7 @@ static int draw_window(GtkWidget *widget, UNUSED GdkEvent *event, UNUSED gpointe
     x = LCD_XSIZE * w + EXTRA_WIDTH / 4;
     y = (LCD_YSIZE * h) / 2 - EXTRA_WIDTH / 4;
     draw_led_text(widget, LCD_XSIZE * w + EXTRA_WIDTH / 2 - 20, y - 10);
+    led_pwm_sim_step_effect();
     gdk_gc_set_rgb_fg_color(gc, &led_color);
     gdk_draw_rectangle(widget->window, gc, 1 /* filled */, x, y, EXTRA_WIDTH / 2, EXTRA_WIDTH / 2);
     gdk_gc_set_rgb_fg_color(gc, &white);
@@ -27,6 +27,8 @@ typedef enum {
     IR_APP6,
     IR_APP7,
 
+    IR_SHOW,        // core/show_sync.c: time beacons and scheduled cues for group shows
+
     IR_MAX_ID
 
 } IR_APP_ID;
@@ -72,18 +74,93 @@ bool ir_remove_callback(ir_data_callback data_cb, IR_APP_ID app_id);
 bool ir_transmitting(void);
 bool ir_listening(void);
 
-// Note that sending > 3 data bytes at the start will block; to prevent this, use ir_send_partial message and check the
-// return value to see how far it got.
+// The message is copied into a queue and sent in the background, so this returns straight away and data can be reused.
+// If the queue is full, the message is dropped and counted in IR_CHANNEL_STATS.tx_queue_full.
 void ir_send_complete_message(const IR_DATA *data);
 
-// Returns the number of data packets that were queued to send, instead of blocking to send out all data.
+// Returns the number of data packets that were queued to send, instead of blocking to send out all data. Returns 0 for
+// the first call while queued messages are still going out.
 uint8_t ir_send_partial_message(const IR_DATA *data, uint8_t starting_sequence_num);
 
+// Send a message with a timestamp in it, for keeping badges' clocks in step. It's queued like
+// ir_send_complete_message(), and once it has the channel, the HAL writes 4 bytes, little endian, into its own copy at
+// data[stamp_at]: the low 32 bits of rtc_get_us_since_boot() + clock_offset_us at
+// the moment receivers will have heard the last frame. The HAL is what knows how long the message takes to go out, so
+// that latency is already accounted for, and a receiver only has to note when its callback ran.
+void ir_send_timed_message(const IR_DATA *data, uint8_t stamp_at, int64_t clock_offset_us);
+
 // TODO maybe we can track this outside of the HAL and in the badge system files somewhere
 bool ir_messages_seen(bool reset);
 int ir_message_count(void);
 
+// Channel access. Before transmitting, the HAL listens for other badges and, if the channel is busy, backs off for a
+// random number of slots (doubling the window each time) so that a room full of badges doesn't keep colliding.
+typedef enum {
+    IR_PRIORITY_BACKGROUND = 0, // repeated broadcasts; dropped if the channel stays busy through every backoff
+    IR_PRIORITY_INTERACTIVE,    // user-initiated traffic; smaller backoff window and always sent eventually
+} IR_PRIORITY;
+
+typedef struct {
+    uint64_t since_us;          // time the counters were last reset
+    uint64_t rx_busy_us;        // air time occupied by other badges
+    uint64_t tx_busy_us;        // air time occupied by our own transmissions
+    uint32_t rx_bad_frames;     // frames that failed NEC validation, mostly collisions
+    uint32_t tx_messages;       // messages actually transmitted
+    uint32_t tx_deferrals;      // backoff waits because the channel was busy
+    uint32_t tx_dropped_busy;   // background messages dropped after exhausting backoff
+    uint32_t tx_rate_limited;   // messages dropped by the per-app rate limit
+    uint32_t tx_queue_full;     // messages dropped because the HAL's transmit queue was full
+} IR_CHANNEL_STATS;
+
+void ir_set_app_priority(IR_APP_ID app_id, IR_PRIORITY priority);
+
+// Drop messages for app_id sent less than min_interval_ms after the previous one. 0 disables the limit.
+void ir_set_app_rate_limit(IR_APP_ID app_id, uint32_t min_interval_ms);
+
+bool ir_channel_busy(void);
+void ir_get_channel_stats(IR_CHANNEL_STATS *stats);
+void ir_reset_channel_stats(void);
+
+// Packet capture. While capturing, every message received or sent is logged with a microsecond timestamp, in the
+// format described in ir_capture.h. On the badge the log is kept in RAM (IR_CAPTURE_BUFFER_SIZE bytes, later messages
+// are dropped) and ir_capture_stop() saves it as a key-value blob named `name`. In the simulator it is written to the
+// file `name` as it goes. NULL picks a default name. ir_capture_stop() returns false if the log couldn't be saved: the
+// flash is full, or the file couldn't be written. On the badge the log is still in RAM for ir_capture_dump() then.
+#define IR_CAPTURE_BUFFER_SIZE (2048)
+#define IR_CAPTURE_DEFAULT_NAME "ircap"
+
+bool ir_capture_start(const char *name);
+bool ir_capture_stop(void);
+bool ir_capturing(void);
+
+// Print a summary of the capture; on the badge this is followed by the log itself in hex, for pulling over USB.
+void ir_capture_dump(void);
+
+#if TARGET_PICO
+// Low power support for lp_sleep_us(). The NEC receiver is a PIO state machine clocked from clk_sys, so it keeps
+// listening (and its RX interrupt wakes the CPU) while the badge runs from the crystal, provided its clock divider is
+// updated whenever clk_sys changes. Transmission isn't rescaled, so the badge stays at full speed until it's done.
+bool ir_can_sleep(void);
+void ir_sys_clock_changed(void);
+#endif
+
 #if TARGET_SIMULATOR
+// Feed the received messages from a capture log into the registered callbacks, keeping their original spacing divided
+// by `speed` (0 means no delays at all). Replay waits until something is listening on the first message's app ID, and
+// prints handler timings when done. Returns false if the log can't be read.
+bool ir_replay_start(const char *path, unsigned int speed);
+
+// The simulator's UDP transmit queue. Messages sent while it is full are dropped.
+typedef struct {
+    unsigned int depth;         // messages waiting to be sent right now
+    unsigned int max_depth;     // high-water mark
+    unsigned int drops;
+    unsigned int sent;
+    unsigned int batches;       // system calls used to send them
+} IR_SIM_TX_QUEUE_STATS;
+
+void ir_sim_get_tx_queue_stats(IR_SIM_TX_QUEUE_STATS *stats);
+
 void disable_interrupts(void);
 void enable_interrupts(void);
 #endif
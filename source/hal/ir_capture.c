@@ -0,0 +1,68 @@
+//
+// Encoding and decoding of IR capture logs. See ir_capture.h for the format.
+//
+
+#include <string.h>
+
+#include "ir_capture.h"
+
+static const uint8_t magic[4] = { 'I', 'R', 'C', 'P' };
+
+size_t ir_capture_write_header(uint8_t *out) {
+    memcpy(out, magic, sizeof(magic));
+    out[4] = IR_CAPTURE_VERSION;
+    out[5] = out[6] = out[7] = 0;
+    return IR_CAPTURE_HEADER_SIZE;
+}
+
+bool ir_capture_check_header(const uint8_t *in, size_t len) {
+    return len >= IR_CAPTURE_HEADER_SIZE && !memcmp(in, magic, sizeof(magic)) && in[4] == IR_CAPTURE_VERSION;
+}
+
+size_t ir_capture_encode(uint8_t *out, size_t space, uint64_t now_us, uint64_t *last_us,
+                         IR_CAPTURE_DIRECTION direction, const IR_DATA *message) {
+    uint8_t length = message->data_length;
+    if (length > MAX_IR_MESSAGE_SIZE) {
+        length = MAX_IR_MESSAGE_SIZE;
+    }
+    if (space < (size_t) IR_CAPTURE_RECORD_HEADER_SIZE + length) {
+        return 0;
+    }
+
+    uint64_t delta = now_us > *last_us ? now_us - *last_us : 0;
+    if (delta > UINT32_MAX) {
+        delta = UINT32_MAX;
+    }
+    *last_us = now_us;
+
+    out[0] = delta;
+    out[1] = delta >> 8;
+    out[2] = delta >> 16;
+    out[3] = delta >> 24;
+    out[4] = direction;
+    out[5] = message->recipient_address;
+    out[6] = message->recipient_address >> 8;
+    out[7] = message->app_address;
+    out[8] = length;
+    memcpy(&out[IR_CAPTURE_RECORD_HEADER_SIZE], message->data, length);
+    return IR_CAPTURE_RECORD_HEADER_SIZE + length;
+}
+
+size_t ir_capture_decode(const uint8_t *in, size_t len, IR_CAPTURE_RECORD *record) {
+    if (len < IR_CAPTURE_RECORD_HEADER_SIZE) {
+        return 0;
+    }
+    uint8_t length = in[8];
+    if (length > MAX_IR_MESSAGE_SIZE || len < (size_t) IR_CAPTURE_RECORD_HEADER_SIZE + length) {
+        return 0;
+    }
+
+    uint32_t delta = in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+    record->timestamp_us += delta;
+    record->direction = in[4] ? IR_CAPTURE_TX : IR_CAPTURE_RX;
+    record->message.recipient_address = in[5] | (in[6] << 8);
+    record->message.app_address = in[7];
+    record->message.data_length = length;
+    record->message.data = (uint8_t *) &in[IR_CAPTURE_RECORD_HEADER_SIZE];
+    return IR_CAPTURE_RECORD_HEADER_SIZE + length;
+}
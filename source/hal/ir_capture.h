@@ -0,0 +1,54 @@
+//
+// Binary log format for IR packet capture, shared by ir_rp2040.c and ir_sim.c (and anything that reads the logs).
+//
+// A log is an 8 byte header followed by one record per message:
+//
+// | 'I' 'R' 'C' 'P' | version (1) | 3 bytes reserved, 0 |
+//
+// | delta_us (4, little endian) | direction (1) | recipient address (2, LE) | app ID (1) | length (1) | data (length) |
+//
+// delta_us is the time since the previous record (or since capture started, for the first one), saturating at
+// 0xffffffff. Messages are at most 64 bytes and most are 2-8, so a record is usually 11-17 bytes.
+//
+
+#ifndef BADGE_C_IR_CAPTURE_H
+#define BADGE_C_IR_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ir.h"
+
+#define IR_CAPTURE_VERSION (1)
+#define IR_CAPTURE_HEADER_SIZE (8)
+#define IR_CAPTURE_RECORD_HEADER_SIZE (9)
+#define IR_CAPTURE_MAX_RECORD_SIZE (IR_CAPTURE_RECORD_HEADER_SIZE + MAX_IR_MESSAGE_SIZE)
+
+typedef enum {
+    IR_CAPTURE_RX = 0,
+    IR_CAPTURE_TX = 1,
+} IR_CAPTURE_DIRECTION;
+
+typedef struct {
+    uint64_t timestamp_us;  // since capture started
+    IR_CAPTURE_DIRECTION direction;
+    IR_DATA message;        // data points into the log buffer
+} IR_CAPTURE_RECORD;
+
+// Write the log header. out must have room for IR_CAPTURE_HEADER_SIZE bytes.
+size_t ir_capture_write_header(uint8_t *out);
+
+// Returns false if the buffer doesn't start with a header this code understands.
+bool ir_capture_check_header(const uint8_t *in, size_t len);
+
+// Encode one record. *last_us is the timestamp of the previous record and is updated. Returns the number of bytes
+// written, or 0 if there wasn't space.
+size_t ir_capture_encode(uint8_t *out, size_t space, uint64_t now_us, uint64_t *last_us,
+                         IR_CAPTURE_DIRECTION direction, const IR_DATA *message);
+
+// Decode one record from in. record->timestamp_us must hold the previous record's timestamp (0 for the first) and is
+// advanced. Returns the number of bytes consumed, or 0 at the end of the log or on a truncated record.
+size_t ir_capture_decode(const uint8_t *in, size_t len, IR_CAPTURE_RECORD *record);
+
+#endif //BADGE_C_IR_CAPTURE_H
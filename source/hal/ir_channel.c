@@ -0,0 +1,182 @@
+//
+// Listen-before-talk for the IR link, shared between ir_rp2040.c and ir_sim.c.
+//
+// The receive path reports carrier activity through ir_channel_note_rx(), which pushes out the time until which the
+// channel is considered busy. Before a message is sent, ir_channel_acquire() waits for that time to pass plus a random
+// number of backoff slots. Each time the channel turns out to be busy again the backoff window doubles, which spreads
+// out badges that all heard the same message end.
+//
+// A transmitter that mustn't block asks ir_channel_try() when to send and comes back when it says; ir_channel_acquire()
+// does the same but sleeps, once, for callers that send straight away.
+//
+
+#include <string.h>
+
+#include "ir.h"
+#include "ir_channel.h"
+#include "rtc.h"
+#include "delay.h"
+#include "random.h"
+
+#define BACKGROUND_CW_MIN_SLOTS (4)
+#define BACKGROUND_MAX_ATTEMPTS (6)
+#define INTERACTIVE_CW_MIN_SLOTS (1)
+#define INTERACTIVE_MAX_ATTEMPTS (3)
+#define CW_MAX_SLOTS (32)
+
+// The whole microsecond clock, which doesn't wrap, so a busy time heard long ago stays in the past. Only the receive
+// path writes it, which on the badge is an interrupt, so a read that it lands in the middle of is done again.
+static volatile uint64_t busy_until_us;
+
+static IR_CHANNEL_STATS stats;
+static IR_PRIORITY app_priority[IR_MAX_ID];
+static uint32_t app_rate_limit_ms[IR_MAX_ID];
+static uint32_t app_last_tx_ms[IR_MAX_ID];
+static bool app_has_sent[IR_MAX_ID];
+
+static uint64_t busy_until(void) {
+    uint64_t until, again;
+    do {
+        until = busy_until_us;
+        again = busy_until_us;
+    } while (until != again);
+    return until;
+}
+
+// Negative once the channel has been quiet for a while
+static int64_t busy_remaining_us(void) {
+    return (int64_t) (busy_until() - rtc_get_us_since_boot());
+}
+
+uint32_t ir_channel_message_airtime_us(uint8_t data_length) {
+    return (data_length + 1) * IR_NEC_FRAME_PERIOD_US;
+}
+
+void ir_channel_note_rx(uint32_t airtime_us, uint32_t busy_for_us, bool valid) {
+    uint64_t until = rtc_get_us_since_boot() + busy_for_us;
+    if (until > busy_until_us) {
+        busy_until_us = until;
+    }
+    stats.rx_busy_us += airtime_us;
+    if (!valid) {
+        stats.rx_bad_frames++;
+    }
+}
+
+void ir_channel_note_tx(uint32_t airtime_us) {
+    stats.tx_busy_us += airtime_us;
+    stats.tx_messages++;
+}
+
+void ir_channel_note_queue_full(void) {
+    stats.tx_queue_full++;
+}
+
+bool ir_channel_busy(void) {
+    return busy_remaining_us() > 0;
+}
+
+static uint32_t random_slots(uint32_t window) {
+    uint8_t r;
+    random_insecure_bytes(&r, 1);
+    return 1 + r % window;
+}
+
+static bool interactive(uint8_t app_id) {
+    return app_id < IR_MAX_ID && app_priority[app_id] == IR_PRIORITY_INTERACTIVE;
+}
+
+bool ir_channel_begin(IR_CHANNEL_ATTEMPT *attempt, uint8_t app_id) {
+    if (app_id >= IR_MAX_ID) {
+        // Not an app we keep state for, but still be polite about the channel.
+        app_id = IR_MAX_ID;
+    }
+
+    uint32_t now_ms = (uint32_t) rtc_get_ms_since_boot();
+    if (app_id < IR_MAX_ID && app_rate_limit_ms[app_id] && app_has_sent[app_id] &&
+        now_ms - app_last_tx_ms[app_id] < app_rate_limit_ms[app_id]) {
+        stats.tx_rate_limited++;
+        return false;
+    }
+
+    attempt->app_id = app_id;
+    attempt->waits_left = interactive(app_id) ? INTERACTIVE_MAX_ATTEMPTS : BACKGROUND_MAX_ATTEMPTS;
+    attempt->window = interactive(app_id) ? INTERACTIVE_CW_MIN_SLOTS : BACKGROUND_CW_MIN_SLOTS;
+    return true;
+}
+
+IR_CHANNEL_DECISION ir_channel_try(IR_CHANNEL_ATTEMPT *attempt, uint32_t *wait_us) {
+    uint8_t app_id = attempt->app_id;
+
+    // Also back off if the channel only just went quiet: every other badge that was waiting heard the same ending.
+    int64_t remaining = busy_remaining_us();
+    if (remaining + IR_CHANNEL_SLOT_US > 0) {
+        if (!attempt->waits_left) {
+            if (!interactive(app_id)) {
+                stats.tx_dropped_busy++;
+                return IR_CHANNEL_DROP;
+            }
+        } else {
+            attempt->waits_left--;
+            stats.tx_deferrals++;
+
+            *wait_us = random_slots(attempt->window) * IR_CHANNEL_SLOT_US;
+            if (remaining > 0) {
+                *wait_us += (uint32_t) remaining;
+            }
+            attempt->window *= 2;
+            if (attempt->window > CW_MAX_SLOTS) {
+                attempt->window = CW_MAX_SLOTS;
+            }
+            return IR_CHANNEL_WAIT;
+        }
+    }
+
+    if (app_id < IR_MAX_ID) {
+        app_last_tx_ms[app_id] = (uint32_t) rtc_get_ms_since_boot();
+        app_has_sent[app_id] = true;
+    }
+    return IR_CHANNEL_SEND;
+}
+
+bool ir_channel_acquire(uint8_t app_id, bool blocking) {
+    IR_CHANNEL_ATTEMPT attempt;
+    uint32_t wait_us;
+
+    if (!ir_channel_begin(&attempt, app_id)) {
+        return false;
+    }
+    if (ir_channel_try(&attempt, &wait_us) == IR_CHANNEL_SEND) {
+        return true;
+    }
+    if (!blocking) {
+        return false;
+    }
+    // Only the one wait, and not a long one, however busy the channel stays: after it, interactive traffic goes anyway
+    // and background traffic is dropped. Callers that can't be held up even this long use a queue instead.
+    sleep_us(wait_us < IR_CHANNEL_MAX_BLOCK_US ? wait_us : IR_CHANNEL_MAX_BLOCK_US);
+    attempt.waits_left = 0;
+    return ir_channel_try(&attempt, &wait_us) == IR_CHANNEL_SEND;
+}
+
+void ir_set_app_priority(IR_APP_ID app_id, IR_PRIORITY priority) {
+    if (app_id < IR_MAX_ID) {
+        app_priority[app_id] = priority;
+    }
+}
+
+void ir_set_app_rate_limit(IR_APP_ID app_id, uint32_t min_interval_ms) {
+    if (app_id < IR_MAX_ID) {
+        app_rate_limit_ms[app_id] = min_interval_ms;
+    }
+}
+
+void ir_get_channel_stats(IR_CHANNEL_STATS *out) {
+    // Counters are updated from the receive interrupt/thread without locking; they're for reporting only.
+    *out = stats;
+}
+
+void ir_reset_channel_stats(void) {
+    memset(&stats, 0, sizeof(stats));
+    stats.since_us = rtc_get_us_since_boot();
+}
@@ -0,0 +1,62 @@
+//
+// Shared IR medium access (listen-before-talk) used by both IR HAL implementations.
+// Apps should not include this; the public API is in ir.h.
+//
+
+#ifndef BADGE_C_IR_CHANNEL_H
+#define BADGE_C_IR_CHANNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// One NEC frame (9 ms leader, 4.5 ms space, 32 bits, stop burst) is 67.5 ms on the air, and the transmitter
+// paces frames at roughly the standard 108 ms NEC repeat period.
+#define IR_NEC_FRAME_US (67500)
+#define IR_NEC_FRAME_PERIOD_US (108000)
+
+// Backoff slot. A quarter of a frame period is short enough to not waste much air time, and long enough that two
+// badges picking different slots will hear each other's leader burst before they both start.
+#define IR_CHANNEL_SLOT_US (IR_NEC_FRAME_PERIOD_US / 4)
+
+// Longest ir_channel_acquire() sleeps for
+#define IR_CHANNEL_MAX_BLOCK_US (IR_NEC_FRAME_PERIOD_US)
+
+// Air time of a whole message: start packet plus one packet per data byte.
+uint32_t ir_channel_message_airtime_us(uint8_t data_length);
+
+// Called by the receive path (possibly in interrupt context) whenever carrier activity is seen. airtime_us is how long
+// the channel was occupied by what was just heard, and the channel is considered busy for busy_for_us from now.
+// Frames that fail NEC validation are counted separately, since they are mostly collisions.
+void ir_channel_note_rx(uint32_t airtime_us, uint32_t busy_for_us, bool valid);
+
+// Called by the transmit path once a message has gone out.
+void ir_channel_note_tx(uint32_t airtime_us);
+
+// Called by a HAL that queues messages when one is dropped because its queue is full.
+void ir_channel_note_queue_full(void);
+
+// Getting the channel for one message, without blocking. ir_channel_begin() applies the per-app rate limit and returns
+// false if the message should be dropped. Then ir_channel_try() says whether to send it now, or to wait *wait_us and
+// ask again, with the backoff window doubled each time, or to drop it: background traffic that has run out of waits.
+// Interactive traffic is sent once its waits run out, busy or not.
+typedef struct {
+    uint8_t app_id;
+    uint8_t waits_left;
+    uint8_t window;         // backoff slots to pick from
+} IR_CHANNEL_ATTEMPT;
+
+typedef enum {
+    IR_CHANNEL_SEND,
+    IR_CHANNEL_WAIT,
+    IR_CHANNEL_DROP,
+} IR_CHANNEL_DECISION;
+
+bool ir_channel_begin(IR_CHANNEL_ATTEMPT *attempt, uint8_t app_id);
+IR_CHANNEL_DECISION ir_channel_try(IR_CHANNEL_ATTEMPT *attempt, uint32_t *wait_us);
+
+// Get the channel for a message that's sent straight away. If blocking is false, this never sleeps and fails
+// immediately when the channel is busy. If it's true, this waits at most once, for no more than a frame period, and
+// then sends interactive traffic anyway and drops background traffic. Returns false if the message should not be sent.
+bool ir_channel_acquire(uint8_t app_id, bool blocking);
+
+#endif //BADGE_C_IR_CHANNEL_H
@@ -44,6 +44,14 @@ int nec_rx_init(PIO pio, uint pin_num) {
 }
 
 
+// Re-derive the state machine's clock divider after clk_sys has changed
+// frequency. The state machine keeps running, so a frame that is being
+// received carries on.
+void nec_rx_clock_changed(PIO pio, uint sm) {
+    pio_sm_set_clkdiv(pio, sm, nec_receive_clkdiv());
+}
+
+
 // Validate a 32-bit frame and store the address and data at the locations
 // provided.
 //
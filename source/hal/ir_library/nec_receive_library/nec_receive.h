@@ -10,4 +10,5 @@
 // public API
 
 int nec_rx_init(PIO pio, uint pin);
+void nec_rx_clock_changed(PIO pio, uint sm);
 bool nec_decode_frame(uint32_t sm, uint8_t *p_address, uint8_t *p_data);
@@ -3,11 +3,19 @@
 //
 
 #include "ir.h"
+#include "ir_channel.h"
+#include "ir_capture.h"
 #include "nec_transmit.h"
 #include "nec_receive.h"
 #include "pinout_rp2040.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "delay.h"
+#include "rtc.h"
+#include "key_value_storage.h"
+#include <stdio.h>
+#include <string.h>
 
 #define IR_MAX_HANDLERS_PER_ID (3)
 
@@ -43,6 +51,40 @@ static int tx_sm;
 static int rx_sm;
 static int message_count;
 static bool receiving_message = false;
+// When the last frame queued to the transmitter will have gone out
+static uint64_t tx_idle_at_us;
+
+// Messages waiting to go out. ir_send_complete_message() and ir_send_timed_message() copy a message in and return; a
+// hardware alarm does the rest: backs off until the channel is free, feeds the frames to the PIO as its FIFO has room,
+// and turns the receiver back on once they're out. Nothing waits for any of it, so neither an app's frame nor a
+// scheduler task stalls for the second or so a message takes. The app adds at tx_head and the alarm takes from tx_tail.
+#define IR_TX_QUEUE_SIZE (4)
+// The receiver stays off for this long after the last frame, so it doesn't hear its own echo
+#define IR_TX_SETTLE_US (200000)
+// Frames before the message's data: one to throw away, then the start frame
+#define IR_TX_LEAD_FRAMES (2)
+
+struct tx_message {
+    IR_DATA data;
+    uint8_t bytes[MAX_IR_MESSAGE_SIZE];
+    int stamp_at;               // < 0 for a message without a timestamp
+    int64_t clock_offset_us;
+};
+
+static struct tx_message tx_queue[IR_TX_QUEUE_SIZE];
+static volatile uint8_t tx_head, tx_tail;
+
+static volatile enum {
+    TX_IDLE = 0,
+    TX_WAITING,                 // for the channel
+    TX_SENDING,
+    TX_SETTLING,
+} tx_state;
+static IR_CHANNEL_ATTEMPT tx_attempt;
+static int tx_frame;            // the next one to put in the FIFO, counting the lead frames
+static int tx_alarm = -1;
+
+static void tx_step(uint alarm_num);
 
 ir_data_callback cb[IR_MAX_ID][IR_MAX_HANDLERS_PER_ID] = {};
 
@@ -61,6 +103,26 @@ static bool get_payload(uint32_t raw_nec_data, uint16_t* payload) {
     return nec_decode_frame(raw_nec_data, &data[0], &data[1]);
 }
 
+static uint8_t capture_log[IR_CAPTURE_BUFFER_SIZE];
+static size_t capture_length;
+static uint64_t capture_last_us;
+static int capture_dropped;
+static bool capturing;
+static char capture_name[MAX_KEY_LENGTH];
+
+// Called from the receive interrupt, or with interrupts disabled.
+static void capture_message(IR_CAPTURE_DIRECTION direction, const IR_DATA *message) {
+    if (!capturing) {
+        return;
+    }
+    size_t written = ir_capture_encode(&capture_log[capture_length], sizeof(capture_log) - capture_length,
+                                       rtc_get_us_since_boot(), &capture_last_us, direction, message);
+    if (!written) {
+        capture_dropped++;
+    }
+    capture_length += written;
+}
+
 #if IR_DEBUG
 uint32_t last_packets[20];
 static int pkt_idx;
@@ -81,9 +143,19 @@ void irq_fifo_handler(void) {
 #endif
         bool success = get_payload(rx_data, &payload);
         if (!success) {
+            // Carrier was there but the frame is garbage, most likely two badges talking at once.
+            ir_channel_note_rx(IR_NEC_FRAME_US, IR_NEC_FRAME_PERIOD_US, false);
             continue;
         }
 
+        // A start packet or a packet with the continuation bit set means more frames are on the way, so hold the
+        // channel busy long enough to hear the next one.
+        if (payload & (START_BIT | CONTINUATION_MASK)) {
+            ir_channel_note_rx(IR_NEC_FRAME_US, 2 * IR_NEC_FRAME_PERIOD_US, true);
+        } else {
+            ir_channel_note_rx(IR_NEC_FRAME_US, IR_NEC_FRAME_PERIOD_US - IR_NEC_FRAME_US, true);
+        }
+
         if (payload & START_BIT) {
             current_rx_message.data_length = 0;
             current_rx_message.recipient_address = (payload & START_RECIPIENT_ADDRESS_MASK) >> START_RECIPIENT_ADDRESS_SHIFT;
@@ -102,6 +174,7 @@ void irq_fifo_handler(void) {
         current_rx_message.data[current_rx_message.data_length++] = payload & DATA_PAYLOAD_MASK;
         if (!(payload & CONTINUATION_MASK)) {
             receiving_message = false;
+            capture_message(IR_CAPTURE_RX, &current_rx_message);
             // End of message!
             if (current_rx_message.recipient_address != IR_BADGE_ID_BROADCAST
                 /* OR recipient address isn't Badge address TODO*/) {
@@ -127,6 +200,7 @@ void irq_fifo_handler(void) {
 }
 
 void ir_init(void) {
+    ir_reset_channel_stats();
     rx_sm = nec_rx_init(IR_PIO, BADGE_GPIO_IR_RX);
     tx_sm = nec_tx_init(IR_PIO, BADGE_GPIO_IR_TX);
 
@@ -134,6 +208,9 @@ void ir_init(void) {
     enum pio_interrupt_source irq_source = pis_sm0_rx_fifo_not_empty + rx_sm;
     pio_set_irq1_source_enabled(IR_PIO, irq_source, true);
     irq_set_enabled(PIO0_IRQ_1, true);
+
+    tx_alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(tx_alarm, tx_step);
 }
 
 bool ir_add_callback(ir_data_callback data_cb, IR_APP_ID app_id) {
@@ -175,12 +252,35 @@ bool ir_listening(void) {
     return (bool) active_callbacks;
 }
 
+bool ir_can_sleep(void) {
+    // Not while a message is queued, either: the alarm could start sending it with clk_sys slowed down.
+    return tx_state == TX_IDLE && tx_head == tx_tail &&
+           pio_sm_is_tx_fifo_empty(IR_PIO, tx_sm) && rtc_get_us_since_boot() >= tx_idle_at_us;
+}
+
+void ir_sys_clock_changed(void) {
+    nec_rx_clock_changed(IR_PIO, rx_sm);
+}
+
+static void note_tx_frame(void) {
+    uint64_t now = rtc_get_us_since_boot();
+    if (tx_idle_at_us < now) {
+        tx_idle_at_us = now;
+    }
+    tx_idle_at_us += IR_NEC_FRAME_PERIOD_US;
+}
+
+static void put_tx_frame(uint32_t raw_nec_data) {
+    pio_sm_put_blocking(IR_PIO, tx_sm, raw_nec_data);
+    note_tx_frame();
+}
+
 static void ir_send_start_packet(const IR_DATA *data) {
 
     uint16_t packet_data = START_BIT;
     packet_data |= (data->recipient_address << START_RECIPIENT_ADDRESS_SHIFT) & START_RECIPIENT_ADDRESS_MASK;
     packet_data |= (data->app_address) & START_APP_ID_MASK;
-    pio_sm_put_blocking(IR_PIO, tx_sm, get_raw_nec_data(packet_data));
+    put_tx_frame(get_raw_nec_data(packet_data));
 
 }
 
@@ -194,40 +294,181 @@ static void ir_send_data_packet(const IR_DATA *data, int index) {
     }
     packet_data |= (index << DATA_SEQUENCE_NUM_SHIFT) & DATA_SEQUENCE_NUM_MASK;
     packet_data |= (data->data[index]);
-    pio_sm_put_blocking(IR_PIO, tx_sm, get_raw_nec_data(packet_data));
+    put_tx_frame(get_raw_nec_data(packet_data));
 
 }
 
-void ir_send_complete_message(const IR_DATA *data) {
+static void write_stamp(const IR_DATA *data, int stamp_at, uint32_t stamp) {
+    for (int i=0; i<4; i++) {
+        data->data[stamp_at + i] = (uint8_t) (stamp >> (8 * i));
+    }
+}
+
+// From the alarm, once the message has the channel: stamp it and pause the receiver
+static void tx_begin(struct tx_message *m) {
+    const IR_DATA *data = &m->data;
+
+    if (m->stamp_at >= 0) {
+        // The throwaway frame goes out as soon as the transmitter is idle, then the start frame, then the data; the
+        // receiver has the message once the last data frame is over.
+        uint64_t first_frame_us = rtc_get_us_since_boot();
+        if (first_frame_us < tx_idle_at_us) {
+            first_frame_us = tx_idle_at_us;
+        }
+        write_stamp(data, m->stamp_at, (uint32_t) (first_frame_us + m->clock_offset_us +
+                    (uint64_t) (data->data_length + 1) * IR_NEC_FRAME_PERIOD_US + IR_NEC_FRAME_US));
+    }
+    uint32_t interrupt_state = save_and_disable_interrupts();
+    capture_message(IR_CAPTURE_TX, data);
+    restore_interrupts(interrupt_state);
 
     irq_set_enabled(PIO0_IRQ_1, false);
     enum pio_interrupt_source irq_source = pis_sm0_rx_fifo_not_empty + rx_sm;
     pio_set_irq1_source_enabled(IR_PIO, irq_source, false);
     // Pause receive while transmitting
     pio_sm_set_enabled(IR_PIO, rx_sm, false);
-    // not sure why, but sometimes the first packet received after idle time is basically garbage. Sending something
-    // we can discard helps
-    pio_sm_put_blocking(IR_PIO, tx_sm, 0xa55aa55a);
+    tx_frame = 0;
+}
 
-    ir_send_start_packet(data);
-    for (int i=0; i<data->data_length; i++) {
-        ir_send_data_packet(data, i);
-    }
+// From the alarm: as many frames as the FIFO has room for; true once they're all in
+static bool tx_fill(const struct tx_message *m) {
+    const IR_DATA *data = &m->data;
 
-    // todo: do this perhaps instead on a FIFO empty interrupt?
-    while (ir_transmitting()) {
-        sleep_ms(1);
+    for (; tx_frame < IR_TX_LEAD_FRAMES + data->data_length; tx_frame++) {
+        if (pio_sm_is_tx_fifo_full(IR_PIO, tx_sm)) {
+            return false;
+        }
+        if (tx_frame == 0) {
+            // not sure why, but sometimes the first packet received after idle time is basically garbage. Sending
+            // something we can discard helps
+            pio_sm_put(IR_PIO, tx_sm, 0xa55aa55a);
+            note_tx_frame();
+        } else if (tx_frame == 1) {
+            ir_send_start_packet(data);
+        } else {
+            ir_send_data_packet(data, tx_frame - IR_TX_LEAD_FRAMES);
+        }
     }
-    sleep_ms(200);
+    return true;
+}
+
+static void tx_end(const struct tx_message *m) {
+    // Air time includes the throwaway frame sent ahead of the message.
+    ir_channel_note_tx(ir_channel_message_airtime_us(m->data.data_length) + IR_NEC_FRAME_PERIOD_US);
 
     pio_sm_clear_fifos(IR_PIO, rx_sm);
     irq_set_enabled(PIO0_IRQ_1, true);
+    enum pio_interrupt_source irq_source = pis_sm0_rx_fifo_not_empty + rx_sm;
     pio_set_irq1_source_enabled(IR_PIO, irq_source, true);
     pio_sm_set_enabled(IR_PIO, rx_sm, true);
 }
 
+// Set the alarm for at_us; false if that's already gone, for the caller to carry straight on
+static bool tx_wait_until(uint64_t at_us) {
+    return !hardware_alarm_set_target(tx_alarm, from_us_since_boot(at_us));
+}
+
+static void tx_step(__attribute__((unused)) uint alarm_num) {
+    for (;;) {
+        struct tx_message *m = &tx_queue[tx_tail];
+        uint32_t wait_us;
+
+        switch (tx_state) {
+        case TX_IDLE:
+            if (tx_tail == tx_head) {
+                return;
+            }
+            if (!ir_channel_begin(&tx_attempt, m->data.app_address)) {
+                tx_tail = (tx_tail + 1) % IR_TX_QUEUE_SIZE;
+                continue;
+            }
+            tx_state = TX_WAITING;
+            // fall through
+        case TX_WAITING:
+            switch (ir_channel_try(&tx_attempt, &wait_us)) {
+            case IR_CHANNEL_WAIT:
+                if (tx_wait_until(rtc_get_us_since_boot() + wait_us)) {
+                    return;
+                }
+                continue;
+            case IR_CHANNEL_DROP:
+                tx_state = TX_IDLE;
+                tx_tail = (tx_tail + 1) % IR_TX_QUEUE_SIZE;
+                continue;
+            case IR_CHANNEL_SEND:
+                break;
+            }
+            tx_begin(m);
+            tx_state = TX_SENDING;
+            // fall through
+        case TX_SENDING:
+            if (!tx_fill(m)) {
+                // A frame goes out every frame period, so there's room for another by then
+                if (tx_wait_until(rtc_get_us_since_boot() + IR_NEC_FRAME_PERIOD_US)) {
+                    return;
+                }
+                continue;
+            }
+            tx_state = TX_SETTLING;
+            if (tx_wait_until(tx_idle_at_us + IR_TX_SETTLE_US)) {
+                return;
+            }
+            // fall through
+        case TX_SETTLING:
+            tx_end(m);
+            tx_state = TX_IDLE;
+            tx_tail = (tx_tail + 1) % IR_TX_QUEUE_SIZE;
+            continue;
+        }
+    }
+}
+
+static void send_message(const IR_DATA *data, int stamp_at, int64_t clock_offset_us) {
+    uint8_t next = (tx_head + 1) % IR_TX_QUEUE_SIZE;
+    struct tx_message *m = &tx_queue[tx_head];
+
+    if (next == tx_tail || data->data_length > MAX_IR_MESSAGE_SIZE) {
+        ir_channel_note_queue_full();
+        return;
+    }
+    m->data = *data;
+    m->data.data = m->bytes;
+    memcpy(m->bytes, data->data, data->data_length);
+    m->stamp_at = stamp_at;
+    m->clock_offset_us = clock_offset_us;
+    tx_head = next;
+
+    // An idle alarm has nothing set and won't look at the queue again by itself, so run it now, in its interrupt
+    if (tx_state == TX_IDLE) {
+        hardware_alarm_force_irq(tx_alarm);
+    }
+}
+
+void ir_send_complete_message(const IR_DATA *data) {
+    send_message(data, -1, 0);
+}
+
+void ir_send_timed_message(const IR_DATA *data, uint8_t stamp_at, int64_t clock_offset_us) {
+    if (stamp_at + 4 > data->data_length) {
+        return;
+    }
+    send_message(data, stamp_at, clock_offset_us);
+}
+
 uint8_t ir_send_partial_message(const IR_DATA *data, uint8_t starting_sequence_num) {
     if (starting_sequence_num == 0) {
+        // The queue owns the transmitter until it's empty
+        if (tx_state != TX_IDLE || tx_head != tx_tail) {
+            return 0;
+        }
+        // Never sleep here; if the channel is busy report that nothing was queued and let the caller try again.
+        if (!ir_channel_acquire(data->app_address, false)) {
+            return 0;
+        }
+        ir_channel_note_tx(ir_channel_message_airtime_us(data->data_length));
+        uint32_t interrupt_state = save_and_disable_interrupts();
+        capture_message(IR_CAPTURE_TX, data);
+        restore_interrupts(interrupt_state);
         ir_send_start_packet(data);
     }
 
@@ -253,3 +494,39 @@ bool ir_messages_seen(bool reset) {
 int ir_message_count(void) {
     return message_count;
 }
+
+bool ir_capture_start(const char *name) {
+    uint32_t interrupt_state = save_and_disable_interrupts();
+    capture_length = ir_capture_write_header(capture_log);
+    capture_last_us = rtc_get_us_since_boot();
+    capture_dropped = 0;
+    capturing = true;
+    restore_interrupts(interrupt_state);
+
+    strncpy(capture_name, name ? name : IR_CAPTURE_DEFAULT_NAME, sizeof(capture_name) - 1);
+    return true;
+}
+
+bool ir_capture_stop(void) {
+    if (!capturing) {
+        return true;
+    }
+    capturing = false;
+    return flash_kv_store_binary(capture_name, capture_log, capture_length);
+}
+
+bool ir_capturing(void) {
+    return capturing;
+}
+
+void ir_capture_dump(void) {
+    printf("IR capture '%s': %u bytes, %d messages dropped%s\n", capture_name, (unsigned) capture_length,
+           capture_dropped, capturing ? " (still capturing)" : "");
+    for (size_t i=0; i<capture_length; i++) {
+        printf("%02x", capture_log[i]);
+        if ((i % 32) == 31) {
+            printf("\n");
+        }
+    }
+    printf("\n");
+}
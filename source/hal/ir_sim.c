@@ -3,15 +3,18 @@
 // Implemented by Stephen M. Cameron on 4/20/2023
 //
 
+#ifdef linux
+/* Must come before any system header for sendmmsg() and pthread_setname_np() */
+#define _GNU_SOURCE
+#endif
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
 #include <ifaddrs.h>
 #include <netinet/in.h>
-#ifdef linux
-#define _GNU_SOURCE
-#endif
 #include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +22,10 @@
 #include <unistd.h>
 
 #include "ir.h"
+#include "ir_channel.h"
+#include "ir_capture.h"
+#include "rtc.h"
+#include "delay.h"
 #include "badge.h"
 
 #define DEBUG_UDP_TRAFFIC 0
@@ -73,50 +80,7 @@ bool ir_remove_callback(ir_data_callback data_cb, IR_APP_ID app_id) {
     return removed;
 }
 
-static pthread_cond_t packet_write_cond = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t interrupt_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define IR_OUTPUT_QUEUE_SIZE 16
-static const IR_DATA *ir_output_queue[IR_OUTPUT_QUEUE_SIZE] = { 0 };
-static int ir_output_queue_input = 0;
-static int ir_output_queue_output = 0;
-static int output_queue_has_new_packets = 0;
-static int IRpacketOutNext = 0;
-static int IRpacketOutCurr = 0;
-
-static int ir_output_queue_empty(void)
-{
-	return ir_output_queue_input == ir_output_queue_output;
-}
-
-static void ir_output_queue_enqueue(const IR_DATA *packet)
-{
-	/* Note packet could be pointing into the stack, so we can't just
-	 * store the pointer, we have to replicate the data
-	 */
-	IR_DATA *new_packet = malloc(sizeof(*new_packet));
-	new_packet->data = malloc(packet->data_length);
-	new_packet->recipient_address = packet->recipient_address;
-	new_packet->app_address = packet->app_address;
-	new_packet->data_length = packet->data_length;
-	memcpy(new_packet->data, packet->data, packet->data_length);
-	/* This data gets freed in write_udp_packets_thread_fn() */
-
-	if (((IRpacketOutNext+1) % IR_OUTPUT_QUEUE_SIZE) != IRpacketOutCurr) {
-		ir_output_queue[ir_output_queue_input] = new_packet;
-		ir_output_queue_input = (ir_output_queue_input + 1) % IR_OUTPUT_QUEUE_SIZE;
-		IRpacketOutNext = (IRpacketOutNext + 1) % IR_OUTPUT_QUEUE_SIZE;
-	}
-}
-
-static const IR_DATA *ir_output_queue_dequeue(void)
-{
-	if (ir_output_queue_empty())
-		return NULL; /* should not happen */
-	const IR_DATA *v = ir_output_queue[ir_output_queue_output];
-	ir_output_queue_output = (ir_output_queue_output + 1) % IR_OUTPUT_QUEUE_SIZE;
-	IRpacketOutCurr = (IRpacketOutCurr + 1) % IR_OUTPUT_QUEUE_SIZE;
-	return v;
-}
 
 static uint64_t cpu_to_be64(uint64_t v)
 {
@@ -145,6 +109,160 @@ struct network_data_packet {
 	uint8_t data[MAX_IR_MESSAGE_SIZE];
 };
 
+/* Transmit queue: a fixed ring of ready-to-send network packets shared between
+ * any number of sending threads and the single UDP writer thread. Senders
+ * serialize straight into a slot, so nothing is allocated per message, and
+ * the only lock they ever take is tx_mutex, briefly, to wake the writer; the
+ * interrupt_mutex that app code and IR callbacks use is never involved.
+ *
+ * This is a bounded multi-producer queue in the style of Dmitry Vyukov's:
+ * each slot carries a sequence number saying whose turn it is. A slot at
+ * position pos is free for a producer when seq == pos, holds a packet for the
+ * consumer when seq == pos + 1, and the consumer frees it for the next lap by
+ * setting seq = pos + IR_OUTPUT_QUEUE_SIZE.
+ */
+#define IR_OUTPUT_QUEUE_SIZE 16 /* must be a power of 2 */
+#define IR_OUTPUT_QUEUE_MASK (IR_OUTPUT_QUEUE_SIZE - 1)
+#define IR_OUTPUT_BATCH 8
+
+struct tx_slot {
+	atomic_uint seq;
+	struct network_data_packet ndp;
+	int stamp_at;		/* < 0 for a message without a timestamp */
+	int64_t clock_offset_us;
+};
+
+static struct tx_slot tx_ring[IR_OUTPUT_QUEUE_SIZE];
+static atomic_uint tx_head;	/* next position to enqueue at */
+static atomic_uint tx_tail;	/* next position to dequeue from; only the writer changes it */
+static atomic_uint tx_max_depth;
+static atomic_uint tx_drops;
+static atomic_uint tx_sent;
+static atomic_uint tx_batches;
+static pthread_mutex_t tx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tx_cond = PTHREAD_COND_INITIALIZER;
+
+static void tx_queue_init(void)
+{
+	for (unsigned int i = 0; i < IR_OUTPUT_QUEUE_SIZE; i++)
+		atomic_store_explicit(&tx_ring[i].seq, i, memory_order_relaxed);
+	atomic_store(&tx_head, 0);
+	atomic_store(&tx_tail, 0);
+}
+
+/* Returns false, and counts a drop, if the queue is full */
+static bool tx_queue_enqueue(const IR_DATA *packet, int stamp_at, int64_t clock_offset_us)
+{
+	struct tx_slot *slot;
+	unsigned int pos = atomic_load_explicit(&tx_head, memory_order_relaxed);
+
+	for (;;) {
+		slot = &tx_ring[pos & IR_OUTPUT_QUEUE_MASK];
+		int diff = (int) (atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&tx_head, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			atomic_fetch_add(&tx_drops, 1);
+			return false;
+		} else {
+			pos = atomic_load_explicit(&tx_head, memory_order_relaxed);
+		}
+	}
+
+	/* Serialize data */
+	slot->ndp.badge_id = cpu_to_be64(badge_system_data()->badgeId);
+	slot->ndp.recipient_address = htons(packet->recipient_address);
+	slot->ndp.app_address = packet->app_address;
+	slot->ndp.data_length = packet->data_length;
+	assert(packet->data_length <= MAX_IR_MESSAGE_SIZE);
+	memcpy(&slot->ndp.data[0], packet->data, packet->data_length);
+	slot->stamp_at = stamp_at;
+	slot->clock_offset_us = clock_offset_us;
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+	unsigned int depth = pos + 1 - atomic_load_explicit(&tx_tail, memory_order_relaxed);
+	unsigned int max_depth = atomic_load_explicit(&tx_max_depth, memory_order_relaxed);
+	while (depth > max_depth &&
+		!atomic_compare_exchange_weak(&tx_max_depth, &max_depth, depth))
+		;
+	return true;
+}
+
+/* Writer only: how many packets starting at tx_tail are ready to send, up to max */
+static int tx_queue_ready(int max)
+{
+	unsigned int tail = atomic_load_explicit(&tx_tail, memory_order_relaxed);
+	int n;
+
+	for (n = 0; n < max; n++) {
+		struct tx_slot *slot = &tx_ring[(tail + n) & IR_OUTPUT_QUEUE_MASK];
+		if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + n + 1)
+			break;
+	}
+	return n;
+}
+
+/* Writer only: hand n sent slots back to the producers */
+static void tx_queue_release(int n)
+{
+	unsigned int tail = atomic_load_explicit(&tx_tail, memory_order_relaxed);
+
+	for (int i = 0; i < n; i++) {
+		struct tx_slot *slot = &tx_ring[(tail + i) & IR_OUTPUT_QUEUE_MASK];
+		atomic_store_explicit(&slot->seq, tail + i + IR_OUTPUT_QUEUE_SIZE, memory_order_release);
+	}
+	atomic_store_explicit(&tx_tail, tail + n, memory_order_relaxed);
+}
+
+void ir_sim_get_tx_queue_stats(IR_SIM_TX_QUEUE_STATS *stats)
+{
+	stats->depth = atomic_load(&tx_head) - atomic_load(&tx_tail);
+	stats->max_depth = atomic_load(&tx_max_depth);
+	stats->drops = atomic_load(&tx_drops);
+	stats->sent = atomic_load(&tx_sent);
+	stats->batches = atomic_load(&tx_batches);
+}
+
+static void capture_message(IR_CAPTURE_DIRECTION direction, const IR_DATA *message);
+
+/* Writer only: listen before talk for one queued packet, backing off here rather than in the app that sent it, as
+ * the badge's transmit alarm does. Once it has the channel, stamp it, count it and capture it. Returns false if it's
+ * to be dropped instead.
+ */
+static bool tx_get_channel(struct tx_slot *slot)
+{
+	struct network_data_packet *ndp = &slot->ndp;
+	IR_DATA data = {
+		.recipient_address = ntohs(ndp->recipient_address),
+		.app_address = ndp->app_address,
+		.data_length = ndp->data_length,
+		.data = ndp->data,
+	};
+	IR_CHANNEL_ATTEMPT attempt;
+	IR_CHANNEL_DECISION decision;
+	uint32_t wait_us;
+
+	if (!ir_channel_begin(&attempt, ndp->app_address))
+		return false;
+	while ((decision = ir_channel_try(&attempt, &wait_us)) == IR_CHANNEL_WAIT)
+		sleep_us(wait_us);
+	if (decision == IR_CHANNEL_DROP)
+		return false;
+
+	if (slot->stamp_at >= 0) {
+		/* UDP gets there all at once, in far less time than the timestamp's resolution matters */
+		uint32_t stamp = (uint32_t) (rtc_get_us_since_boot() + slot->clock_offset_us);
+
+		for (int i = 0; i < 4; i++)
+			ndp->data[slot->stamp_at + i] = (uint8_t) (stamp >> (8 * i));
+	}
+	ir_channel_note_tx(ir_channel_message_airtime_us(ndp->data_length));
+	capture_message(IR_CAPTURE_TX, &data);
+	return true;
+}
+
 struct udp_thread_info {
 	unsigned short recv_port;
 };
@@ -221,52 +339,109 @@ static void *write_udp_packets_thread_fn(void *thread_info)
 	bcast_addr.sin_port = htons(port_to_recv_on);
 
 	/* Start sending packets */
-	pthread_mutex_lock(&interrupt_mutex);
 	do {
+		int n;
+
 		/* Wait for a packet to write to appear */
 		udpdebug(stderr, "Waiting for a packet to appear for transmission\n");
-		rc = pthread_cond_wait(&packet_write_cond, &interrupt_mutex);
-		if (rc != 0)
-			fprintf(stderr, "pthread_cond_wait failed\n");
-		if (!output_queue_has_new_packets) {
-			udpdebug(stderr, "Woken for output packet, but none present\n");
-			continue;
+		pthread_mutex_lock(&tx_mutex);
+		while ((n = tx_queue_ready(IR_OUTPUT_BATCH)) == 0) {
+			rc = pthread_cond_wait(&tx_cond, &tx_mutex);
+			if (rc != 0)
+				fprintf(stderr, "pthread_cond_wait failed\n");
 		}
-		do {
-			udpdebug(stderr, "Woken for output packet, should be there\n");
-			/* fucking const cancer... */
-			IR_DATA *v = (IR_DATA *) ir_output_queue_dequeue();
-			if (!v) {
-				udpdebug(stderr, "Unexpectedly no output packet found\n");
-			}
-
-			/* Serialize data */
-			struct network_data_packet ndp;
-			ndp.badge_id = cpu_to_be64(badge_system_data()->badgeId);
-			ndp.recipient_address = htons(v->recipient_address);
-			ndp.app_address = v->app_address;
-			ndp.data_length = v->data_length;
-			assert(v->data_length <= MAX_IR_MESSAGE_SIZE);
-			memcpy(&ndp.data[0], v->data, v->data_length);
+		pthread_mutex_unlock(&tx_mutex);
+
+		unsigned int tail = atomic_load_explicit(&tx_tail, memory_order_relaxed);
+		int sending[IR_OUTPUT_BATCH];
+		int nsending = 0;
 
+		for (int i = 0; i < n; i++)
+			if (tx_get_channel(&tx_ring[(tail + i) & IR_OUTPUT_QUEUE_MASK]))
+				sending[nsending++] = (tail + i) & IR_OUTPUT_QUEUE_MASK;
+#if DEBUG_UDP_TRAFFIC
+		for (int i = 0; i < nsending; i++) {
+			struct network_data_packet *ndp = &tx_ring[sending[i]].ndp;
 			udpdebug(stderr, "Transmitting: rcp: 0x%04x, appid: 0x%02x, len: %d\n",
-				v->recipient_address, v->app_address, v->data_length);
-			udpdebug(stderr, "data: ");
-			for (int i = 0; i < v->data_length; i++)
-				udpdebug(stderr, " %02x", v->data[i]);
-			udpdebug(stderr, "\n");
-			free(v->data);
-			free(v);
-
-			rc = sendto(bcast, &ndp, sizeof(ndp), 0, (struct sockaddr *) &bcast_addr, sizeof(bcast_addr));
+				ntohs(ndp->recipient_address), ndp->app_address, ndp->data_length);
+		}
+#endif
+#ifdef linux
+		/* Send everything that's queued up in one system call */
+		struct mmsghdr msgs[IR_OUTPUT_BATCH];
+		struct iovec iovecs[IR_OUTPUT_BATCH];
+		memset(msgs, 0, sizeof(msgs));
+		for (int i = 0; i < nsending; i++) {
+			iovecs[i].iov_base = &tx_ring[sending[i]].ndp;
+			iovecs[i].iov_len = sizeof(struct network_data_packet);
+			msgs[i].msg_hdr.msg_iov = &iovecs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &bcast_addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(bcast_addr);
+		}
+		rc = nsending ? sendmmsg(bcast, msgs, nsending, 0) : 0;
+		if (rc < 0)
+			fprintf(stderr, "sendmmsg failed: %s\n", strerror(errno));
+		else if (rc < nsending)
+			fprintf(stderr, "sendmmsg sent only %d of %d packets\n", rc, nsending);
+#else
+		for (int i = 0; i < nsending; i++) {
+			rc = sendto(bcast, &tx_ring[sending[i]].ndp,
+				sizeof(struct network_data_packet), 0,
+				(struct sockaddr *) &bcast_addr, sizeof(bcast_addr));
 			if (rc < 0)
 				fprintf(stderr, "sendto failed: %s\n", strerror(errno));
-		} while (!ir_output_queue_empty());
+		}
+#endif
+		tx_queue_release(n);
+		atomic_fetch_add(&tx_sent, nsending);
+		atomic_fetch_add(&tx_batches, 1);
 	} while (1);
-	pthread_mutex_unlock(&interrupt_mutex);
 	return NULL;
 }
 
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *capture_file;
+static uint64_t capture_last_us;
+
+static void capture_message(IR_CAPTURE_DIRECTION direction, const IR_DATA *message)
+{
+	uint8_t record[IR_CAPTURE_MAX_RECORD_SIZE];
+
+	pthread_mutex_lock(&capture_mutex);
+	if (capture_file) {
+		size_t len = ir_capture_encode(record, sizeof(record), rtc_get_us_since_boot(),
+						&capture_last_us, direction, message);
+		if (fwrite(record, 1, len, capture_file) != len)
+			fprintf(stderr, "ir capture: write failed: %s\n", strerror(errno));
+		fflush(capture_file);
+	}
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+/* Returns the number of handlers the message was delivered to */
+static int dispatch_ir_message(const IR_DATA *p)
+{
+	int handlers = 0;
+
+	if (p->recipient_address != IR_BADGE_ID_BROADCAST)
+		/* TODO: OR recipient_address != badge address */
+		return 0;
+	if (p->app_address >= IR_MAX_ID)
+		return 0;
+	for (int i = 0; i < IR_MAX_HANDLERS_PER_ID; i++) {
+		if (cb[p->app_address][i] == NULL)
+			break; /* no handler */
+		pthread_mutex_lock(&interrupt_mutex);
+		cb[p->app_address][i](p);
+		pthread_mutex_unlock(&interrupt_mutex);
+		handlers++;
+	}
+	if (handlers)
+		message_count++;
+	return handlers;
+}
+
 static void *read_udp_packets_thread_fn(void *thread_info)
 {
 	struct udp_thread_info *ti = thread_info;
@@ -319,6 +494,13 @@ static void *read_udp_packets_thread_fn(void *thread_info)
 			continue;
 		}
 		udpdebug(stderr, "Received incoming IR packet\n");
+		/* UDP delivers the whole message at once; pretend we just heard its start packet
+		 * and that the rest of it is still on the air.
+		 */
+		if (ndp.data_length > MAX_IR_MESSAGE_SIZE)
+			continue;
+		uint32_t airtime = ir_channel_message_airtime_us(ndp.data_length);
+		ir_channel_note_rx(airtime, airtime, true);
 		/* fprintf(stderr, "Received broadcast lobby info: addr = %08x, port = %04x\n",
 				ntohl(payload.ipaddr), ntohs(payload.port)); */
 		p = &current_rx_message;
@@ -327,35 +509,12 @@ static void *read_udp_packets_thread_fn(void *thread_info)
 		p->data_length = ndp.data_length;
 		memset(p->data, 0, MAX_IR_MESSAGE_SIZE);
 		memcpy(p->data, ndp.data, ndp.data_length);
-		if (p->recipient_address != IR_BADGE_ID_BROADCAST)
-			/* TODO: OR recipient_address != badge address */
-			continue;
-		if (p->app_address > IR_MAX_ID)
-			continue;
-		int message_processed = 0;
-		for (int i = 0; i < IR_MAX_HANDLERS_PER_ID; i++) {
-			if (cb[p->app_address][i] == NULL)
-				break; /* no handler */
-			pthread_mutex_lock(&interrupt_mutex);
-			cb[p->app_address][i](p);
-			pthread_mutex_unlock(&interrupt_mutex);
-			message_processed = 1;
-		}
-		if (message_processed)
-			message_count++;
+		capture_message(IR_CAPTURE_RX, p);
+		dispatch_ir_message(p);
 	} while(1);
 	return NULL;
 }
 
-#ifdef linux
-/* This extern should not be needed with #define _GNU_SOUCE #include <pthread.h>
- * but for some unknown reason (cmake problem?) I'm getting implicit
- * declaration of pthread_setname_np() without this.
- * TODO: figure this out properly.
- */
-extern int pthread_setname_np(pthread_t thread, const char *name);
-#endif
-
 static void setup_ir_sensor(unsigned short port_to_recv_from)
 {
 	pthread_t thr;
@@ -388,6 +547,7 @@ static void setup_ir_transmitter(unsigned short port_to_recv_from)
 
 static void setup_linux_ir_simulator(unsigned short port_to_recv_from)
 {
+	tx_queue_init();
 	setup_ir_sensor(port_to_recv_from);
 	setup_ir_transmitter(port_to_recv_from);
 }
@@ -413,24 +573,53 @@ void ir_init(void)
 		if (rc == 1)
 			recv_port = p;
 	}
+	ir_reset_channel_stats();
 	setup_linux_ir_simulator(recv_port);
+
+	char *capture = getenv("BADGE_IR_CAPTURE");
+	if (capture)
+		ir_capture_start(capture);
+	char *replay = getenv("BADGE_IR_REPLAY");
+	if (replay) {
+		unsigned int speed = 1;
+		char *sp = getenv("BADGE_IR_REPLAY_SPEED");
+		if (sp && sscanf(sp, "%u", &speed) != 1)
+			speed = 1;
+		ir_replay_start(replay, speed);
+	}
 }
 
 bool ir_transmitting(void) {
     return false;
 }
 
-void ir_send_complete_message(const IR_DATA *data)
+/* stamp_at < 0 for a message without a timestamp */
+static void send_message(const IR_DATA *data, int stamp_at, int64_t clock_offset_us)
 {
 	int rc;
 
-	pthread_mutex_lock(&interrupt_mutex);
-	ir_output_queue_enqueue(data);
-	output_queue_has_new_packets = 1;
-	rc = pthread_cond_broadcast(&packet_write_cond);
-	pthread_mutex_unlock(&interrupt_mutex);
+	/* The writer thread waits for the channel, so the app doesn't */
+	if (!tx_queue_enqueue(data, stamp_at, clock_offset_us)) {
+		ir_channel_note_queue_full();
+		return;
+	}
+	pthread_mutex_lock(&tx_mutex);
+	rc = pthread_cond_signal(&tx_cond);
+	pthread_mutex_unlock(&tx_mutex);
 	if (rc)
-		fprintf(stderr, "pthread_cond_broadcast failed: %s\n", strerror(errno));
+		fprintf(stderr, "pthread_cond_signal failed: %s\n", strerror(rc));
+}
+
+void ir_send_complete_message(const IR_DATA *data)
+{
+	send_message(data, -1, 0);
+}
+
+void ir_send_timed_message(const IR_DATA *data, uint8_t stamp_at, int64_t clock_offset_us)
+{
+	if (stamp_at + 4 > data->data_length)
+		return;
+	send_message(data, stamp_at, clock_offset_us);
 }
 
 // Returns the number of data packets that were queued to send, instead of blocking to send out all data.
@@ -453,3 +642,146 @@ int ir_message_count(void)
 {
     return message_count;
 }
+
+bool ir_capture_start(const char *name)
+{
+	uint8_t header[IR_CAPTURE_HEADER_SIZE];
+	bool ok = true;
+
+	if (!name)
+		name = IR_CAPTURE_DEFAULT_NAME ".bin";
+	pthread_mutex_lock(&capture_mutex);
+	if (capture_file)
+		fclose(capture_file);
+	capture_file = fopen(name, "wb");
+	if (!capture_file) {
+		fprintf(stderr, "ir capture: can't open %s: %s\n", name, strerror(errno));
+		ok = false;
+	} else {
+		fwrite(header, 1, ir_capture_write_header(header), capture_file);
+		capture_last_us = rtc_get_us_since_boot();
+	}
+	pthread_mutex_unlock(&capture_mutex);
+	return ok;
+}
+
+bool ir_capture_stop(void)
+{
+	bool saved = true;
+
+	pthread_mutex_lock(&capture_mutex);
+	if (capture_file)
+		saved = fclose(capture_file) == 0;
+	capture_file = NULL;
+	pthread_mutex_unlock(&capture_mutex);
+	return saved;
+}
+
+bool ir_capturing(void)
+{
+	return capture_file != NULL;
+}
+
+void ir_capture_dump(void)
+{
+	pthread_mutex_lock(&capture_mutex);
+	if (capture_file)
+		printf("IR capture: %ld bytes written so far\n", ftell(capture_file));
+	else
+		printf("IR capture: not capturing\n");
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+struct replay_info {
+	uint8_t *log;
+	size_t len;
+	unsigned int speed;
+};
+
+static void *replay_thread_fn(void *thread_info)
+{
+	struct replay_info *ri = thread_info;
+	IR_CAPTURE_RECORD rec = { 0 };
+	size_t pos = IR_CAPTURE_HEADER_SIZE, n;
+	uint64_t first_us = 0, start_us, handler_us = 0, max_handler_us = 0;
+	int replayed = 0, delivered = 0;
+
+	/* Find the first received message, and wait until somebody is listening for it */
+	while ((n = ir_capture_decode(ri->log + pos, ri->len - pos, &rec)) && rec.direction != IR_CAPTURE_RX)
+		pos += n;
+	if (!n)
+		goto done;
+	first_us = rec.timestamp_us;
+	while (rec.message.app_address < IR_MAX_ID && cb[rec.message.app_address][0] == NULL)
+		usleep(10000);
+
+	start_us = rtc_get_us_since_boot();
+	do {
+		pos += n;
+		if (rec.direction != IR_CAPTURE_RX)
+			continue;
+		if (ri->speed) {
+			uint64_t due = start_us + (rec.timestamp_us - first_us) / ri->speed;
+			uint64_t now = rtc_get_us_since_boot();
+			if (due > now)
+				usleep(due - now);
+		}
+		uint64_t t0 = rtc_get_us_since_boot();
+		delivered += dispatch_ir_message(&rec.message) ? 1 : 0;
+		uint64_t t = rtc_get_us_since_boot() - t0;
+		handler_us += t;
+		if (t > max_handler_us)
+			max_handler_us = t;
+		replayed++;
+	} while ((n = ir_capture_decode(ri->log + pos, ri->len - pos, &rec)));
+
+	fprintf(stderr, "ir replay: %d messages (%d handled) in %llu us, handlers took %llu us total, %llu us max\n",
+		replayed, delivered, (unsigned long long) (rtc_get_us_since_boot() - start_us),
+		(unsigned long long) handler_us, (unsigned long long) max_handler_us);
+done:
+	free(ri->log);
+	free(ri);
+	return NULL;
+}
+
+bool ir_replay_start(const char *path, unsigned int speed)
+{
+	FILE *f;
+	long len;
+	pthread_t thr;
+	int rc;
+	struct replay_info *ri;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "ir replay: can't open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	ri = malloc(sizeof(*ri));
+	ri->log = malloc(len > 0 ? len : 1);
+	ri->len = fread(ri->log, 1, len > 0 ? len : 0, f);
+	ri->speed = speed;
+	fclose(f);
+	if (!ir_capture_check_header(ri->log, ri->len)) {
+		fprintf(stderr, "ir replay: %s is not an IR capture log\n", path);
+		free(ri->log);
+		free(ri);
+		return false;
+	}
+
+	rc = pthread_create(&thr, NULL, replay_thread_fn, ri);
+	if (rc) {
+		fprintf(stderr, "Failed to create thread to replay IR capture: %s\n", strerror(rc));
+		free(ri->log);
+		free(ri);
+		return false;
+	}
+#ifdef linux
+	pthread_setname_np(thr, "badge_ir_replay");
+#endif
+	pthread_detach(thr);
+	return true;
+}
@@ -0,0 +1,137 @@
+//
+// LED effect keyframes, and the ready made effects, which are just keyframes.
+//
+
+#include <stddef.h>
+
+#include "led_effect.h"
+
+// round(255 * (i / 255) ^ 2.2)
+const uint8_t led_gamma[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+void led_effect_start(struct led_effect_state *state, const struct led_effect *effect, const uint8_t from[3]) {
+    state->num_keyframes = effect->num_keyframes < LED_EFFECT_MAX_KEYFRAMES
+                           ? effect->num_keyframes : LED_EFFECT_MAX_KEYFRAMES;
+    state->flags = effect->flags;
+    state->total_ms = 0;
+    for (int i = 0; i < state->num_keyframes; i++) {
+        state->keyframes[i] = effect->keyframes[i];
+        state->total_ms += effect->keyframes[i].fade_ms + effect->keyframes[i].hold_ms;
+    }
+    for (int c = 0; c < 3; c++) {
+        state->from[c] = from[c];
+    }
+}
+
+static void keyframe_color(const struct led_keyframe *k, uint8_t rgb[3]) {
+    rgb[0] = k->red;
+    rgb[1] = k->green;
+    rgb[2] = k->blue;
+}
+
+uint32_t led_effect_color_at(const struct led_effect_state *state, uint32_t ms, uint8_t rgb[3]) {
+    uint8_t prev[3];
+
+    if (!state->num_keyframes) {
+        for (int c = 0; c < 3; c++) {
+            rgb[c] = state->from[c];
+        }
+        return LED_EFFECT_DONE;
+    }
+    if (!state->total_ms || (ms >= state->total_ms && !(state->flags & LED_EFFECT_LOOP))) {
+        keyframe_color(&state->keyframes[state->num_keyframes - 1], rgb);
+        return LED_EFFECT_DONE;
+    }
+
+    // Passes after the first fade in from the last keyframe
+    if (ms >= state->total_ms) {
+        keyframe_color(&state->keyframes[state->num_keyframes - 1], prev);
+        ms %= state->total_ms;
+    } else {
+        for (int c = 0; c < 3; c++) {
+            prev[c] = state->from[c];
+        }
+    }
+    for (int i = 0; i < state->num_keyframes; i++) {
+        const struct led_keyframe *k = &state->keyframes[i];
+
+        keyframe_color(k, rgb);
+        if (ms < k->fade_ms) {
+            uint32_t left = k->fade_ms - ms;
+
+            for (int c = 0; c < 3; c++) {
+                rgb[c] = (uint8_t) (prev[c] + ((int32_t) rgb[c] - prev[c]) * (int32_t) ms / k->fade_ms);
+            }
+            return left < LED_EFFECT_FADE_STEP_MS ? left : LED_EFFECT_FADE_STEP_MS;
+        }
+        ms -= k->fade_ms;
+        if (ms < k->hold_ms) {
+            return k->hold_ms - ms;
+        }
+        ms -= k->hold_ms;
+        keyframe_color(k, prev);
+    }
+    // Not reached: ms was less than total_ms
+    return LED_EFFECT_DONE;
+}
+
+static void play(const struct led_keyframe *keyframes, uint8_t n, uint8_t flags) {
+    struct led_effect effect = { keyframes, n, flags };
+
+    led_effect_play(&effect);
+}
+
+void led_effect_fade(uint8_t red, uint8_t green, uint8_t blue, uint16_t ms) {
+    struct led_keyframe k[] = { { red, green, blue, ms, 0 } };
+
+    play(k, 1, 0);
+}
+
+void led_effect_pulse(uint8_t red, uint8_t green, uint8_t blue, uint16_t period_ms) {
+    struct led_keyframe k[] = {
+        { red, green, blue, period_ms / 2, 0 },
+        { 0, 0, 0, period_ms - period_ms / 2, 0 },
+    };
+
+    play(k, 2, LED_EFFECT_LOOP);
+}
+
+void led_effect_strobe(uint8_t red, uint8_t green, uint8_t blue, uint16_t on_ms, uint16_t off_ms) {
+    struct led_keyframe k[] = {
+        { red, green, blue, 0, on_ms },
+        { 0, 0, 0, 0, off_ms },
+    };
+
+    play(k, 2, LED_EFFECT_LOOP);
+}
+
+void led_effect_rainbow(uint16_t period_ms) {
+    uint16_t step = period_ms / 6;
+    struct led_keyframe k[] = {
+        { 255, 0, 0, step, 0 },
+        { 255, 255, 0, step, 0 },
+        { 0, 255, 0, step, 0 },
+        { 0, 255, 255, step, 0 },
+        { 0, 0, 255, step, 0 },
+        { 255, 0, 255, step, 0 },
+    };
+
+    play(k, 6, LED_EFFECT_LOOP);
+}
@@ -0,0 +1,36 @@
+//
+// Keyframe stepping for LED effects, shared by led_pwm_rp2040.c and the simulators, which each keep one
+// led_effect_state and step it on their own clock. Apps should not include this; the public API is in led_pwm.h.
+//
+
+#ifndef BADGE_C_LED_EFFECT_H
+#define BADGE_C_LED_EFFECT_H
+
+#include <stdint.h>
+
+#include "led_pwm.h"
+
+// How often a fade is stepped
+#define LED_EFFECT_FADE_STEP_MS (10)
+// led_effect_color_at() once the effect is over
+#define LED_EFFECT_DONE (UINT32_MAX)
+
+struct led_effect_state {
+    struct led_keyframe keyframes[LED_EFFECT_MAX_KEYFRAMES];
+    uint8_t num_keyframes;
+    uint8_t flags;
+    uint8_t from[3];        // the color before the first keyframe
+    uint32_t total_ms;      // of one pass through the keyframes
+};
+
+// PWM duty for each perceived brightness 0-255
+extern const uint8_t led_gamma[256];
+
+// Copy effect into state, to start from the color from[].
+void led_effect_start(struct led_effect_state *state, const struct led_effect *effect, const uint8_t from[3]);
+
+// Set rgb[] to the color ms after the start, and return how long it stays that color, or LED_EFFECT_DONE if the
+// effect has ended on it.
+uint32_t led_effect_color_at(const struct led_effect_state *state, uint32_t ms, uint8_t rgb[3]);
+
+#endif //BADGE_C_LED_EFFECT_H
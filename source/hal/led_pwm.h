@@ -28,4 +28,39 @@ bool led_pwm_is_on(BADGE_LED led);
 // Sets LED scaling (range 0-255) on the 3-color LED.
 void led_pwm_set_scale(uint8_t scale);
 
+// Effects: the 3-color LED follows a list of keyframes by itself, so an app sets it going once instead of changing the
+// LED every frame. On the badge a hardware alarm steps it, only as often as the color changes, and the badge can
+// sleep in between. Colors are as they look; a gamma table turns them into PWM duty. Calling led_pwm_enable() or
+// led_pwm_disable() on the 3-color LED stops the effect.
+#define LED_EFFECT_MAX_KEYFRAMES (12)
+#define LED_EFFECT_LOOP (1 << 0)    // go back to the first keyframe after the last, until led_effect_stop()
+
+// Fade from the color before to this one, then hold it
+struct led_keyframe {
+    uint8_t red, green, blue;
+    uint16_t fade_ms;
+    uint16_t hold_ms;
+};
+
+struct led_effect {
+    const struct led_keyframe *keyframes;   // copied, so needn't stay around
+    uint8_t num_keyframes;                  // up to LED_EFFECT_MAX_KEYFRAMES
+    uint8_t flags;
+};
+
+// Start an effect from whatever color the LED is now, replacing any effect already playing. Once a non-looping
+// effect ends, the LED stays at its last color.
+void led_effect_play(const struct led_effect *effect);
+
+// Stop the effect and turn the 3-color LED off.
+void led_effect_stop(void);
+
+bool led_effect_is_playing(void);
+
+// Ready made effects
+void led_effect_fade(uint8_t red, uint8_t green, uint8_t blue, uint16_t ms);
+void led_effect_pulse(uint8_t red, uint8_t green, uint8_t blue, uint16_t period_ms);
+void led_effect_strobe(uint8_t red, uint8_t green, uint8_t blue, uint16_t on_ms, uint16_t off_ms);
+void led_effect_rainbow(uint16_t period_ms);
+
 #endif //BADGE_C_LED_PWM_H
@@ -3,12 +3,25 @@
 //
 
 #include "led_pwm.h"
+#include "led_effect.h"
 #include "pinout_rp2040.h"
 #include "hardware/pwm.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
 #include <stdio.h>
 
 static uint8_t scale = 0xFF;
 
+// Effects are stepped from a hardware alarm, which keeps running through lp_sleep_us()'s deep sleep along with the
+// PWM, and wakes the processor only when the color changes. LEDs lit by an effect don't count as on for
+// led_pwm_is_on(), so they don't keep the badge from sleeping.
+static struct led_effect_state effect;
+static volatile bool effect_playing;
+static int effect_alarm = -1;
+static absolute_time_t effect_start;
+static uint8_t rgb_now[3];
+
 static const int _gpio_map[BADGE_LED_MAX] = {
     BADGE_GPIO_LED_RED,
     BADGE_GPIO_LED_GREEN,
@@ -26,11 +39,10 @@ void led_pwm_init_gpio() {
     }
 }
 
-void led_pwm_enable(BADGE_LED led, uint8_t duty) {
-    if (led >= BADGE_LED_MAX) {
-        return;
-    }
-    
+static void set_duty(BADGE_LED led, uint8_t duty) {
+    uint slice = pwm_gpio_to_slice_num(_gpio_map[led]);
+    uint channel = pwm_gpio_to_channel(_gpio_map[led]);
+
     if (BADGE_LED_DISPLAY_BACKLIGHT == led) {
         // LED backlight has opposite pin polarity (active high)
         duty = ~duty;
@@ -39,8 +51,11 @@ void led_pwm_enable(BADGE_LED led, uint8_t duty) {
         duty = (duty * scale) >> 8;
     }
 
-    uint slice = pwm_gpio_to_slice_num(_gpio_map[led]);
-    uint channel = pwm_gpio_to_channel(_gpio_map[led]);
+    // Already set up, as it is for each step of an effect: only the level changes
+    if (gpio_get_function(_gpio_map[led]) == GPIO_FUNC_PWM) {
+        pwm_set_chan_level(slice, channel, duty);
+        return;
+    }
 
     gpio_set_function(_gpio_map[led], GPIO_FUNC_PWM);
     pwm_set_enabled(slice, false);
@@ -49,14 +64,29 @@ void led_pwm_enable(BADGE_LED led, uint8_t duty) {
     pwm_set_chan_level(slice, channel, duty);
     pwm_set_output_polarity(slice, true, true);
     pwm_set_enabled(slice, true);
-    led_is_on[led] = true;
 }
 
-void led_pwm_disable(BADGE_LED led) {
+static void effect_stop_alarm(void) {
+    effect_playing = false;
+    if (effect_alarm >= 0) {
+        hardware_alarm_cancel(effect_alarm);
+    }
+}
+
+void led_pwm_enable(BADGE_LED led, uint8_t duty) {
     if (led >= BADGE_LED_MAX) {
         return;
     }
+    if (led != BADGE_LED_DISPLAY_BACKLIGHT) {
+        effect_stop_alarm();
+        rgb_now[led] = duty;
+    }
 
+    set_duty(led, duty);
+    led_is_on[led] = true;
+}
+
+static void turn_off(BADGE_LED led) {
     uint slice = pwm_gpio_to_slice_num(_gpio_map[led]);
     uint channel = pwm_gpio_to_channel(_gpio_map[led]);
 
@@ -84,7 +114,18 @@ void led_pwm_disable(BADGE_LED led) {
     if (!still_using_slice) {
         pwm_set_enabled(slice, false);
     }
+}
 
+void led_pwm_disable(BADGE_LED led) {
+    if (led >= BADGE_LED_MAX) {
+        return;
+    }
+    if (led != BADGE_LED_DISPLAY_BACKLIGHT) {
+        effect_stop_alarm();
+        rgb_now[led] = 0;
+    }
+
+    turn_off(led);
     led_is_on[led] = false;
 }
 
@@ -99,4 +140,78 @@ bool led_pwm_is_on(BADGE_LED led) {
 
 void led_pwm_set_scale(uint8_t new_scale) {
     scale = new_scale;
-}
\ No newline at end of file
+}
+
+static void effect_step(uint alarm_num) {
+    uint32_t ms, next;
+
+    if (!effect_playing) {
+        return;
+    }
+    ms = (uint32_t) (absolute_time_diff_us(effect_start, get_absolute_time()) / 1000);
+    next = led_effect_color_at(&effect, ms, rgb_now);
+    for (int c = 0; c < 3; c++) {
+        uint8_t level = rgb_now[c];
+        bool driven = false;
+
+        // Channels that share a pin (all three do on the one-color flair LED) set it once, to the brightest of them,
+        // rather than each in turn with the last one winning
+        for (int other = 0; other < 3; other++) {
+            if (other == c || _gpio_map[other] != _gpio_map[c]) {
+                continue;
+            }
+            if (other < c) {
+                driven = true;
+            } else if (rgb_now[other] > level) {
+                level = rgb_now[other];
+            }
+        }
+        if (driven) {
+            continue;
+        }
+        if (level) {
+            set_duty((BADGE_LED) c, led_gamma[level]);
+        } else if (gpio_get_function(_gpio_map[c]) == GPIO_FUNC_PWM) {
+            turn_off((BADGE_LED) c);
+        }
+    }
+    if (next == LED_EFFECT_DONE) {
+        effect_playing = false;
+        return;
+    }
+    // Straight on to the next step if that's already due
+    if (hardware_alarm_set_target(alarm_num, delayed_by_ms(get_absolute_time(), next))) {
+        effect_step(alarm_num);
+    }
+}
+
+void led_effect_play(const struct led_effect *new_effect) {
+    uint32_t irq_state;
+
+    if (effect_alarm < 0) {
+        effect_alarm = hardware_alarm_claim_unused(true);
+        hardware_alarm_set_callback(effect_alarm, effect_step);
+    }
+    effect_stop_alarm();
+    for (int c = 0; c < 3; c++) {
+        led_is_on[c] = false;
+    }
+
+    irq_state = save_and_disable_interrupts();
+    led_effect_start(&effect, new_effect, rgb_now);
+    effect_start = get_absolute_time();
+    effect_playing = true;
+    restore_interrupts(irq_state);
+    effect_step(effect_alarm);
+}
+
+void led_effect_stop(void) {
+    effect_stop_alarm();
+    for (int c = 0; c < 3; c++) {
+        led_pwm_disable((BADGE_LED) c);
+    }
+}
+
+bool led_effect_is_playing(void) {
+    return effect_playing;
+}
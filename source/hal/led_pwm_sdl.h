@@ -6,4 +6,7 @@ extern struct led_pwm_sdl_color {
 	uint8_t red, green, blue, alpha;
 } led_color;
 
+// Bring led_color up to date with the effect playing, if there is one; for drawing the LED.
+void led_pwm_sdl_step_effect(void);
+
 #endif
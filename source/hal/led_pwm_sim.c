@@ -3,18 +3,37 @@
 //
 
 #include "led_pwm.h"
+#include "led_effect.h"
+#include "rtc.h"
 #include <stdio.h>
+#include <pthread.h>
 #include <gtk/gtk.h>
 
 int lcd_brightness = 255;
 GdkColor led_color;
 static uint8_t scale = 255;
 
+// No alarm here: the effect's color is worked out whenever the LED is drawn. The screen shows colors as they look,
+// so there's no gamma either.
+static struct led_effect_state effect;
+static bool effect_playing;
+static uint64_t effect_start_us;
+static pthread_mutex_t effect_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void stop_effect(BADGE_LED led) {
+    if (led != BADGE_LED_DISPLAY_BACKLIGHT) {
+        pthread_mutex_lock(&effect_lock);
+        effect_playing = false;
+        pthread_mutex_unlock(&effect_lock);
+    }
+}
+
 void led_pwm_init_gpio() {
 
 }
 
 void led_pwm_enable(BADGE_LED led, uint8_t duty) {
+    stop_effect(led);
     switch(led) {
         case BADGE_LED_RGB_BLUE:
             // Max RGB values are 16-bit in the simulator
@@ -35,6 +54,7 @@ void led_pwm_enable(BADGE_LED led, uint8_t duty) {
 }
 
 void led_pwm_disable(BADGE_LED led) {
+    stop_effect(led);
     switch(led) {
         case BADGE_LED_RGB_BLUE:
             led_color.blue = 0;
@@ -57,3 +77,42 @@ void led_pwm_disable(BADGE_LED led) {
 void led_pwm_set_scale(uint8_t new_scale) {
     scale = new_scale;
 }
+
+void led_effect_play(const struct led_effect *new_effect) {
+    uint8_t from[3] = { led_color.red / 256, led_color.green / 256, led_color.blue / 256 };
+
+    pthread_mutex_lock(&effect_lock);
+    led_effect_start(&effect, new_effect, from);
+    effect_start_us = rtc_get_us_since_boot();
+    effect_playing = true;
+    pthread_mutex_unlock(&effect_lock);
+}
+
+void led_effect_stop(void) {
+    pthread_mutex_lock(&effect_lock);
+    effect_playing = false;
+    pthread_mutex_unlock(&effect_lock);
+    for (int c = 0; c < 3; c++) {
+        led_pwm_disable((BADGE_LED) c);
+    }
+}
+
+bool led_effect_is_playing(void) {
+    return effect_playing;
+}
+
+void led_pwm_sim_step_effect(void) {
+    uint8_t rgb[3];
+
+    pthread_mutex_lock(&effect_lock);
+    if (effect_playing) {
+        if (led_effect_color_at(&effect, (uint32_t) ((rtc_get_us_since_boot() - effect_start_us) / 1000), rgb)
+            == LED_EFFECT_DONE) {
+            effect_playing = false;
+        }
+        led_color.red = rgb[0] * scale;
+        led_color.green = rgb[1] * scale;
+        led_color.blue = rgb[2] * scale;
+    }
+    pthread_mutex_unlock(&effect_lock);
+}
@@ -18,6 +18,7 @@
 #include "flash_storage.h"
 #include "delay.h"
 #include "init.h"
+#include "scheduler.h"
 
 int exit_process(__attribute__((unused)) char *args) {
     return -1;
@@ -46,6 +47,10 @@ CLI_COMMAND help_command = {
     .process = help_process,
 };
 
+static void frame(__attribute__((unused)) void *context) {
+    ProcessIO();
+}
+
 int badge_main(__attribute__((unused)) int argc, __attribute__((unused)) char** argv) {
 
     UserInit();
@@ -74,19 +79,8 @@ int badge_main(__attribute__((unused)) int argc, __attribute__((unused)) char**
     }
 
     // run main app
-    uint64_t frame_time = rtc_get_us_since_boot();
-    while (1) {
-        uint64_t frame_period_us = ProcessIO();
-        uint64_t current_time = rtc_get_us_since_boot();
-        if (frame_time + frame_period_us <= current_time) {
-            printf("Frame time was long: %lu\n", (unsigned long)(current_time - frame_time));
-            frame_time = current_time;
-            continue;
-        }
-
-        frame_time = frame_period_us + frame_time;
-        lp_sleep_us(frame_time-current_time);
-    }
+    scheduler_set_frame(frame, NULL);
+    scheduler_main_loop();
 
     return 0;
 }
@@ -0,0 +1,45 @@
+/*
+ * Generates source/core/fxp_math_tables.h, the lookup tables used by
+ * source/core/fxp_math.c:
+ *
+ *   ./fxp-math-tables > ../source/core/fxp_math_tables.h
+ *
+ * The tables are computed here in double precision rather than on the badge,
+ * which has no floating point hardware.
+ */
+#include <stdio.h>
+#include <math.h>
+
+#include "../source/core/fxp_math.h"
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char *argv[])
+{
+	const int quarter = FXP_SINE_TABLE_SIZE;
+
+	printf("/* Generated by tools/fxp-math-tables.c, do not edit. */\n\n");
+
+	printf("/* sin(i * 90 / %d degrees) * 65536 for i = 0 to %d, the last entry clamped to fit */\n",
+		quarter, quarter);
+	printf("static const uint16_t fxp_sine_table[%d] = {", quarter + 1);
+	for (int i = 0; i <= quarter; i++) {
+		long v = lround(sin(i * M_PI / (2.0 * quarter)) * 65536.0);
+		if (v > 65535)
+			v = 65535;
+		printf("%s%ld,", (i % 12) == 0 ? "\n\t" : " ", v);
+	}
+	printf("\n};\n\n");
+
+	/*
+	 * Minimax polynomial for atan(t), t = 0 to 1, from Abramowitz and Stegun
+	 * 4.4.49, scaled to fxp_angle steps * 4.
+	 */
+	static const double atan_poly[FXP_ATAN_POLY_TERMS] = {
+		0.9998660, -0.3302995, 0.1801410, -0.0851330, 0.0208351,
+	};
+	printf("/* Coefficients of t, t^3, t^5 ... for atan(t), in fxp_angle steps * 4 */\n");
+	printf("static const int32_t fxp_atan_poly[%d] = {\n\t", FXP_ATAN_POLY_TERMS);
+	for (int i = 0; i < FXP_ATAN_POLY_TERMS; i++)
+		printf("%ld,%s", lround(atan_poly[i] * 4.0 * 65536.0 / (2.0 * M_PI)), i < FXP_ATAN_POLY_TERMS - 1 ? " " : "");
+	printf("\n};\n");
+	return 0;
+}
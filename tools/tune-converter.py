@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Converts the old tables of struct note ({ frequency, milliseconds } pairs) in
+a C file into tunes for the sequencer in source/core/music.c, and prints them:
+
+    ./tune-converter.py ../source/apps/gulag.c natl_anthem_notes=ukrainian_natl_anthem
+
+Each table named on the command line becomes a byte string of the same name
+and a struct tune named after the '=' (or the table's name with _tune on the
+end). Frequencies are looked up in source/core/music.h and the file's own
+#defines, and become the nearest note; durations become ticks of their
+greatest common divisor. Runs of notes that repeat become TUNE_REPEAT.
+"""
+
+import math
+import os
+import re
+import sys
+
+MUSIC_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "../source/core/music.h")
+NOTE_NAMES = ["C", "Cs", "D", "Ef", "E", "F", "Fs", "G", "Af", "A", "Bf", "B"]
+MAX_REPEAT_BLOCK = 32
+ITEMS_PER_LINE = 8
+
+
+def read_defines(text, defines):
+    for name, value in re.findall(r"^[ \t]*#define[ \t]+(\w+)[ \t]+([^\n/]+)", text, re.M):
+        try:
+            defines[name] = evaluate(value, defines)
+        except (KeyError, ValueError, SyntaxError):
+            pass
+
+
+def evaluate(expression, defines):
+    expression = re.sub(r"\b[A-Za-z_]\w*\b", lambda m: str(defines[m.group(0)]), expression.strip())
+    if not re.fullmatch(r"[0-9+\-*/() ]+", expression):
+        raise ValueError(expression)
+    return int(eval(expression))
+
+
+def strip_comments(text):
+    return re.sub(r"/\*.*?\*/|//[^\n]*", "", text, flags=re.S)
+
+
+def read_table(text, name, defines):
+    match = re.search(r"struct\s+note\s+" + re.escape(name) + r"\s*\[\s*\]\s*=\s*\{(.*?)\};", text, re.S)
+    if not match:
+        sys.exit("no struct note table called %s" % name)
+    notes = []
+    for line in match.group(1).split("\n"):
+        comment = re.search(r"/\*(.*?)\*/|//(.*)", line)
+        for freq, duration in re.findall(r"\{\s*([^,{}]+?)\s*,\s*([^,{}]+?)\s*,?\s*\}", strip_comments(line)):
+            notes.append([evaluate(freq, defines), evaluate(duration, defines), None])
+        if comment and notes:
+            notes[-1][2] = (comment.group(1) or comment.group(2)).strip()
+    return notes
+
+
+def midi_note(freq, name):
+    note = round(69 + 12 * math.log2(freq / 440.0))
+    exact = 440.0 * 2 ** ((note - 69) / 12.0)
+    if abs(freq - exact) / exact > 0.01:
+        sys.stderr.write("%s: %d Hz is %.0f Hz off %s\n" % (name, freq, abs(freq - exact), note_text(note)))
+    return note
+
+
+def note_text(note):
+    return "TUNE_N(%s, %d)" % (NOTE_NAMES[note % 12], note // 12 - 1)
+
+
+def encode(events, comments, start, end, length, depth):
+    """Returns the items for events[start:end], starting with the note length at length (None if unknown), and the
+    length after them. Each item is its text and the comment on the note it starts, if any."""
+    items = []
+    i = start
+    while i < end:
+        best = None
+        if depth < 2:
+            for size in range(1, min(MAX_REPEAT_BLOCK, (end - i) // 2) + 1):
+                block = events[i:i + size]
+                count = 1
+                while i + (count + 1) * size <= end and events[i + count * size:i + (count + 1) * size] == block:
+                    count += 1
+                if count < 2:
+                    continue
+                inner, _ = encode(events, comments, i, i + size, None, depth + 1)
+                saving = (count - 1) * cost(inner) - 3
+                if saving > 0 and (best is None or saving > best[0]):
+                    best = (saving, size, count)
+        if best:
+            _, size, count = best
+            inner, length = encode(events, comments, i, i + size, None, depth + 1)
+            items.append(("TUNE_REPEAT(%d)" % count, None))
+            items += inner
+            items.append(("TUNE_REPEAT_END", None))
+            i += size * count
+            continue
+        note, ticks = events[i]
+        comment = comments[i]
+        if ticks != length:
+            items.append(("TUNE_LENGTH(%d)" % ticks, comment))
+            length = ticks
+            comment = None
+        items.append((note_text(note) if note is not None else "TUNE_REST", comment))
+        i += 1
+    return items, length
+
+
+def cost(items):
+    return sum(2 if item.startswith("TUNE_LENGTH") or item.startswith("TUNE_REPEAT(") else 1 for item, _ in items)
+
+
+def convert(text, table, tune_name, defines):
+    notes = read_table(text, table, defines)
+    tick = 0
+    for _, duration, _ in notes:
+        tick = math.gcd(tick, duration)
+    events = []
+    comments = []
+    for freq, duration, comment in notes:
+        ticks = duration // tick
+        note = midi_note(freq, table) if freq else None
+        while ticks > 255:
+            if note is not None:
+                sys.exit("%s: a note of %d ms is too long for %d ms ticks" % (table, duration, tick))
+            events.append((None, 255))
+            comments.append(None)
+            ticks -= 255
+        events.append((note, ticks))
+        comments.append(comment)
+    items, _ = encode(events, comments, 0, len(events), None, 0)
+
+    print("/* Converted from the struct note table %s by tools/tune-converter.py */" % table)
+    print("static const uint8_t %s[] = {" % table)
+    # A new line for each comment in the table, which goes after the notes it was next to
+    line = []
+    line_comment = None
+    for item, comment in items + [("TUNE_END", None)]:
+        if line and (comment or len(line) == ITEMS_PER_LINE):
+            print("\t" + " ".join(line) + (" /* %s */" % line_comment if line_comment else ""))
+            line = []
+            line_comment = None
+        line.append(item + ",")
+        line_comment = line_comment or comment
+    print("\t" + " ".join(line) + (" /* %s */" % line_comment if line_comment else ""))
+    print("};")
+    print()
+    print("static const struct tune %s = {" % tune_name)
+    print("\t.tick_ms = %d," % tick)
+    print("\t.num_channels = 1,")
+    print("\t.channel = { %s }," % table)
+    print("};")
+    print()
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: %s file.c table[=tune_name]..." % sys.argv[0])
+    defines = {}
+    with open(MUSIC_H) as f:
+        read_defines(f.read(), defines)
+    with open(sys.argv[1]) as f:
+        text = f.read()
+    read_defines(text, defines)
+    for arg in sys.argv[2:]:
+        table, _, tune_name = arg.partition("=")
+        convert(text, table, tune_name or table + "_tune", defines)
+
+
+if __name__ == "__main__":
+    main()